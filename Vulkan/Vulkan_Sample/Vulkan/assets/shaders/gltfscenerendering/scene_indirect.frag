@@ -0,0 +1,61 @@
+#version 450
+
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Material table and texture array for multi-draw-indirect, see common/indirectScene.h
+// Invocations from different draws of one indirect call can share a subgroup, so the material index is not dynamically uniform
+struct MaterialData
+{
+	uint baseColorTexture;
+	uint normalTexture;
+	float alphaCutoff;
+	uint padding;
+};
+
+layout (constant_id = 0) const bool ALPHA_MASK = false;
+layout (constant_id = 1) const int TEXTURE_COUNT = 1;
+
+layout (std430, set = 1, binding = 2) readonly buffer Materials
+{
+	MaterialData materials[];
+};
+
+layout (set = 1, binding = 3) uniform sampler2D textures[TEXTURE_COUNT];
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec3 inColor;
+layout (location = 2) in vec2 inUV;
+layout (location = 3) in vec3 inViewVec;
+layout (location = 4) in vec3 inLightVec;
+layout (location = 5) in vec4 inTangent;
+layout (location = 6) flat in uint inMaterial;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main() 
+{
+	MaterialData material = materials[inMaterial];
+	vec4 color = texture(textures[nonuniformEXT(material.baseColorTexture)], inUV) * vec4(inColor, 1.0);
+
+	if (ALPHA_MASK) {
+		if (color.a < material.alphaCutoff) {
+			discard;
+		}
+	}
+
+	vec3 N = normalize(inNormal);
+	vec3 T = normalize(inTangent.xyz);
+	vec3 B = cross(inNormal, inTangent.xyz) * inTangent.w;
+	mat3 TBN = mat3(T, B, N);
+	// Normal maps may be BC5 (xy only), so reconstruct z
+	vec2 normalXY = texture(textures[nonuniformEXT(material.normalTexture)], inUV).xy * 2.0 - vec2(1.0);
+	N = TBN * normalize(vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0))));
+
+	const float ambient = 0.1;
+	vec3 L = normalize(inLightVec);
+	vec3 V = normalize(inViewVec);
+	vec3 R = reflect(-L, N);
+	vec3 diffuse = max(dot(N, L), ambient).rrr;
+	float specular = pow(max(dot(R, V), 0.0), 32.0);
+	outFragColor = vec4(diffuse * color.rgb + specular, color.a);
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#version 450
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec2 inUV;
+layout (location = 3) in vec3 inColor;
+layout (location = 4) in vec4 inTangent;
+
+layout (set = 0, binding = 0) uniform UBOScene 
+{
+	mat4 projection;
+	mat4 view;
+	vec4 lightPos;
+	vec4 viewPos;
+} uboScene;
+
+// Per-draw data, firstInstance of each indirect command is the draw index, see common/indirectScene.h
+struct DrawData
+{
+	uint matrixIndex;
+	uint materialIndex;
+	uint padding0;
+	uint padding1;
+};
+
+layout (std430, set = 1, binding = 0) readonly buffer Matrices
+{
+	mat4 matrices[];
+};
+
+layout (std430, set = 1, binding = 1) readonly buffer Draws
+{
+	DrawData draws[];
+};
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec2 outUV;
+layout (location = 3) out vec3 outViewVec;
+layout (location = 4) out vec3 outLightVec;
+layout (location = 5) out vec4 outTangent;
+layout (location = 6) flat out uint outMaterial;
+
+void main() 
+{
+	DrawData draw = draws[gl_InstanceIndex];
+	mat4 model = matrices[draw.matrixIndex];
+	outMaterial = draw.materialIndex;
+
+	outNormal = inNormal;
+	outColor = inColor;
+	outUV = inUV;
+	outTangent = inTangent;
+	gl_Position = uboScene.projection * uboScene.view * model * vec4(inPos.xyz, 1.0);
+	
+	outNormal = mat3(model) * inNormal;
+	vec4 pos = model * vec4(inPos, 1.0);
+	outLightVec = uboScene.lightPos.xyz - pos.xyz;
+	outViewVec = uboScene.viewPos.xyz - pos.xyz;
+}
\ No newline at end of file
@@ -0,0 +1,72 @@
+#version 450
+
+// Quantized vertex layout, see common/packedVertex.h
+// Position is snorm16 in the primitive bounds, the dequant transform is folded into the per-draw model matrix
+layout (location = 0) in vec4 inPos;
+layout (location = 1) in vec2 inNormal;
+layout (location = 2) in vec2 inUV;
+layout (location = 3) in vec4 inColor;
+layout (location = 4) in vec2 inTangent;
+
+layout (set = 0, binding = 0) uniform UBOScene 
+{
+	mat4 projection;
+	mat4 view;
+	vec4 lightPos;
+	vec4 viewPos;
+} uboScene;
+
+// Per-draw data, firstInstance of each indirect command is the draw index, see common/indirectScene.h
+struct DrawData
+{
+	uint matrixIndex;
+	uint materialIndex;
+	uint padding0;
+	uint padding1;
+};
+
+layout (std430, set = 1, binding = 0) readonly buffer Matrices
+{
+	mat4 matrices[];
+};
+
+layout (std430, set = 1, binding = 1) readonly buffer Draws
+{
+	DrawData draws[];
+};
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec2 outUV;
+layout (location = 3) out vec3 outViewVec;
+layout (location = 4) out vec3 outLightVec;
+layout (location = 5) out vec4 outTangent;
+layout (location = 6) flat out uint outMaterial;
+
+vec3 octDecode(vec2 e)
+{
+	vec3 v = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-v.z, 0.0);
+	v.x += v.x >= 0.0 ? -t : t;
+	v.y += v.y >= 0.0 ? -t : t;
+	return normalize(v);
+}
+
+void main() 
+{
+	DrawData draw = draws[gl_InstanceIndex];
+	mat4 model = matrices[draw.matrixIndex];
+	outMaterial = draw.materialIndex;
+
+	outColor = inColor.rgb;
+	outUV = inUV;
+	// Tangent handedness is stored in position.w
+	outTangent = vec4(octDecode(inTangent), inPos.w < 0.0 ? -1.0 : 1.0);
+	gl_Position = uboScene.projection * uboScene.view * model * vec4(inPos.xyz, 1.0);
+	
+	// model carries a uniform dequant scale, renormalize
+	outNormal = normalize(mat3(model) * octDecode(inNormal));
+	vec4 pos = model * vec4(inPos.xyz, 1.0);
+	outLightVec = uboScene.lightPos.xyz - pos.xyz;
+	outViewVec = uboScene.viewPos.xyz - pos.xyz;
+}
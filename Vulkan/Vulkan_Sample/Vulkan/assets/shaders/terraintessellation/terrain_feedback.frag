@@ -0,0 +1,30 @@
+#version 450
+
+layout (push_constant) uniform VirtualTexture
+{
+	float virtualSize;
+	float tileCount;
+	float tileSize;
+	float border;
+	float pageSize;
+	float cacheSize;
+	float maxLevel;
+	float lodBias;
+} vt;
+
+layout (location = 1) in vec2 inUV;
+
+layout (location = 0) out uint outFeedback;
+
+// Rendered at a fraction of the screen, lodBias compensates for the larger derivatives
+void main()
+{
+	vec2 dx = dFdx(inUV * vt.virtualSize);
+	vec2 dy = dFdy(inUV * vt.virtualSize);
+	float lod = clamp(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vt.lodBias, 0.0, vt.maxLevel);
+
+	int level = int(floor(lod));
+	int tiles = int(vt.tileCount) >> level;
+	ivec2 tile = clamp(ivec2(inUV * float(tiles)), ivec2(0), ivec2(tiles - 1));
+	outFeedback = (uint(level) << 28) | (uint(tile.y) << 14) | uint(tile.x);
+}
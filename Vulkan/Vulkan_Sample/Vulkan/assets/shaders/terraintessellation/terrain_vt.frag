@@ -0,0 +1,81 @@
+#version 450
+
+layout (set = 0, binding = 3) uniform sampler2D samplerCache;
+layout (set = 0, binding = 4) uniform usampler2D samplerPageTable;
+
+layout (push_constant) uniform VirtualTexture
+{
+	float virtualSize;
+	float tileCount;
+	float tileSize;
+	float border;
+	float pageSize;
+	float cacheSize;
+	float maxLevel;
+	float lodBias;
+} vt;
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec2 inUV;
+layout (location = 2) in vec3 inViewVec;
+layout (location = 3) in vec3 inLightVec;
+layout (location = 4) in vec3 inEyePos;
+layout (location = 5) in vec3 inWorldPos;
+
+layout (location = 0) out vec4 outFragColor;
+
+float virtualLod(vec2 uv)
+{
+	vec2 dx = dFdx(uv * vt.virtualSize);
+	vec2 dy = dFdy(uv * vt.virtualSize);
+	float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vt.lodBias;
+	return clamp(lod, 0.0, vt.maxLevel);
+}
+
+// The page table entry points at this tile or its nearest resident ancestor
+vec3 sampleVirtualLevel(vec2 uv, int level)
+{
+	int tiles = int(vt.tileCount) >> level;
+	ivec2 tile = clamp(ivec2(uv * float(tiles)), ivec2(0), ivec2(tiles - 1));
+	uvec4 entry = texelFetch(samplerPageTable, tile, level);
+
+	float residentTiles = float(int(vt.tileCount) >> int(entry.b));
+	vec2 residentCoord = clamp(uv, 0.0, 1.0) * residentTiles;
+	vec2 inTile = residentCoord - min(floor(residentCoord), vec2(residentTiles - 1.0));
+	vec2 texel = vec2(entry.rg) * vt.pageSize + vt.border + inTile * vt.tileSize;
+	return textureLod(samplerCache, texel / vt.cacheSize, 0.0).rgb;
+}
+
+// Trilinear between the two nearest levels, the cache itself has no mips
+vec3 sampleVirtualTexture(vec2 uv)
+{
+	float lod = virtualLod(uv);
+	int level = int(floor(lod));
+	vec3 color = sampleVirtualLevel(uv, level);
+	if (level < int(vt.maxLevel))
+	{
+		color = mix(color, sampleVirtualLevel(uv, level + 1), fract(lod));
+	}
+	return color;
+}
+
+float fog(float density)
+{
+	const float LOG2 = -1.442695;
+	float dist = gl_FragCoord.z / gl_FragCoord.w * 0.1;
+	float d = density * dist;
+	return 1.0 - clamp(exp2(d * d * LOG2), 0.0, 1.0);
+}
+
+void main()
+{
+	vec3 N = normalize(inNormal);
+	vec3 L = normalize(inLightVec);
+	vec3 ambient = vec3(0.5);
+	vec3 diffuse = max(dot(N, L), 0.0) * vec3(1.0);
+
+	vec4 color = vec4((ambient + diffuse) * sampleVirtualTexture(inUV), 1.0);
+
+	const vec4 fogColor = vec4(0.47, 0.5, 0.67, 0.0);
+	outFragColor  = mix(color, fogColor, fog(0.25));
+}
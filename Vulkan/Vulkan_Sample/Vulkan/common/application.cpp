@@ -1,5 +1,6 @@
 
 #include "application.h"
+#include "resourceCache.h"
 
 const std::vector<const char*> validationLayers =
 {
@@ -230,6 +231,10 @@ void Application::clear()
     }
     
     vkDestroyRenderPass(m_device, m_renderPass, nullptr);
+    if(m_loadRenderPass != VK_NULL_HANDLE)
+    {
+        vkDestroyRenderPass(m_device, m_loadRenderPass, nullptr);
+    }
     
     for(const auto& frameBuffer : m_framebuffers)
     {
@@ -250,6 +255,7 @@ void Application::clear()
     }
     
     vkDestroySwapchainKHR(m_device, m_swapchainKHR, nullptr);
+    ResourceCache::clear();
     vkDestroyDevice(m_device, nullptr);
     vkDestroySurfaceKHR(m_instance, m_surfaceKHR, nullptr);
     vkDestroyInstance(m_instance, nullptr);
@@ -372,6 +378,23 @@ void Application::choosePhysicalDevice()
 //    std::cout << m_deviceFeatures.fillModeNonSolid << std::endl;
 }
 
+bool Application::isDeviceExtensionSupported(const char* extensionName)
+{
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, extensions.data());
+    
+    for(const VkExtensionProperties& extension : extensions)
+    {
+        if(strcmp(extension.extensionName, extensionName) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 void Application::createLogicDeivce()
 {
     uint32_t graphicsFamily = m_familyIndices.graphicsFamily.value();
@@ -408,11 +431,14 @@ void Application::createLogicDeivce()
     createInfo.flags = 0;
     createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
     createInfo.ppEnabledLayerNames = validationLayers.data();
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    std::vector<const char*> extensions = deviceExtensions;
+    extensions.insert(extensions.end(), m_enabledDeviceExtensions.begin(), m_enabledDeviceExtensions.end());
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    createInfo.ppEnabledExtensionNames = extensions.data();
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
     createInfo.pQueueCreateInfos = queueCreateInfos.data();
     createInfo.pEnabledFeatures = &m_deviceEnabledFeatures;
+    createInfo.pNext = m_pDeviceCreateNext;
     
     if( vkCreateDevice(m_physicalDevice, &createInfo, nullptr, &m_device) != VK_SUCCESS )
     {
@@ -482,8 +508,14 @@ void Application::createDepthBuffer()
         flags |= VK_IMAGE_ASPECT_STENCIL_BIT;
     }
     
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+    if(m_depthSampled)
+    {
+        usage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    }
+    
     Tools::createImageAndMemoryThenBind(m_depthFormat, m_swapchainExtent.width, m_swapchainExtent.height, 1, 1,
-                                 m_sampleCount, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT,
+                                 m_sampleCount, usage,
                                  VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                                  m_depthImage, m_depthMemory);
     
@@ -598,7 +630,8 @@ void Application::createCommandPool()
 
 void Application::createAttachmentDescription()
 {
-    VkAttachmentDescription depthAttachmentDescription = Tools::getAttachmentDescription(m_depthFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    VkAttachmentStoreOp depthStoreOp = m_depthSampled ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    VkAttachmentDescription depthAttachmentDescription = Tools::getAttachmentDescription(m_depthFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, depthStoreOp, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
     
     VkAttachmentDescription colorAttachmentDescription = Tools::getAttachmentDescription(m_surfaceFormatKHR.format, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
     
@@ -644,6 +677,60 @@ void Application::createRenderPass()
     }
 }
 
+void Application::createLoadRenderPass()
+{
+    //只适用于默认的单个subpass, 颜色和深度两个附件的pass
+    assert(m_attachmentDescriptions.size() == 2);
+    
+    VkAttachmentDescription attachments[2] = {m_attachmentDescriptions[0], m_attachmentDescriptions[1]};
+    for(VkAttachmentDescription& attachment : attachments)
+    {
+        attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        attachment.initialLayout = attachment.finalLayout;
+    }
+    attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    
+    VkAttachmentReference colorAttachmentReference = {};
+    colorAttachmentReference.attachment = 0;
+    colorAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    
+    VkAttachmentReference depthAttachmentReference = {};
+    depthAttachmentReference.attachment = 1;
+    depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    
+    VkSubpassDescription subpassDescription = {};
+    subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpassDescription.colorAttachmentCount = 1;
+    subpassDescription.pColorAttachments = &colorAttachmentReference;
+    subpassDescription.pDepthStencilAttachment = &depthAttachmentReference;
+    
+    VkRenderPassCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    createInfo.attachmentCount = 2;
+    createInfo.pAttachments = attachments;
+    createInfo.subpassCount = 1;
+    createInfo.pSubpasses = &subpassDescription;
+    
+    if( vkCreateRenderPass(m_device, &createInfo, nullptr, &m_loadRenderPass) != VK_SUCCESS )
+    {
+        throw std::runtime_error("failed to create load renderpass!");
+    }
+}
+
+void Application::beginLoadRenderPass(const VkCommandBuffer commandBuffer)
+{
+    VkRenderPassBeginInfo passBeginInfo = {};
+    passBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    passBeginInfo.renderPass = m_loadRenderPass;
+    passBeginInfo.framebuffer = m_framebuffers[m_imageIndex];
+    passBeginInfo.renderArea.offset = {0, 0};
+    passBeginInfo.renderArea.extent = m_swapchainExtent;
+    passBeginInfo.clearValueCount = 0;
+    passBeginInfo.pClearValues = nullptr;
+    
+    vkCmdBeginRenderPass(commandBuffer, &passBeginInfo, m_subpassContents);
+}
+
 VkFormat Application::findDepthFormat()
 {
     return Tools::findSupportedFormat(
@@ -778,6 +865,7 @@ void Application::beginRenderCommandAndPass(const VkCommandBuffer commandBuffer,
 void Application::endRenderCommandAndPass(const VkCommandBuffer commandBuffer)
 {
     vkCmdEndRenderPass(commandBuffer);
+    recordAfterRenderPass(commandBuffer);
 
     if( vkEndCommandBuffer(commandBuffer) != VK_SUCCESS )
     {
@@ -785,6 +873,9 @@ void Application::endRenderCommandAndPass(const VkCommandBuffer commandBuffer)
     }
 }
 
+void Application::recordAfterRenderPass(const VkCommandBuffer commandBuffer)
+{}
+
 
 // -- helper function --
 
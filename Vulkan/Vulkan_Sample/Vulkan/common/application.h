@@ -39,6 +39,8 @@ public:
     void beginRenderCommandAndPass(const VkCommandBuffer commandBuffer, int frameBufferIndex);
     virtual void recordRenderCommand(const VkCommandBuffer commandBuffer) = 0;
     void endRenderCommandAndPass(const VkCommandBuffer commandBuffer);
+    // 主渲染通道结束之后, 命令缓冲结束之前, 比如录制截帧的拷贝
+    virtual void recordAfterRenderPass(const VkCommandBuffer commandBuffer);
     virtual void queueResult();
     
     virtual void keyboard(int key, int scancode, int action, int mods);
@@ -50,6 +52,7 @@ protected:
     void createInstance();
     void createSurface();
     void choosePhysicalDevice();
+    bool isDeviceExtensionSupported(const char* extensionName);
     void createLogicDeivce();
     void createSwapchain();
     void createSwapchainImageView();
@@ -71,6 +74,9 @@ protected:
     void createCommandBuffers();
     virtual void createAttachmentDescription();
     virtual void createRenderPass();
+    // 和m_renderPass兼容, 颜色和深度都保留之前的内容, 用于在一帧中间插入compute后继续绘制
+    void createLoadRenderPass();
+    void beginLoadRenderPass(const VkCommandBuffer commandBuffer);
     void createFramebuffers();
     void createSemaphores();
     
@@ -107,6 +113,8 @@ protected:
     VkPhysicalDeviceFeatures m_deviceFeatures;
     VkPhysicalDeviceMemoryProperties m_deviceMemoryProperties;
     VkPhysicalDeviceFeatures m_deviceEnabledFeatures = {}; //上面是总的特征,这个是程序支持的特征.
+    std::vector<const char*> m_enabledDeviceExtensions; //可选的设备扩展, 在setEnabledFeatures里按支持情况添加
+    void* m_pDeviceCreateNext = nullptr; //扩展特征结构链(如描述符索引), 创建设备时挂到VkDeviceCreateInfo::pNext, 在setEnabledFeatures里设置
     
     VkImageUsageFlags m_swapchainImageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
     
@@ -123,6 +131,7 @@ protected:
     VkImage m_depthImage;
     VkDeviceMemory m_depthMemory;
     VkImageView m_depthImageView;
+    bool m_depthSampled = false;    //深度保存到pass之后并且可以采样(Hi-Z), 在setEnabledFeatures里设置
     
     VkCommandPool m_commandPool;
     VkDescriptorPool m_descriptorPool;
@@ -132,6 +141,7 @@ protected:
     
     std::vector<VkAttachmentDescription> m_attachmentDescriptions;
     VkRenderPass m_renderPass;
+    VkRenderPass m_loadRenderPass = VK_NULL_HANDLE;
     VkSubpassContents m_subpassContents = VK_SUBPASS_CONTENTS_INLINE;
     
     std::vector<VkFramebuffer> m_framebuffers;
@@ -0,0 +1,234 @@
+
+#include "asyncLoader.h"
+#include "textureUploader.h"
+#include "mappedFile.h"
+
+AsyncLoader::AsyncLoader()
+{
+}
+
+AsyncLoader::~AsyncLoader()
+{
+    clear();
+}
+
+void AsyncLoader::prepare(VkQueue transferQueue, uint32_t threadCount)
+{
+    m_transferQueue = transferQueue;
+    m_threadPool.setThreadCount(std::max(1u, threadCount));
+    m_startTime = std::chrono::steady_clock::now();
+    m_statistics = Statistics();
+}
+
+void AsyncLoader::clear()
+{
+    m_threadPool.wait();
+    m_threadPool.setThreadCount(0);
+    m_textureJobs.clear();
+    m_modelJobs.clear();
+}
+
+Texture* AsyncLoader::loadTexture(const std::string& fileName)
+{
+    TextureData placeholder;
+    placeholder.m_name = fileName;
+    placeholder.m_width = 1;
+    placeholder.m_height = 1;
+    placeholder.m_mipLevels = 1;
+    placeholder.m_mipOffsets.assign(1, 0);
+    placeholder.m_data = {128, 128, 128, 255};
+
+    TextureUploader uploader(m_transferQueue);
+    Texture* texture = uploader.add(placeholder);
+    uploader.flush();
+
+    std::unique_ptr<TextureJob> job(new TextureJob());
+    job->texture = texture;
+    job->fileName = fileName;
+    job->loader = nullptr;
+    job->imageIndex = 0;
+    job->isReady = false;
+    addTextureJob(std::move(job));
+    return texture;
+}
+
+void AsyncLoader::loadModel(GltfLoader* loader, const std::string& fileName, uint32_t loadFlags, std::function<void(GltfLoader* loader)> onLoaded)
+{
+    std::unique_ptr<ModelJob> job(new ModelJob());
+    job->loader = loader;
+    job->onLoaded = onLoaded;
+    job->isReady = false;
+
+    ModelJob* pJob = job.get();
+    VkQueue transferQueue = m_transferQueue;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_modelJobs.push_back(std::move(job));
+        m_statistics.fullyLoadedTime = 0.0;
+    }
+
+    //loadFromFile带DeferTextures时只用到CPU
+    m_threadPool.m_threads[m_nextThread++ % m_threadPool.m_threads.size()]->addJob([this, pJob, fileName, loadFlags, transferQueue] {
+        pJob->loader->loadFromFile(fileName, transferQueue, loadFlags | GltfFileLoadFlags::DeferTextures);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        pJob->isReady = true;
+    });
+}
+
+void AsyncLoader::addTextureJob(std::unique_ptr<TextureJob> job)
+{
+    TextureJob* pJob = job.get();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_textureJobs.push_back(std::move(job));
+        m_statistics.fullyLoadedTime = 0.0;
+    }
+
+    m_threadPool.m_threads[m_nextThread++ % m_threadPool.m_threads.size()]->addJob([this, pJob] {
+        if(pJob->loader)
+        {
+            pJob->loader->decodeDeferredImage(pJob->imageIndex, pJob->data);
+        }
+        else
+        {
+            MappedFile file;
+            const uint8_t* bytes = file.open(pJob->fileName) ? file.m_data : nullptr;
+            Texture::decodeImage(bytes, bytes ? file.m_size : 0, pJob->fileName, pJob->data);
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        pJob->isReady = true;
+    });
+}
+
+void AsyncLoader::update()
+{
+    if(m_statistics.firstFrameTime == 0.0)
+    {
+        m_statistics.firstFrameTime = getElapsedTime();
+    }
+
+    //解析完的模型先填占位, 交给调用者创建绘制用的资源, 再把图片排进解码队列
+    std::vector<std::unique_ptr<ModelJob>> readyModels;
+    std::vector<std::unique_ptr<TextureJob>> readyTextures;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(size_t i = 0; i < m_modelJobs.size(); )
+        {
+            if(m_modelJobs[i]->isReady)
+            {
+                readyModels.push_back(std::move(m_modelJobs[i]));
+                m_modelJobs.erase(m_modelJobs.begin() + i);
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        //按请求的顺序上传, 超过上限的留到下一帧
+        VkDeviceSize uploadSize = 0;
+        for(size_t i = 0; i < m_textureJobs.size(); )
+        {
+            TextureJob* job = m_textureJobs[i].get();
+            if(!job->isReady)
+            {
+                i++;
+                continue;
+            }
+
+            VkDeviceSize size = job->data.m_data.size();
+            if(uploadSize > 0 && uploadSize + size > m_maxUploadBytes)
+            {
+                break;
+            }
+            uploadSize += size;
+            readyTextures.push_back(std::move(m_textureJobs[i]));
+            m_textureJobs.erase(m_textureJobs.begin() + i);
+        }
+    }
+
+    for(std::unique_ptr<ModelJob>& job : readyModels)
+    {
+        GltfLoader* loader = job->loader;
+        loader->createPlaceholderTextures();
+        if(job->onLoaded)
+        {
+            job->onLoaded(loader);
+        }
+        m_statistics.loadedModelCount++;
+
+        for(uint32_t i = 0; i < loader->getDeferredImageCount(); i++)
+        {
+            std::unique_ptr<TextureJob> textureJob(new TextureJob());
+            textureJob->texture = loader->m_textures[i];
+            textureJob->loader = loader;
+            textureJob->imageIndex = i;
+            textureJob->isReady = false;
+            addTextureJob(std::move(textureJob));
+        }
+    }
+
+    if(!readyTextures.empty())
+    {
+        //先上传到新的Texture, 一批提交, 再把image和view换进已经被引用的Texture
+        TextureUploader uploader(m_transferQueue);
+        std::vector<Texture*> sources;
+        for(std::unique_ptr<TextureJob>& job : readyTextures)
+        {
+            m_statistics.uploadedBytes += job->data.m_data.size();
+            sources.push_back(uploader.add(job->data));
+        }
+        uploader.flush();
+        vkQueueWaitIdle(m_transferQueue);
+
+        for(size_t i = 0; i < readyTextures.size(); i++)
+        {
+            replaceTexture(readyTextures[i]->texture, sources[i]);
+            if(m_onTextureChanged)
+            {
+                m_onTextureChanged(readyTextures[i]->texture);
+            }
+        }
+        m_statistics.loadedTextureCount += static_cast<uint32_t>(readyTextures.size());
+    }
+
+    bool isIdle = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_statistics.pendingCount = static_cast<uint32_t>(m_textureJobs.size() + m_modelJobs.size());
+        isIdle = m_statistics.pendingCount == 0;
+    }
+
+    if(isIdle && m_statistics.fullyLoadedTime == 0.0 && (m_statistics.loadedTextureCount > 0 || m_statistics.loadedModelCount > 0))
+    {
+        m_statistics.fullyLoadedTime = getElapsedTime();
+    }
+}
+
+bool AsyncLoader::isIdle()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_textureJobs.empty() && m_modelJobs.empty();
+}
+
+// 保留target的名字和描述符, 占位的Vulkan对象释放掉
+void AsyncLoader::replaceTexture(Texture* target, Texture* source)
+{
+    target->clear();
+    target->m_width = source->m_width;
+    target->m_height = source->m_height;
+    target->m_mipLevels = source->m_mipLevels;
+    target->m_layerCount = source->m_layerCount;
+    target->m_imageLayout = source->m_imageLayout;
+    target->m_fromat = source->m_fromat;
+    target->m_image = source->m_image;
+    target->m_imageMemory = source->m_imageMemory;
+    target->m_imageView = source->m_imageView;
+    target->m_sampler = source->m_sampler;
+    delete source;
+}
+
+double AsyncLoader::getElapsedTime() const
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_startTime).count();
+}
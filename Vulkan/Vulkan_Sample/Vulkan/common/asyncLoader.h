@@ -0,0 +1,75 @@
+
+#pragma once
+
+#include "tools.h"
+#include "texture.h"
+#include "gltfLoader.h"
+#include "thread.h"
+#include <chrono>
+
+// 后台加载模型和纹理. 读文件, 解析和解码在工作线程里, Vulkan对象只在主线程的update里创建(命令池和队列不是线程安全的).
+// loadTexture立即返回1x1占位的Texture, 可以直接写进描述符. 数据准备好后在帧边界上传, 替换Texture里的image和view,
+// 再由m_onTextureChanged重写引用它的描述符. loadModel在工作线程里解析和解码网格, 完成后在update里填上占位纹理并调用onLoaded,
+// 调用者在onLoaded里创建顶点缓冲, 描述符和管线, 之后模型的图片逐张按纹理的方式替换
+class AsyncLoader
+{
+public:
+    struct Statistics {
+        double firstFrameTime = 0.0;        //prepare到第一次update, 毫秒
+        double fullyLoadedTime = 0.0;       //prepare到所有请求都上传完, 还没完成时为0
+        uint32_t pendingCount = 0;
+        uint32_t loadedTextureCount = 0;
+        uint32_t loadedModelCount = 0;
+        VkDeviceSize uploadedBytes = 0;
+    };
+
+    AsyncLoader();
+    ~AsyncLoader();
+    void prepare(VkQueue transferQueue, uint32_t threadCount = 2);
+    // 等工作线程结束, 没有完成的请求丢掉, 已经返回的Texture保持占位
+    void clear();
+
+    // 单层2D纹理, ktx或者png/jpg. 返回的Texture由调用者释放
+    Texture* loadTexture(const std::string& fileName);
+    // loader在onLoaded之前不能使用
+    void loadModel(GltfLoader* loader, const std::string& fileName, uint32_t loadFlags, std::function<void(GltfLoader* loader)> onLoaded);
+
+    // 每帧在录制命令之前调用, 这时上一帧已经结束(每帧末尾vkDeviceWaitIdle), 可以安全地释放占位
+    void update();
+    bool isIdle();
+    const Statistics& getStatistics() { return m_statistics; }
+
+private:
+    struct TextureJob {
+        Texture* texture;
+        std::string fileName;
+        GltfLoader* loader;             //不为空时从模型里解码第imageIndex张图
+        uint32_t imageIndex;
+        TextureData data;
+        bool isReady;
+    };
+
+    struct ModelJob {
+        GltfLoader* loader;
+        std::function<void(GltfLoader* loader)> onLoaded;
+        bool isReady;
+    };
+
+    void addTextureJob(std::unique_ptr<TextureJob> job);
+    void replaceTexture(Texture* target, Texture* source);
+    double getElapsedTime() const;
+
+public:
+    VkDeviceSize m_maxUploadBytes = 32 * 1024 * 1024;      //每次update上传的上限, 至少上传一张
+    std::function<void(Texture* texture)> m_onTextureChanged;
+
+private:
+    VkQueue m_transferQueue = VK_NULL_HANDLE;
+    ThreadPool m_threadPool;
+    uint32_t m_nextThread = 0;
+    std::mutex m_mutex;                 //保护isReady, 工作线程会修改
+    std::vector<std::unique_ptr<TextureJob>> m_textureJobs;
+    std::vector<std::unique_ptr<ModelJob>> m_modelJobs;
+    std::chrono::steady_clock::time_point m_startTime;
+    Statistics m_statistics;
+};
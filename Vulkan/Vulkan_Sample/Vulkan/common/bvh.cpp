@@ -0,0 +1,608 @@
+
+#include "bvh.h"
+#include <chrono>
+#include <random>
+
+float Bvh::Aabb::area() const
+{
+    glm::vec3 e = max - min;
+    if(e.x < 0.0f || e.y < 0.0f || e.z < 0.0f)
+    {
+        return 0.0f;
+    }
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+Bvh::Bvh()
+{
+}
+
+Bvh::~Bvh()
+{}
+
+void Bvh::clear()
+{
+    m_nodes.clear();
+    m_objectIndices.clear();
+    m_bounds.clear();
+    m_centers.clear();
+}
+
+void Bvh::build(const std::vector<Aabb>& bounds)
+{
+    clear();
+    if(bounds.empty())
+    {
+        return ;
+    }
+
+    uint32_t objectCount = static_cast<uint32_t>(bounds.size());
+    m_bounds = bounds;
+    m_objectIndices.resize(objectCount);
+    m_centers.resize(objectCount);
+    for(uint32_t i = 0; i < objectCount; ++i)
+    {
+        m_objectIndices[i] = i;
+        m_centers[i] = bounds[i].center();
+    }
+
+    m_nodes.reserve(objectCount * 2);
+    Node root = {};
+    root.leftFirst = 0;
+    root.count = objectCount;
+    m_nodes.push_back(root);
+    updateNodeBounds(0);
+    subdivide(0, 0);
+
+    m_nodes.shrink_to_fit();
+    m_centers.clear();
+}
+
+void Bvh::updateNodeBounds(uint32_t nodeIndex)
+{
+    Node& node = m_nodes[nodeIndex];
+    Aabb box;
+    for(uint32_t i = 0; i < node.count; ++i)
+    {
+        box.grow(m_bounds[m_objectIndices[node.leftFirst + i]]);
+    }
+    node.min = box.min;
+    node.max = box.max;
+}
+
+bool Bvh::findSplit(const Node& node, uint32_t& axis, float& position) const
+{
+    // 分桶用中心点的范围, 比包围盒范围分得更均匀
+    Aabb centerBounds;
+    for(uint32_t i = 0; i < node.count; ++i)
+    {
+        centerBounds.grow(m_centers[m_objectIndices[node.leftFirst + i]]);
+    }
+
+    Aabb nodeBounds;
+    nodeBounds.min = node.min;
+    nodeBounds.max = node.max;
+    float bestCost = node.count * nodeBounds.area();
+    bool found = false;
+
+    for(uint32_t a = 0; a < 3; ++a)
+    {
+        float lo = centerBounds.min[a];
+        float hi = centerBounds.max[a];
+        if(hi <= lo)
+        {
+            continue;
+        }
+
+        Aabb bins[m_binCount];
+        uint32_t binCounts[m_binCount] = {};
+        float scale = m_binCount / (hi - lo);
+        for(uint32_t i = 0; i < node.count; ++i)
+        {
+            uint32_t object = m_objectIndices[node.leftFirst + i];
+            uint32_t bin = std::min(m_binCount - 1, static_cast<uint32_t>((m_centers[object][a] - lo) * scale));
+            binCounts[bin]++;
+            bins[bin].grow(m_bounds[object]);
+        }
+
+        // 从两端扫描, 得到每个分割面左右两侧的面积和数量
+        float leftAreas[m_binCount - 1];
+        float rightAreas[m_binCount - 1];
+        uint32_t leftCounts[m_binCount - 1];
+        uint32_t rightCounts[m_binCount - 1];
+        Aabb leftBox;
+        Aabb rightBox;
+        uint32_t leftSum = 0;
+        uint32_t rightSum = 0;
+        for(uint32_t i = 0; i < m_binCount - 1; ++i)
+        {
+            leftSum += binCounts[i];
+            leftBox.grow(bins[i]);
+            leftCounts[i] = leftSum;
+            leftAreas[i] = leftBox.area();
+
+            rightSum += binCounts[m_binCount - 1 - i];
+            rightBox.grow(bins[m_binCount - 1 - i]);
+            rightCounts[m_binCount - 2 - i] = rightSum;
+            rightAreas[m_binCount - 2 - i] = rightBox.area();
+        }
+
+        for(uint32_t i = 0; i < m_binCount - 1; ++i)
+        {
+            if(leftCounts[i] == 0 || rightCounts[i] == 0)
+            {
+                continue;
+            }
+
+            float cost = leftCounts[i] * leftAreas[i] + rightCounts[i] * rightAreas[i];
+            if(cost < bestCost)
+            {
+                bestCost = cost;
+                axis = a;
+                position = lo + (i + 1) / scale;
+                found = true;
+            }
+        }
+    }
+
+    return found;
+}
+
+void Bvh::subdivide(uint32_t nodeIndex, uint32_t depth)
+{
+    uint32_t axis = 0;
+    float position = 0.0f;
+    {
+        const Node& node = m_nodes[nodeIndex];
+        if(node.count <= m_maxLeafSize || depth >= m_maxDepth || !findSplit(node, axis, position))
+        {
+            return ;
+        }
+    }
+
+    uint32_t first = m_nodes[nodeIndex].leftFirst;
+    uint32_t count = m_nodes[nodeIndex].count;
+    uint32_t i = first;
+    uint32_t j = first + count - 1;
+    while(i <= j && j != UINT32_MAX)
+    {
+        if(m_centers[m_objectIndices[i]][axis] < position)
+        {
+            i++;
+        }
+        else
+        {
+            std::swap(m_objectIndices[i], m_objectIndices[j--]);
+        }
+    }
+
+    // 和分桶时的浮点误差可能导致一侧为空
+    uint32_t leftCount = i - first;
+    if(leftCount == 0 || leftCount == count)
+    {
+        return ;
+    }
+
+    uint32_t leftIndex = static_cast<uint32_t>(m_nodes.size());
+    Node child = {};
+    child.leftFirst = first;
+    child.count = leftCount;
+    m_nodes.push_back(child);
+    child.leftFirst = i;
+    child.count = count - leftCount;
+    m_nodes.push_back(child);
+
+    m_nodes[nodeIndex].leftFirst = leftIndex;
+    m_nodes[nodeIndex].count = 0;
+
+    updateNodeBounds(leftIndex);
+    updateNodeBounds(leftIndex + 1);
+    subdivide(leftIndex, depth + 1);
+    subdivide(leftIndex + 1, depth + 1);
+}
+
+void Bvh::refit(const std::vector<Aabb>& bounds)
+{
+    assert(bounds.size() == m_bounds.size());
+    m_bounds = bounds;
+
+    // 子结点总在父结点之后, 倒序遍历即自底向上
+    for(size_t n = m_nodes.size(); n-- > 0;)
+    {
+        Node& node = m_nodes[n];
+        if(node.count > 0)
+        {
+            updateNodeBounds(static_cast<uint32_t>(n));
+        }
+        else
+        {
+            const Node& left = m_nodes[node.leftFirst];
+            const Node& right = m_nodes[node.leftFirst + 1];
+            node.min = glm::min(left.min, right.min);
+            node.max = glm::max(left.max, right.max);
+        }
+    }
+}
+
+void Bvh::addSubtree(uint32_t nodeIndex, std::vector<uint32_t>& visible) const
+{
+    const Node& node = m_nodes[nodeIndex];
+    if(node.count > 0)
+    {
+        visible.insert(visible.end(), m_objectIndices.begin() + node.leftFirst, m_objectIndices.begin() + node.leftFirst + node.count);
+        return ;
+    }
+    addSubtree(node.leftFirst, visible);
+    addSubtree(node.leftFirst + 1, visible);
+}
+
+void Bvh::cullFrustum(const Frustum& frustum, std::vector<uint32_t>& visible) const
+{
+    if(m_nodes.empty())
+    {
+        return ;
+    }
+
+    // 每个结点带一个平面掩码, 父结点完全在某个平面内侧时子结点不再测试这个平面
+    std::pair<uint32_t, uint32_t> stack[m_maxDepth * 2 + 2];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = std::make_pair(0u, 0x3Fu);
+
+    while(stackSize > 0)
+    {
+        uint32_t nodeIndex = stack[stackSize - 1].first;
+        uint32_t mask = stack[stackSize - 1].second;
+        stackSize--;
+
+        const Node& node = m_nodes[nodeIndex];
+        glm::vec3 center = (node.min + node.max) * 0.5f;
+        glm::vec3 extents = (node.max - node.min) * 0.5f;
+
+        bool outside = false;
+        for(uint32_t i = 0; i < 6; ++i)
+        {
+            if((mask & (1u << i)) == 0)
+            {
+                continue;
+            }
+
+            const glm::vec4& plane = frustum.m_planes[i];
+            float d = glm::dot(glm::vec3(plane), center) + plane.w;
+            float r = glm::dot(glm::abs(glm::vec3(plane)), extents);
+            if(d + r <= 0.0f)
+            {
+                outside = true;
+                break;
+            }
+            if(d - r >= 0.0f)
+            {
+                mask &= ~(1u << i);
+            }
+        }
+
+        if(outside)
+        {
+            continue;
+        }
+
+        if(mask == 0 || node.count > 0)
+        {
+            // 叶子里的物体逐个测试剩下的平面
+            if(mask != 0)
+            {
+                for(uint32_t k = 0; k < node.count; ++k)
+                {
+                    uint32_t object = m_objectIndices[node.leftFirst + k];
+                    const Aabb& box = m_bounds[object];
+                    glm::vec3 c = box.center();
+                    glm::vec3 e = (box.max - box.min) * 0.5f;
+                    bool inside = true;
+                    for(uint32_t i = 0; i < 6 && inside; ++i)
+                    {
+                        if(mask & (1u << i))
+                        {
+                            const glm::vec4& plane = frustum.m_planes[i];
+                            inside = glm::dot(glm::vec3(plane), c) + plane.w + glm::dot(glm::abs(glm::vec3(plane)), e) > 0.0f;
+                        }
+                    }
+                    if(inside)
+                    {
+                        visible.push_back(object);
+                    }
+                }
+            }
+            else
+            {
+                addSubtree(nodeIndex, visible);
+            }
+            continue;
+        }
+
+        stack[stackSize++] = std::make_pair(node.leftFirst + 1, mask);
+        stack[stackSize++] = std::make_pair(node.leftFirst, mask);
+    }
+}
+
+bool Bvh::intersectRay(const Node& node, const glm::vec3& origin, const glm::vec3& invDir, float maxDistance, float& distance) const
+{
+    glm::vec3 t0 = (node.min - origin) * invDir;
+    glm::vec3 t1 = (node.max - origin) * invDir;
+    glm::vec3 tMin = glm::min(t0, t1);
+    glm::vec3 tMax = glm::max(t0, t1);
+    float tNear = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+    float tFar = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDistance));
+    distance = tNear;
+    return tNear <= tFar;
+}
+
+bool Bvh::raycast(const glm::vec3& origin, const glm::vec3& dir, float maxDistance, uint32_t& objectIndex, float& distance) const
+{
+    if(m_nodes.empty())
+    {
+        return false;
+    }
+
+    glm::vec3 invDir = 1.0f / dir;
+    float closest = maxDistance;
+    bool hit = false;
+
+    uint32_t stack[m_maxDepth * 2 + 2];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while(stackSize > 0)
+    {
+        const Node& node = m_nodes[stack[--stackSize]];
+        float t;
+        if(!intersectRay(node, origin, invDir, closest, t))
+        {
+            continue;
+        }
+
+        if(node.count > 0)
+        {
+            for(uint32_t i = 0; i < node.count; ++i)
+            {
+                uint32_t object = m_objectIndices[node.leftFirst + i];
+                Node box = {m_bounds[object].min, 0, m_bounds[object].max, 1};
+                if(intersectRay(box, origin, invDir, closest, t))
+                {
+                    closest = t;
+                    objectIndex = object;
+                    hit = true;
+                }
+            }
+            continue;
+        }
+
+        // 近的子结点后入栈, 先处理, 尽早缩短closest
+        float tLeft = 0.0f;
+        float tRight = 0.0f;
+        bool hitLeft = intersectRay(m_nodes[node.leftFirst], origin, invDir, closest, tLeft);
+        bool hitRight = intersectRay(m_nodes[node.leftFirst + 1], origin, invDir, closest, tRight);
+        if(hitLeft && hitRight)
+        {
+            bool leftFirst = tLeft <= tRight;
+            stack[stackSize++] = leftFirst ? node.leftFirst + 1 : node.leftFirst;
+            stack[stackSize++] = leftFirst ? node.leftFirst : node.leftFirst + 1;
+        }
+        else if(hitLeft)
+        {
+            stack[stackSize++] = node.leftFirst;
+        }
+        else if(hitRight)
+        {
+            stack[stackSize++] = node.leftFirst + 1;
+        }
+    }
+
+    if(hit)
+    {
+        distance = closest;
+    }
+    return hit;
+}
+
+void Bvh::queryRay(const glm::vec3& origin, const glm::vec3& dir, float maxDistance, std::vector<uint32_t>& results) const
+{
+    if(m_nodes.empty())
+    {
+        return ;
+    }
+
+    glm::vec3 invDir = 1.0f / dir;
+    uint32_t stack[m_maxDepth * 2 + 2];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while(stackSize > 0)
+    {
+        const Node& node = m_nodes[stack[--stackSize]];
+        float t;
+        if(!intersectRay(node, origin, invDir, maxDistance, t))
+        {
+            continue;
+        }
+
+        if(node.count > 0)
+        {
+            for(uint32_t i = 0; i < node.count; ++i)
+            {
+                uint32_t object = m_objectIndices[node.leftFirst + i];
+                Node box = {m_bounds[object].min, 0, m_bounds[object].max, 1};
+                if(intersectRay(box, origin, invDir, maxDistance, t))
+                {
+                    results.push_back(object);
+                }
+            }
+            continue;
+        }
+
+        stack[stackSize++] = node.leftFirst + 1;
+        stack[stackSize++] = node.leftFirst;
+    }
+}
+
+void Bvh::queryOverlap(const Aabb& box, std::vector<uint32_t>& results) const
+{
+    if(m_nodes.empty())
+    {
+        return ;
+    }
+
+    auto overlap = [&box](const glm::vec3& min, const glm::vec3& max) {
+        return glm::all(glm::lessThanEqual(min, box.max)) && glm::all(glm::greaterThanEqual(max, box.min));
+    };
+
+    uint32_t stack[m_maxDepth * 2 + 2];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while(stackSize > 0)
+    {
+        const Node& node = m_nodes[stack[--stackSize]];
+        if(!overlap(node.min, node.max))
+        {
+            continue;
+        }
+
+        if(node.count > 0)
+        {
+            for(uint32_t i = 0; i < node.count; ++i)
+            {
+                uint32_t object = m_objectIndices[node.leftFirst + i];
+                if(overlap(m_bounds[object].min, m_bounds[object].max))
+                {
+                    results.push_back(object);
+                }
+            }
+            continue;
+        }
+
+        stack[stackSize++] = node.leftFirst + 1;
+        stack[stackSize++] = node.leftFirst;
+    }
+}
+
+Bvh::Aabb Bvh::transformBounds(const glm::vec3& min, const glm::vec3& max, const glm::mat4& matrix)
+{
+    // 中心变换, 半边长乘矩阵绝对值
+    glm::vec3 center = glm::vec3(matrix * glm::vec4((min + max) * 0.5f, 1.0f));
+    glm::vec3 extents = (max - min) * 0.5f;
+    glm::mat3 absMatrix = glm::mat3(glm::abs(glm::vec3(matrix[0])), glm::abs(glm::vec3(matrix[1])), glm::abs(glm::vec3(matrix[2])));
+    glm::vec3 newExtents = absMatrix * extents;
+
+    Aabb box;
+    box.min = center - newExtents;
+    box.max = center + newExtents;
+    return box;
+}
+
+Bvh::Aabb Bvh::getPrimitiveBounds(GltfLoader* pLoader, GltfNode* node, Primitive* primitive)
+{
+    // 和GltfLoader::transformVertices一致, FlipY在预变换之后, 否则在结点矩阵之前
+    glm::mat4 flip = glm::mat4(1.0f);
+    if(pLoader->getLoadFlags() & GltfFileLoadFlags::FlipY)
+    {
+        flip = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -1.0f, 1.0f));
+    }
+
+    bool preTransform = pLoader->getLoadFlags() & GltfFileLoadFlags::PreTransformVertices;
+    return transformBounds(primitive->m_min, primitive->m_max, preTransform ? flip * node->m_worldMatrix : node->m_worldMatrix * flip);
+}
+
+void Bvh::getSceneBounds(GltfLoader* pLoader, std::vector<SceneObject>& objects, std::vector<Aabb>& bounds)
+{
+    objects.clear();
+    bounds.clear();
+    for(GltfNode* node : pLoader->m_linearNodes)
+    {
+        if(node->m_mesh == nullptr)
+        {
+            continue;
+        }
+
+        for(Primitive* primitive : node->m_mesh->m_primitives)
+        {
+            if(primitive->m_min.x > primitive->m_max.x)
+            {
+                continue;
+            }
+
+            objects.push_back({node, primitive});
+            bounds.push_back(getPrimitiveBounds(pLoader, node, primitive));
+        }
+    }
+}
+
+void Bvh::benchmark(const std::vector<uint32_t>& objectCounts)
+{
+    std::default_random_engine engine(1);
+    std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+    std::uniform_real_distribution<float> size(0.5f, 5.0f);
+
+    // 和场景相机类似的视锥, 覆盖一部分物体
+    glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 800.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, -900.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum;
+    frustum.update(proj * view);
+
+    for(uint32_t objectCount : objectCounts)
+    {
+        std::vector<Aabb> bounds(objectCount);
+        std::vector<glm::vec4> spheres(objectCount);
+        for(uint32_t i = 0; i < objectCount; ++i)
+        {
+            glm::vec3 center = glm::vec3(position(engine), position(engine), position(engine));
+            glm::vec3 extents = glm::vec3(size(engine), size(engine), size(engine));
+            bounds[i].min = center - extents;
+            bounds[i].max = center + extents;
+            spheres[i] = glm::vec4(center, glm::length(extents));
+        }
+
+        const uint32_t repeat = 20;
+        auto tStart = std::chrono::high_resolution_clock::now();
+        Bvh bvh;
+        bvh.build(bounds);
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        double buildTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+
+        tStart = std::chrono::high_resolution_clock::now();
+        bvh.refit(bounds);
+        tEnd = std::chrono::high_resolution_clock::now();
+        double refitTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+
+        // 和MultiThread::threadRenderCode一样逐个测试包围球
+        std::vector<uint32_t> linearVisible;
+        linearVisible.reserve(objectCount);
+        tStart = std::chrono::high_resolution_clock::now();
+        for(uint32_t r = 0; r < repeat; ++r)
+        {
+            linearVisible.clear();
+            for(uint32_t i = 0; i < objectCount; ++i)
+            {
+                if(frustum.checkSphere(glm::vec3(spheres[i]), spheres[i].w))
+                {
+                    linearVisible.push_back(i);
+                }
+            }
+        }
+        tEnd = std::chrono::high_resolution_clock::now();
+        double linearTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count() / repeat;
+
+        std::vector<uint32_t> bvhVisible;
+        bvhVisible.reserve(objectCount);
+        tStart = std::chrono::high_resolution_clock::now();
+        for(uint32_t r = 0; r < repeat; ++r)
+        {
+            bvhVisible.clear();
+            bvh.cullFrustum(frustum, bvhVisible);
+        }
+        tEnd = std::chrono::high_resolution_clock::now();
+        double bvhTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count() / repeat;
+
+        std::cout << objectCount << " objects, " << bvh.m_nodes.size() << " nodes, build " << buildTime << " ms, refit " << refitTime << " ms"
+                  << ", linear cull " << linearTime << " ms (" << linearVisible.size() << " visible), bvh cull " << bvhTime << " ms ("
+                  << bvhVisible.size() << " visible)" << std::endl;
+    }
+}
@@ -0,0 +1,78 @@
+
+#pragma once
+
+#include "tools.h"
+#include "frustum.h"
+#include "gltfLoader.h"
+
+// 物体包围盒上的层次包围盒树, 用于CPU端视锥剔除, 拾取和区域查询.
+// 按分桶SAH自顶向下构建, 物体移动后refit只更新包围盒不改拓扑, 移动过大时应重新build.
+// 结点按深度优先存放, 父结点在子结点之前, 两个子结点相邻
+class Bvh
+{
+public:
+    struct Aabb {
+        glm::vec3 min = glm::vec3(FLT_MAX);
+        glm::vec3 max = glm::vec3(-FLT_MAX);
+
+        void grow(const glm::vec3& p) { min = glm::min(min, p); max = glm::max(max, p); }
+        void grow(const Aabb& b) { min = glm::min(min, b.min); max = glm::max(max, b.max); }
+        glm::vec3 center() const { return (min + max) * 0.5f; }
+        float area() const;
+    };
+
+    // count为0时是内部结点, 子结点为leftFirst和leftFirst+1; 否则是叶子, 物体为m_objectIndices[leftFirst, leftFirst+count)
+    struct Node {
+        glm::vec3 min;
+        uint32_t leftFirst;
+        glm::vec3 max;
+        uint32_t count;
+    };
+
+    // 场景里每个primitive一个物体, 包围盒由Primitive的m_min/m_max变换到世界空间
+    struct SceneObject {
+        GltfNode* node;
+        Primitive* primitive;
+    };
+
+    Bvh();
+    ~Bvh();
+    void clear();
+
+    void build(const std::vector<Aabb>& bounds);
+    // bounds数量和build时一致
+    void refit(const std::vector<Aabb>& bounds);
+
+    // 和Frustum::checkSphere一样, 与平面相切算不可见. 返回物体序号, 不排序
+    void cullFrustum(const Frustum& frustum, std::vector<uint32_t>& visible) const;
+    // 最近的包围盒交点, dir不需要单位化, distance以dir长度为单位
+    bool raycast(const glm::vec3& origin, const glm::vec3& dir, float maxDistance, uint32_t& objectIndex, float& distance) const;
+    // 包围盒和射线相交的所有物体, 调用者再做精确测试
+    void queryRay(const glm::vec3& origin, const glm::vec3& dir, float maxDistance, std::vector<uint32_t>& results) const;
+    void queryOverlap(const Aabb& box, std::vector<uint32_t>& results) const;
+
+    static Aabb transformBounds(const glm::vec3& min, const glm::vec3& max, const glm::mat4& matrix);
+    // 世界空间包围盒, 处理了FlipY
+    static Aabb getPrimitiveBounds(GltfLoader* pLoader, GltfNode* node, Primitive* primitive);
+    // 结点矩阵更新后重新调用, 再refit
+    static void getSceneBounds(GltfLoader* pLoader, std::vector<SceneObject>& objects, std::vector<Aabb>& bounds);
+    // 随机物体上对比线性扫描和BVH的剔除时间, 输出到std::cout
+    static void benchmark(const std::vector<uint32_t>& objectCounts);
+
+private:
+    void subdivide(uint32_t nodeIndex, uint32_t depth);
+    bool findSplit(const Node& node, uint32_t& axis, float& position) const;
+    void updateNodeBounds(uint32_t nodeIndex);
+    void addSubtree(uint32_t nodeIndex, std::vector<uint32_t>& visible) const;
+    bool intersectRay(const Node& node, const glm::vec3& origin, const glm::vec3& invDir, float maxDistance, float& distance) const;
+
+public:
+    static const uint32_t m_binCount = 12;
+    static const uint32_t m_maxLeafSize = 4;
+    static const uint32_t m_maxDepth = 64;
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_objectIndices;
+    std::vector<Aabb> m_bounds;
+    std::vector<glm::vec3> m_centers;       //只在build时使用
+};
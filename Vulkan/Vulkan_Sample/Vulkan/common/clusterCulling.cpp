@@ -0,0 +1,312 @@
+
+#include "clusterCulling.h"
+#include "resourceCache.h"
+
+ClusterCulling::ClusterCulling()
+{
+}
+
+ClusterCulling::~ClusterCulling()
+{}
+
+void ClusterCulling::clear()
+{
+    vkDestroyPipeline(Tools::m_device, m_pipeline, nullptr);
+    vkDestroyPipelineLayout(Tools::m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(Tools::m_device, m_descriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(Tools::m_device, m_descriptorPool, nullptr);
+
+    if(m_pHiZPlaceholder)
+    {
+        ResourceCache::releaseTexture(m_pHiZPlaceholder);
+        m_pHiZPlaceholder = nullptr;
+    }
+
+    vkFreeMemory(Tools::m_device, m_uniformMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_uniformBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_lastVisibleMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_lastVisibleBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_culledIndexMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_culledIndexBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_indirectMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_indirectBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_drawTemplateMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_drawTemplateBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_meshletMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_meshletBuffer, nullptr);
+}
+
+void ClusterCulling::prepare(GltfLoader* pLoader, VkPipelineCache pipelineCache)
+{
+    assert(pLoader && pLoader->getIndexCount() > 0);
+    //蒙皮或预变换的顶点无法使用预计算的世界空间包围球
+    assert(pLoader->m_skins.size() == 0);
+    m_pLoader = pLoader;
+
+    buildMeshlets();
+    createBuffers();
+    createDescriptorSet();
+    createComputePipeline(pipelineCache);
+}
+
+void ClusterCulling::buildMeshlets()
+{
+    m_meshlets.clear();
+    m_drawNodes.clear();
+    m_drawPrimitives.clear();
+    m_drawCommands.clear();
+
+    for(GltfNode* node : m_pLoader->m_linearNodes)
+    {
+        if(node->m_mesh == nullptr)
+        {
+            continue;
+        }
+
+        for(Primitive* primitive : node->m_mesh->m_primitives)
+        {
+            if(primitive->m_indexCount == 0)
+            {
+                continue;
+            }
+
+            // 双面和alpha测试的材质背面也可能可见, 写入退化的法线锥, 不做法线锥剔除
+            Material* mat = primitive->m_material;
+            bool coneCulling = mat == nullptr || (mat->m_doubleSided == false && mat->m_alphaMode == Material::OPAQUE);
+            uint32_t vertexOffset = m_pLoader->m_isLocalIndex ? primitive->m_vertexOffset : 0;
+            uint32_t drawIndex = static_cast<uint32_t>(m_drawCommands.size());
+            MeshletBuilder::build(m_pLoader->getVertices(), m_pLoader->getIndices(), primitive, node->m_worldMatrix, coneCulling, vertexOffset, drawIndex, m_meshlets);
+
+            // 输出的索引已经是全局索引, 区间和源索引一致
+            VkDrawIndexedIndirectCommand command = {};
+            command.indexCount = 0;
+            command.instanceCount = 1;
+            command.firstIndex = primitive->m_indexOffset;
+            command.vertexOffset = 0;
+            command.firstInstance = 0;
+            m_drawCommands.push_back(command);
+            m_drawNodes.push_back(node);
+            m_drawPrimitives.push_back(primitive);
+        }
+    }
+}
+
+void ClusterCulling::createBuffers()
+{
+    VkDeviceSize meshletSize = m_meshlets.size() * sizeof(MeshletBuilder::Meshlet);
+    VkDeviceSize commandSize = m_drawCommands.size() * sizeof(VkDrawIndexedIndirectCommand);
+
+    VkBuffer meshletStagingBuffer;
+    VkDeviceMemory meshletStagingMemory;
+    Tools::createBufferAndMemoryThenBind(meshletSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, meshletStagingBuffer, meshletStagingMemory);
+    Tools::mapMemory(meshletStagingMemory, meshletSize, m_meshlets.data());
+    Tools::createBufferAndMemoryThenBind(meshletSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_meshletBuffer, m_meshletMemory);
+
+    VkBuffer commandStagingBuffer;
+    VkDeviceMemory commandStagingMemory;
+    Tools::createBufferAndMemoryThenBind(commandSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, commandStagingBuffer, commandStagingMemory);
+    Tools::mapMemory(commandStagingMemory, commandSize, m_drawCommands.data());
+    Tools::createBufferAndMemoryThenBind(commandSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_drawTemplateBuffer, m_drawTemplateMemory);
+    Tools::createBufferAndMemoryThenBind(commandSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indirectBuffer, m_indirectMemory);
+
+    VkDeviceSize indexSize = m_pLoader->getIndexCount() * sizeof(uint32_t);
+    Tools::createBufferAndMemoryThenBind(indexSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_culledIndexBuffer, m_culledIndexMemory);
+
+    VkDeviceSize lastVisibleSize = m_meshlets.size() * sizeof(uint32_t);
+    Tools::createBufferAndMemoryThenBind(lastVisibleSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_lastVisibleBuffer, m_lastVisibleMemory);
+
+    Tools::createBufferAndMemoryThenBind(sizeof(Uniform), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_uniformBuffer, m_uniformMemory);
+
+    VkCommandBuffer copyCmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    VkBufferCopy copyRegion = {};
+    copyRegion.size = meshletSize;
+    vkCmdCopyBuffer(copyCmd, meshletStagingBuffer, m_meshletBuffer, 1, &copyRegion);
+    copyRegion.size = commandSize;
+    vkCmdCopyBuffer(copyCmd, commandStagingBuffer, m_drawTemplateBuffer, 1, &copyRegion);
+    //第一帧Early什么都不画, 全部在Late里测试
+    vkCmdFillBuffer(copyCmd, m_lastVisibleBuffer, 0, VK_WHOLE_SIZE, 0);
+    Tools::flushCommandBuffer(copyCmd, m_pLoader->m_graphicsQueue, true);
+
+    vkDestroyBuffer(Tools::m_device, meshletStagingBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, meshletStagingMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, commandStagingBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, commandStagingMemory, nullptr);
+}
+
+void ClusterCulling::createDescriptorSet()
+{
+    //没有Hi-Z时绑定1x1的占位纹理, 遮挡剔除关闭
+    m_pHiZPlaceholder = ResourceCache::acquireEmptyTexture(m_pLoader->m_graphicsQueue);
+
+    std::array<VkDescriptorPoolSize, 3> poolSizes;
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = 5;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[1].descriptorCount = 1;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[2].descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = 0;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+    VK_CHECK_RESULT(vkCreateDescriptorPool(Tools::m_device, &poolInfo, nullptr, &m_descriptorPool));
+
+    std::array<VkDescriptorSetLayoutBinding, 7> bindings;
+    for(uint32_t i = 0; i < 4; ++i)
+    {
+        bindings[i] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, i);
+    }
+    bindings[4] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 4);
+    bindings[5] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 5);
+    bindings[6] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 6);
+    VkDescriptorSetLayoutCreateInfo layoutInfo = Tools::getDescriptorSetLayoutCreateInfo(bindings.data(), static_cast<uint32_t>(bindings.size()));
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(Tools::m_device, &layoutInfo, nullptr, &m_descriptorSetLayout));
+
+    Tools::allocateDescriptorSets(m_descriptorPool, &m_descriptorSetLayout, 1, m_descriptorSet);
+
+    VkDescriptorBufferInfo bufferInfos[6] = {};
+    bufferInfos[0].buffer = m_meshletBuffer;
+    bufferInfos[0].range = VK_WHOLE_SIZE;
+    bufferInfos[1].buffer = m_pLoader->m_indexBuffer;
+    bufferInfos[1].range = VK_WHOLE_SIZE;
+    bufferInfos[2].buffer = m_culledIndexBuffer;
+    bufferInfos[2].range = VK_WHOLE_SIZE;
+    bufferInfos[3].buffer = m_indirectBuffer;
+    bufferInfos[3].range = VK_WHOLE_SIZE;
+    bufferInfos[4].buffer = m_uniformBuffer;
+    bufferInfos[4].range = sizeof(Uniform);
+    bufferInfos[5].buffer = m_lastVisibleBuffer;
+    bufferInfos[5].range = VK_WHOLE_SIZE;
+    VkDescriptorImageInfo imageInfo = m_pHiZPlaceholder->getDescriptorImageInfo();
+
+    std::array<VkWriteDescriptorSet, 7> writes;
+    for(uint32_t i = 0; i < 6; ++i)
+    {
+        writes[i] = Tools::getWriteDescriptorSet(m_descriptorSet, bindings[i].descriptorType, i, &bufferInfos[i]);
+    }
+    writes[6] = Tools::getWriteDescriptorSet(m_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6, &imageInfo);
+    vkUpdateDescriptorSets(Tools::m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void ClusterCulling::createComputePipeline(VkPipelineCache pipelineCache)
+{
+    //剔除阶段用push constant传入
+    VkPushConstantRange pushConstantRange = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t)};
+
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &m_descriptorSetLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(Tools::m_device, &layoutInfo, nullptr, &m_pipelineLayout));
+
+    VkShaderModule compModule = Tools::createShaderModule( Tools::getShaderPath() + "gltfscenerendering/clustercull.comp.spv");
+
+    VkComputePipelineCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    createInfo.layout = m_pipelineLayout;
+    createInfo.flags = 0;
+    createInfo.stage = Tools::getPipelineShaderStageCreateInfo(compModule, VK_SHADER_STAGE_COMPUTE_BIT);
+
+    if( vkCreateComputePipelines(Tools::m_device, pipelineCache, 1, &createInfo, nullptr, &m_pipeline) != VK_SUCCESS )
+    {
+        throw std::runtime_error("failed to create cluster culling pipeline!");
+    }
+
+    vkDestroyShaderModule(Tools::m_device, compModule, nullptr);
+}
+
+void ClusterCulling::setHiZ(VkImageView imageView, VkSampler sampler, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageLayout imageLayout)
+{
+    m_hizImageView = imageView;
+    m_hizWidth = width;
+    m_hizHeight = height;
+    m_hizMipLevels = mipLevels;
+
+    VkDescriptorImageInfo imageInfo = m_pHiZPlaceholder->getDescriptorImageInfo();
+    if(imageView != VK_NULL_HANDLE)
+    {
+        imageInfo.imageView = imageView;
+        imageInfo.sampler = sampler;
+        imageInfo.imageLayout = imageLayout;
+    }
+    VkWriteDescriptorSet write = Tools::getWriteDescriptorSet(m_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 6, &imageInfo);
+    vkUpdateDescriptorSets(Tools::m_device, 1, &write, 0, nullptr);
+}
+
+void ClusterCulling::update(const glm::mat4& viewProjMatrix, const glm::vec3& cameraPos)
+{
+    m_frustum.update(viewProjMatrix);
+    for(uint32_t i = 0; i < 6; ++i)
+    {
+        m_uniform.frustumPlanes[i] = m_frustum.m_planes[i];
+    }
+    m_uniform.cameraPos = glm::vec4(cameraPos, 1.0f);
+    m_uniform.meshletCount = static_cast<uint32_t>(m_meshlets.size());
+    m_uniform.indexIs16Bit = m_pLoader->m_indexType == VK_INDEX_TYPE_UINT16 ? 1 : 0;
+    m_uniform.frustumCulling = m_frustumCulling ? 1 : 0;
+    m_uniform.coneCulling = m_coneCulling ? 1 : 0;
+    m_uniform.viewProjMatrix = viewProjMatrix;
+    m_uniform.occlusionCulling = (m_occlusionCulling && m_hizImageView != VK_NULL_HANDLE) ? 1 : 0;
+    m_uniform.hizWidth = m_hizWidth;
+    m_uniform.hizHeight = m_hizHeight;
+    m_uniform.hizMipLevels = m_hizMipLevels;
+    Tools::mapMemory(m_uniformMemory, sizeof(Uniform), &m_uniform);
+}
+
+void ClusterCulling::dispatch(VkCommandBuffer commandBuffer, OcclusionPhase phase)
+{
+    // 上一帧(或Early阶段)的间接命令和索引读取结束后才能重置
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    VkBufferCopy copyRegion = {};
+    copyRegion.size = m_drawCommands.size() * sizeof(VkDrawIndexedIndirectCommand);
+    vkCmdCopyBuffer(commandBuffer, m_drawTemplateBuffer, m_indirectBuffer, 1, &copyRegion);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    //每个work group处理一个meshlet
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+    uint32_t phaseValue = static_cast<uint32_t>(phase);
+    vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &phaseValue);
+    vkCmdDispatch(commandBuffer, static_cast<uint32_t>(m_meshlets.size()), 1, 1);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+void ClusterCulling::bindBuffers(VkCommandBuffer commandBuffer)
+{
+    const VkDeviceSize offsets[1] = {0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_pLoader->m_vertexBuffer, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, m_culledIndexBuffer, 0, VK_INDEX_TYPE_UINT32);
+}
+
+void ClusterCulling::draw(VkCommandBuffer commandBuffer, const VkPipelineLayout& pipelineLayout)
+{
+    for(uint32_t i = 0; i < m_drawCommands.size(); ++i)
+    {
+        GltfNode* node = m_drawNodes[i];
+        Primitive* primitive = m_drawPrimitives[i];
+        glm::mat4 modelMatrix = node->m_worldMatrix * primitive->m_dequantMatrix;
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &modelMatrix);
+
+        Material* mat = primitive->m_material;
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mat->m_graphicsPipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &mat->m_descriptorSet, 0, nullptr);
+
+        vkCmdDrawIndexedIndirect(commandBuffer, m_indirectBuffer, i * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
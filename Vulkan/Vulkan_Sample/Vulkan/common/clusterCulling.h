@@ -0,0 +1,90 @@
+
+#pragma once
+
+#include "tools.h"
+#include "gltfLoader.h"
+#include "meshlet.h"
+#include "frustum.h"
+#include "hiZPyramid.h"
+
+// 每帧用compute shader按meshlet做视锥, 法线锥和Hi-Z遮挡剔除, 可见簇的索引压缩写入新的索引buffer,
+// 每个primitive一条VkDrawIndexedIndirectCommand, indexCount由shader原子累加.
+// 包围球在世界空间预计算, 只适用于静态场景
+class ClusterCulling
+{
+public:
+    struct Uniform {
+        glm::vec4 frustumPlanes[6];
+        glm::vec4 cameraPos;
+        uint32_t meshletCount;
+        uint32_t indexIs16Bit;
+        uint32_t frustumCulling;
+        uint32_t coneCulling;
+        glm::mat4 viewProjMatrix;
+        uint32_t occlusionCulling;
+        uint32_t hizWidth;
+        uint32_t hizHeight;
+        uint32_t hizMipLevels;
+    };
+
+    ClusterCulling();
+    ~ClusterCulling();
+    void clear();
+
+    void prepare(GltfLoader* pLoader, VkPipelineCache pipelineCache);
+    // 和GpuCulling::setHiZ一致, 设置后才会做遮挡剔除. 需要在GPU空闲时调用
+    void setHiZ(VkImageView imageView, VkSampler sampler, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_GENERAL);
+    void update(const glm::mat4& viewProjMatrix, const glm::vec3& cameraPos);
+    // 两阶段时Early在render pass之前, Late在Hi-Z建好之后, 每次dispatch之后draw一次
+    void dispatch(VkCommandBuffer commandBuffer, OcclusionPhase phase = SinglePhase);
+    void bindBuffers(VkCommandBuffer commandBuffer);
+    // 和GltfLoader::draw的method 3一致: 绑定材质pipeline和set 1, push模型矩阵
+    void draw(VkCommandBuffer commandBuffer, const VkPipelineLayout& pipelineLayout);
+
+private:
+    void buildMeshlets();
+    void createBuffers();
+    void createDescriptorSet();
+    void createComputePipeline(VkPipelineCache pipelineCache);
+
+public:
+    static const uint32_t m_workGroupSize = 64;
+
+    GltfLoader* m_pLoader = nullptr;
+    bool m_frustumCulling = true;
+    bool m_coneCulling = true;
+    bool m_occlusionCulling = true;
+
+    std::vector<MeshletBuilder::Meshlet> m_meshlets;
+    std::vector<GltfNode*> m_drawNodes;                 //按drawIndex排列
+    std::vector<Primitive*> m_drawPrimitives;
+    std::vector<VkDrawIndexedIndirectCommand> m_drawCommands;
+
+    Frustum m_frustum;
+    Uniform m_uniform = {};
+
+    VkBuffer m_meshletBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_meshletMemory = VK_NULL_HANDLE;
+    VkBuffer m_drawTemplateBuffer = VK_NULL_HANDLE;     //indexCount为0的命令, 每帧拷贝重置
+    VkDeviceMemory m_drawTemplateMemory = VK_NULL_HANDLE;
+    VkBuffer m_indirectBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_indirectMemory = VK_NULL_HANDLE;
+    VkBuffer m_culledIndexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_culledIndexMemory = VK_NULL_HANDLE;
+    VkBuffer m_lastVisibleBuffer = VK_NULL_HANDLE;      //每个meshlet上一帧是否可见, 两阶段剔除用
+    VkDeviceMemory m_lastVisibleMemory = VK_NULL_HANDLE;
+    VkBuffer m_uniformBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_uniformMemory = VK_NULL_HANDLE;
+
+    Texture* m_pHiZPlaceholder = nullptr;
+    VkImageView m_hizImageView = VK_NULL_HANDLE;
+    uint32_t m_hizWidth = 0;
+    uint32_t m_hizHeight = 0;
+    uint32_t m_hizMipLevels = 0;
+
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+};
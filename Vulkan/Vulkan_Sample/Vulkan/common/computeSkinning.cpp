@@ -0,0 +1,239 @@
+
+#include "computeSkinning.h"
+
+ComputeSkinning::ComputeSkinning()
+{
+}
+
+ComputeSkinning::~ComputeSkinning()
+{}
+
+void ComputeSkinning::clear()
+{
+    vkDestroyPipeline(Tools::m_device, m_pipeline, nullptr);
+    vkDestroyPipelineLayout(Tools::m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(Tools::m_device, m_descriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(Tools::m_device, m_descriptorPool, nullptr);
+
+    vkFreeMemory(Tools::m_device, m_boundsMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_boundsBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_skinnedVertexMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_skinnedVertexBuffer, nullptr);
+}
+
+void ComputeSkinning::prepare(GltfLoader* pLoader, VkPipelineCache pipelineCache, bool computeBounds)
+{
+    assert(pLoader && pLoader->m_skins.size() > 0);
+    //compute shader按float读取Vertex, 不支持压缩顶点
+    assert(pLoader->m_packedLayout.m_stride == 0);
+    m_pLoader = pLoader;
+    m_computeBounds = computeBounds;
+
+    createBuffers();
+    createDescriptorSets();
+    createComputePipeline(pipelineCache);
+}
+
+void ComputeSkinning::createBuffers()
+{
+    VkDeviceSize vertexBufferSize = m_pLoader->getVertexCount() * sizeof(Vertex);
+    Tools::createBufferAndMemoryThenBind(vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_skinnedVertexBuffer, m_skinnedVertexMemory);
+
+    // 先整体拷贝一份bind pose, 没有skin的结点之后就不用再处理
+    VkCommandBuffer copyCmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    VkBufferCopy copyRegion = {};
+    copyRegion.size = vertexBufferSize;
+    vkCmdCopyBuffer(copyCmd, m_pLoader->m_vertexBuffer, m_skinnedVertexBuffer, 1, &copyRegion);
+    Tools::flushCommandBuffer(copyCmd, m_pLoader->m_graphicsQueue, true);
+
+    Tools::createBufferAndMemoryThenBind(sizeof(Bounds), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                         m_boundsBuffer, m_boundsMemory);
+}
+
+void ComputeSkinning::createDescriptorSets()
+{
+    uint32_t skinCount = static_cast<uint32_t>(m_pLoader->m_skins.size());
+
+    VkDescriptorPoolSize poolSize = {};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = 4 * skinCount;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = 0;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = skinCount;
+    VK_CHECK_RESULT(vkCreateDescriptorPool(Tools::m_device, &poolInfo, nullptr, &m_descriptorPool));
+
+    std::array<VkDescriptorSetLayoutBinding, 4> bindings;
+    for(uint32_t i = 0; i < bindings.size(); ++i)
+    {
+        bindings[i] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, i);
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfo = Tools::getDescriptorSetLayoutCreateInfo(bindings.data(), static_cast<uint32_t>(bindings.size()));
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(Tools::m_device, &layoutInfo, nullptr, &m_descriptorSetLayout));
+
+    VkDeviceSize vertexBufferSize = m_pLoader->getVertexCount() * sizeof(Vertex);
+    m_descriptorSets.resize(skinCount);
+    for(uint32_t i = 0; i < skinCount; ++i)
+    {
+        Skin* skin = m_pLoader->m_skins.at(i);
+        Tools::allocateDescriptorSets(m_descriptorPool, &m_descriptorSetLayout, 1, m_descriptorSets[i]);
+
+        VkDescriptorBufferInfo bufferInfos[4] = {};
+        bufferInfos[0].buffer = m_pLoader->m_vertexBuffer;
+        bufferInfos[0].range = vertexBufferSize;
+        bufferInfos[1].buffer = m_skinnedVertexBuffer;
+        bufferInfos[1].range = vertexBufferSize;
+        bufferInfos[2].buffer = skin->m_jointMatrixBuffer;
+        bufferInfos[2].range = skin->m_totalSize;
+        bufferInfos[3].buffer = m_boundsBuffer;
+        bufferInfos[3].range = sizeof(Bounds);
+
+        std::array<VkWriteDescriptorSet, 4> writes;
+        for(uint32_t j = 0; j < writes.size(); ++j)
+        {
+            writes[j] = Tools::getWriteDescriptorSet(m_descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, j, &bufferInfos[j]);
+        }
+        vkUpdateDescriptorSets(Tools::m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+void ComputeSkinning::createComputePipeline(VkPipelineCache pipelineCache)
+{
+    VkPushConstantRange pushConstantRange = {};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(PushConstant);
+
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &m_descriptorSetLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(Tools::m_device, &layoutInfo, nullptr, &m_pipelineLayout));
+
+    VkShaderModule compModule = Tools::createShaderModule( Tools::getShaderPath() + "gltfskinning/skinning.comp.spv");
+
+    VkComputePipelineCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    createInfo.layout = m_pipelineLayout;
+    createInfo.flags = 0;
+    createInfo.stage = Tools::getPipelineShaderStageCreateInfo(compModule, VK_SHADER_STAGE_COMPUTE_BIT);
+
+    if( vkCreateComputePipelines(Tools::m_device, pipelineCache, 1, &createInfo, nullptr, &m_pipeline) != VK_SUCCESS )
+    {
+        throw std::runtime_error("failed to create compute skinning pipeline!");
+    }
+
+    vkDestroyShaderModule(Tools::m_device, compModule, nullptr);
+}
+
+void ComputeSkinning::dispatch(VkCommandBuffer commandBuffer)
+{
+    // 上一帧的顶点读取结束后才能覆盖
+    VkBufferMemoryBarrier vertexBarrier = {};
+    vertexBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    vertexBarrier.srcAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    vertexBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vertexBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    vertexBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    vertexBarrier.buffer = m_skinnedVertexBuffer;
+    vertexBarrier.offset = 0;
+    vertexBarrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &vertexBarrier, 0, nullptr);
+
+    if(m_computeBounds)
+    {
+        vkCmdFillBuffer(commandBuffer, m_boundsBuffer, offsetof(Bounds, min), sizeof(Bounds::min), 0xFFFFFFFF);
+        vkCmdFillBuffer(commandBuffer, m_boundsBuffer, offsetof(Bounds, max), sizeof(Bounds::max), 0);
+
+        VkBufferMemoryBarrier boundsBarrier = vertexBarrier;
+        boundsBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        boundsBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        boundsBarrier.buffer = m_boundsBuffer;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &boundsBarrier, 0, nullptr);
+    }
+
+    PushConstant pushConstant = {};
+    pushConstant.vertexStride = sizeof(Vertex) / sizeof(float);
+    pushConstant.positionOffset = offsetof(Vertex, m_position) / sizeof(float);
+    pushConstant.normalOffset = offsetof(Vertex, m_normal) / sizeof(float);
+    pushConstant.jointIndexOffset = offsetof(Vertex, m_jointIndex) / sizeof(float);
+    pushConstant.jointWeightOffset = offsetof(Vertex, m_jointWeight) / sizeof(float);
+    pushConstant.computeBounds = m_computeBounds ? 1 : 0;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    for(GltfNode* node : m_pLoader->m_linearNodes)
+    {
+        if(node->m_mesh == nullptr || node->m_skinIndex == static_cast<uint32_t>(-1) || node->m_skinIndex >= m_descriptorSets.size())
+        {
+            continue;
+        }
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSets.at(node->m_skinIndex), 0, nullptr);
+        for(Primitive* primitive : node->m_mesh->m_primitives)
+        {
+            pushConstant.vertexOffset = primitive->m_vertexOffset;
+            pushConstant.vertexCount = primitive->m_vertexCount;
+            vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstant), &pushConstant);
+            vkCmdDispatch(commandBuffer, (primitive->m_vertexCount + m_workGroupSize - 1) / m_workGroupSize, 1, 1);
+        }
+    }
+
+    // 蒙皮结果写完后才能作为顶点输入
+    vertexBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    vertexBarrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &vertexBarrier, 0, nullptr);
+
+    if(m_computeBounds)
+    {
+        VkBufferMemoryBarrier boundsBarrier = vertexBarrier;
+        boundsBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        boundsBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        boundsBarrier.buffer = m_boundsBuffer;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &boundsBarrier, 0, nullptr);
+    }
+}
+
+void ComputeSkinning::bindBuffers(VkCommandBuffer commandBuffer)
+{
+    const VkDeviceSize offsets[1] = {0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_skinnedVertexBuffer, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, m_pLoader->m_indexBuffer, 0, m_pLoader->m_indexType);
+}
+
+// 读取上一次dispatch算出的包围盒, 调用前需要保证该帧已经执行完成
+bool ComputeSkinning::getBounds(glm::vec3& min, glm::vec3& max)
+{
+    if(m_computeBounds == false)
+    {
+        return false;
+    }
+
+    Bounds bounds = {};
+    void* data = nullptr;
+    VK_CHECK_RESULT(vkMapMemory(Tools::m_device, m_boundsMemory, 0, sizeof(Bounds), 0, &data));
+    memcpy(&bounds, data, sizeof(Bounds));
+    vkUnmapMemory(Tools::m_device, m_boundsMemory);
+
+    if(bounds.min[0] > bounds.max[0])
+    {
+        return false;
+    }
+
+    auto decode = [](uint32_t u) -> float {
+        u = (u & 0x80000000u) ? (u & 0x7FFFFFFFu) : ~u;
+        float f;
+        memcpy(&f, &u, sizeof(float));
+        return f;
+    };
+
+    min = glm::vec3(decode(bounds.min[0]), decode(bounds.min[1]), decode(bounds.min[2]));
+    max = glm::vec3(decode(bounds.max[0]), decode(bounds.max[1]), decode(bounds.max[2]));
+    return true;
+}
@@ -0,0 +1,59 @@
+
+#pragma once
+
+#include "tools.h"
+#include "gltfLoader.h"
+
+// 用compute shader预先蒙皮, 输出的顶点buffer和原始顶点布局一致,
+// 之后的所有pass(主pass, 阴影, 深度预pass等)都当作静态几何体来绑定, 只蒙皮一次.
+class ComputeSkinning
+{
+public:
+    struct PushConstant {
+        uint32_t vertexOffset;
+        uint32_t vertexCount;
+        uint32_t vertexStride;      // sizeof(Vertex)/sizeof(float)
+        uint32_t positionOffset;
+        uint32_t normalOffset;
+        uint32_t jointIndexOffset;
+        uint32_t jointWeightOffset;
+        uint32_t computeBounds;
+    };
+
+    // 有序uint编码的包围盒, atomicMin/atomicMax可以直接作用在上面
+    struct Bounds {
+        uint32_t min[4];
+        uint32_t max[4];
+    };
+
+    ComputeSkinning();
+    ~ComputeSkinning();
+    void clear();
+
+    void prepare(GltfLoader* pLoader, VkPipelineCache pipelineCache, bool computeBounds = false);
+    void dispatch(VkCommandBuffer commandBuffer);
+    void bindBuffers(VkCommandBuffer commandBuffer);
+    bool getBounds(glm::vec3& min, glm::vec3& max);
+
+private:
+    void createBuffers();
+    void createDescriptorSets();
+    void createComputePipeline(VkPipelineCache pipelineCache);
+
+public:
+    static const uint32_t m_workGroupSize = 64;
+
+    GltfLoader* m_pLoader = nullptr;
+    bool m_computeBounds = false;
+
+    VkBuffer m_skinnedVertexBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_skinnedVertexMemory = VK_NULL_HANDLE;
+    VkBuffer m_boundsBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_boundsMemory = VK_NULL_HANDLE;
+
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> m_descriptorSets;  //每个skin一个
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+};
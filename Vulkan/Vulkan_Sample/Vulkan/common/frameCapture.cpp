@@ -0,0 +1,410 @@
+
+#include "frameCapture.h"
+#include <iomanip>
+#include <sstream>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+FrameCapture::FrameCapture()
+{}
+
+FrameCapture::~FrameCapture()
+{}
+
+void FrameCapture::prepare(uint32_t width, uint32_t height, VkFormat format, uint32_t slotCount, uint32_t threadCount)
+{
+    uint32_t pixelSize = PixelConvert::getPixelSize(format);
+    if(pixelSize == 0)
+    {
+        throw std::runtime_error("failed to prepare frame capture, unsupported format!");
+    }
+
+    m_width = width;
+    m_height = height;
+    m_format = format;
+    m_rowPitch = static_cast<VkDeviceSize>(width) * pixelSize;
+
+    m_slots.resize(std::max(slotCount, 1u));
+    for(Slot& slot : m_slots)
+    {
+        createBuffer(slot);
+
+        VkFenceCreateInfo fenceCreateInfo = {};
+        fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if(vkCreateFence(Tools::m_device, &fenceCreateInfo, nullptr, &slot.fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to create fence!");
+        }
+    }
+
+    m_threadPool.setThreadCount(threadCount);
+}
+
+void FrameCapture::clear()
+{
+    if(m_slots.empty())
+    {
+        return;
+    }
+
+    flush();
+    m_threadPool.setThreadCount(0);
+
+    for(Slot& slot : m_slots)
+    {
+        vkUnmapMemory(Tools::m_device, slot.memory);
+        vkFreeMemory(Tools::m_device, slot.memory, nullptr);
+        vkDestroyBuffer(Tools::m_device, slot.buffer, nullptr);
+        vkDestroyFence(Tools::m_device, slot.fence, nullptr);
+    }
+    m_slots.clear();
+}
+
+// CPU要逐字节读回, 优先用HOST_CACHED的内存, 没有时退回HOST_COHERENT
+void FrameCapture::createBuffer(Slot& slot)
+{
+    VkBufferCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.size = m_rowPitch * m_height;
+    createInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    if(vkCreateBuffer(Tools::m_device, &createInfo, nullptr, &slot.buffer) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to create buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(Tools::m_device, slot.buffer, &memRequirements);
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(Tools::m_physicalDevice, &memoryProperties);
+
+    const VkMemoryPropertyFlags candidates[] = {
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+    };
+    uint32_t memoryTypeIndex = UINT32_MAX;
+    for(VkMemoryPropertyFlags flags : candidates)
+    {
+        for(uint32_t i = 0; i < memoryProperties.memoryTypeCount && memoryTypeIndex == UINT32_MAX; ++i)
+        {
+            if((memRequirements.memoryTypeBits & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & flags) == flags)
+            {
+                memoryTypeIndex = i;
+                m_isCoherent = (memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+            }
+        }
+    }
+    if(memoryTypeIndex == UINT32_MAX)
+    {
+        throw std::runtime_error("failed to find suitable memory type!");
+    }
+
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = memRequirements.size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+    if(vkAllocateMemory(Tools::m_device, &allocInfo, nullptr, &slot.memory) != VK_SUCCESS)
+    {
+        throw std::runtime_error("failed to allocate memory!");
+    }
+    vkBindBufferMemory(Tools::m_device, slot.buffer, slot.memory, 0);
+    vkMapMemory(Tools::m_device, slot.memory, 0, VK_WHOLE_SIZE, 0, &slot.pMapped);
+}
+
+bool FrameCapture::record(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout, const std::string& fileName, Encoding encoding)
+{
+    Slot* pSlot = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(Slot& slot : m_slots)
+        {
+            if(slot.state == SlotState::Free)
+            {
+                pSlot = &slot;
+                break;
+            }
+        }
+
+        if(!pSlot)
+        {
+            m_droppedCount++;
+            return false;
+        }
+        pSlot->state = SlotState::Recorded;
+    }
+    pSlot->fileName = fileName;
+    pSlot->encoding = encoding;
+
+    VkImageMemoryBarrier imageBarrier = {};
+    imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.image = image;
+    imageBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    imageBarrier.oldLayout = layout;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    region.imageExtent = {m_width, m_height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, pSlot->buffer, 1, &region);
+
+    // image回到原来的布局, buffer的写入对host可见
+    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.newLayout = layout;
+    imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    imageBarrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+    VkBufferMemoryBarrier bufferBarrier = {};
+    bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.buffer = pSlot->buffer;
+    bufferBarrier.size = VK_WHOLE_SIZE;
+    bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bufferBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &bufferBarrier, 1, &imageBarrier);
+    return true;
+}
+
+void FrameCapture::submit(VkQueue queue)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(Slot& slot : m_slots)
+    {
+        if(slot.state != SlotState::Recorded)
+        {
+            continue;
+        }
+
+        vkResetFences(Tools::m_device, 1, &slot.fence);
+        if(vkQueueSubmit(queue, 0, nullptr, slot.fence) != VK_SUCCESS)
+        {
+            throw std::runtime_error("failed to queue submit!");
+        }
+        slot.state = SlotState::Submitted;
+    }
+}
+
+void FrameCapture::update()
+{
+    std::vector<Slot*> finished;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(Slot& slot : m_slots)
+        {
+            if(slot.state == SlotState::Submitted && vkGetFenceStatus(Tools::m_device, slot.fence) == VK_SUCCESS)
+            {
+                slot.state = SlotState::Encoding;
+                finished.push_back(&slot);
+            }
+        }
+    }
+
+    for(Slot* pSlot : finished)
+    {
+        if(!m_isCoherent)
+        {
+            VkMappedMemoryRange range = {};
+            range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range.memory = pSlot->memory;
+            range.size = VK_WHOLE_SIZE;
+            vkInvalidateMappedMemoryRanges(Tools::m_device, 1, &range);
+        }
+
+        if(m_threadPool.m_threads.empty())
+        {
+            encode(*pSlot);
+        }
+        else
+        {
+            m_threadPool.m_threads[m_nextThread]->addJob([this, pSlot] { encode(*pSlot); });
+            m_nextThread = (m_nextThread + 1) % static_cast<uint32_t>(m_threadPool.m_threads.size());
+        }
+    }
+}
+
+void FrameCapture::flush()
+{
+    for(Slot& slot : m_slots)
+    {
+        bool submitted = false;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            submitted = slot.state == SlotState::Submitted;
+        }
+        if(submitted)
+        {
+            vkWaitForFences(Tools::m_device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+        }
+    }
+    update();
+    m_threadPool.wait();
+}
+
+// 先转换到RGBA8就释放槽位, 编码和写盘不占用readback buffer
+void FrameCapture::encode(Slot& slot)
+{
+    std::vector<uint8_t> rgba(static_cast<size_t>(m_width) * m_height * 4);
+    PixelConvert::toRgba8(m_format, slot.pMapped, m_rowPitch, m_width, m_height, rgba.data(), m_width * 4);
+    std::string fileName = slot.fileName;
+    Encoding encoding = slot.encoding;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        slot.state = SlotState::Free;
+    }
+
+    bool written = encoding == Encoding::Png ? writePng(fileName, rgba.data(), m_width, m_height) : writeQoi(fileName, rgba.data(), m_width, m_height);
+    if(!written)
+    {
+        std::cout << "failed to write " << fileName << std::endl;
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_capturedCount++;
+}
+
+void FrameCapture::beginSequence(const std::string& prefix, Encoding encoding)
+{
+    m_isRecordingSequence = true;
+    m_sequencePrefix = prefix;
+    m_sequenceEncoding = encoding;
+    m_sequenceFrame = 0;
+}
+
+void FrameCapture::endSequence()
+{
+    m_isRecordingSequence = false;
+}
+
+bool FrameCapture::recordSequenceFrame(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout)
+{
+    if(!m_isRecordingSequence)
+    {
+        return false;
+    }
+
+    std::ostringstream fileName;
+    fileName << m_sequencePrefix << "_" << std::setw(6) << std::setfill('0') << m_sequenceFrame << (m_sequenceEncoding == Encoding::Png ? ".png" : ".qoi");
+    if(!record(commandBuffer, image, layout, fileName.str(), m_sequenceEncoding))
+    {
+        return false;
+    }
+    m_sequenceFrame++;
+    return true;
+}
+
+bool FrameCapture::writePng(const std::string& fileName, const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+    return stbi_write_png(fileName.c_str(), static_cast<int>(width), static_cast<int>(height), 4, rgba, static_cast<int>(width * 4)) != 0;
+}
+
+bool FrameCapture::writeQoi(const std::string& fileName, const uint8_t* rgba, uint32_t width, uint32_t height)
+{
+    std::vector<uint8_t> data;
+    encodeQoi(rgba, width, height, data);
+
+    FILE* fp = fopen(fileName.c_str(), "wb");
+    if(!fp)
+    {
+        return false;
+    }
+    bool written = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    fclose(fp);
+    return written;
+}
+
+// https://qoiformat.org/qoi-specification.pdf
+void FrameCapture::encodeQoi(const uint8_t* rgba, uint32_t width, uint32_t height, std::vector<uint8_t>& data)
+{
+    const uint8_t opIndex = 0x00;
+    const uint8_t opDiff = 0x40;
+    const uint8_t opLuma = 0x80;
+    const uint8_t opRun = 0xC0;
+    const uint8_t opRgb = 0xFE;
+    const uint8_t opRgba = 0xFF;
+
+    size_t pixelCount = static_cast<size_t>(width) * height;
+    data.clear();
+    data.reserve(14 + pixelCount * 5 + 8);
+
+    auto write32 = [&data](uint32_t value) {
+        data.push_back(static_cast<uint8_t>(value >> 24));
+        data.push_back(static_cast<uint8_t>(value >> 16));
+        data.push_back(static_cast<uint8_t>(value >> 8));
+        data.push_back(static_cast<uint8_t>(value));
+    };
+    data.insert(data.end(), {'q', 'o', 'i', 'f'});
+    write32(width);
+    write32(height);
+    data.push_back(4);      //RGBA
+    data.push_back(0);      //sRGB, alpha线性
+
+    uint8_t index[64][4] = {};
+    uint8_t previous[4] = {0, 0, 0, 255};
+    uint32_t run = 0;
+    for(size_t i = 0; i < pixelCount; ++i)
+    {
+        const uint8_t* pixel = rgba + i * 4;
+        if(memcmp(pixel, previous, 4) == 0)
+        {
+            run++;
+            if(run == 62 || i + 1 == pixelCount)
+            {
+                data.push_back(static_cast<uint8_t>(opRun | (run - 1)));
+                run = 0;
+            }
+            continue;
+        }
+
+        if(run > 0)
+        {
+            data.push_back(static_cast<uint8_t>(opRun | (run - 1)));
+            run = 0;
+        }
+
+        uint32_t hash = (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64;
+        if(memcmp(index[hash], pixel, 4) == 0)
+        {
+            data.push_back(static_cast<uint8_t>(opIndex | hash));
+        }
+        else
+        {
+            memcpy(index[hash], pixel, 4);
+            if(pixel[3] == previous[3])
+            {
+                int8_t dr = static_cast<int8_t>(pixel[0] - previous[0]);
+                int8_t dg = static_cast<int8_t>(pixel[1] - previous[1]);
+                int8_t db = static_cast<int8_t>(pixel[2] - previous[2]);
+                int8_t drg = static_cast<int8_t>(dr - dg);
+                int8_t dbg = static_cast<int8_t>(db - dg);
+                if(dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+                {
+                    data.push_back(static_cast<uint8_t>(opDiff | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2)));
+                }
+                else if(drg >= -8 && drg <= 7 && dg >= -32 && dg <= 31 && dbg >= -8 && dbg <= 7)
+                {
+                    data.push_back(static_cast<uint8_t>(opLuma | (dg + 32)));
+                    data.push_back(static_cast<uint8_t>(((drg + 8) << 4) | (dbg + 8)));
+                }
+                else
+                {
+                    data.insert(data.end(), {opRgb, pixel[0], pixel[1], pixel[2]});
+                }
+            }
+            else
+            {
+                data.insert(data.end(), {opRgba, pixel[0], pixel[1], pixel[2], pixel[3]});
+            }
+        }
+        memcpy(previous, pixel, 4);
+    }
+
+    data.insert(data.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+}
@@ -0,0 +1,85 @@
+
+#pragma once
+
+#include "tools.h"
+#include "thread.h"
+#include "pixelConvert.h"
+
+// 异步截帧: 拷贝命令录制在调用者的命令缓冲里(vkCmdCopyImageToBuffer到常驻映射的readback buffer),
+// 提交后每个槽位用fence轮询, 完成的帧在工作线程上转换格式并编码成PNG(deflate)或QOI写盘. 渲染线程从不等待GPU,
+// 槽位都被占用时丢掉这一帧. 用法: record -> 提交命令缓冲 -> submit -> 每帧update, 退出前flush
+class FrameCapture
+{
+public:
+    enum class Encoding {
+        Png = 0,        //stb_image_write, 体积小, 编码慢
+        Qoi = 1,        //无损, 编码快很多, 适合连续截帧
+    };
+
+    FrameCapture();
+    ~FrameCapture();
+    // format为被拷贝image的格式, 必须是PixelConvert::toRgba8支持的格式. threadCount为0时在update里同步编码
+    void prepare(uint32_t width, uint32_t height, VkFormat format, uint32_t slotCount = 3, uint32_t threadCount = 2);
+    void clear();
+
+    // image在layout里, 拷贝完回到layout. 没有空闲槽位时返回false
+    bool record(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout, const std::string& fileName, Encoding encoding = Encoding::Png);
+    // 在提交了包含record的命令缓冲之后调用, 同一个队列上提交一个只带fence的空批次, 之前的命令都完成后fence发出
+    void submit(VkQueue queue);
+    // 不阻塞, 拷贝完成的槽位交给工作线程
+    void update();
+    // 阻塞到所有拷贝和编码完成
+    void flush();
+
+    // 连续截帧, 文件名为prefix_000000.png这样的序号
+    void beginSequence(const std::string& prefix, Encoding encoding = Encoding::Qoi);
+    void endSequence();
+    bool isRecordingSequence() const { return m_isRecordingSequence; }
+    bool recordSequenceFrame(VkCommandBuffer commandBuffer, VkImage image, VkImageLayout layout);
+
+    // 同步编码RGBA8
+    static bool writePng(const std::string& fileName, const uint8_t* rgba, uint32_t width, uint32_t height);
+    static bool writeQoi(const std::string& fileName, const uint8_t* rgba, uint32_t width, uint32_t height);
+    static void encodeQoi(const uint8_t* rgba, uint32_t width, uint32_t height, std::vector<uint8_t>& data);
+
+private:
+    enum class SlotState {
+        Free = 0,
+        Recorded = 1,       //录制了拷贝, 还没有submit
+        Submitted = 2,      //等fence
+        Encoding = 3,       //交给了工作线程
+    };
+
+    struct Slot {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        void* pMapped = nullptr;
+        VkFence fence = VK_NULL_HANDLE;
+        SlotState state = SlotState::Free;
+        std::string fileName;
+        Encoding encoding = Encoding::Png;
+    };
+
+    void createBuffer(Slot& slot);
+    void encode(Slot& slot);
+
+public:
+    uint32_t m_capturedCount = 0;       //已经写盘的帧数
+    uint32_t m_droppedCount = 0;        //没有空闲槽位丢掉的帧数
+    uint32_t m_sequenceFrame = 0;
+
+private:
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    VkFormat m_format = VK_FORMAT_UNDEFINED;
+    VkDeviceSize m_rowPitch = 0;
+    bool m_isCoherent = true;
+    std::vector<Slot> m_slots;
+    std::mutex m_mutex;                 //保护槽位状态和计数, 工作线程会修改
+    ThreadPool m_threadPool;
+    uint32_t m_nextThread = 0;
+
+    bool m_isRecordingSequence = false;
+    std::string m_sequencePrefix;
+    Encoding m_sequenceEncoding = Encoding::Qoi;
+};
@@ -1,5 +1,15 @@
 
 #include "frustum.h"
+#include <chrono>
+#include <random>
+
+#if defined(__SSE2__) || defined(__x86_64__)
+#define FRUSTUM_USE_SSE 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define FRUSTUM_USE_NEON 1
+#include <arm_neon.h>
+#endif
 
 void Frustum::update(glm::mat4 matrix)
 {
@@ -54,3 +64,300 @@ bool Frustum::checkSphere(glm::vec3 pos, float radius)
     return true;
 }
 
+
+namespace
+{
+    struct PlaneData {
+        float nx[6], ny[6], nz[6], d[6];
+        float ax[6], ay[6], az[6];      //法线的绝对值, 求包围盒在法线上的投影半径
+    };
+
+    // 平面一致性: 相邻的物体通常被同一个平面剔除, 从上次剔除整批的平面开始测试
+    template<bool isSphere>
+    uint32_t testScalar(const PlaneData& planes, const float* const* soa, uint32_t i, uint32_t& lastPlane)
+    {
+        for(uint32_t k = 0; k < 6; ++k)
+        {
+            uint32_t p = (lastPlane + k) % 6;
+            float dist = planes.nx[p] * soa[0][i] + planes.ny[p] * soa[1][i] + planes.nz[p] * soa[2][i] + planes.d[p];
+            float r = isSphere ? soa[3][i] : planes.ax[p] * soa[3][i] + planes.ay[p] * soa[4][i] + planes.az[p] * soa[5][i];
+            if(dist + r <= 0.0f)
+            {
+                lastPlane = p;
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+#if FRUSTUM_USE_SSE
+    template<bool isSphere>
+    uint32_t testSse(const PlaneData& planes, const float* const* soa, uint32_t i, uint32_t& lastPlane)
+    {
+        __m128 x = _mm_loadu_ps(soa[0] + i);
+        __m128 y = _mm_loadu_ps(soa[1] + i);
+        __m128 z = _mm_loadu_ps(soa[2] + i);
+        __m128 ex = _mm_loadu_ps(soa[3] + i);
+        __m128 ey = isSphere ? ex : _mm_loadu_ps(soa[4] + i);
+        __m128 ez = isSphere ? ex : _mm_loadu_ps(soa[5] + i);
+
+        int bits = 0xF;
+        for(uint32_t k = 0; k < 6; ++k)
+        {
+            uint32_t p = (lastPlane + k) % 6;
+            __m128 dist = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.nx[p]), x), _mm_mul_ps(_mm_set1_ps(planes.ny[p]), y));
+            dist = _mm_add_ps(_mm_add_ps(dist, _mm_mul_ps(_mm_set1_ps(planes.nz[p]), z)), _mm_set1_ps(planes.d[p]));
+            __m128 r = ex;
+            if(!isSphere)
+            {
+                r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(planes.ax[p]), ex), _mm_mul_ps(_mm_set1_ps(planes.ay[p]), ey)), _mm_mul_ps(_mm_set1_ps(planes.az[p]), ez));
+            }
+            bits &= _mm_movemask_ps(_mm_cmpgt_ps(_mm_add_ps(dist, r), _mm_setzero_ps()));
+            if(bits == 0)
+            {
+                lastPlane = p;
+                break;
+            }
+        }
+        return static_cast<uint32_t>(bits);
+    }
+
+    // AVX2在运行时检测, 不要求整个工程用-mavx2编译
+    template<bool isSphere>
+    __attribute__((target("avx2,fma")))
+    uint32_t testAvx2(const PlaneData& planes, const float* const* soa, uint32_t i, uint32_t& lastPlane)
+    {
+        __m256 x = _mm256_loadu_ps(soa[0] + i);
+        __m256 y = _mm256_loadu_ps(soa[1] + i);
+        __m256 z = _mm256_loadu_ps(soa[2] + i);
+        __m256 ex = _mm256_loadu_ps(soa[3] + i);
+        __m256 ey = isSphere ? ex : _mm256_loadu_ps(soa[4] + i);
+        __m256 ez = isSphere ? ex : _mm256_loadu_ps(soa[5] + i);
+
+        int bits = 0xFF;
+        for(uint32_t k = 0; k < 6; ++k)
+        {
+            uint32_t p = (lastPlane + k) % 6;
+            __m256 dist = _mm256_fmadd_ps(_mm256_set1_ps(planes.nx[p]), x, _mm256_set1_ps(planes.d[p]));
+            dist = _mm256_fmadd_ps(_mm256_set1_ps(planes.ny[p]), y, dist);
+            dist = _mm256_fmadd_ps(_mm256_set1_ps(planes.nz[p]), z, dist);
+            if(isSphere)
+            {
+                dist = _mm256_add_ps(dist, ex);
+            }
+            else
+            {
+                dist = _mm256_fmadd_ps(_mm256_set1_ps(planes.ax[p]), ex, dist);
+                dist = _mm256_fmadd_ps(_mm256_set1_ps(planes.ay[p]), ey, dist);
+                dist = _mm256_fmadd_ps(_mm256_set1_ps(planes.az[p]), ez, dist);
+            }
+            bits &= _mm256_movemask_ps(_mm256_cmp_ps(dist, _mm256_setzero_ps(), _CMP_GT_OQ));
+            if(bits == 0)
+            {
+                lastPlane = p;
+                break;
+            }
+        }
+        return static_cast<uint32_t>(bits);
+    }
+
+    bool hasAvx2()
+    {
+        static const bool supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        return supported;
+    }
+#elif FRUSTUM_USE_NEON
+    template<bool isSphere>
+    uint32_t testNeon(const PlaneData& planes, const float* const* soa, uint32_t i, uint32_t& lastPlane)
+    {
+        float32x4_t x = vld1q_f32(soa[0] + i);
+        float32x4_t y = vld1q_f32(soa[1] + i);
+        float32x4_t z = vld1q_f32(soa[2] + i);
+        float32x4_t ex = vld1q_f32(soa[3] + i);
+        float32x4_t ey = isSphere ? ex : vld1q_f32(soa[4] + i);
+        float32x4_t ez = isSphere ? ex : vld1q_f32(soa[5] + i);
+        const uint32_t laneBits[4] = {1, 2, 4, 8};
+        uint32x4_t laneMask = vld1q_u32(laneBits);
+
+        uint32_t bits = 0xF;
+        for(uint32_t k = 0; k < 6; ++k)
+        {
+            uint32_t p = (lastPlane + k) % 6;
+            float32x4_t dist = vfmaq_n_f32(vdupq_n_f32(planes.d[p]), x, planes.nx[p]);
+            dist = vfmaq_n_f32(dist, y, planes.ny[p]);
+            dist = vfmaq_n_f32(dist, z, planes.nz[p]);
+            if(isSphere)
+            {
+                dist = vaddq_f32(dist, ex);
+            }
+            else
+            {
+                dist = vfmaq_n_f32(dist, ex, planes.ax[p]);
+                dist = vfmaq_n_f32(dist, ey, planes.ay[p]);
+                dist = vfmaq_n_f32(dist, ez, planes.az[p]);
+            }
+            bits &= vaddvq_u32(vandq_u32(vcgtq_f32(dist, vdupq_n_f32(0.0f)), laneMask));
+            if(bits == 0)
+            {
+                lastPlane = p;
+                break;
+            }
+        }
+        return bits;
+    }
+#endif
+}
+
+template<bool isSphere>
+void Frustum::cullRange(const float* const* soa, uint32_t begin, uint32_t end, uint64_t* visibleMask) const
+{
+    PlaneData planes;
+    for(uint32_t p = 0; p < 6; ++p)
+    {
+        planes.nx[p] = m_planes[p].x;
+        planes.ny[p] = m_planes[p].y;
+        planes.nz[p] = m_planes[p].z;
+        planes.d[p] = m_planes[p].w;
+        planes.ax[p] = fabsf(m_planes[p].x);
+        planes.ay[p] = fabsf(m_planes[p].y);
+        planes.az[p] = fabsf(m_planes[p].z);
+    }
+
+    // begin是64的倍数, 每批4或8个物体不会跨字
+    std::fill(visibleMask + begin / 64, visibleMask + (end + 63) / 64, 0);
+    uint32_t lastPlane = 0;
+    uint32_t i = begin;
+
+#if FRUSTUM_USE_SSE
+    if(hasAvx2())
+    {
+        for(; i + 8 <= end; i += 8)
+        {
+            visibleMask[i >> 6] |= static_cast<uint64_t>(testAvx2<isSphere>(planes, soa, i, lastPlane)) << (i & 63);
+        }
+    }
+    for(; i + 4 <= end; i += 4)
+    {
+        visibleMask[i >> 6] |= static_cast<uint64_t>(testSse<isSphere>(planes, soa, i, lastPlane)) << (i & 63);
+    }
+#elif FRUSTUM_USE_NEON
+    for(; i + 4 <= end; i += 4)
+    {
+        visibleMask[i >> 6] |= static_cast<uint64_t>(testNeon<isSphere>(planes, soa, i, lastPlane)) << (i & 63);
+    }
+#endif
+
+    for(; i < end; ++i)
+    {
+        visibleMask[i >> 6] |= static_cast<uint64_t>(testScalar<isSphere>(planes, soa, i, lastPlane)) << (i & 63);
+    }
+}
+
+void Frustum::cullSpheres(const SphereSoA& spheres, uint32_t count, uint64_t* visibleMask, ThreadPool* pThreadPool) const
+{
+    const float* soa[4] = {spheres.x, spheres.y, spheres.z, spheres.radius};
+    if(pThreadPool && count > m_parallelGrainSize)
+    {
+        pThreadPool->parallelFor(count, m_parallelGrainSize, [&](uint32_t begin, uint32_t end) {
+            cullRange<true>(soa, begin, end, visibleMask);
+        });
+        return ;
+    }
+    cullRange<true>(soa, 0, count, visibleMask);
+}
+
+void Frustum::cullAabbs(const AabbSoA& boxes, uint32_t count, uint64_t* visibleMask, ThreadPool* pThreadPool) const
+{
+    const float* soa[6] = {boxes.x, boxes.y, boxes.z, boxes.extentX, boxes.extentY, boxes.extentZ};
+    if(pThreadPool && count > m_parallelGrainSize)
+    {
+        pThreadPool->parallelFor(count, m_parallelGrainSize, [&](uint32_t begin, uint32_t end) {
+            cullRange<false>(soa, begin, end, visibleMask);
+        });
+        return ;
+    }
+    cullRange<false>(soa, 0, count, visibleMask);
+}
+
+uint32_t Frustum::compactVisible(const uint64_t* visibleMask, uint32_t count, uint32_t* indices)
+{
+    uint32_t visibleCount = 0;
+    uint32_t wordCount = (count + 63) / 64;
+    for(uint32_t w = 0; w < wordCount; ++w)
+    {
+        uint64_t word = visibleMask[w];
+        while(word != 0)
+        {
+            indices[visibleCount++] = w * 64 + static_cast<uint32_t>(__builtin_ctzll(word));
+            word &= word - 1;
+        }
+    }
+    return visibleCount;
+}
+
+void Frustum::benchmark(const std::vector<uint32_t>& objectCounts, ThreadPool* pThreadPool)
+{
+    std::default_random_engine engine(1);
+    std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+    std::uniform_real_distribution<float> size(0.5f, 5.0f);
+
+    Frustum frustum;
+    glm::mat4 proj = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 800.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, -900.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    frustum.update(proj * view);
+
+    auto measure = [](const std::function<void()>& function) {
+        const uint32_t repeat = 20;
+        auto tStart = std::chrono::high_resolution_clock::now();
+        for(uint32_t r = 0; r < repeat; ++r)
+        {
+            function();
+        }
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(tEnd - tStart).count() / repeat;
+    };
+
+    for(uint32_t objectCount : objectCounts)
+    {
+        std::vector<float> x(objectCount), y(objectCount), z(objectCount), radius(objectCount);
+        std::vector<float> extentX(objectCount), extentY(objectCount), extentZ(objectCount);
+        for(uint32_t i = 0; i < objectCount; ++i)
+        {
+            x[i] = position(engine);
+            y[i] = position(engine);
+            z[i] = position(engine);
+            extentX[i] = size(engine);
+            extentY[i] = size(engine);
+            extentZ[i] = size(engine);
+            radius[i] = sqrtf(extentX[i] * extentX[i] + extentY[i] * extentY[i] + extentZ[i] * extentZ[i]);
+        }
+        SphereSoA spheres = {x.data(), y.data(), z.data(), radius.data()};
+        AabbSoA boxes = {x.data(), y.data(), z.data(), extentX.data(), extentY.data(), extentZ.data()};
+
+        std::vector<uint8_t> scalarVisible(objectCount);
+        std::vector<uint64_t> mask((objectCount + 63) / 64);
+        std::vector<uint32_t> indices(objectCount);
+        uint32_t visibleCount = 0;
+
+        double scalarTime = measure([&] {
+            for(uint32_t i = 0; i < objectCount; ++i)
+            {
+                scalarVisible[i] = frustum.checkSphere(glm::vec3(x[i], y[i], z[i]), radius[i]) ? 1 : 0;
+            }
+        });
+        double sphereTime = measure([&] { frustum.cullSpheres(spheres, objectCount, mask.data()); });
+
+        uint32_t mismatch = 0;
+        for(uint32_t i = 0; i < objectCount; ++i)
+        {
+            mismatch += scalarVisible[i] != ((mask[i >> 6] >> (i & 63)) & 1) ? 1 : 0;
+        }
+
+        double parallelTime = measure([&] { frustum.cullSpheres(spheres, objectCount, mask.data(), pThreadPool); });
+        double compactTime = measure([&] { visibleCount = compactVisible(mask.data(), objectCount, indices.data()); });
+        double aabbTime = measure([&] { frustum.cullAabbs(boxes, objectCount, mask.data()); });
+
+        std::cout << objectCount << " spheres, checkSphere " << scalarTime << " ms, batch " << sphereTime << " ms, parallel " << parallelTime
+                  << " ms, compact " << compactTime << " ms (" << visibleCount << " visible, " << mismatch << " mismatches), batch aabb " << aabbTime << " ms" << std::endl;
+    }
+}
@@ -2,14 +2,47 @@
 #pragma once
 
 #include "tools.h"
+#include "thread.h"
 
 class Frustum
 {
 public:
+    // 结构数组形式的包围体, 所有数组长度相同
+    struct SphereSoA {
+        const float* x;
+        const float* y;
+        const float* z;
+        const float* radius;
+    };
+
+    struct AabbSoA {
+        const float* x;             // 中心
+        const float* y;
+        const float* z;
+        const float* extentX;       // 半边长
+        const float* extentY;
+        const float* extentZ;
+    };
+
     void update(glm::mat4 matrix);
     bool checkSphere(glm::vec3 pos, float radius);
-    
+
+    // 批量剔除, 每个物体一位, visibleMask至少(count + 63) / 64个字. 和checkSphere一样, 与平面相切算不可见.
+    // 一次测试8个(AVX2)或4个(SSE/NEON)物体, 其它平台逐个测试. 传入线程池且物体较多时按m_parallelGrainSize分块并行
+    void cullSpheres(const SphereSoA& spheres, uint32_t count, uint64_t* visibleMask, ThreadPool* pThreadPool = nullptr) const;
+    void cullAabbs(const AabbSoA& boxes, uint32_t count, uint64_t* visibleMask, ThreadPool* pThreadPool = nullptr) const;
+    // 可见物体的序号按顺序写入indices, 返回个数
+    static uint32_t compactVisible(const uint64_t* visibleMask, uint32_t count, uint32_t* indices);
+    // 随机包围球上对比checkSphere和批量剔除, 输出到std::cout
+    static void benchmark(const std::vector<uint32_t>& objectCounts, ThreadPool* pThreadPool);
+
+private:
+    template<bool isSphere>
+    void cullRange(const float* const* soa, uint32_t begin, uint32_t end, uint64_t* visibleMask) const;
+
 public:
     enum Plane_Side { LEFT = 0, RIGHT = 1, TOP = 2, BOTTOM = 3, BACK = 4, FRONT = 5 };
     std::array<glm::vec4, 6> m_planes;
+
+    static const uint32_t m_parallelGrainSize = 16384;     //64的倍数, 每块写整数个字
 };
@@ -0,0 +1,235 @@
+
+#include "gltfAccessor.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+const uint8_t* GltfAccessor::getBufferData(const tinygltf::Model& model, int bufferView, size_t byteOffset)
+{
+    const tinygltf::BufferView& view = model.bufferViews[bufferView];
+    return model.buffers[view.buffer].data.data() + view.byteOffset + byteOffset;
+}
+
+bool GltfAccessor::isIndexTypeSupported(int componentType)
+{
+    return componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT || componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT ||
+           componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+}
+
+uint32_t GltfAccessor::readIndex(const uint8_t* src, int componentType)
+{
+    switch (componentType)
+    {
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+        {
+            uint32_t value;
+            memcpy(&value, src, sizeof(uint32_t));
+            return value;
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+        {
+            uint16_t value;
+            memcpy(&value, src, sizeof(uint16_t));
+            return value;
+        }
+        default:
+            return *src;
+    }
+}
+
+// normalized的整数按规范映射到[0,1]或[-1,1]
+void GltfAccessor::convertElement(const uint8_t* src, int componentType, bool normalized, uint32_t components, float* dst)
+{
+    switch (componentType)
+    {
+        case TINYGLTF_COMPONENT_TYPE_FLOAT:
+        {
+            memcpy(dst, src, components * sizeof(float));
+            return;
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        {
+            float scale = normalized ? 1.0f / 255.0f : 1.0f;
+#if defined(__SSE2__)
+            if (components == 4)
+            {
+                uint32_t packed;
+                memcpy(&packed, src, sizeof(uint32_t));
+                __m128i zero = _mm_setzero_si128();
+                __m128i value = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(packed)), zero), zero);
+                _mm_storeu_ps(dst, _mm_mul_ps(_mm_cvtepi32_ps(value), _mm_set1_ps(scale)));
+                return;
+            }
+#elif defined(__ARM_NEON)
+            if (components == 4)
+            {
+                uint32_t packed;
+                memcpy(&packed, src, sizeof(uint32_t));
+                uint32x4_t value = vmovl_u16(vget_low_u16(vmovl_u8(vcreate_u8(packed))));
+                vst1q_f32(dst, vmulq_n_f32(vcvtq_f32_u32(value), scale));
+                return;
+            }
+#endif
+            for (uint32_t i = 0; i < components; ++i)
+            {
+                dst[i] = src[i] * scale;
+            }
+            return;
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+        {
+            float scale = normalized ? 1.0f / 65535.0f : 1.0f;
+#if defined(__SSE2__)
+            if (components == 4)
+            {
+                __m128i value = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src)), _mm_setzero_si128());
+                _mm_storeu_ps(dst, _mm_mul_ps(_mm_cvtepi32_ps(value), _mm_set1_ps(scale)));
+                return;
+            }
+#elif defined(__ARM_NEON)
+            if (components == 4)
+            {
+                uint16_t packed[4];
+                memcpy(packed, src, sizeof(packed));
+                vst1q_f32(dst, vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vld1_u16(packed))), scale));
+                return;
+            }
+#endif
+            uint16_t value[4];
+            memcpy(value, src, components * sizeof(uint16_t));
+            for (uint32_t i = 0; i < components; ++i)
+            {
+                dst[i] = value[i] * scale;
+            }
+            return;
+        }
+        case TINYGLTF_COMPONENT_TYPE_BYTE:
+        {
+            const int8_t* value = reinterpret_cast<const int8_t*>(src);
+            for (uint32_t i = 0; i < components; ++i)
+            {
+                dst[i] = normalized ? std::max(value[i] / 127.0f, -1.0f) : value[i];
+            }
+            return;
+        }
+        case TINYGLTF_COMPONENT_TYPE_SHORT:
+        {
+            int16_t value[4];
+            memcpy(value, src, components * sizeof(int16_t));
+            for (uint32_t i = 0; i < components; ++i)
+            {
+                dst[i] = normalized ? std::max(value[i] / 32767.0f, -1.0f) : value[i];
+            }
+            return;
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+        {
+            uint32_t value[4];
+            memcpy(value, src, components * sizeof(uint32_t));
+            for (uint32_t i = 0; i < components; ++i)
+            {
+                dst[i] = static_cast<float>(value[i]);
+            }
+            return;
+        }
+        default:
+            return;
+    }
+}
+
+void GltfAccessor::readFloats(const tinygltf::Model& model, const tinygltf::Accessor& accessor, float* dst, size_t dstStride, uint32_t dstComponents)
+{
+    uint32_t components = std::min(static_cast<uint32_t>(tinygltf::GetNumComponentsInType(accessor.type)), dstComponents);
+    uint8_t* dstBytes = reinterpret_cast<uint8_t*>(dst);
+
+    //没有bufferView时(只有sparse)初始值为0
+    if (accessor.bufferView > -1)
+    {
+        const uint8_t* src = getBufferData(model, accessor.bufferView, accessor.byteOffset);
+        size_t srcStride = accessor.ByteStride(model.bufferViews[accessor.bufferView]);
+        for (size_t i = 0; i < accessor.count; ++i)
+        {
+            convertElement(src + i * srcStride, accessor.componentType, accessor.normalized, components, reinterpret_cast<float*>(dstBytes + i * dstStride));
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < accessor.count; ++i)
+        {
+            memset(dstBytes + i * dstStride, 0, components * sizeof(float));
+        }
+    }
+
+    if (accessor.sparse.isSparse)
+    {
+        const uint8_t* indices = getBufferData(model, accessor.sparse.indices.bufferView, accessor.sparse.indices.byteOffset);
+        const uint8_t* values = getBufferData(model, accessor.sparse.values.bufferView, accessor.sparse.values.byteOffset);
+        size_t indexSize = tinygltf::GetComponentSizeInBytes(accessor.sparse.indices.componentType);
+        size_t valueSize = tinygltf::GetComponentSizeInBytes(accessor.componentType) * tinygltf::GetNumComponentsInType(accessor.type);
+        for (int i = 0; i < accessor.sparse.count; ++i)
+        {
+            uint32_t index = readIndex(indices + i * indexSize, accessor.sparse.indices.componentType);
+            if (index < accessor.count)
+            {
+                convertElement(values + i * valueSize, accessor.componentType, accessor.normalized, components, reinterpret_cast<float*>(dstBytes + index * dstStride));
+            }
+        }
+    }
+}
+
+void GltfAccessor::readIndices(const tinygltf::Model& model, const tinygltf::Accessor& accessor, uint32_t* dst, uint32_t vertexOffset)
+{
+    if (accessor.bufferView > -1)
+    {
+        const uint8_t* src = getBufferData(model, accessor.bufferView, accessor.byteOffset);
+        size_t srcStride = accessor.ByteStride(model.bufferViews[accessor.bufferView]);
+        switch (accessor.componentType)
+        {
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+                for (size_t i = 0; i < accessor.count; ++i)
+                {
+                    uint32_t value;
+                    memcpy(&value, src + i * srcStride, sizeof(uint32_t));
+                    dst[i] = value + vertexOffset;
+                }
+                break;
+            case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+                for (size_t i = 0; i < accessor.count; ++i)
+                {
+                    uint16_t value;
+                    memcpy(&value, src + i * srcStride, sizeof(uint16_t));
+                    dst[i] = value + vertexOffset;
+                }
+                break;
+            default:
+                for (size_t i = 0; i < accessor.count; ++i)
+                {
+                    dst[i] = src[i * srcStride] + vertexOffset;
+                }
+                break;
+        }
+    }
+    else
+    {
+        std::fill(dst, dst + accessor.count, vertexOffset);
+    }
+
+    if (accessor.sparse.isSparse)
+    {
+        const uint8_t* indices = getBufferData(model, accessor.sparse.indices.bufferView, accessor.sparse.indices.byteOffset);
+        const uint8_t* values = getBufferData(model, accessor.sparse.values.bufferView, accessor.sparse.values.byteOffset);
+        size_t indexSize = tinygltf::GetComponentSizeInBytes(accessor.sparse.indices.componentType);
+        size_t valueSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+        for (int i = 0; i < accessor.sparse.count; ++i)
+        {
+            uint32_t index = readIndex(indices + i * indexSize, accessor.sparse.indices.componentType);
+            if (index < accessor.count)
+            {
+                dst[index] = readIndex(values + i * valueSize, accessor.componentType) + vertexOffset;
+            }
+        }
+    }
+}
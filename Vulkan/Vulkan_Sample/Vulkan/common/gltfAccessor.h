@@ -0,0 +1,22 @@
+
+#pragma once
+
+#include "tools.h"
+#include "tiny_gltf.h"
+
+// 按glTF规范读取accessor: 支持byteStride, 所有分量类型(含normalized), 以及sparse accessor.
+// 直接写到调用者预先分配好的数组里, 只读访问model, 可以在多个线程里同时调用
+class GltfAccessor
+{
+public:
+    // 每个元素转成float写dstComponents个分量(accessor分量更少时其余保持不变), 相邻元素间隔dstStride字节
+    static void readFloats(const tinygltf::Model& model, const tinygltf::Accessor& accessor, float* dst, size_t dstStride, uint32_t dstComponents);
+    // 写入的索引都加上vertexOffset
+    static void readIndices(const tinygltf::Model& model, const tinygltf::Accessor& accessor, uint32_t* dst, uint32_t vertexOffset);
+    static bool isIndexTypeSupported(int componentType);
+
+private:
+    static const uint8_t* getBufferData(const tinygltf::Model& model, int bufferView, size_t byteOffset);
+    static void convertElement(const uint8_t* src, int componentType, bool normalized, uint32_t components, float* dst);
+    static uint32_t readIndex(const uint8_t* src, int componentType);
+};
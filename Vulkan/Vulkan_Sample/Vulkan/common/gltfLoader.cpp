@@ -1,5 +1,17 @@
 
 #include "gltfLoader.h"
+#include "sceneCooker.h"
+#include "gltfAccessor.h"
+#include "textureCompressor.h"
+#include "resourceCache.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 VkDescriptorSetLayout GltfLoader::m_uniformDescriptorSetLayout = VK_NULL_HANDLE;
 VkDescriptorSetLayout GltfLoader::m_imageDescriptorSetLayout = VK_NULL_HANDLE;
@@ -27,6 +39,12 @@ void GltfLoader::clear()
     vkFreeMemory(Tools::m_device, m_indexMemory, nullptr);
     vkDestroyBuffer(Tools::m_device, m_indexBuffer, nullptr);
     
+    m_pCookedVertices = nullptr;
+    m_pCookedIndices = nullptr;
+    m_cookedVertexCount = 0;
+    m_cookedIndexCount = 0;
+    m_cookedFile.close();
+    
     if(m_descriptorPool)
     {
         vkDestroyDescriptorPool(Tools::m_device, m_descriptorPool, nullptr);
@@ -55,11 +73,7 @@ void GltfLoader::clear()
         delete ani;
     }
     
-    if(m_emptyTexture)
-    {
-        m_emptyTexture->clear();
-        delete m_emptyTexture;
-    }
+    ResourceCache::releaseTexture(m_emptyTexture);
     
     for(Texture* tex : m_textures)
     {
@@ -73,6 +87,7 @@ void GltfLoader::clear()
         delete mat;
     }
     
+    m_renderList.clear();
     for(GltfNode* node : m_linearNodes)
     {
         delete node;
@@ -89,7 +104,22 @@ void GltfLoader::loadFromFile(std::string fileName, VkQueue transferQueue, uint3
 #else
     m_graphicsQueue = transferQueue;
     m_loadFlags = loadFlags;
-    load(fileName);
+    if(!m_isCooking && !Tools::m_deviceEnabledFeatures.textureCompressionBC)
+    {
+        m_loadFlags &= ~GltfFileLoadFlags::CompressTextures;
+    }
+    
+    //同目录下有烘焙好的文件, 并且比glTF和图片都新时优先使用
+    auto tStart = std::chrono::high_resolution_clock::now();
+    std::string cookedFile = fileName + ".cooked";
+    bool isCooked = !m_isCooking && !(m_loadFlags & GltfFileLoadFlags::DeferTextures) && Tools::isFileExists(cookedFile) && SceneCooker::load(this, cookedFile);
+    if(!isCooked)
+    {
+        load(fileName);
+    }
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    m_statistics.isCooked = isCooked;
+    m_statistics.loadTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
 #endif
 }
 
@@ -100,7 +130,7 @@ void GltfLoader::bindBuffers(VkCommandBuffer commandBuffer)
 #else
     const VkDeviceSize offsets[1] = {0};
     vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_vertexBuffer, offsets);
-    vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, m_indexType);
 #endif
 }
 
@@ -110,14 +140,24 @@ void GltfLoader::draw(VkCommandBuffer commandBuffer)
     draw(commandBuffer, notUseLayout, 0);
 }
 
-void GltfLoader::draw(VkCommandBuffer commandBuffer, const VkPipelineLayout& pipelineLayout, int method)
+void GltfLoader::draw(VkCommandBuffer commandBuffer, const VkPipelineLayout& pipelineLayout, int method, uint32_t passFlags)
 {
 #ifdef USE_BUILDIN_LOAD_GLTF
     m_pModel->draw(commandBuffer);
 #else
-    for (auto& node : m_treeNodes)
+    //第一次绘制时生成列表, 此时材质的pipeline和描述符集都已创建
+    if(m_renderList.isEmpty())
+    {
+        m_renderList.build(m_linearNodes, m_materials, m_loadFlags);
+    }
+    
+    RenderList::BindState state;
+    for (const RenderList::DrawItem* item : m_renderList.m_sortedItems)
     {
-        drawNode(commandBuffer, node, pipelineLayout, method);
+        if((passFlags & (1 << item->pass)) && item->isVisible)
+        {
+            drawItem(commandBuffer, *item, pipelineLayout, method, state);
+        }
     }
 #endif
 }
@@ -136,6 +176,18 @@ bool callbackImageLoad(tinygltf::Image* image, const int imageIndex, std::string
     return tinygltf::LoadImageData(image, imageIndex, error, warning, req_width, req_height, bytes, size, userData);
 }
 
+// 只保存原始数据, 解码放到loadImages的工作线程里
+bool callbackImageLoadDeferred(tinygltf::Image* /*image*/, const int imageIndex, std::string* /*error*/, std::string* /*warning*/, int /*req_width*/, int /*req_height*/, const unsigned char* bytes, int size, void* userData)
+{
+    std::vector<std::vector<unsigned char>>* encodedImages = static_cast<std::vector<std::vector<unsigned char>>*>(userData);
+    if (encodedImages->size() <= static_cast<size_t>(imageIndex))
+    {
+        encodedImages->resize(imageIndex + 1);
+    }
+    encodedImages->at(imageIndex).assign(bytes, bytes + size);
+    return true;
+}
+
 bool callbackImageLoadEmpty(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int req_width, int req_height, const unsigned char* bytes, int size, void* userData)
 {
     return true;
@@ -145,14 +197,19 @@ void GltfLoader::load(std::string fileName)
 {
     tinygltf::TinyGLTF gltfContext;
     
-    if( m_loadFlags & GltfFileLoadFlags::DontLoadImages )
+    if( (m_loadFlags & GltfFileLoadFlags::DontLoadImages) && !m_isCooking )
     {
         gltfContext.SetImageLoader(callbackImageLoadEmpty, nullptr);
     }
-    else
+    else if( m_isCooking )
     {
         gltfContext.SetImageLoader(callbackImageLoad, nullptr);
     }
+    else
+    {
+        m_encodedImages.clear();
+        gltfContext.SetImageLoader(callbackImageLoadDeferred, &m_encodedImages);
+    }
     
     std::string error, warning;
     if(gltfContext.LoadASCIIFromFile(&m_gltfModel, &error, &warning, fileName) == false)
@@ -164,9 +221,16 @@ void GltfLoader::load(std::string fileName)
     size_t pos = fileName.find_last_of('/');
     m_modelPath = fileName.substr(0, pos);
     
-    if (!(m_loadFlags & GltfFileLoadFlags::DontLoadImages))
+    if (!(m_loadFlags & GltfFileLoadFlags::DontLoadImages) && !m_isCooking)
     {
-        loadImages();
+        if (m_loadFlags & GltfFileLoadFlags::DeferTextures)
+        {
+            createDeferredTextures();
+        }
+        else
+        {
+            loadImages();
+        }
     }
 
     this->loadMaterials();
@@ -180,41 +244,25 @@ void GltfLoader::load(std::string fileName)
         }
     }
     
+    //预变换需要世界矩阵, 和解码在同一遍里完成
+    this->decodePrimitives();
+    
     this->loadSkins();
     this->loadAnimations();
     
     this->calculateSceneDimensions();
     
-    if ((m_loadFlags & GltfFileLoadFlags::PreTransformVertices) || (m_loadFlags & GltfFileLoadFlags::PreMultiplyVertexColors) || (m_loadFlags & GltfFileLoadFlags::FlipY))
+    //在预变换之后简化, 误差和绘制时的顶点坐标在同一空间
+    if(m_loadFlags & GltfFileLoadFlags::GenerateLods)
     {
-        const bool preTransform = m_loadFlags & GltfFileLoadFlags::PreTransformVertices;
-        const bool preMultiplyColor = m_loadFlags & GltfFileLoadFlags::PreMultiplyVertexColors;
-        const bool flipY = m_loadFlags & GltfFileLoadFlags::FlipY;
-        
+        m_lodTriangleCounts.assign(m_lodCount, 0);
         for(GltfNode* node : m_linearNodes)
         {
             if(node->m_mesh)
             {
                 for (Primitive* primitive : node->m_mesh->m_primitives)
                 {
-                    for(uint32_t i = 0; i < primitive->m_vertexCount; ++i)
-                    {
-                        Vertex& vert = m_vertexData[primitive->m_vertexOffset + i];
-                        if(preTransform)
-                        {
-                            vert.m_position = glm::vec3(node->m_worldMatrix * glm::vec4(vert.m_position, 1.0f));
-                            vert.m_normal = glm::normalize(glm::mat3(node->m_worldMatrix) * vert.m_normal);
-                        }
-                        if(flipY)
-                        {
-                            vert.m_position.y *= -1.0f;
-                            vert.m_normal.y *= -1.0f;
-                        }
-                        if(preMultiplyColor)
-                        {
-                            vert.m_color = primitive->m_material->m_baseColor * vert.m_color;
-                        }
-                    }
+                    generateLods(primitive);
                 }
             }
         }
@@ -224,13 +272,195 @@ void GltfLoader::load(std::string fileName)
 
 void GltfLoader::loadImages()
 {
-    for (tinygltf::Image &image : m_gltfModel.images)
+    auto tStart = std::chrono::high_resolution_clock::now();
+    size_t imageCount = m_gltfModel.images.size();
+    m_encodedImages.resize(imageCount);
+    
+    //每张图的解码, RGB->RGBA和mip生成都在工作线程里, 主线程按顺序取结果合批上传, 上传和解码重叠
+    std::vector<TextureData> textureDatas(imageCount);
+    std::vector<bool> decoded(imageCount, false);
+    std::mutex decodedMutex;
+    std::condition_variable decodedCondition;
+    
+    //压缩时法线贴图用BC5
+    const bool compressTextures = m_loadFlags & GltfFileLoadFlags::CompressTextures;
+    std::vector<bool> isNormalMap = findNormalMapImages();
+    
+    ThreadPool threadPool;
+    uint32_t threadCount = std::max(1u, std::min(std::thread::hardware_concurrency(), static_cast<uint32_t>(imageCount)));
+    threadPool.setThreadCount(threadCount);
+    for (size_t i = 0; i < imageCount; ++i)
+    {
+        threadPool.m_threads[i % threadCount]->addJob([&, i] {
+            if (compressTextures)
+            {
+                decodeCompressedImage(static_cast<uint32_t>(i), isNormalMap[i], textureDatas[i]);
+            }
+            else
+            {
+                const std::vector<unsigned char>& bytes = m_encodedImages[i];
+                Texture::decodeImage(bytes.data(), bytes.size(), m_gltfModel.images[i].uri, textureDatas[i]);
+            }
+            std::lock_guard<std::mutex> lock(decodedMutex);
+            decoded[i] = true;
+            decodedCondition.notify_one();
+        });
+    }
+    
+    TextureUploader uploader(m_graphicsQueue);
+    VkDeviceSize uncompressedSize = 0;
+    VkDeviceSize textureSize = 0;
+    for (size_t i = 0; i < imageCount; ++i)
+    {
+        {
+            std::unique_lock<std::mutex> lock(decodedMutex);
+            decodedCondition.wait(lock, [&] { return decoded[i]; });
+        }
+        const TextureData& textureData = textureDatas[i];
+        for (uint32_t level = 0; level < textureData.m_mipLevels; level++)
+        {
+            uncompressedSize += Texture::getLevelSize(VK_FORMAT_R8G8B8A8_UNORM, std::max(1u, textureData.m_width >> level), std::max(1u, textureData.m_height >> level));
+        }
+        textureSize += textureData.m_data.size();
+        m_textures.push_back(m_pTextureStreamer ? m_pTextureStreamer->add(textureDatas[i]) : uploader.add(textureDatas[i]));
+        std::vector<unsigned char>().swap(m_encodedImages[i]);
+    }
+    uploader.flush();
+    if (m_pTextureStreamer)
+    {
+        m_pTextureStreamer->flush();
+    }
+    threadPool.wait();
+    m_encodedImages.clear();
+    
+    m_emptyTexture = ResourceCache::acquireEmptyTexture(m_graphicsQueue);
+    
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    m_statistics.imageCount = static_cast<uint32_t>(imageCount);
+    m_statistics.decodeThreadCount = threadCount;
+    m_statistics.uploadBatchCount = uploader.m_batchCount;
+    m_statistics.imageTime = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+    m_statistics.textureSize = textureSize;
+    m_statistics.uncompressedTextureSize = uncompressedSize;
+}
+
+std::vector<bool> GltfLoader::findNormalMapImages()
+{
+    size_t imageCount = m_gltfModel.images.size();
+    std::vector<bool> isNormalMap(imageCount, false);
+    for (tinygltf::Material &mat : m_gltfModel.materials)
+    {
+        if (mat.additionalValues.find("normalTexture") != mat.additionalValues.end())
+        {
+            int index = m_gltfModel.textures[mat.additionalValues["normalTexture"].TextureIndex()].source;
+            if (index >= 0 && static_cast<size_t>(index) < imageCount)
+            {
+                isNormalMap[index] = true;
+            }
+        }
+    }
+    return isNormalMap;
+}
+
+// 在工作线程里调用, 只创建对象, 材质可以先引用它们
+void GltfLoader::createDeferredTextures()
+{
+    m_encodedImages.resize(m_gltfModel.images.size());
+    m_isNormalMapImage = findNormalMapImages();
+    for (size_t i = 0; i < m_gltfModel.images.size(); ++i)
+    {
+        Texture* newTexture = new Texture();
+        newTexture->m_name = m_gltfModel.images[i].uri;
+        m_textures.push_back(newTexture);
+    }
+    m_emptyTexture = new Texture();
+}
+
+void GltfLoader::createPlaceholderTextures()
+{
+    TextureUploader uploader(m_graphicsQueue);
+    for (size_t i = 0; i < m_textures.size() + 1; ++i)
+    {
+        //最后一个是m_emptyTexture, 和loadTextureEmpty一样全0
+        bool isEmpty = i == m_textures.size();
+        TextureData textureData;
+        textureData.m_name = isEmpty ? "empty" : m_textures[i]->m_name;
+        textureData.m_width = 1;
+        textureData.m_height = 1;
+        textureData.m_mipLevels = 1;
+        textureData.m_mipOffsets.assign(1, 0);
+        if (isEmpty)
+        {
+            textureData.m_data = {0, 0, 0, 0};
+        }
+        else if (m_isNormalMapImage[i])
+        {
+            textureData.m_data = {128, 128, 255, 255};
+        }
+        else
+        {
+            textureData.m_data = {128, 128, 128, 255};
+        }
+        uploader.add(textureData, isEmpty ? m_emptyTexture : m_textures[i]);
+    }
+    uploader.flush();
+}
+
+void GltfLoader::decodeDeferredImage(uint32_t imageIndex, TextureData& textureData)
+{
+    if (m_loadFlags & GltfFileLoadFlags::CompressTextures)
+    {
+        decodeCompressedImage(imageIndex, m_isNormalMapImage[imageIndex], textureData);
+    }
+    else
+    {
+        const std::vector<unsigned char>& bytes = m_encodedImages[imageIndex];
+        Texture::decodeImage(bytes.data(), bytes.size(), m_gltfModel.images[imageIndex].uri, textureData);
+    }
+    std::vector<unsigned char>().swap(m_encodedImages[imageIndex]);
+}
+
+// 压缩结果缓存在Tools::getCachePath()下, 文件名是图片路径把分隔符换成'_'再加.ktx2, 比图片新时直接使用, 内嵌的图片每次都重新压缩
+void GltfLoader::decodeCompressedImage(uint32_t imageIndex, bool isNormalMap, TextureData& textureData)
+{
+    const std::string& uri = m_gltfModel.images[imageIndex].uri;
+    const bool useCache = !uri.empty() && uri.compare(0, 5, "data:") != 0;
+    const std::string sourceFile = m_modelPath + "/" + uri;
+    std::string cacheName = sourceFile + ".ktx2";
+    std::replace(cacheName.begin(), cacheName.end(), '/', '_');
+    std::replace(cacheName.begin(), cacheName.end(), '\\', '_');
+    const std::string cacheFile = Tools::getCachePath() + cacheName;
+    
+    struct stat sourceStat, cacheStat;
+    if (useCache && stat(cacheFile.c_str(), &cacheStat) == 0 && (stat(sourceFile.c_str(), &sourceStat) != 0 || cacheStat.st_mtime >= sourceStat.st_mtime))
     {
-        Texture* tex = Texture::loadTexture2D(image, m_modelPath, m_graphicsQueue);
-        m_textures.push_back(tex);
+        std::vector<char> bytes = Tools::readFile(cacheFile);
+        if (TextureCompressor::loadKtx2(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size(), textureData) && TextureCompressor::isFormatSupported(textureData.m_format))
+        {
+            textureData.m_name = uri;
+            return ;
+        }
+    }
+    
+    const std::vector<unsigned char>& bytes = m_encodedImages[imageIndex];
+    Texture::decodeImage(bytes.data(), bytes.size(), uri, textureData);
+    VkFormat format = TextureCompressor::chooseFormat(textureData, isNormalMap);
+    if (format == textureData.m_format || !TextureCompressor::isFormatSupported(format))
+    {
+        return ;
     }
     
-    m_emptyTexture = Texture::loadTextureEmpty(m_graphicsQueue);
+    //已经在解码的工作线程里, 不再嵌套线程池
+    TextureCompressor::compress(textureData, format);
+    //目录已存在时mkdir失败, 不用处理
+    if (useCache)
+    {
+        mkdir(Tools::getCachePath().c_str(), 0755);
+    }
+    if (useCache && !TextureCompressor::saveKtx2(cacheFile, textureData))
+    {
+        std::cout << "failed to write texture cache " << cacheFile << std::endl;
+    }
 }
 
 void GltfLoader::loadMaterials()
@@ -253,12 +483,12 @@ void GltfLoader::loadMaterials()
         if (mat.values.find("baseColorTexture") != mat.values.end())
         {
             int index = m_gltfModel.textures[mat.values["baseColorTexture"].TextureIndex()].source;
-            newMat->m_pBaseColorTexture = m_textures.at(index);
+            newMat->m_pBaseColorTexture = index >= 0 && static_cast<size_t>(index) < m_textures.size() ? m_textures.at(index) : nullptr;  //没有加载图片时为空
         }
         if (mat.additionalValues.find("normalTexture") != mat.additionalValues.end())
         {
             int index = m_gltfModel.textures[mat.additionalValues["normalTexture"].TextureIndex()].source;
-            newMat->m_pNormalTexture = m_textures.at(index);
+            newMat->m_pNormalTexture = index >= 0 && static_cast<size_t>(index) < m_textures.size() ? m_textures.at(index) : m_emptyTexture;
         }
         else
         {
@@ -280,6 +510,7 @@ void GltfLoader::loadMaterials()
         {
             newMat->m_alphaCutoff = static_cast<float>(mat.additionalValues["alphaCutoff"].Factor());
         }
+        newMat->m_doubleSided = mat.doubleSided;
 
         m_materials.push_back(newMat);
     }
@@ -580,9 +811,9 @@ void GltfLoader::loadSingleNode(GltfNode* parent, const tinygltf::Node &node, ui
     {
         Mesh *newMesh = new Mesh();
         newMesh->m_matrix = newNode->m_originMat;
-        const tinygltf::Mesh mesh = m_gltfModel.meshes[node.mesh];
+        const tinygltf::Mesh &mesh = m_gltfModel.meshes[node.mesh];
         newMesh->m_name = mesh.name;
-        loadMesh(newMesh, mesh);
+        loadMesh(newMesh, mesh, newNode);
         newNode->m_mesh = newMesh;
     }
     
@@ -598,7 +829,8 @@ void GltfLoader::loadSingleNode(GltfNode* parent, const tinygltf::Node &node, ui
     m_linearNodes.push_back(newNode);
 }
 
-void GltfLoader::loadMesh(Mesh* newMesh, const tinygltf::Mesh &mesh)
+// 第一阶段: 只根据accessor的数量分配顶点和索引区间, 数据在decodePrimitives里并行填充
+void GltfLoader::loadMesh(Mesh* newMesh, const tinygltf::Mesh &mesh, GltfNode* node)
 {
     for (size_t j = 0; j < mesh.primitives.size(); j++)
     {
@@ -607,156 +839,287 @@ void GltfLoader::loadMesh(Mesh* newMesh, const tinygltf::Mesh &mesh)
             continue;
         }
         
-        //vertex
         assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
-
         const tinygltf::Accessor &posAccessor = m_gltfModel.accessors[primitive.attributes.find("POSITION")->second];
-        const tinygltf::BufferView &posView = m_gltfModel.bufferViews[posAccessor.bufferView];
-        const float *bufferPos = reinterpret_cast<const float *>(&(m_gltfModel.buffers[posView.buffer].data[posAccessor.byteOffset + posView.byteOffset]));
-        glm::vec3 posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
-        glm::vec3 posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
-        
-        const float *bufferNormals = nullptr;
-        if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
-            const tinygltf::Accessor &normAccessor = m_gltfModel.accessors[primitive.attributes.find("NORMAL")->second];
-            const tinygltf::BufferView &normView = m_gltfModel.bufferViews[normAccessor.bufferView];
-            bufferNormals = reinterpret_cast<const float *>(&(m_gltfModel.buffers[normView.buffer].data[normAccessor.byteOffset + normView.byteOffset]));
+        const tinygltf::Accessor &indexAccessor = m_gltfModel.accessors[primitive.indices];
+        if (!GltfAccessor::isIndexTypeSupported(indexAccessor.componentType))
+        {
+            throw std::runtime_error("Index component type not support!");
         }
         
-        const float *bufferTexCoords = nullptr;
-        if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-            const tinygltf::Accessor &uvAccessor = m_gltfModel.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-            const tinygltf::BufferView &uvView = m_gltfModel.bufferViews[uvAccessor.bufferView];
-            bufferTexCoords = reinterpret_cast<const float *>(&(m_gltfModel.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
+        Primitive *newPrimitive = new Primitive();
+        newPrimitive->m_vertexOffset = 0;
+        newPrimitive->m_indexOffset = 0;
+        if (!m_primitiveJobs.empty())
+        {
+            const Primitive* last = m_primitiveJobs.back().primitive;
+            newPrimitive->m_vertexOffset = last->m_vertexOffset + last->m_vertexCount;
+            newPrimitive->m_indexOffset = last->m_indexOffset + last->m_indexCount;
         }
-        
-        uint32_t numColorComponents = 0;
-        const float* bufferColors = nullptr;
-        if (primitive.attributes.find("COLOR_0") != primitive.attributes.end())
+        newPrimitive->m_vertexCount = static_cast<uint32_t>(posAccessor.count);
+        newPrimitive->m_indexCount = static_cast<uint32_t>(indexAccessor.count);
+        //min/max缺失时在解码后计算
+        if (posAccessor.minValues.size() >= 3 && posAccessor.maxValues.size() >= 3)
         {
-            const tinygltf::Accessor& colorAccessor = m_gltfModel.accessors[primitive.attributes.find("COLOR_0")->second];
-            const tinygltf::BufferView& colorView = m_gltfModel.bufferViews[colorAccessor.bufferView];
-            // Color buffer are either of type vec3 or vec4
-            numColorComponents = colorAccessor.type == TINYGLTF_PARAMETER_TYPE_FLOAT_VEC3 ? 3 : 4;
-            bufferColors = reinterpret_cast<const float*>(&(m_gltfModel.buffers[colorView.buffer].data[colorAccessor.byteOffset + colorView.byteOffset]));
+            newPrimitive->m_min = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
+            newPrimitive->m_max = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
         }
-        
-        const float* bufferTangents = nullptr;
-        if (primitive.attributes.find("TANGENT") != primitive.attributes.end())
+        else
         {
-            const tinygltf::Accessor &tangentAccessor = m_gltfModel.accessors[primitive.attributes.find("TANGENT")->second];
-            const tinygltf::BufferView &tangentView = m_gltfModel.bufferViews[tangentAccessor.bufferView];
-            bufferTangents = reinterpret_cast<const float *>(&(m_gltfModel.buffers[tangentView.buffer].data[tangentAccessor.byteOffset + tangentView.byteOffset]));
+            newPrimitive->m_min = glm::vec3(FLT_MAX);
+            newPrimitive->m_max = glm::vec3(-FLT_MAX);
         }
-        
-        const uint16_t *bufferJoints = nullptr;
-        if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
-            const tinygltf::Accessor &jointAccessor = m_gltfModel.accessors[primitive.attributes.find("JOINTS_0")->second];
-            const tinygltf::BufferView &jointView = m_gltfModel.bufferViews[jointAccessor.bufferView];
-            bufferJoints = reinterpret_cast<const uint16_t *>(&(m_gltfModel.buffers[jointView.buffer].data[jointAccessor.byteOffset + jointView.byteOffset]));
+        if(primitive.material > - 1)
+        {
+            newPrimitive->m_material = m_materials[primitive.material];
         }
-
-        const float *bufferWeights = nullptr;
-        if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
-            const tinygltf::Accessor &uvAccessor = m_gltfModel.accessors[primitive.attributes.find("WEIGHTS_0")->second];
-            const tinygltf::BufferView &uvView = m_gltfModel.bufferViews[uvAccessor.bufferView];
-            bufferWeights = reinterpret_cast<const float *>(&(m_gltfModel.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
+        else
+        {
+            newPrimitive->m_material = m_materials.back();
         }
+        newMesh->m_primitives.push_back(newPrimitive);
         
-        bool hasSkin = (bufferJoints && bufferWeights);
+        PrimitiveJob job = {};
+        job.primitive = newPrimitive;
+        job.source = &primitive;
+        job.node = node;
+        m_primitiveJobs.push_back(job);
+    }
+}
 
-        uint32_t vertexOffset = static_cast<uint32_t>(m_vertexData.size());
-        uint32_t vertexCount = static_cast<uint32_t>(posAccessor.count);
-        
-        for (size_t i = 0; i < posAccessor.count; i++)
-        {
-            Vertex vert = {};
-            vert.m_position = glm::vec4(glm::make_vec3(&bufferPos[i * 3]), 1.0f);
-            vert.m_normal = glm::normalize(glm::vec3(bufferNormals ? glm::make_vec3(&bufferNormals[i * 3]) : glm::vec3(0.0f)));
-            vert.m_uv = bufferTexCoords ? glm::make_vec2(&bufferTexCoords[i * 2]) : glm::vec3(0.0f);
-            if(numColorComponents > 0)
+// 第二阶段: 每个primitive写自己的区间, 互不重叠, 工作线程从共享计数器领取任务
+void GltfLoader::decodePrimitives()
+{
+    uint32_t vertexCount = 0;
+    uint32_t indexCount = 0;
+    if (!m_primitiveJobs.empty())
+    {
+        const Primitive* last = m_primitiveJobs.back().primitive;
+        vertexCount = last->m_vertexOffset + last->m_vertexCount;
+        indexCount = last->m_indexOffset + last->m_indexCount;
+    }
+    m_vertexData.resize(vertexCount);
+    m_indexData.resize(indexCount);
+    
+    //大的primitive先做, 减少最后等待单个任务的时间
+    std::vector<PrimitiveJob*> jobs;
+    for (PrimitiveJob& job : m_primitiveJobs)
+    {
+        jobs.push_back(&job);
+    }
+    std::sort(jobs.begin(), jobs.end(), [](const PrimitiveJob* a, const PrimitiveJob* b) {
+        return a->primitive->m_vertexCount > b->primitive->m_vertexCount;
+    });
+    
+    std::atomic<size_t> nextJob(0);
+    uint32_t threadCount = std::max(1u, std::min(std::thread::hardware_concurrency(), static_cast<uint32_t>(jobs.size())));
+    ThreadPool threadPool;
+    threadPool.setThreadCount(threadCount);
+    for (uint32_t t = 0; t < threadCount; ++t)
+    {
+        threadPool.m_threads[t]->addJob([&] {
+            for (size_t i = nextJob++; i < jobs.size(); i = nextJob++)
             {
-                if(numColorComponents == 3)
-                {
-                    vert.m_color = glm::vec4(glm::make_vec3(&bufferColors[i * 3]), 1.0f);
-                }
-                else if(numColorComponents == 4)
-                {
-                    vert.m_color = glm::make_vec4(&bufferColors[i * 4]);
-                }
+                decodePrimitive(*jobs[i]);
             }
-            vert.m_tangent = bufferTangents ? glm::vec4(glm::make_vec4(&bufferTangents[i * 4])) : glm::vec4(0.0f);
-            vert.m_jointIndex = hasSkin ? glm::vec4(glm::make_vec4(&bufferJoints[i * 4])) : glm::vec4(0.0f);
-            vert.m_jointWeight = hasSkin ? glm::make_vec4(&bufferWeights[i * 4]) : glm::vec4(0.0f);
-            m_vertexData.push_back(vert);
+        });
+    }
+    threadPool.wait();
+    
+    for (const PrimitiveJob& job : m_primitiveJobs)
+    {
+        m_cacheStatsBefore += job.cacheStatsBefore;
+        m_cacheStatsAfter += job.cacheStatsAfter;
+    }
+    m_primitiveJobs.clear();
+}
+
+void GltfLoader::decodePrimitive(PrimitiveJob& job)
+{
+    Primitive* primitive = job.primitive;
+    const tinygltf::Primitive& source = *job.source;
+    Vertex* vertices = m_vertexData.data() + primitive->m_vertexOffset;
+    uint32_t* indices = m_indexData.data() + primitive->m_indexOffset;
+    
+    //没有的属性保持这里的默认值
+    for (uint32_t i = 0; i < primitive->m_vertexCount; ++i)
+    {
+        vertices[i].m_position = glm::vec3(0.0f);
+        vertices[i].m_normal = glm::vec3(0.0f);
+        vertices[i].m_uv = glm::vec2(0.0f);
+        vertices[i].m_color = glm::vec4(1.0f);
+        vertices[i].m_tangent = glm::vec4(0.0f);
+        vertices[i].m_jointIndex = glm::vec4(0.0f);
+        vertices[i].m_jointWeight = glm::vec4(0.0f);
+    }
+    
+    auto readAttribute = [&](const char* name, float* dst, uint32_t components) {
+        auto it = source.attributes.find(name);
+        if (it == source.attributes.end())
+        {
+            return false;
         }
-        
-        //index
-        const tinygltf::Accessor &indexAccessor = m_gltfModel.accessors[primitive.indices];
-        const tinygltf::BufferView &indexView = m_gltfModel.bufferViews[indexAccessor.bufferView];
-        const tinygltf::Buffer &buffer = m_gltfModel.buffers[indexView.buffer];
-        
-        uint32_t indexOffset = static_cast<uint32_t>(m_indexData.size());
-        uint32_t indexCount = static_cast<uint32_t>(indexAccessor.count);
-        
-        switch (indexAccessor.componentType)
+        GltfAccessor::readFloats(m_gltfModel, m_gltfModel.accessors[it->second], dst, sizeof(Vertex), components);
+        return true;
+    };
+    
+    readAttribute("POSITION", &vertices->m_position.x, 3);
+    bool hasNormal = readAttribute("NORMAL", &vertices->m_normal.x, 3);
+    readAttribute("TEXCOORD_0", &vertices->m_uv.x, 2);
+    readAttribute("COLOR_0", &vertices->m_color.x, 4);
+    readAttribute("TANGENT", &vertices->m_tangent.x, 4);
+    if (source.attributes.find("JOINTS_0") != source.attributes.end() && source.attributes.find("WEIGHTS_0") != source.attributes.end())
+    {
+        readAttribute("JOINTS_0", &vertices->m_jointIndex.x, 4);
+        readAttribute("WEIGHTS_0", &vertices->m_jointWeight.x, 4);
+    }
+    
+    if (hasNormal)
+    {
+        for (uint32_t i = 0; i < primitive->m_vertexCount; ++i)
         {
-            case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT:
-            {
-                uint32_t *buf = new uint32_t[indexAccessor.count];
-                memcpy(buf, &buffer.data[indexAccessor.byteOffset + indexView.byteOffset], indexAccessor.count * sizeof(uint32_t));
-                for (size_t index = 0; index < indexAccessor.count; index++) {
-                    m_indexData.push_back(buf[index] + vertexOffset);
-                }
-                delete[] buf;
-                break;
-            }
-                
-            case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT:
+            vertices[i].m_normal = glm::normalize(vertices[i].m_normal);
+        }
+    }
+    
+    if (primitive->m_min.x > primitive->m_max.x)
+    {
+        for (uint32_t i = 0; i < primitive->m_vertexCount; ++i)
+        {
+            primitive->m_min = glm::min(primitive->m_min, vertices[i].m_position);
+            primitive->m_max = glm::max(primitive->m_max, vertices[i].m_position);
+        }
+    }
+    
+    //优化器使用局部索引
+    const bool optimize = m_loadFlags & GltfFileLoadFlags::OptimizeMesh;
+    GltfAccessor::readIndices(m_gltfModel, m_gltfModel.accessors[source.indices], indices, optimize ? 0 : primitive->m_vertexOffset);
+    if (optimize)
+    {
+        job.cacheStatsBefore = MeshOptimizer::analyzeVertexCache(indices, primitive->m_indexCount, primitive->m_vertexCount);
+        MeshOptimizer::optimize(vertices, primitive->m_vertexCount, indices, primitive->m_indexCount);
+        job.cacheStatsAfter = MeshOptimizer::analyzeVertexCache(indices, primitive->m_indexCount, primitive->m_vertexCount);
+        for (uint32_t i = 0; i < primitive->m_indexCount; ++i)
+        {
+            indices[i] += primitive->m_vertexOffset;
+        }
+    }
+    
+    transformVertices(vertices, primitive->m_vertexCount, job.node->m_worldMatrix, primitive->m_material->m_baseColor);
+}
+
+// 预变换, FlipY和预乘顶点色合成一次遍历
+void GltfLoader::transformVertices(Vertex* vertices, uint32_t vertexCount, const glm::mat4& worldMatrix, const glm::vec4& baseColor)
+{
+    const bool preTransform = m_loadFlags & GltfFileLoadFlags::PreTransformVertices;
+    const bool preMultiplyColor = m_loadFlags & GltfFileLoadFlags::PreMultiplyVertexColors;
+    const bool flipY = m_loadFlags & GltfFileLoadFlags::FlipY;
+    if (!preTransform && !preMultiplyColor && !flipY)
+    {
+        return ;
+    }
+    
+    //FlipY合并到矩阵里
+    glm::mat4 positionMatrix = preTransform ? worldMatrix : glm::mat4(1.0f);
+    glm::mat3 normalMatrix = glm::mat3(positionMatrix);
+    if (flipY)
+    {
+        glm::mat4 flip = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -1.0f, 1.0f));
+        positionMatrix = flip * positionMatrix;
+        normalMatrix = glm::mat3(flip) * normalMatrix;
+    }
+    
+#if defined(__SSE2__)
+    const __m128 col0 = _mm_loadu_ps(&positionMatrix[0][0]);
+    const __m128 col1 = _mm_loadu_ps(&positionMatrix[1][0]);
+    const __m128 col2 = _mm_loadu_ps(&positionMatrix[2][0]);
+    const __m128 col3 = _mm_loadu_ps(&positionMatrix[3][0]);
+#endif
+    
+    for (uint32_t i = 0; i < vertexCount; ++i)
+    {
+        Vertex& vert = vertices[i];
+        if (preTransform || flipY)
+        {
+#if defined(__SSE2__)
+            __m128 p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(col0, _mm_set1_ps(vert.m_position.x)), _mm_mul_ps(col1, _mm_set1_ps(vert.m_position.y))),
+                                  _mm_add_ps(_mm_mul_ps(col2, _mm_set1_ps(vert.m_position.z)), col3));
+            float result[4];
+            _mm_storeu_ps(result, p);
+            vert.m_position = glm::vec3(result[0], result[1], result[2]);
+#else
+            vert.m_position = glm::vec3(positionMatrix * glm::vec4(vert.m_position, 1.0f));
+#endif
+            if (preTransform)
             {
-                uint16_t *buf = new uint16_t[indexAccessor.count];
-                memcpy(buf, &buffer.data[indexAccessor.byteOffset + indexView.byteOffset], indexAccessor.count * sizeof(uint16_t));
-                for (size_t index = 0; index < indexAccessor.count; index++)
-                {
-                    m_indexData.push_back(buf[index] + vertexOffset);
-                }
-                delete[] buf;
-                break;
+                vert.m_normal = glm::normalize(normalMatrix * vert.m_normal);
             }
-                
-            case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE:
+            else
             {
-                uint8_t *buf = new uint8_t[indexAccessor.count];
-                memcpy(buf, &buffer.data[indexAccessor.byteOffset + indexView.byteOffset], indexAccessor.count * sizeof(uint8_t));
-                for (size_t index = 0; index < indexAccessor.count; index++)
-                {
-                    m_indexData.push_back(buf[index] + vertexOffset);
-                }
-                delete[] buf;
-                break;
+                vert.m_normal.y *= -1.0f;
             }
-                
-            default:
-                throw std::runtime_error("Index component type not support!");
-                break;
+        }
+        if (preMultiplyColor)
+        {
+            vert.m_color = baseColor * vert.m_color;
+        }
+    }
+}
+
+void GltfLoader::generateLods(Primitive* primitive)
+{
+    primitive->m_lods.clear();
+    primitive->m_lods.push_back({primitive->m_indexOffset, primitive->m_indexCount, 0.0f});
+    m_lodTriangleCounts[0] += primitive->m_indexCount / 3;
+    if(primitive->m_indexCount == 0)
+    {
+        return ;
+    }
+    
+    std::vector<uint32_t> indices(m_indexData.begin() + primitive->m_indexOffset, m_indexData.begin() + primitive->m_indexOffset + primitive->m_indexCount);
+    for(uint32_t& index : indices)
+    {
+        index -= primitive->m_vertexOffset;
+    }
+    
+    const Vertex* vertices = m_vertexData.data() + primitive->m_vertexOffset;
+    size_t targetIndexCount = indices.size();
+    for(uint32_t level = 1; level < m_lodCount; ++level)
+    {
+        // 每级三角形减半, 都从原始网格简化, 误差相对原始网格
+        targetIndexCount = targetIndexCount / 6 * 3;
+        float error = 0.0f;
+        std::vector<uint32_t> lodIndices = MeshSimplifier::simplify(vertices, primitive->m_vertexCount, indices.data(), indices.size(), targetIndexCount, FLT_MAX, &error);
+        
+        //被边界锁住简化不下去时不再生成
+        const Primitive::Lod& previous = primitive->m_lods.back();
+        if(lodIndices.empty() || lodIndices.size() * 10 > previous.indexCount * 9)
+        {
+            break;
         }
         
-        Primitive *newPrimitive = new Primitive();
-        newPrimitive->m_vertexOffset = vertexOffset;
-        newPrimitive->m_vertexCount = vertexCount;
-        newPrimitive->m_indexOffset = indexOffset;
-        newPrimitive->m_indexCount = indexCount;
-        newPrimitive->m_min = posMin;
-        newPrimitive->m_max = posMax;
-        if(primitive.material > - 1)
+        if(m_loadFlags & GltfFileLoadFlags::OptimizeMesh)
         {
-            newPrimitive->m_material = m_materials[primitive.material];
+            MeshOptimizer::optimizeVertexCache(lodIndices.data(), lodIndices.size(), primitive->m_vertexCount);
         }
-        else
+        
+        Primitive::Lod lod = {};
+        lod.indexOffset = static_cast<uint32_t>(m_indexData.size());
+        lod.indexCount = static_cast<uint32_t>(lodIndices.size());
+        lod.error = std::max(error, previous.error);
+        for(uint32_t index : lodIndices)
         {
-            newPrimitive->m_material = m_materials.back();
+            m_indexData.push_back(index + primitive->m_vertexOffset);
         }
-        newMesh->m_primitives.push_back(newPrimitive);
+        primitive->m_lods.push_back(lod);
+        m_lodTriangleCounts[level] += lod.indexCount / 3;
+        targetIndexCount = lodIndices.size();
+    }
+    
+    //级数不足时沿用最后一级, 方便按级统计
+    for(uint32_t level = static_cast<uint32_t>(primitive->m_lods.size()); level < m_lodCount; ++level)
+    {
+        m_lodTriangleCounts[level] += primitive->m_lods.back().indexCount / 3;
     }
 }
 
@@ -768,16 +1131,32 @@ void GltfLoader::createVertexAndIndexBuffer()
     VkBuffer indexStagingBuffer;
     VkDeviceMemory vertexStagingMemory;
     VkDeviceMemory indexStagingMemory;
-    size_t vertexBufferSize = m_vertexData.size() * sizeof(Vertex);
-    size_t indexBufferSize = m_indexData.size() * sizeof(uint32_t);
     
+    //先确定大小, 压缩和转换直接写进staging buffer, 烘焙文件的数据从映射直接拷贝
+    chooseIndexType();
+    size_t vertexBufferSize = getVertexCount() * getPackedVertexStride();
+    size_t indexDataSize = getIndexCount() * (m_indexType == VK_INDEX_TYPE_UINT16 ? sizeof(uint16_t) : sizeof(uint32_t));
+    //16位索引补齐到4字节, compute按uint读取时不越界
+    size_t indexBufferSize = (indexDataSize + 3) & ~static_cast<size_t>(3);
+    m_statistics.originBufferSize = getVertexCount() * sizeof(Vertex) + getIndexCount() * sizeof(uint32_t);
+    m_statistics.vertexBufferSize = vertexBufferSize;
+    m_statistics.indexBufferSize = indexBufferSize;
+    
+    void* pData = nullptr;
     Tools::createBufferAndMemoryThenBind(vertexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vertexStagingBuffer, vertexStagingMemory);
-    Tools::mapMemory(vertexStagingMemory, vertexBufferSize, m_vertexData.data());
-    Tools::createBufferAndMemoryThenBind(vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,  m_vertexBuffer, m_vertexMemory);
+    VK_CHECK_RESULT(vkMapMemory(Tools::m_device, vertexStagingMemory, 0, vertexBufferSize, 0, &pData));
+    packVertexData(static_cast<uint8_t*>(pData));
+    vkUnmapMemory(Tools::m_device, vertexStagingMemory);
+    //storage和transfer src用于compute蒙皮读取bind pose
+    Tools::createBufferAndMemoryThenBind(vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,  m_vertexBuffer, m_vertexMemory);
     
     Tools::createBufferAndMemoryThenBind(indexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, indexStagingBuffer, indexStagingMemory);
-    Tools::mapMemory(indexStagingMemory, indexBufferSize, m_indexData.data());
-    Tools::createBufferAndMemoryThenBind(indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indexBuffer, m_indexMemory);
+    VK_CHECK_RESULT(vkMapMemory(Tools::m_device, indexStagingMemory, 0, indexBufferSize, 0, &pData));
+    packIndexData(static_cast<uint8_t*>(pData));
+    memset(static_cast<uint8_t*>(pData) + indexDataSize, 0, indexBufferSize - indexDataSize);
+    vkUnmapMemory(Tools::m_device, indexStagingMemory);
+    //storage用于compute簇剔除读取源索引
+    Tools::createBufferAndMemoryThenBind(indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indexBuffer, m_indexMemory);
     
     VkCommandBuffer copyCmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
     VkBufferCopy copyRegion = {};
@@ -794,8 +1173,148 @@ void GltfLoader::createVertexAndIndexBuffer()
 #endif
 }
 
+size_t GltfLoader::getPackedVertexStride()
+{
+    if(!(m_loadFlags & GltfFileLoadFlags::QuantizeVertices))
+    {
+        return sizeof(Vertex);
+    }
+    
+    //反量化矩阵要和结点矩阵一起push, 预变换后没有push constant
+    if(m_loadFlags & GltfFileLoadFlags::PreTransformVertices)
+    {
+        throw std::runtime_error("QuantizeVertices can't be used with PreTransformVertices!");
+    }
+    
+    if(m_packedLayout.m_stride == 0)
+    {
+        throw std::runtime_error("call setVertexBindingAndAttributeDescription before createVertexAndIndexBuffer when quantize vertices!");
+    }
+    return m_packedLayout.m_stride;
+}
+
+void GltfLoader::packVertexData(uint8_t* vertexBytes)
+{
+    const Vertex* vertices = getVertices();
+    if(!(m_loadFlags & GltfFileLoadFlags::QuantizeVertices))
+    {
+        memcpy(vertexBytes, vertices, getVertexCount() * sizeof(Vertex));
+        return ;
+    }
+    
+    for(GltfNode* node : m_linearNodes)
+    {
+        if(node->m_mesh)
+        {
+            for (Primitive* primitive : node->m_mesh->m_primitives)
+            {
+                glm::vec3 posMin = glm::vec3(FLT_MAX);
+                glm::vec3 posMax = glm::vec3(-FLT_MAX);
+                for(uint32_t i = 0; i < primitive->m_vertexCount; ++i)
+                {
+                    posMin = glm::min(posMin, vertices[primitive->m_vertexOffset + i].m_position);
+                    posMax = glm::max(posMax, vertices[primitive->m_vertexOffset + i].m_position);
+                }
+                
+                primitive->m_dequant = PackedVertexLayout::computeDequant(posMin, posMax);
+                primitive->m_dequantMatrix = PackedVertexLayout::getDequantMatrix(primitive->m_dequant);
+                
+                for(uint32_t i = 0; i < primitive->m_vertexCount; ++i)
+                {
+                    uint32_t index = primitive->m_vertexOffset + i;
+                    m_packedLayout.pack(vertices[index], primitive->m_dequant, vertexBytes + index * m_packedLayout.m_stride);
+                }
+            }
+        }
+    }
+}
+
+void GltfLoader::chooseIndexType()
+{
+    const uint32_t maxUint16Vertices = 65536;
+    m_indexType = VK_INDEX_TYPE_UINT32;
+    m_isLocalIndex = false;
+    
+    if(getVertexCount() <= maxUint16Vertices)
+    {
+        m_indexType = VK_INDEX_TYPE_UINT16;
+    }
+    else if(m_loadFlags & GltfFileLoadFlags::QuantizeVertices)
+    {
+        //每个primitive的顶点数都够小时, 去掉vertexOffset后依然可以用16位索引
+        bool fitUint16 = true;
+        for(GltfNode* node : m_linearNodes)
+        {
+            if(node->m_mesh)
+            {
+                for (Primitive* primitive : node->m_mesh->m_primitives)
+                {
+                    fitUint16 = fitUint16 && primitive->m_vertexCount <= maxUint16Vertices;
+                }
+            }
+        }
+        
+        if(fitUint16)
+        {
+            m_indexType = VK_INDEX_TYPE_UINT16;
+            m_isLocalIndex = true;
+        }
+    }
+}
+
+void GltfLoader::packIndexData(uint8_t* indexBytes)
+{
+    const uint32_t* indices = getIndices();
+    if(m_indexType == VK_INDEX_TYPE_UINT32)
+    {
+        memcpy(indexBytes, indices, getIndexCount() * sizeof(uint32_t));
+        return ;
+    }
+    
+    uint16_t* dst = reinterpret_cast<uint16_t*>(indexBytes);
+    if(m_isLocalIndex)
+    {
+        for(GltfNode* node : m_linearNodes)
+        {
+            if(node->m_mesh)
+            {
+                for (Primitive* primitive : node->m_mesh->m_primitives)
+                {
+                    std::vector<Primitive::Lod> ranges = primitive->m_lods;
+                    if(ranges.empty())
+                    {
+                        ranges.push_back({primitive->m_indexOffset, primitive->m_indexCount, 0.0f});
+                    }
+                    
+                    for(const Primitive::Lod& range : ranges)
+                    {
+                        for(uint32_t i = 0; i < range.indexCount; ++i)
+                        {
+                            uint32_t index = range.indexOffset + i;
+                            dst[index] = static_cast<uint16_t>(indices[index] - primitive->m_vertexOffset);
+                        }
+                    }
+                }
+            }
+        }
+    }
+    else
+    {
+        for(size_t i = 0; i < getIndexCount(); ++i)
+        {
+            dst[i] = static_cast<uint16_t>(indices[i]);
+        }
+    }
+}
+
 void GltfLoader::createDescriptorPoolAndLayout()
 {
+    //ResourceCache共享的模型可能被多个使用者调用
+    if(m_descriptorPool != VK_NULL_HANDLE)
+    {
+        return ;
+    }
+    
     uint32_t uniformCount = 0;
 //    for(auto node : m_linearNodes)
 //    {
@@ -872,6 +1391,19 @@ void GltfLoader::setVertexBindingAndAttributeDescription(const std::vector<Verte
 {
 #ifdef USE_BUILDIN_LOAD_GLTF
 #else
+    m_vertexComponents = components;
+    if(m_loadFlags & GltfFileLoadFlags::QuantizeVertices)
+    {
+        size_t jointCount = 0;
+        for(Skin* skin : m_skins)
+        {
+            jointCount = std::max(jointCount, skin->m_joints.size());
+        }
+        m_packedLayout.build(components, jointCount > 256);
+        m_packedLayout.setVertexInputDescription(0);
+        return ;
+    }
+    
     Vertex::setVertexInputBindingDescription(0);
     Vertex::setVertexInputAttributeDescription(0,components);
 #endif
@@ -928,75 +1460,78 @@ VkPipelineVertexInputStateCreateInfo* GltfLoader::getPipelineVertexInputState()
 #endif
 }
 
-void GltfLoader::drawNode(VkCommandBuffer commandBuffer, GltfNode* node, const VkPipelineLayout& pipelineLayout, int method)
+void GltfLoader::drawItem(VkCommandBuffer commandBuffer, const RenderList::DrawItem& item, const VkPipelineLayout& pipelineLayout, int method, RenderList::BindState& state)
 {
     const bool preTransform = m_loadFlags & GltfFileLoadFlags::PreTransformVertices;
     const bool dotLoadImage = m_loadFlags & GltfFileLoadFlags::DontLoadImages;
+    const bool quantize = m_loadFlags & GltfFileLoadFlags::QuantizeVertices;
     
-    if (node->m_mesh)
+    Primitive* primitive = item.primitive;
+    //压缩的顶点坐标在[-1,1]内, 反量化矩阵并入模型矩阵
+    glm::mat4 modelMatrix = quantize ? item.node->m_worldMatrix * primitive->m_dequantMatrix : item.node->m_worldMatrix;
+    
+    if(method == 1)
     {
-        for (Primitive* primitive : node->m_mesh->m_primitives)
+        if(preTransform == false)
         {
-            if(method == 1)
-            {
-                if(preTransform == false)
-                {
-                    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &node->m_worldMatrix);
-                }
-                
-                if(dotLoadImage == false)
-                {
-                    if(primitive->m_material && primitive->m_material->m_pBaseColorTexture)
-                    {
-                        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &primitive->m_material->m_pBaseColorTexture->m_descriptorSet, 0, nullptr);
-                    }
-                }
-            }
-            else if(method == 2)
+            state.pushMatrix(commandBuffer, pipelineLayout, modelMatrix);
+        }
+        
+        if(dotLoadImage == false)
+        {
+            if(primitive->m_material && primitive->m_material->m_pBaseColorTexture)
             {
-                if(preTransform == false)
-                {
-                    glm::mat4 mat(1.0f);
-                    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &mat);
-                }
-                
-                if(m_skins.size() > 0)
-                {
-                    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &m_skins.at(0)->m_descriptorSet, 0, nullptr);
-                }
-                
-                if(dotLoadImage == false)
-                {
-                    if(primitive->m_material && primitive->m_material->m_pBaseColorTexture)
-                    {
-                        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 2, 1, &primitive->m_material->m_pBaseColorTexture->m_descriptorSet, 0, nullptr);
-                    }
-                }
+                state.bindDescriptorSet(commandBuffer, pipelineLayout, 1, primitive->m_material->m_pBaseColorTexture->m_descriptorSet);
             }
-            else if(method == 3)
-            {
-                if(preTransform == false)
-                {
-                    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &node->m_worldMatrix);
-                }
-                
-                Material* mat = primitive->m_material;
-                vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, mat->m_graphicsPipeline);
-                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &mat->m_descriptorSet, 0, nullptr);
-            }
-            else if(method == 4)
+        }
+    }
+    else if(method == 2)
+    {
+        if(preTransform == false)
+        {
+            state.pushMatrix(commandBuffer, pipelineLayout, primitive->m_dequantMatrix);
+        }
+        
+        if(m_skins.size() > 0)
+        {
+            state.bindDescriptorSet(commandBuffer, pipelineLayout, 1, m_skins.at(0)->m_descriptorSet);
+        }
+        
+        if(dotLoadImage == false)
+        {
+            if(primitive->m_material && primitive->m_material->m_pBaseColorTexture)
             {
-                Material* mat = primitive->m_material;
-                vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &mat->m_descriptorSet, 0, nullptr);
+                state.bindDescriptorSet(commandBuffer, pipelineLayout, 2, primitive->m_material->m_pBaseColorTexture->m_descriptorSet);
             }
-            
-            vkCmdDrawIndexed(commandBuffer, primitive->m_indexCount, 1, primitive->m_indexOffset, 0, 0);
         }
     }
+    else if(method == 3)
+    {
+        if(preTransform == false)
+        {
+            state.pushMatrix(commandBuffer, pipelineLayout, modelMatrix);
+        }
+        
+        Material* mat = primitive->m_material;
+        state.bindPipeline(commandBuffer, mat->m_graphicsPipeline);
+        state.bindDescriptorSet(commandBuffer, pipelineLayout, 1, mat->m_descriptorSet);
+    }
+    else if(method == 4)
+    {
+        Material* mat = primitive->m_material;
+        state.bindDescriptorSet(commandBuffer, pipelineLayout, 1, mat->m_descriptorSet);
+    }
     
-    for (auto& child : node->m_children) {
-        drawNode(commandBuffer, child, pipelineLayout, method);
+    vkCmdDrawIndexed(commandBuffer, primitive->m_indexCount, 1, primitive->m_indexOffset, m_isLocalIndex ? primitive->m_vertexOffset : 0, 0);
+}
+
+void GltfLoader::sortRenderList(const glm::vec3& viewPos)
+{
+    if(m_renderList.isEmpty())
+    {
+        m_renderList.build(m_linearNodes, m_materials, m_loadFlags);
     }
+    m_renderList.sort(viewPos);
 }
 
 
@@ -6,8 +6,16 @@
 #include "gltfNode.h"
 
 #include "vertex.h"
+#include "packedVertex.h"
+#include "meshOptimizer.h"
+#include "meshSimplifier.h"
 #include "primitive.h"
 #include "texture.h"
+#include "textureUploader.h"
+#include "textureStreamer.h"
+#include "renderList.h"
+#include "thread.h"
+#include "mappedFile.h"
 #include "mesh.h"
 #include "skin.h"
 #include "animation.h"
@@ -19,7 +27,12 @@ enum GltfFileLoadFlags {
     PreTransformVertices = 0x00000001,
     PreMultiplyVertexColors = 0x00000002,
     FlipY = 0x00000004,
-    DontLoadImages = 0x00000008
+    DontLoadImages = 0x00000008,
+    QuantizeVertices = 0x00000010,
+    OptimizeMesh = 0x00000020,
+    GenerateLods = 0x00000040,
+    CompressTextures = 0x00000080,      //图片压缩成BC格式, 法线贴图用BC5, 设备不支持时忽略
+    DeferTextures = 0x00000100          //只创建空的Texture对象, 不解码不上传, 由AsyncLoader在后台逐张替换. 不使用烘焙文件
 };
 
 enum GltfDescriptorBindingFlags
@@ -30,7 +43,23 @@ enum GltfDescriptorBindingFlags
 
 class GltfLoader
 {
+    friend class SceneCooker;
 public:
+    // 加载和创建buffer时的统计, 由sample输出
+    struct Statistics {
+        bool isCooked = false;              //从烘焙文件加载
+        double loadTime = 0.0;              //loadFromFile的耗时, 毫秒
+        uint32_t imageCount = 0;
+        uint32_t decodeThreadCount = 0;
+        uint32_t uploadBatchCount = 0;
+        double imageTime = 0.0;             //图片解码和上传的耗时, 毫秒
+        VkDeviceSize textureSize = 0;
+        VkDeviceSize uncompressedTextureSize = 0;   //全部按RGBA8时的大小
+        size_t originBufferSize = 0;        //Vertex和32位索引时的顶点和索引大小
+        size_t vertexBufferSize = 0;
+        size_t indexBufferSize = 0;
+    };
+
     GltfLoader();
     ~GltfLoader();
     void clear();
@@ -38,6 +67,13 @@ public:
 
 public:
     VkPipelineVertexInputStateCreateInfo* getPipelineVertexInputState();
+    uint32_t getLoadFlags() const { return m_loadFlags; }
+    const Statistics& getStatistics() { return m_statistics; }
+    // CPU端的顶点和索引, 从烘焙文件加载时直接指向映射的文件, m_vertexData和m_indexData为空
+    const Vertex* getVertices() const { return m_pCookedVertices ? m_pCookedVertices : m_vertexData.data(); }
+    const uint32_t* getIndices() const { return m_pCookedIndices ? m_pCookedIndices : m_indexData.data(); }
+    size_t getVertexCount() const { return m_pCookedVertices ? m_cookedVertexCount : m_vertexData.size(); }
+    size_t getIndexCount() const { return m_pCookedIndices ? m_cookedIndexCount : m_indexData.size(); }
     void bindBuffers(VkCommandBuffer commandBuffer);
     void createVertexAndIndexBuffer();
     void createDescriptorPoolAndLayout();
@@ -45,27 +81,56 @@ public:
     void createMaterialBuffer();
     void setVertexBindingAndAttributeDescription(const std::vector<VertexComponent> components);
     void draw(VkCommandBuffer commandBuffer);
-    void draw(VkCommandBuffer commandBuffer, const VkPipelineLayout& pipelineLayout, int method);
+    void draw(VkCommandBuffer commandBuffer, const VkPipelineLayout& pipelineLayout, int method, uint32_t passFlags = RenderList::AllPasses);
+    // 按相机位置重新排序绘制列表, 在updateRenderData里调用
+    void sortRenderList(const glm::vec3& viewPos);
 
     void updateAnimation(float deltaTime);
     void updateAnimation(uint32_t index, float deltaTime);
     
+    //DeferTextures时使用. 在主线程给所有空的Texture填上1x1的占位, 法线贴图为平的法线
+    void createPlaceholderTextures();
+    uint32_t getDeferredImageCount() const { return static_cast<uint32_t>(m_encodedImages.size()); }
+    //线程安全, 不同的index可以并行解码, 解码后释放原始数据
+    void decodeDeferredImage(uint32_t imageIndex, TextureData& textureData);
+    
 private:
+    //loadNodes时记录, decodePrimitives时并行解码
+    struct PrimitiveJob {
+        Primitive* primitive;
+        const tinygltf::Primitive* source;
+        GltfNode* node;
+        MeshOptimizer::Statistics cacheStatsBefore;
+        MeshOptimizer::Statistics cacheStatsAfter;
+    };
+    
     void load(std::string fileName);
     void loadNodes();
     void loadSingleNode(GltfNode* parent, const tinygltf::Node &node, uint32_t indexAtScene);
 
     void loadMaterials();
-    void loadMesh(Mesh* newMesh, const tinygltf::Mesh &mesh);
+    void loadMesh(Mesh* newMesh, const tinygltf::Mesh &mesh, GltfNode* node);
+    void decodePrimitives();
+    void decodePrimitive(PrimitiveJob& job);
+    void transformVertices(Vertex* vertices, uint32_t vertexCount, const glm::mat4& worldMatrix, const glm::vec4& baseColor);
+    void generateLods(Primitive* primitive);
 
     void loadImages();
+    void createDeferredTextures();
+    std::vector<bool> findNormalMapImages();
+    void decodeCompressedImage(uint32_t imageIndex, bool isNormalMap, TextureData& textureData);
     void loadSkins();
     void loadAnimations();
     
     void calculateSceneDimensions();
+    size_t getPackedVertexStride();
+    void chooseIndexType();
+    // 直接写进映射的staging buffer
+    void packVertexData(uint8_t* vertexBytes);
+    void packIndexData(uint8_t* indexBytes);
 
 private:
-    void drawNode(VkCommandBuffer commandBuffer, GltfNode* node, const VkPipelineLayout& pipelineLayout, int method);
+    void drawItem(VkCommandBuffer commandBuffer, const RenderList::DrawItem& item, const VkPipelineLayout& pipelineLayout, int method, RenderList::BindState& state);
     GltfNode* findNode(GltfNode *parent, uint32_t index);
     GltfNode* nodeFromIndex(uint32_t index);
     
@@ -73,6 +138,16 @@ private:
     GltfDescriptorBindingFlags m_descriptorBindingFlags;
     uint32_t m_loadFlags;
     std::string m_modelPath;
+    bool m_isCooking = false;   //离线烘焙时只解码图片, 不创建Vulkan资源
+    std::vector<std::vector<unsigned char>> m_encodedImages;    //tinygltf读到的原始图片数据, 在loadImages里并行解码
+    std::vector<PrimitiveJob> m_primitiveJobs;
+    std::vector<bool> m_isNormalMapImage;   //DeferTextures时记录, 占位和解码时使用
+    Statistics m_statistics;
+    MappedFile m_cookedFile;        //烘焙文件一直映射到clear, 顶点和索引不拷贝到堆上
+    const Vertex* m_pCookedVertices = nullptr;
+    const uint32_t* m_pCookedIndices = nullptr;
+    size_t m_cookedVertexCount = 0;
+    size_t m_cookedIndexCount = 0;
     
     tinygltf::Model m_gltfModel;
 
@@ -95,6 +170,26 @@ public:
     glm::vec3 m_min;
     glm::vec3 m_max;
     float m_radius;
+    
+    //压缩顶点, 需要在createVertexAndIndexBuffer之前设置好顶点分量
+    std::vector<VertexComponent> m_vertexComponents;
+    PackedVertexLayout m_packedLayout;
+    VkIndexType m_indexType = VK_INDEX_TYPE_UINT32;
+    bool m_isLocalIndex = false;    //索引不含vertexOffset, 绘制时由vkCmdDrawIndexed传入
+    
+    //OptimizeMesh前后的顶点缓存统计
+    MeshOptimizer::Statistics m_cacheStatsBefore;
+    MeshOptimizer::Statistics m_cacheStatsAfter;
+    
+    //GenerateLods的级数(包含原始网格), 需要在loadFromFile之前设置
+    uint32_t m_lodCount = 4;
+    std::vector<uint32_t> m_lodTriangleCounts;  //每级LOD所有primitive的三角形总数
+    
+    //扁平的排序绘制列表, 代替递归drawNode
+    RenderList m_renderList;
+    
+    //设置后图片交给它渐进上传, 需要在loadFromFile之前设置
+    TextureStreamer* m_pTextureStreamer = nullptr;
 
 public:
     VkQueue m_graphicsQueue;
@@ -0,0 +1,435 @@
+
+#include "gpuCulling.h"
+#include "resourceCache.h"
+
+GpuCulling::GpuCulling()
+{
+}
+
+GpuCulling::~GpuCulling()
+{}
+
+void GpuCulling::clear()
+{
+    vkDestroyPipeline(Tools::m_device, m_scatterPipeline, nullptr);
+    vkDestroyPipeline(Tools::m_device, m_prefixPipeline, nullptr);
+    vkDestroyPipeline(Tools::m_device, m_cullPipeline, nullptr);
+    vkDestroyPipelineLayout(Tools::m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(Tools::m_device, m_descriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(Tools::m_device, m_descriptorPool, nullptr);
+
+    if(m_pHiZPlaceholder)
+    {
+        ResourceCache::releaseTexture(m_pHiZPlaceholder);
+        m_pHiZPlaceholder = nullptr;
+    }
+
+    if(m_pReadback)
+    {
+        vkUnmapMemory(Tools::m_device, m_readbackMemory);
+        m_pReadback = nullptr;
+    }
+
+    vkFreeMemory(Tools::m_device, m_uniformMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_uniformBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_readbackMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_readbackBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_statisticsMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_statisticsBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_indirectMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_indirectBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_drawTemplateMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_drawTemplateBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_lastVisibleMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_lastVisibleBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_visibilityMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_visibilityBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_instanceMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_instanceBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_srcInstanceMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_srcInstanceBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_groupMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_groupBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_boundsMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_boundsBuffer, nullptr);
+}
+
+uint32_t GpuCulling::addGroup(GltfLoader* pLoader, Primitive* primitive)
+{
+    assert(pLoader && primitive && primitive->m_indexCount > 0);
+
+    // 包围盒取primitive引用的顶点, 预变换后accessor的min/max已经不准. CPU端的索引总是全局的, 局部索引只在GPU上
+    glm::vec3 minPos = glm::vec3(FLT_MAX);
+    glm::vec3 maxPos = glm::vec3(-FLT_MAX);
+    for(uint32_t i = 0; i < primitive->m_indexCount; ++i)
+    {
+        const glm::vec3& pos = pLoader->getVertices()[pLoader->getIndices()[primitive->m_indexOffset + i]].m_position;
+        minPos = glm::min(minPos, pos);
+        maxPos = glm::max(maxPos, pos);
+    }
+    glm::vec3 center = (minPos + maxPos) * 0.5f;
+    m_groupSpheres.push_back(glm::vec4(center, glm::length(maxPos - center)));
+
+    Group group = {};
+    group.firstCommand = static_cast<uint32_t>(m_drawCommands.size());
+    group.lodCount = std::max<uint32_t>(1, std::min<uint32_t>(static_cast<uint32_t>(primitive->m_lods.size()), m_maxLodCount));
+    m_groups.push_back(group);
+    m_groupPrimitives.push_back(primitive);
+
+    for(uint32_t lod = 0; lod < m_maxLodCount; ++lod)
+    {
+        m_groupLodErrors.push_back(lod < primitive->m_lods.size() ? primitive->m_lods[lod].error : 0.0f);
+    }
+
+    // instanceCount和firstInstance由shader写入
+    for(uint32_t lod = 0; lod < group.lodCount; ++lod)
+    {
+        VkDrawIndexedIndirectCommand command = {};
+        command.indexCount = primitive->m_lods.empty() ? primitive->m_indexCount : primitive->m_lods[lod].indexCount;
+        command.instanceCount = 0;
+        command.firstIndex = primitive->m_lods.empty() ? primitive->m_indexOffset : primitive->m_lods[lod].indexOffset;
+        command.vertexOffset = pLoader->m_isLocalIndex ? static_cast<int32_t>(primitive->m_vertexOffset) : 0;
+        command.firstInstance = 0;
+        m_drawCommands.push_back(command);
+    }
+
+    return static_cast<uint32_t>(m_groups.size() - 1);
+}
+
+void GpuCulling::prepare(const void* instanceData, uint32_t instanceStride, const std::vector<Bounds>& bounds, VkQueue queue, VkPipelineCache pipelineCache)
+{
+    assert(instanceStride > 0 && instanceStride % 16 == 0);
+    assert(bounds.size() > 0 && m_groups.size() > 0);
+    m_instanceCount = static_cast<uint32_t>(bounds.size());
+    m_instanceStride = instanceStride;
+
+    createBuffers(instanceData, bounds, queue);
+    createDescriptorSet(queue);
+    createComputePipelines(pipelineCache);
+}
+
+void GpuCulling::createBuffers(const void* instanceData, const std::vector<Bounds>& bounds, VkQueue queue)
+{
+    VkDeviceSize boundsSize = bounds.size() * sizeof(Bounds);
+    VkDeviceSize groupSize = m_groups.size() * sizeof(Group);
+    VkDeviceSize instanceSize = static_cast<VkDeviceSize>(m_instanceCount) * m_instanceStride;
+    VkDeviceSize commandSize = m_drawCommands.size() * sizeof(VkDrawIndexedIndirectCommand);
+
+    //一个staging buffer依次放所有初始数据
+    VkDeviceSize groupOffset = boundsSize;
+    VkDeviceSize instanceOffset = groupOffset + groupSize;
+    VkDeviceSize commandOffset = instanceOffset + instanceSize;
+    VkDeviceSize stagingSize = commandOffset + commandSize;
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    Tools::createBufferAndMemoryThenBind(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingMemory);
+    uint8_t* data = nullptr;
+    VK_CHECK_RESULT(vkMapMemory(Tools::m_device, stagingMemory, 0, stagingSize, 0, (void**)&data));
+    memcpy(data, bounds.data(), boundsSize);
+    memcpy(data + groupOffset, m_groups.data(), groupSize);
+    memcpy(data + instanceOffset, instanceData, instanceSize);
+    memcpy(data + commandOffset, m_drawCommands.data(), commandSize);
+    vkUnmapMemory(Tools::m_device, stagingMemory);
+
+    Tools::createBufferAndMemoryThenBind(boundsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_boundsBuffer, m_boundsMemory);
+    //LOD距离每帧更新
+    Tools::createBufferAndMemoryThenBind(groupSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_groupBuffer, m_groupMemory);
+    Tools::createBufferAndMemoryThenBind(instanceSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_srcInstanceBuffer, m_srcInstanceMemory);
+    Tools::createBufferAndMemoryThenBind(instanceSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_instanceBuffer, m_instanceMemory);
+    Tools::createBufferAndMemoryThenBind(m_instanceCount * sizeof(glm::uvec2), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_visibilityBuffer, m_visibilityMemory);
+    Tools::createBufferAndMemoryThenBind(m_instanceCount * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_lastVisibleBuffer, m_lastVisibleMemory);
+    Tools::createBufferAndMemoryThenBind(commandSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_drawTemplateBuffer, m_drawTemplateMemory);
+    Tools::createBufferAndMemoryThenBind(commandSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indirectBuffer, m_indirectMemory);
+    Tools::createBufferAndMemoryThenBind(sizeof(Statistics), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_statisticsBuffer, m_statisticsMemory);
+    Tools::createBufferAndMemoryThenBind(m_readbackFrameCount * sizeof(Statistics), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_readbackBuffer, m_readbackMemory);
+    VK_CHECK_RESULT(vkMapMemory(Tools::m_device, m_readbackMemory, 0, VK_WHOLE_SIZE, 0, (void**)&m_pReadback));
+    Tools::createBufferAndMemoryThenBind(sizeof(Uniform), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_uniformBuffer, m_uniformMemory);
+
+    VkCommandBuffer copyCmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = 0;
+    copyRegion.size = boundsSize;
+    vkCmdCopyBuffer(copyCmd, stagingBuffer, m_boundsBuffer, 1, &copyRegion);
+    copyRegion.srcOffset = groupOffset;
+    copyRegion.size = groupSize;
+    vkCmdCopyBuffer(copyCmd, stagingBuffer, m_groupBuffer, 1, &copyRegion);
+    copyRegion.srcOffset = instanceOffset;
+    copyRegion.size = instanceSize;
+    vkCmdCopyBuffer(copyCmd, stagingBuffer, m_srcInstanceBuffer, 1, &copyRegion);
+    copyRegion.srcOffset = commandOffset;
+    copyRegion.size = commandSize;
+    vkCmdCopyBuffer(copyCmd, stagingBuffer, m_drawTemplateBuffer, 1, &copyRegion);
+    vkCmdCopyBuffer(copyCmd, stagingBuffer, m_indirectBuffer, 1, &copyRegion);
+    //第一帧Early什么都不画, 全部在Late里测试
+    vkCmdFillBuffer(copyCmd, m_lastVisibleBuffer, 0, VK_WHOLE_SIZE, 0);
+    Tools::flushCommandBuffer(copyCmd, queue, true);
+
+    vkDestroyBuffer(Tools::m_device, stagingBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, stagingMemory, nullptr);
+}
+
+void GpuCulling::createDescriptorSet(VkQueue queue)
+{
+    //没有Hi-Z时绑定1x1的占位纹理, 遮挡剔除关闭
+    m_pHiZPlaceholder = ResourceCache::acquireEmptyTexture(queue);
+
+    std::array<VkDescriptorPoolSize, 3> poolSizes;
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = 8;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[1].descriptorCount = 1;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[2].descriptorCount = 1;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = 0;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+    VK_CHECK_RESULT(vkCreateDescriptorPool(Tools::m_device, &poolInfo, nullptr, &m_descriptorPool));
+
+    std::array<VkDescriptorSetLayoutBinding, 10> bindings;
+    for(uint32_t i = 0; i < 8; ++i)
+    {
+        bindings[i] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, i);
+    }
+    bindings[8] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 8);
+    bindings[9] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 9);
+    VkDescriptorSetLayoutCreateInfo layoutInfo = Tools::getDescriptorSetLayoutCreateInfo(bindings.data(), static_cast<uint32_t>(bindings.size()));
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(Tools::m_device, &layoutInfo, nullptr, &m_descriptorSetLayout));
+
+    Tools::allocateDescriptorSets(m_descriptorPool, &m_descriptorSetLayout, 1, m_descriptorSet);
+
+    VkDescriptorBufferInfo bufferInfos[9] = {};
+    bufferInfos[0].buffer = m_boundsBuffer;
+    bufferInfos[1].buffer = m_groupBuffer;
+    bufferInfos[2].buffer = m_srcInstanceBuffer;
+    bufferInfos[3].buffer = m_instanceBuffer;
+    bufferInfos[4].buffer = m_visibilityBuffer;
+    bufferInfos[5].buffer = m_indirectBuffer;
+    bufferInfos[6].buffer = m_statisticsBuffer;
+    bufferInfos[7].buffer = m_lastVisibleBuffer;
+    bufferInfos[8].buffer = m_uniformBuffer;
+    for(uint32_t i = 0; i < 9; ++i)
+    {
+        bufferInfos[i].range = VK_WHOLE_SIZE;
+    }
+    VkDescriptorImageInfo imageInfo = m_pHiZPlaceholder->getDescriptorImageInfo();
+
+    std::array<VkWriteDescriptorSet, 10> writes;
+    for(uint32_t i = 0; i < 9; ++i)
+    {
+        writes[i] = Tools::getWriteDescriptorSet(m_descriptorSet, bindings[i].descriptorType, i, &bufferInfos[i]);
+    }
+    writes[9] = Tools::getWriteDescriptorSet(m_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9, &imageInfo);
+    vkUpdateDescriptorSets(Tools::m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void GpuCulling::createComputePipelines(VkPipelineCache pipelineCache)
+{
+    //剔除阶段用push constant传入, 同一个command buffer里Early和Late各一次
+    VkPushConstantRange pushConstantRange = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t)};
+
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &m_descriptorSetLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(Tools::m_device, &layoutInfo, nullptr, &m_pipelineLayout));
+
+    VkShaderModule compModule = Tools::createShaderModule( Tools::getShaderPath() + "base/instancecull.comp.spv");
+
+    //同一个shader, 用特化常量区分三步
+    struct SpecializationData {
+        uint32_t pass;
+        uint32_t instanceVec4Count;
+    } specializationData = {0, m_instanceStride / 16};
+
+    std::array<VkSpecializationMapEntry, 2> specializationMapEntries;
+    specializationMapEntries[0].constantID = 0;
+    specializationMapEntries[0].offset = offsetof(SpecializationData, pass);
+    specializationMapEntries[0].size = sizeof(uint32_t);
+    specializationMapEntries[1].constantID = 1;
+    specializationMapEntries[1].offset = offsetof(SpecializationData, instanceVec4Count);
+    specializationMapEntries[1].size = sizeof(uint32_t);
+
+    VkSpecializationInfo specializationInfo = {};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationMapEntries.size());
+    specializationInfo.pMapEntries = specializationMapEntries.data();
+    specializationInfo.dataSize = sizeof(SpecializationData);
+    specializationInfo.pData = &specializationData;
+
+    VkComputePipelineCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    createInfo.layout = m_pipelineLayout;
+    createInfo.flags = 0;
+    createInfo.stage = Tools::getPipelineShaderStageCreateInfo(compModule, VK_SHADER_STAGE_COMPUTE_BIT);
+    createInfo.stage.pSpecializationInfo = &specializationInfo;
+
+    VkPipeline* pipelines[3] = {&m_cullPipeline, &m_prefixPipeline, &m_scatterPipeline};
+    for(uint32_t pass = 0; pass < 3; ++pass)
+    {
+        specializationData.pass = pass;
+        if( vkCreateComputePipelines(Tools::m_device, pipelineCache, 1, &createInfo, nullptr, pipelines[pass]) != VK_SUCCESS )
+        {
+            throw std::runtime_error("failed to create gpu culling pipeline!");
+        }
+    }
+
+    vkDestroyShaderModule(Tools::m_device, compModule, nullptr);
+}
+
+void GpuCulling::setHiZ(VkImageView imageView, VkSampler sampler, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageLayout imageLayout)
+{
+    m_hizImageView = imageView;
+    m_hizWidth = width;
+    m_hizHeight = height;
+    m_hizMipLevels = mipLevels;
+
+    VkDescriptorImageInfo imageInfo = m_pHiZPlaceholder->getDescriptorImageInfo();
+    if(imageView != VK_NULL_HANDLE)
+    {
+        imageInfo.imageView = imageView;
+        imageInfo.sampler = sampler;
+        imageInfo.imageLayout = imageLayout;
+    }
+    VkWriteDescriptorSet write = Tools::getWriteDescriptorSet(m_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 9, &imageInfo);
+    vkUpdateDescriptorSets(Tools::m_device, 1, &write, 0, nullptr);
+}
+
+void GpuCulling::update(const glm::mat4& viewProjMatrix, const glm::vec3& cameraPos, float pixelsPerUnit, float maxPixelError)
+{
+    readStatistics();
+
+    m_frustum.update(viewProjMatrix);
+    for(uint32_t i = 0; i < 6; ++i)
+    {
+        m_uniform.frustumPlanes[i] = m_frustum.m_planes[i];
+    }
+    m_uniform.viewProjMatrix = viewProjMatrix;
+    m_uniform.cameraPos = glm::vec4(cameraPos, 1.0f);
+    m_uniform.instanceCount = m_instanceCount;
+    m_uniform.commandCount = static_cast<uint32_t>(m_drawCommands.size());
+    m_uniform.frustumCulling = m_frustumCulling ? 1 : 0;
+    m_uniform.occlusionCulling = (m_occlusionCulling && m_hizImageView != VK_NULL_HANDLE) ? 1 : 0;
+    m_uniform.lodSelection = m_lodSelection ? 1 : 0;
+    m_uniform.hizWidth = m_hizWidth;
+    m_uniform.hizHeight = m_hizHeight;
+    m_uniform.hizMipLevels = m_hizMipLevels;
+    Tools::mapMemory(m_uniformMemory, sizeof(Uniform), &m_uniform);
+
+    // 和Primitive::selectLod一致: 误差投影不超过maxPixelError的最小距离
+    for(uint32_t i = 0; i < m_groups.size(); ++i)
+    {
+        Group& group = m_groups[i];
+        for(uint32_t lod = 0; lod < m_maxLodCount; ++lod)
+        {
+            group.lodDistances[lod / 4][lod % 4] = m_groupLodErrors[i * m_maxLodCount + lod] * pixelsPerUnit / std::max(maxPixelError, 1e-4f);
+        }
+    }
+    Tools::mapMemory(m_groupMemory, m_groups.size() * sizeof(Group), m_groups.data());
+}
+
+void GpuCulling::readStatistics()
+{
+    // 下一次dispatch要覆盖的槽位是m_readbackFrameCount帧以前写入的, 已经完成, 不需要等待
+    if(m_dispatchCount >= m_readbackFrameCount)
+    {
+        m_statistics = m_pReadback[m_dispatchCount % m_readbackFrameCount];
+        m_hasStatistics = true;
+    }
+}
+
+bool GpuCulling::getStatistics(Statistics& statistics) const
+{
+    statistics = m_statistics;
+    return m_hasStatistics;
+}
+
+void GpuCulling::dispatch(VkCommandBuffer commandBuffer, OcclusionPhase phase)
+{
+    // 上一帧(或Early阶段)的间接命令和实例读取结束后才能重置
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    VkBufferCopy copyRegion = {};
+    copyRegion.size = m_drawCommands.size() * sizeof(VkDrawIndexedIndirectCommand);
+    vkCmdCopyBuffer(commandBuffer, m_drawTemplateBuffer, m_indirectBuffer, 1, &copyRegion);
+    //统计只在Late阶段累加
+    if(phase != LatePhase)
+    {
+        vkCmdFillBuffer(commandBuffer, m_statisticsBuffer, 0, sizeof(Statistics), 0);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    uint32_t groupCount = (m_instanceCount + m_workGroupSize - 1) / m_workGroupSize;
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+    uint32_t phaseValue = static_cast<uint32_t>(phase);
+    vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &phaseValue);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+    vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_prefixPipeline);
+    vkCmdDispatch(commandBuffer, 1, 1, 1);
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_scatterPipeline);
+    vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    if(phase == EarlyPhase)
+    {
+        return ;
+    }
+
+    //统计拷贝到本帧的回读槽位, 几帧后在update里读取
+    copyRegion.srcOffset = 0;
+    copyRegion.dstOffset = (m_dispatchCount % m_readbackFrameCount) * sizeof(Statistics);
+    copyRegion.size = sizeof(Statistics);
+    vkCmdCopyBuffer(commandBuffer, m_statisticsBuffer, m_readbackBuffer, 1, &copyRegion);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    m_dispatchCount++;
+}
+
+void GpuCulling::bindInstanceBuffer(VkCommandBuffer commandBuffer, uint32_t binding)
+{
+    const VkDeviceSize offsets[1] = {0};
+    vkCmdBindVertexBuffers(commandBuffer, binding, 1, &m_instanceBuffer, offsets);
+}
+
+void GpuCulling::draw(VkCommandBuffer commandBuffer, bool multiDrawIndirect)
+{
+    uint32_t commandCount = static_cast<uint32_t>(m_drawCommands.size());
+    if(multiDrawIndirect)
+    {
+        vkCmdDrawIndexedIndirect(commandBuffer, m_indirectBuffer, 0, commandCount, sizeof(VkDrawIndexedIndirectCommand));
+    }
+    else
+    {
+        for(uint32_t i = 0; i < commandCount; ++i)
+        {
+            vkCmdDrawIndexedIndirect(commandBuffer, m_indirectBuffer, i * sizeof(VkDrawIndexedIndirectCommand), 1, sizeof(VkDrawIndexedIndirectCommand));
+        }
+    }
+}
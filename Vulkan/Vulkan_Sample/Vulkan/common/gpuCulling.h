@@ -0,0 +1,140 @@
+
+#pragma once
+
+#include "tools.h"
+#include "gltfLoader.h"
+#include "frustum.h"
+#include "hiZPyramid.h"
+
+// 通用的GPU实例剔除: 每个实例一个世界空间包围球, compute shader做视锥/Hi-Z遮挡剔除并按距离选LOD,
+// 可见实例原子压缩写入输出实例buffer, 每个(组, LOD)一条VkDrawIndexedIndirectCommand.
+// 分三步: 剔除并计数 -> 前缀和分配firstInstance -> 按槽位拷贝实例数据.
+// 可见/剔除数量拷贝到host可见的环形buffer, 几帧后再读, 不等待GPU
+class GpuCulling
+{
+public:
+    // 实例的世界空间包围球, extents.w不为0时用中心为sphere.xyz, 半边长为extents.xyz的包围盒.
+    // lodScale为实例缩放, 选LOD时距离除以它
+    struct Bounds {
+        glm::vec4 sphere;
+        glm::vec4 extents = glm::vec4(0.0f);
+        uint32_t group;
+        float lodScale;
+        uint32_t padding[2];
+    };
+
+    // 一种网格, 每级LOD对应一条命令, lodDistances为选中每一级的最小距离
+    struct Group {
+        uint32_t firstCommand;
+        uint32_t lodCount;
+        uint32_t padding[2];
+        glm::vec4 lodDistances[2];
+    };
+
+    struct Uniform {
+        glm::vec4 frustumPlanes[6];
+        glm::mat4 viewProjMatrix;
+        glm::vec4 cameraPos;
+        uint32_t instanceCount;
+        uint32_t commandCount;
+        uint32_t frustumCulling;
+        uint32_t occlusionCulling;
+        uint32_t lodSelection;
+        uint32_t hizWidth;
+        uint32_t hizHeight;
+        uint32_t hizMipLevels;
+    };
+
+    struct Statistics {
+        uint32_t visible;
+        uint32_t frustumCulled;
+        uint32_t occlusionCulled;
+        uint32_t padding;
+    };
+
+    GpuCulling();
+    ~GpuCulling();
+    void clear();
+
+    // 返回组序号, 包围球由primitive实际引用的顶点计算(顶点坐标空间)
+    uint32_t addGroup(GltfLoader* pLoader, Primitive* primitive);
+    // instanceData为实例数据, 大小为instanceStride的整数倍且stride是16的倍数, 顺序和bounds一致
+    void prepare(const void* instanceData, uint32_t instanceStride, const std::vector<Bounds>& bounds, VkQueue queue, VkPipelineCache pipelineCache);
+    // Hi-Z金字塔, 每个texel的r为覆盖区域的最远深度, 设置后才会做遮挡剔除. 需要在GPU空闲时调用
+    void setHiZ(VkImageView imageView, VkSampler sampler, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_GENERAL);
+    void update(const glm::mat4& viewProjMatrix, const glm::vec3& cameraPos, float pixelsPerUnit, float maxPixelError);
+    // 两阶段时Early在render pass之前, Late在Hi-Z建好之后, 每次dispatch之后draw一次
+    void dispatch(VkCommandBuffer commandBuffer, OcclusionPhase phase = SinglePhase);
+    // 调用者已经绑定pipeline, 顶点和索引buffer
+    void bindInstanceBuffer(VkCommandBuffer commandBuffer, uint32_t binding);
+    void draw(VkCommandBuffer commandBuffer, bool multiDrawIndirect);
+    // 最近一次已完成的统计, 还没有结果时返回false
+    bool getStatistics(Statistics& statistics) const;
+
+private:
+    void createBuffers(const void* instanceData, const std::vector<Bounds>& bounds, VkQueue queue);
+    void createDescriptorSet(VkQueue queue);
+    void createComputePipelines(VkPipelineCache pipelineCache);
+    void readStatistics();
+
+public:
+    static const uint32_t m_workGroupSize = 64;
+    static const uint32_t m_maxLodCount = 8;
+    static const uint32_t m_readbackFrameCount = 4;    //不小于同时在飞的帧数+1
+
+    bool m_frustumCulling = true;
+    bool m_occlusionCulling = true;
+    bool m_lodSelection = true;
+
+    std::vector<Group> m_groups;
+    std::vector<Primitive*> m_groupPrimitives;
+    std::vector<glm::vec4> m_groupSpheres;
+    std::vector<float> m_groupLodErrors;                //每组m_maxLodCount个
+    std::vector<VkDrawIndexedIndirectCommand> m_drawCommands;
+    uint32_t m_instanceCount = 0;
+    uint32_t m_instanceStride = 0;
+
+    Frustum m_frustum;
+    Uniform m_uniform = {};
+    Statistics m_statistics = {};
+    bool m_hasStatistics = false;
+    uint64_t m_dispatchCount = 0;
+
+    VkBuffer m_boundsBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_boundsMemory = VK_NULL_HANDLE;
+    VkBuffer m_groupBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_groupMemory = VK_NULL_HANDLE;
+    VkBuffer m_srcInstanceBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_srcInstanceMemory = VK_NULL_HANDLE;
+    VkBuffer m_instanceBuffer = VK_NULL_HANDLE;         //压缩后的可见实例, 作为实例顶点buffer
+    VkDeviceMemory m_instanceMemory = VK_NULL_HANDLE;
+    VkBuffer m_visibilityBuffer = VK_NULL_HANDLE;       //每个实例(命令, 槽位)
+    VkDeviceMemory m_visibilityMemory = VK_NULL_HANDLE;
+    VkBuffer m_lastVisibleBuffer = VK_NULL_HANDLE;      //每个实例上一帧是否可见, 两阶段剔除用
+    VkDeviceMemory m_lastVisibleMemory = VK_NULL_HANDLE;
+    VkBuffer m_drawTemplateBuffer = VK_NULL_HANDLE;     //instanceCount为0的命令, 每帧拷贝重置
+    VkDeviceMemory m_drawTemplateMemory = VK_NULL_HANDLE;
+    VkBuffer m_indirectBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_indirectMemory = VK_NULL_HANDLE;
+    VkBuffer m_statisticsBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_statisticsMemory = VK_NULL_HANDLE;
+    VkBuffer m_readbackBuffer = VK_NULL_HANDLE;         //m_readbackFrameCount份Statistics, 一直映射
+    VkDeviceMemory m_readbackMemory = VK_NULL_HANDLE;
+    Statistics* m_pReadback = nullptr;
+    VkBuffer m_uniformBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_uniformMemory = VK_NULL_HANDLE;
+
+    Texture* m_pHiZPlaceholder = nullptr;
+    VkImageView m_hizImageView = VK_NULL_HANDLE;
+    uint32_t m_hizWidth = 0;
+    uint32_t m_hizHeight = 0;
+    uint32_t m_hizMipLevels = 0;
+
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_cullPipeline = VK_NULL_HANDLE;
+    VkPipeline m_prefixPipeline = VK_NULL_HANDLE;
+    VkPipeline m_scatterPipeline = VK_NULL_HANDLE;
+};
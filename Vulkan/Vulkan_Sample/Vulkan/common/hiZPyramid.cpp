@@ -0,0 +1,229 @@
+
+#include "hiZPyramid.h"
+
+HiZPyramid::HiZPyramid()
+{
+}
+
+HiZPyramid::~HiZPyramid()
+{}
+
+void HiZPyramid::clear()
+{
+    vkDestroyPipeline(Tools::m_device, m_pipeline, nullptr);
+    vkDestroyPipelineLayout(Tools::m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(Tools::m_device, m_descriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(Tools::m_device, m_descriptorPool, nullptr);
+
+    vkDestroySampler(Tools::m_device, m_sampler, nullptr);
+    for(VkImageView view : m_mipViews)
+    {
+        vkDestroyImageView(Tools::m_device, view, nullptr);
+    }
+    m_mipViews.clear();
+    vkDestroyImageView(Tools::m_device, m_imageView, nullptr);
+    vkDestroyImage(Tools::m_device, m_image, nullptr);
+    vkFreeMemory(Tools::m_device, m_memory, nullptr);
+
+    vkDestroySampler(Tools::m_device, m_depthSampler, nullptr);
+    vkDestroyImageView(Tools::m_device, m_depthView, nullptr);
+}
+
+void HiZPyramid::prepare(VkImage depthImage, VkFormat depthFormat, uint32_t width, uint32_t height, VkPipelineCache pipelineCache)
+{
+    m_depthImage = depthImage;
+    m_depthFormat = depthFormat;
+    m_depthWidth = width;
+    m_depthHeight = height;
+
+    createPyramid();
+    createDescriptorSets();
+    createComputePipeline(pipelineCache);
+}
+
+void HiZPyramid::createPyramid()
+{
+    // 第0级向下取整到一半, 奇数边多出的一行/列并入最后一个texel
+    m_width = std::max(1u, m_depthWidth / 2);
+    m_height = std::max(1u, m_depthHeight / 2);
+    m_mipLevels = static_cast<uint32_t>(floor(log2(std::max(m_width, m_height)))) + 1;
+
+    Tools::createImageAndMemoryThenBind(VK_FORMAT_R32G32_SFLOAT, m_width, m_height, m_mipLevels, 1, VK_SAMPLE_COUNT_1_BIT,
+                                        VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_TILING_OPTIMAL,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_image, m_memory);
+    Tools::createImageView(m_image, VK_FORMAT_R32G32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, m_mipLevels, 1, m_imageView);
+
+    m_mipViews.resize(m_mipLevels);
+    for(uint32_t i = 0; i < m_mipLevels; ++i)
+    {
+        VkImageViewCreateInfo createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        createInfo.image = m_image;
+        createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        createInfo.format = VK_FORMAT_R32G32_SFLOAT;
+        createInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        createInfo.subresourceRange.baseMipLevel = i;
+        createInfo.subresourceRange.levelCount = 1;
+        createInfo.subresourceRange.baseArrayLayer = 0;
+        createInfo.subresourceRange.layerCount = 1;
+        VK_CHECK_RESULT(vkCreateImageView(Tools::m_device, &createInfo, nullptr, &m_mipViews[i]));
+    }
+
+    Tools::createImageView(m_depthImage, m_depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1, 1, m_depthView);
+
+    VkSamplerCreateInfo samplerInfo = {};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.anisotropyEnable = VK_FALSE;
+    samplerInfo.maxAnisotropy = 1.0f;
+    samplerInfo.compareEnable = VK_FALSE;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = static_cast<float>(m_mipLevels);
+    samplerInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    VK_CHECK_RESULT(vkCreateSampler(Tools::m_device, &samplerInfo, nullptr, &m_sampler));
+    samplerInfo.maxLod = 0.0f;
+    VK_CHECK_RESULT(vkCreateSampler(Tools::m_device, &samplerInfo, nullptr, &m_depthSampler));
+
+    VkCommandBuffer cmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    VkImageSubresourceRange range = {VK_IMAGE_ASPECT_COLOR_BIT, 0, m_mipLevels, 0, 1};
+    Tools::setImageLayout(cmd, m_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, range);
+    Tools::flushCommandBuffer(cmd, Tools::m_graphicsQueue, true);
+}
+
+void HiZPyramid::createDescriptorSets()
+{
+    std::array<VkDescriptorPoolSize, 2> poolSizes;
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = m_mipLevels;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = 2 * m_mipLevels;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = 0;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = m_mipLevels;
+    VK_CHECK_RESULT(vkCreateDescriptorPool(Tools::m_device, &poolInfo, nullptr, &m_descriptorPool));
+
+    std::array<VkDescriptorSetLayoutBinding, 3> bindings;
+    bindings[0] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0);
+    bindings[1] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1);
+    bindings[2] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 2);
+    VkDescriptorSetLayoutCreateInfo layoutInfo = Tools::getDescriptorSetLayoutCreateInfo(bindings.data(), static_cast<uint32_t>(bindings.size()));
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(Tools::m_device, &layoutInfo, nullptr, &m_descriptorSetLayout));
+
+    //第i级从第i-1级读, 第0级从深度读, 它的src绑定不会被访问
+    m_descriptorSets.resize(m_mipLevels);
+    for(uint32_t i = 0; i < m_mipLevels; ++i)
+    {
+        Tools::allocateDescriptorSets(m_descriptorPool, &m_descriptorSetLayout, 1, m_descriptorSets[i]);
+
+        VkDescriptorImageInfo depthInfo = {m_depthSampler, m_depthView, VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL};
+        VkDescriptorImageInfo srcInfo = {VK_NULL_HANDLE, m_mipViews[i > 0 ? i - 1 : 0], VK_IMAGE_LAYOUT_GENERAL};
+        VkDescriptorImageInfo dstInfo = {VK_NULL_HANDLE, m_mipViews[i], VK_IMAGE_LAYOUT_GENERAL};
+
+        std::array<VkWriteDescriptorSet, 3> writes;
+        writes[0] = Tools::getWriteDescriptorSet(m_descriptorSets[i], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &depthInfo);
+        writes[1] = Tools::getWriteDescriptorSet(m_descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, &srcInfo);
+        writes[2] = Tools::getWriteDescriptorSet(m_descriptorSets[i], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2, &dstInfo);
+        vkUpdateDescriptorSets(Tools::m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+}
+
+void HiZPyramid::createComputePipeline(VkPipelineCache pipelineCache)
+{
+    VkPushConstantRange pushConstantRange = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstant)};
+
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &m_descriptorSetLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(Tools::m_device, &layoutInfo, nullptr, &m_pipelineLayout));
+
+    VkShaderModule compModule = Tools::createShaderModule( Tools::getShaderPath() + "base/hizreduce.comp.spv");
+
+    VkComputePipelineCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    createInfo.layout = m_pipelineLayout;
+    createInfo.flags = 0;
+    createInfo.stage = Tools::getPipelineShaderStageCreateInfo(compModule, VK_SHADER_STAGE_COMPUTE_BIT);
+
+    if( vkCreateComputePipelines(Tools::m_device, pipelineCache, 1, &createInfo, nullptr, &m_pipeline) != VK_SUCCESS )
+    {
+        throw std::runtime_error("failed to create hiz pipeline!");
+    }
+
+    vkDestroyShaderModule(Tools::m_device, compModule, nullptr);
+}
+
+void HiZPyramid::build(VkCommandBuffer commandBuffer)
+{
+    VkImageAspectFlags depthAspect = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if(m_depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || m_depthFormat == VK_FORMAT_D24_UNORM_S8_UINT)
+    {
+        depthAspect |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+
+    // 深度写入结束后转为只读, 金字塔上一次的读取(剔除)结束后才能覆盖
+    std::array<VkImageMemoryBarrier, 2> barriers = {};
+    barriers[0].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barriers[0].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    barriers[0].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[0].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[0].image = m_depthImage;
+    barriers[0].subresourceRange = {depthAspect, 0, 1, 0, 1};
+
+    barriers[1].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barriers[1].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barriers[1].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[1].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[1].image = m_image;
+    barriers[1].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, m_mipLevels, 0, 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+
+    PushConstant pushConstant = {};
+    pushConstant.srcSize = glm::ivec2(m_depthWidth, m_depthHeight);
+    for(uint32_t i = 0; i < m_mipLevels; ++i)
+    {
+        pushConstant.dstSize = glm::ivec2(std::max(1u, m_width >> i), std::max(1u, m_height >> i));
+        pushConstant.fromDepth = i == 0 ? 1 : 0;
+
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSets[i], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstant), &pushConstant);
+        vkCmdDispatch(commandBuffer, (pushConstant.dstSize.x + m_workGroupSize - 1) / m_workGroupSize, (pushConstant.dstSize.y + m_workGroupSize - 1) / m_workGroupSize, 1);
+
+        //下一级读这一级
+        VkImageMemoryBarrier mipBarrier = barriers[1];
+        mipBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        mipBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        mipBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1};
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
+
+        pushConstant.srcSize = pushConstant.dstSize;
+    }
+
+    // 后面的render pass继续使用深度
+    barriers[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    barriers[0].oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+    barriers[0].newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barriers[0]);
+
+    m_isBuilt = true;
+}
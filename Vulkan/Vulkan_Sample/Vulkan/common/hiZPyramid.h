@@ -0,0 +1,60 @@
+
+#pragma once
+
+#include "tools.h"
+
+// 两阶段遮挡剔除: Early只画上一帧可见的物体, 用它们的深度建Hi-Z, Late测试全部物体, 补画新出现的并记录可见性.
+// SinglePhase直接用已有的Hi-Z
+enum OcclusionPhase { SinglePhase, EarlyPhase, LatePhase };
+
+// 深度金字塔: 第0级是深度图的一半大小, 每个texel保存覆盖区域的(最远, 最近)深度, 每级一次dispatch.
+// 用于GPU遮挡剔除, 金字塔一直处于VK_IMAGE_LAYOUT_GENERAL.
+// 深度附件需要m_depthSampled, build时在DEPTH_STENCIL_ATTACHMENT_OPTIMAL和只读布局之间切换
+class HiZPyramid
+{
+public:
+    struct PushConstant {
+        glm::ivec2 srcSize;
+        glm::ivec2 dstSize;
+        uint32_t fromDepth;
+    };
+
+    HiZPyramid();
+    ~HiZPyramid();
+    void clear();
+
+    void prepare(VkImage depthImage, VkFormat depthFormat, uint32_t width, uint32_t height, VkPipelineCache pipelineCache);
+    // 在render pass之外调用
+    void build(VkCommandBuffer commandBuffer);
+
+private:
+    void createPyramid();
+    void createDescriptorSets();
+    void createComputePipeline(VkPipelineCache pipelineCache);
+
+public:
+    static const uint32_t m_workGroupSize = 8;
+
+    VkImage m_depthImage = VK_NULL_HANDLE;
+    VkFormat m_depthFormat = VK_FORMAT_D32_SFLOAT;
+    uint32_t m_depthWidth = 0;
+    uint32_t m_depthHeight = 0;
+    VkImageView m_depthView = VK_NULL_HANDLE;           //只有深度aspect, 用于采样
+    VkSampler m_depthSampler = VK_NULL_HANDLE;
+
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_mipLevels = 0;
+    VkImage m_image = VK_NULL_HANDLE;
+    VkDeviceMemory m_memory = VK_NULL_HANDLE;
+    VkImageView m_imageView = VK_NULL_HANDLE;           //所有mip, 剔除时采样
+    std::vector<VkImageView> m_mipViews;                //每级一个, 作为storage image
+    VkSampler m_sampler = VK_NULL_HANDLE;               //最近点采样, 不做mip间插值
+    bool m_isBuilt = false;
+
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> m_descriptorSets;      //每级一个
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+};
@@ -0,0 +1,361 @@
+
+#include "indirectScene.h"
+
+// 通过staging buffer上传到device local的buffer
+static void createDeviceLocalBuffer(VkQueue queue, const void* data, VkDeviceSize size, VkBufferUsageFlags usage, VkBuffer& buffer, VkDeviceMemory& memory)
+{
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    Tools::createBufferAndMemoryThenBind(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingMemory);
+    Tools::mapMemory(stagingMemory, size, const_cast<void*>(data));
+    Tools::createBufferAndMemoryThenBind(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+
+    VkCommandBuffer copyCmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    VkBufferCopy copyRegion = {};
+    copyRegion.size = size;
+    vkCmdCopyBuffer(copyCmd, stagingBuffer, buffer, 1, &copyRegion);
+    Tools::flushCommandBuffer(copyCmd, queue, true);
+
+    vkDestroyBuffer(Tools::m_device, stagingBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, stagingMemory, nullptr);
+}
+
+IndirectScene::IndirectScene()
+{
+}
+
+IndirectScene::~IndirectScene()
+{}
+
+void IndirectScene::clear()
+{
+    vkDestroyDescriptorSetLayout(Tools::m_device, m_descriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(Tools::m_device, m_descriptorPool, nullptr);
+
+    vkFreeMemory(Tools::m_device, m_regionMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_regionBuffer, nullptr);
+    m_textureAtlas.clear();
+    vkFreeMemory(Tools::m_device, m_materialMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_materialBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_matrixMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_matrixBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_drawDataMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_drawDataBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_countMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_countBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, m_indirectMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_indirectBuffer, nullptr);
+}
+
+void IndirectScene::prepare(GltfLoader* pLoader, bool useDrawIndirectCount, bool packTextures, bool releaseSources)
+{
+    assert(pLoader && pLoader->getIndexCount() > 0);
+    m_pLoader = pLoader;
+
+    //需要设备启用VK_KHR_draw_indirect_count
+    m_useDrawIndirectCount = useDrawIndirectCount;
+    if(m_useDrawIndirectCount)
+    {
+        m_vkCmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(Tools::m_device, "vkCmdDrawIndexedIndirectCountKHR"));
+        m_useDrawIndirectCount = m_vkCmdDrawIndexedIndirectCount != nullptr;
+    }
+
+    buildDraws();
+    m_isTexturePacked = packTextures;
+    if(m_isTexturePacked)
+    {
+        this->packTextures(releaseSources);
+    }
+    createBuffers();
+    createDescriptorSet();
+}
+
+void IndirectScene::buildDraws()
+{
+    m_drawCommands.clear();
+    m_drawData.clear();
+    m_matrixSources.clear();
+    m_materialData.clear();
+    m_textures.clear();
+
+    //材质和纹理表, 纹理按指针去重
+    auto textureIndex = [this](Texture* texture) {
+        if(texture == nullptr)
+        {
+            texture = m_pLoader->m_emptyTexture;
+        }
+        assert(texture);
+        auto it = std::find(m_textures.begin(), m_textures.end(), texture);
+        if(it != m_textures.end())
+        {
+            return static_cast<uint32_t>(it - m_textures.begin());
+        }
+        m_textures.push_back(texture);
+        return static_cast<uint32_t>(m_textures.size() - 1);
+    };
+
+    for(Material* mat : m_pLoader->m_materials)
+    {
+        MaterialData materialData = {};
+        materialData.baseColorTexture = textureIndex(mat->m_pBaseColorTexture);
+        materialData.normalTexture = textureIndex(mat->m_pNormalTexture);
+        materialData.alphaCutoff = mat->m_alphaCutoff;
+        m_materialData.push_back(materialData);
+    }
+
+    //先按桶收集, 再拼成连续的命令数组
+    const bool quantize = m_pLoader->getLoadFlags() & GltfFileLoadFlags::QuantizeVertices;
+    std::vector<VkDrawIndexedIndirectCommand> bucketCommands[BucketCount];
+    std::vector<DrawData> bucketData[BucketCount];
+    for(GltfNode* node : m_pLoader->m_linearNodes)
+    {
+        if(node->m_mesh == nullptr)
+        {
+            continue;
+        }
+
+        //不压缩顶点时同一结点的primitive共用一个矩阵
+        uint32_t nodeMatrix = static_cast<uint32_t>(m_matrixSources.size());
+        if(!quantize)
+        {
+            m_matrixSources.push_back(std::make_pair(node, nullptr));
+        }
+
+        for(Primitive* primitive : node->m_mesh->m_primitives)
+        {
+            if(primitive->m_indexCount == 0)
+            {
+                continue;
+            }
+
+            Material* mat = primitive->m_material;
+            BucketType bucket = Opaque;
+            if(mat && mat->m_alphaMode == Material::MASK)
+            {
+                bucket = Mask;
+            }
+            else if(mat && mat->m_alphaMode == Material::BLEND)
+            {
+                bucket = Blend;
+            }
+
+            DrawData drawData = {};
+            drawData.matrixIndex = nodeMatrix;
+            if(quantize)
+            {
+                drawData.matrixIndex = static_cast<uint32_t>(m_matrixSources.size());
+                m_matrixSources.push_back(std::make_pair(node, primitive));
+            }
+            auto it = std::find(m_pLoader->m_materials.begin(), m_pLoader->m_materials.end(), mat);
+            drawData.materialIndex = it == m_pLoader->m_materials.end() ? 0 : static_cast<uint32_t>(it - m_pLoader->m_materials.begin());
+
+            VkDrawIndexedIndirectCommand command = {};
+            command.indexCount = primitive->m_indexCount;
+            command.instanceCount = 1;
+            command.firstIndex = primitive->m_indexOffset;
+            command.vertexOffset = m_pLoader->m_isLocalIndex ? primitive->m_vertexOffset : 0;
+            bucketCommands[bucket].push_back(command);
+            bucketData[bucket].push_back(drawData);
+        }
+    }
+
+    for(uint32_t i = 0; i < BucketCount; ++i)
+    {
+        m_buckets[i].firstDraw = static_cast<uint32_t>(m_drawCommands.size());
+        m_buckets[i].drawCount = static_cast<uint32_t>(bucketCommands[i].size());
+        m_drawCommands.insert(m_drawCommands.end(), bucketCommands[i].begin(), bucketCommands[i].end());
+        m_drawData.insert(m_drawData.end(), bucketData[i].begin(), bucketData[i].end());
+    }
+
+    //firstInstance即绘制序号, 顶点着色器用gl_InstanceIndex取DrawData
+    for(uint32_t i = 0; i < m_drawCommands.size(); ++i)
+    {
+        m_drawCommands[i].firstInstance = i;
+    }
+
+    m_matrices.resize(m_matrixSources.size());
+}
+
+// 材质表里的纹理下标不变, 改为查Region表, 所以按m_textures的顺序加入
+void IndirectScene::packTextures(bool releaseSources)
+{
+    for(Texture* texture : m_textures)
+    {
+        m_textureAtlas.add(texture);
+    }
+    m_textureAtlas.build(m_pLoader->m_graphicsQueue);
+
+    //缺省纹理由ResourceCache共享, 不能释放
+    if(releaseSources)
+    {
+        m_textureAtlas.releaseSources({m_pLoader->m_emptyTexture});
+    }
+    m_textures = m_textureAtlas.m_pages;
+}
+
+void IndirectScene::createBuffers()
+{
+    VkQueue queue = m_pLoader->m_graphicsQueue;
+    createDeviceLocalBuffer(queue, m_drawCommands.data(), m_drawCommands.size() * sizeof(VkDrawIndexedIndirectCommand),
+                            VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, m_indirectBuffer, m_indirectMemory);
+    createDeviceLocalBuffer(queue, m_drawData.data(), m_drawData.size() * sizeof(DrawData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, m_drawDataBuffer, m_drawDataMemory);
+    createDeviceLocalBuffer(queue, m_materialData.data(), m_materialData.size() * sizeof(MaterialData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, m_materialBuffer, m_materialMemory);
+    if(m_isTexturePacked)
+    {
+        const std::vector<TextureAtlas::Region>& regions = m_textureAtlas.m_regions;
+        createDeviceLocalBuffer(queue, regions.data(), regions.size() * sizeof(TextureAtlas::Region), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, m_regionBuffer, m_regionMemory);
+    }
+
+    //数量先填满, 以后可以由剔除的compute shader写入
+    uint32_t counts[BucketCount];
+    for(uint32_t i = 0; i < BucketCount; ++i)
+    {
+        counts[i] = m_buckets[i].drawCount;
+    }
+    createDeviceLocalBuffer(queue, counts, sizeof(counts), VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, m_countBuffer, m_countMemory);
+
+    VkDeviceSize matrixSize = std::max<size_t>(m_matrices.size(), 1) * sizeof(glm::mat4);
+    Tools::createBufferAndMemoryThenBind(matrixSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_matrixBuffer, m_matrixMemory);
+    updateMatrices();
+}
+
+void IndirectScene::updateMatrices()
+{
+    //和GltfLoader::draw一致: 预变换时顶点已在世界空间
+    const bool preTransform = m_pLoader->getLoadFlags() & GltfFileLoadFlags::PreTransformVertices;
+    for(size_t i = 0; i < m_matrixSources.size(); ++i)
+    {
+        GltfNode* node = m_matrixSources[i].first;
+        Primitive* primitive = m_matrixSources[i].second;
+        glm::mat4 modelMatrix = preTransform ? glm::mat4(1.0f) : node->m_worldMatrix;
+        m_matrices[i] = primitive ? modelMatrix * primitive->m_dequantMatrix : modelMatrix;
+    }
+
+    if(m_matrices.size() > 0)
+    {
+        Tools::mapMemory(m_matrixMemory, m_matrices.size() * sizeof(glm::mat4), m_matrices.data());
+    }
+}
+
+void IndirectScene::createDescriptorSet()
+{
+    uint32_t textureCount = static_cast<uint32_t>(m_textures.size());
+    uint32_t bufferCount = m_isTexturePacked ? 4 : 3;
+
+    std::array<VkDescriptorPoolSize, 2> poolSizes;
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = bufferCount;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = textureCount;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = 0;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = 1;
+    VK_CHECK_RESULT(vkCreateDescriptorPool(Tools::m_device, &poolInfo, nullptr, &m_descriptorPool));
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings(4);
+    bindings[0] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0);
+    bindings[1] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 1);
+    bindings[2] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 2);
+    bindings[3] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3, textureCount);
+    if(m_isTexturePacked)
+    {
+        bindings.push_back(Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_FRAGMENT_BIT, 4));
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfo = Tools::getDescriptorSetLayoutCreateInfo(bindings.data(), static_cast<uint32_t>(bindings.size()));
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(Tools::m_device, &layoutInfo, nullptr, &m_descriptorSetLayout));
+
+    Tools::allocateDescriptorSets(m_descriptorPool, &m_descriptorSetLayout, 1, m_descriptorSet);
+
+    VkDescriptorBufferInfo bufferInfos[4] = {};
+    bufferInfos[0].buffer = m_matrixBuffer;
+    bufferInfos[0].range = VK_WHOLE_SIZE;
+    bufferInfos[1].buffer = m_drawDataBuffer;
+    bufferInfos[1].range = VK_WHOLE_SIZE;
+    bufferInfos[2].buffer = m_materialBuffer;
+    bufferInfos[2].range = VK_WHOLE_SIZE;
+    bufferInfos[3].buffer = m_regionBuffer;
+    bufferInfos[3].range = VK_WHOLE_SIZE;
+
+    std::vector<VkDescriptorImageInfo> imageInfos;
+    for(Texture* texture : m_textures)
+    {
+        imageInfos.push_back(texture->getDescriptorImageInfo());
+    }
+
+    std::vector<VkWriteDescriptorSet> writes;
+    for(uint32_t i = 0; i < 3; ++i)
+    {
+        writes.push_back(Tools::getWriteDescriptorSet(m_descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, i, &bufferInfos[i]));
+    }
+    writes.push_back(Tools::getWriteDescriptorSet(m_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, imageInfos.data(), textureCount));
+    if(m_isTexturePacked)
+    {
+        writes.push_back(Tools::getWriteDescriptorSet(m_descriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4, &bufferInfos[3]));
+    }
+    vkUpdateDescriptorSets(Tools::m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
+
+void IndirectScene::updateTexture(Texture* texture)
+{
+    if(m_isTexturePacked)
+    {
+        return ;
+    }
+
+    auto it = std::find(m_textures.begin(), m_textures.end(), texture);
+    if(it == m_textures.end())
+    {
+        return ;
+    }
+
+    VkDescriptorImageInfo imageInfo = texture->getDescriptorImageInfo();
+    VkWriteDescriptorSet write = Tools::getWriteDescriptorSet(m_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &imageInfo);
+    write.dstArrayElement = static_cast<uint32_t>(it - m_textures.begin());
+    vkUpdateDescriptorSets(Tools::m_device, 1, &write, 0, nullptr);
+}
+
+void IndirectScene::bindBuffers(VkCommandBuffer commandBuffer)
+{
+    m_pLoader->bindBuffers(commandBuffer);
+}
+
+void IndirectScene::draw(VkCommandBuffer commandBuffer, const VkPipelineLayout& pipelineLayout, uint32_t set)
+{
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, set, 1, &m_descriptorSet, 0, nullptr);
+
+    //间接命令的firstInstance不为0需要drawIndirectFirstInstance
+    const bool useFirstInstance = Tools::m_deviceEnabledFeatures.drawIndirectFirstInstance;
+    const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+    for(uint32_t i = 0; i < BucketCount; ++i)
+    {
+        const Bucket& bucket = m_buckets[i];
+        if(bucket.drawCount == 0 || bucket.pipeline == VK_NULL_HANDLE)
+        {
+            continue;
+        }
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, bucket.pipeline);
+        VkDeviceSize offset = bucket.firstDraw * stride;
+        if(useFirstInstance && m_useDrawIndirectCount)
+        {
+            m_vkCmdDrawIndexedIndirectCount(commandBuffer, m_indirectBuffer, offset, m_countBuffer, i * sizeof(uint32_t), bucket.drawCount, stride);
+        }
+        else if(useFirstInstance && Tools::m_deviceEnabledFeatures.multiDrawIndirect)
+        {
+            vkCmdDrawIndexedIndirect(commandBuffer, m_indirectBuffer, offset, bucket.drawCount, stride);
+        }
+        else
+        {
+            //不支持时退回逐个绘制, 直接绘制的firstInstance没有限制
+            for(uint32_t j = bucket.firstDraw; j < bucket.firstDraw + bucket.drawCount; ++j)
+            {
+                const VkDrawIndexedIndirectCommand& command = m_drawCommands[j];
+                vkCmdDrawIndexed(commandBuffer, command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+            }
+        }
+    }
+}
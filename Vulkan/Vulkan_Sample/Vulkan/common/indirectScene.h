@@ -0,0 +1,89 @@
+
+#pragma once
+
+#include "tools.h"
+#include "gltfLoader.h"
+#include "textureAtlas.h"
+
+// 整个glTF场景的多重间接绘制: 每个primitive一条VkDrawIndexedIndirectCommand, firstInstance为绘制序号,
+// shader用gl_InstanceIndex读取每次绘制的数据(矩阵下标, 材质下标), 材质纹理放在一个sampler数组里.
+// 绘制按材质的alpha模式分桶, 每个桶一次vkCmdDrawIndexedIndirect(支持时用drawIndirectCount, 数量从count buffer读取).
+// 打包纹理时材质纹理合并成数组和图集(见textureAtlas.h), sampler数组里只剩几页, 材质里的下标改为查TextureAtlas::Region表
+class IndirectScene
+{
+public:
+    enum BucketType { Opaque, Mask, Blend, BucketCount };
+
+    struct DrawData {
+        uint32_t matrixIndex;
+        uint32_t materialIndex;
+        uint32_t padding[2];
+    };
+
+    struct MaterialData {
+        uint32_t baseColorTexture;  //m_textures中的下标
+        uint32_t normalTexture;
+        float alphaCutoff;
+        uint32_t padding;
+    };
+
+    struct Bucket {
+        uint32_t firstDraw;
+        uint32_t drawCount;
+        VkPipeline pipeline;
+    };
+
+    IndirectScene();
+    ~IndirectScene();
+    void clear();
+
+    // 需要在创建pipeline之前调用, pipeline layout要包含m_descriptorSetLayout, 纹理数组大小为m_textures.size().
+    // packTextures时默认在打包后释放原来的纹理, 不能再和纹理流送一起使用. releaseSources为false时原来的纹理保留,
+    // 图集里是打包时常驻的mip, 之后纹理流送的变化不会反映到图集
+    void prepare(GltfLoader* pLoader, bool useDrawIndirectCount, bool packTextures = false, bool releaseSources = true);
+    // 结点矩阵变化(动画)后调用
+    void updateMatrices();
+    // 纹理的image view变化(纹理流送)后重写数组里对应的描述符, 打包纹理时不起作用
+    void updateTexture(Texture* texture);
+    void bindBuffers(VkCommandBuffer commandBuffer);
+    void draw(VkCommandBuffer commandBuffer, const VkPipelineLayout& pipelineLayout, uint32_t set);
+
+private:
+    void buildDraws();
+    void packTextures(bool releaseSources);
+    void createBuffers();
+    void createDescriptorSet();
+
+public:
+    GltfLoader* m_pLoader = nullptr;
+
+    std::vector<VkDrawIndexedIndirectCommand> m_drawCommands;   //按桶排列
+    std::vector<DrawData> m_drawData;
+    std::vector<glm::mat4> m_matrices;
+    std::vector<MaterialData> m_materialData;
+    std::vector<Texture*> m_textures;                           //打包时为图集的页
+    std::vector<std::pair<GltfNode*, Primitive*>> m_matrixSources;
+    Bucket m_buckets[BucketCount] = {};
+
+    bool m_useDrawIndirectCount = false;
+    bool m_isTexturePacked = false;
+    TextureAtlas m_textureAtlas;
+    PFN_vkCmdDrawIndexedIndirectCountKHR m_vkCmdDrawIndexedIndirectCount = nullptr;
+
+    VkBuffer m_indirectBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_indirectMemory = VK_NULL_HANDLE;
+    VkBuffer m_countBuffer = VK_NULL_HANDLE;            //每个桶一个uint32
+    VkDeviceMemory m_countMemory = VK_NULL_HANDLE;
+    VkBuffer m_drawDataBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_drawDataMemory = VK_NULL_HANDLE;
+    VkBuffer m_matrixBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_matrixMemory = VK_NULL_HANDLE;
+    VkBuffer m_materialBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_materialMemory = VK_NULL_HANDLE;
+    VkBuffer m_regionBuffer = VK_NULL_HANDLE;           //打包时材质纹理在图集里的位置
+    VkDeviceMemory m_regionMemory = VK_NULL_HANDLE;
+
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+};
@@ -0,0 +1,194 @@
+
+#include "ktxFile.h"
+
+namespace
+{
+    const uint8_t ktx1Identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+    const uint8_t ktx2Identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+    // 文件里的字段不保证对齐
+    template <typename T> T readValue(const uint8_t* data, size_t offset)
+    {
+        T value;
+        memcpy(&value, data + offset, sizeof(T));
+        return value;
+    }
+
+    VkDeviceSize alignTo4(VkDeviceSize value)
+    {
+        return (value + 3) & ~static_cast<VkDeviceSize>(3);
+    }
+}
+
+KtxFile::KtxFile()
+{
+}
+
+KtxFile::~KtxFile()
+{
+    close();
+}
+
+bool KtxFile::open(const std::string& fileName)
+{
+    close();
+    if(!m_file.open(fileName))
+    {
+        return false;
+    }
+
+    if(!parse(m_file.m_data, m_file.m_size))
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+bool KtxFile::parse(const uint8_t* data, size_t size)
+{
+    m_data = data;
+    m_size = size;
+    m_levels.clear();
+    m_format = VK_FORMAT_UNDEFINED;
+
+    bool isValid = false;
+    if(size >= 64 && memcmp(data, ktx1Identifier, 12) == 0)
+    {
+        m_version = 1;
+        isValid = parseKtx1();
+    }
+    else if(size >= 80 && memcmp(data, ktx2Identifier, 12) == 0)
+    {
+        m_version = 2;
+        isValid = parseKtx2();
+    }
+
+    if(!isValid)
+    {
+        m_version = 0;
+        m_levels.clear();
+    }
+    return isValid;
+}
+
+void KtxFile::close()
+{
+    m_file.close();
+    m_data = nullptr;
+    m_size = 0;
+    m_version = 0;
+    m_levels.clear();
+}
+
+bool KtxFile::parseKtx1()
+{
+    //大端的文件需要逐个字段翻转, 交给libktx
+    if(readValue<uint32_t>(m_data, 12) != 0x04030201)
+    {
+        return false;
+    }
+
+    m_width = readValue<uint32_t>(m_data, 36);
+    m_height = std::max(1u, readValue<uint32_t>(m_data, 40));
+    m_depth = std::max(1u, readValue<uint32_t>(m_data, 44));
+    uint32_t arrayElements = readValue<uint32_t>(m_data, 48);
+    m_layerCount = std::max(1u, arrayElements);
+    m_faceCount = std::max(1u, readValue<uint32_t>(m_data, 52));
+    m_levelCount = std::max(1u, readValue<uint32_t>(m_data, 56));
+    if(m_width == 0 || (m_faceCount != 1 && m_faceCount != 6))
+    {
+        return false;
+    }
+
+    //非数组的立方体imageSize是一个面的大小, 其它情况是整个level的大小
+    bool isCubemap = m_faceCount == 6 && arrayElements == 0;
+    VkDeviceSize imageCount = static_cast<VkDeviceSize>(m_layerCount) * m_faceCount;
+    VkDeviceSize offset = 64 + static_cast<VkDeviceSize>(readValue<uint32_t>(m_data, 60));
+    for(uint32_t level = 0; level < m_levelCount; level++)
+    {
+        if(offset + 4 > m_size)
+        {
+            return false;
+        }
+
+        VkDeviceSize imageSize = readValue<uint32_t>(m_data, offset);
+        offset += 4;
+
+        Level levelInfo = {};
+        levelInfo.offset = offset;
+        if(isCubemap)
+        {
+            levelInfo.imageSize = imageSize;
+            levelInfo.imageStride = alignTo4(imageSize);
+        }
+        else
+        {
+            levelInfo.imageSize = imageSize / imageCount;
+            levelInfo.imageStride = levelInfo.imageSize;
+        }
+
+        VkDeviceSize levelSize = levelInfo.imageStride * imageCount;
+        if(offset + levelSize > m_size)
+        {
+            return false;
+        }
+
+        m_levels.push_back(levelInfo);
+        offset = alignTo4(offset + levelSize);
+    }
+    return true;
+}
+
+bool KtxFile::parseKtx2()
+{
+    //zstd/basis等超压缩需要先解压
+    if(readValue<uint32_t>(m_data, 44) != 0)
+    {
+        return false;
+    }
+
+    m_format = static_cast<VkFormat>(readValue<uint32_t>(m_data, 12));
+    m_width = readValue<uint32_t>(m_data, 20);
+    m_height = std::max(1u, readValue<uint32_t>(m_data, 24));
+    m_depth = std::max(1u, readValue<uint32_t>(m_data, 28));
+    m_layerCount = std::max(1u, readValue<uint32_t>(m_data, 32));
+    m_faceCount = std::max(1u, readValue<uint32_t>(m_data, 36));
+    m_levelCount = std::max(1u, readValue<uint32_t>(m_data, 40));
+    if(m_width == 0 || (m_faceCount != 1 && m_faceCount != 6) || 80 + static_cast<size_t>(m_levelCount) * 24 > m_size)
+    {
+        return false;
+    }
+
+    //level索引紧跟在文件头后面, 每项是byteOffset, byteLength, uncompressedByteLength
+    VkDeviceSize imageCount = static_cast<VkDeviceSize>(m_layerCount) * m_faceCount;
+    for(uint32_t level = 0; level < m_levelCount; level++)
+    {
+        VkDeviceSize byteOffset = readValue<uint64_t>(m_data, 80 + level * 24);
+        VkDeviceSize byteLength = readValue<uint64_t>(m_data, 80 + level * 24 + 8);
+        if(byteOffset + byteLength > m_size)
+        {
+            return false;
+        }
+
+        Level levelInfo = {};
+        levelInfo.offset = byteOffset;
+        levelInfo.imageSize = byteLength / imageCount;
+        levelInfo.imageStride = levelInfo.imageSize;
+        m_levels.push_back(levelInfo);
+    }
+    return true;
+}
+
+VkDeviceSize KtxFile::getImageOffset(uint32_t level, uint32_t layer, uint32_t face) const
+{
+    assert(level < m_levels.size() && layer < m_layerCount && face < m_faceCount);
+    const Level& levelInfo = m_levels[level];
+    return levelInfo.offset + (static_cast<VkDeviceSize>(layer) * m_faceCount + face) * levelInfo.imageStride;
+}
+
+VkDeviceSize KtxFile::getImageSize(uint32_t level) const
+{
+    assert(level < m_levels.size());
+    return m_levels[level].imageSize;
+}
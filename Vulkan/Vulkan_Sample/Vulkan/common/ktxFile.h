@@ -0,0 +1,49 @@
+
+#pragma once
+
+#include "tools.h"
+#include "mappedFile.h"
+
+// 自己解析KTX1/KTX2的文件头, 数据留在映射的文件里, 按(level, layer, face)取偏移, 不经过libktx的堆拷贝.
+// 只支持小端, 没有超压缩的文件, 其它情况open/parse返回false, 由调用者退回libktx
+class KtxFile
+{
+public:
+    KtxFile();
+    ~KtxFile();
+
+    bool open(const std::string& fileName);
+    // data在KtxFile使用期间必须有效
+    bool parse(const uint8_t* data, size_t size);
+    void close();
+
+    // 一张图(一个level的一个layer的一个face, 包含所有z切片)在文件里的偏移和字节数
+    VkDeviceSize getImageOffset(uint32_t level, uint32_t layer, uint32_t face) const;
+    VkDeviceSize getImageSize(uint32_t level) const;
+
+public:
+    uint32_t m_version = 0;
+    VkFormat m_format = VK_FORMAT_UNDEFINED;    //只有KTX2记录, KTX1是GL格式, 为UNDEFINED
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_depth = 1;
+    uint32_t m_layerCount = 1;
+    uint32_t m_faceCount = 1;
+    uint32_t m_levelCount = 1;
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+
+private:
+    struct Level {
+        VkDeviceSize offset;        //第一张图的偏移
+        VkDeviceSize imageSize;
+        VkDeviceSize imageStride;   //相邻layer/face的间距, KTX1非数组的立方体每个面补齐到4字节
+    };
+
+    bool parseKtx1();
+    bool parseKtx2();
+
+private:
+    std::vector<Level> m_levels;
+    MappedFile m_file;
+};
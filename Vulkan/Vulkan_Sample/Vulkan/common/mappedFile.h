@@ -0,0 +1,22 @@
+
+#pragma once
+
+#include "tools.h"
+
+// 只读映射整个文件, 页面按需调入, 数据不经过额外的拷贝
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const std::string& fileName);
+    void close();
+
+public:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+
+private:
+    int m_fd = -1;
+};
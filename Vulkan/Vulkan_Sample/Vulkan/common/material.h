@@ -41,6 +41,7 @@ public:
 public:
     AlphaMode m_alphaMode = AlphaMode::OPAQUE;
     float m_alphaCutoff = 1.0f;
+    bool m_doubleSided = false;
     float m_metallic = 1.0f;
     float m_roughness = 1.0f;
     glm::vec4 m_baseColor = glm::vec4(1.0f);
@@ -48,7 +49,7 @@ public:
     Texture* m_pNormalTexture = nullptr;
     
 public:
-    VkDescriptorSet m_descriptorSet;
-    VkPipeline m_graphicsPipeline;
+    VkDescriptorSet m_descriptorSet = VK_NULL_HANDLE;
+    VkPipeline m_graphicsPipeline = VK_NULL_HANDLE;
     bool m_isNeedVkBuffer = false;
 };
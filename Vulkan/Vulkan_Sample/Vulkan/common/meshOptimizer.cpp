@@ -0,0 +1,295 @@
+
+#include "meshOptimizer.h"
+#include <algorithm>
+
+MeshOptimizer::Statistics& MeshOptimizer::Statistics::operator+=(const Statistics& other)
+{
+    triangleCount += other.triangleCount;
+    vertexCount += other.vertexCount;
+    transformedCount += other.transformedCount;
+    return *this;
+}
+
+// FIFO缓存模拟
+MeshOptimizer::Statistics MeshOptimizer::analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+{
+    Statistics stats = {};
+    stats.triangleCount = static_cast<uint32_t>(indexCount / 3);
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    uint32_t timestamp = cacheSize + 1;
+
+    for(size_t i = 0; i < indexCount; ++i)
+    {
+        uint32_t v = indices[i];
+        assert(v < vertexCount);
+
+        if(!referenced[v])
+        {
+            referenced[v] = true;
+            stats.vertexCount++;
+        }
+
+        if(timestamp - cacheTime[v] > cacheSize)
+        {
+            cacheTime[v] = timestamp++;
+            stats.transformedCount++;
+        }
+    }
+
+    return stats;
+}
+
+void MeshOptimizer::optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t>* clusters, uint32_t cacheSize)
+{
+    size_t triangleCount = indexCount / 3;
+    if(triangleCount == 0)
+    {
+        return ;
+    }
+
+    // 顶点 -> 相邻三角形
+    std::vector<uint32_t> live(vertexCount, 0);
+    for(size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        live[indices[i]]++;
+    }
+
+    std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+    for(size_t v = 0; v < vertexCount; ++v)
+    {
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + live[v];
+    }
+
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+    for(uint32_t t = 0; t < triangleCount; ++t)
+    {
+        for(uint32_t k = 0; k < 3; ++k)
+        {
+            uint32_t v = indices[t * 3 + k];
+            adjacency[fill[v]++] = t;
+        }
+    }
+
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    deadEnd.reserve(triangleCount * 3);
+
+    uint32_t timestamp = cacheSize + 1;
+    uint32_t cursor = 0;
+    int64_t fanning = 0;
+
+    if(clusters)
+    {
+        clusters->clear();
+        clusters->push_back(0);
+    }
+
+    while(fanning >= 0)
+    {
+        candidates.clear();
+        for(uint32_t a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; ++a)
+        {
+            uint32_t t = adjacency[a];
+            if(emitted[t])
+            {
+                continue;
+            }
+
+            for(uint32_t k = 0; k < 3; ++k)
+            {
+                uint32_t v = indices[t * 3 + k];
+                output.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                if(timestamp - cacheTime[v] > cacheSize)
+                {
+                    cacheTime[v] = timestamp++;
+                }
+            }
+            emitted[t] = true;
+        }
+
+        // 在刚输出的顶点里找还在缓存中且仍有三角形的顶点
+        int64_t best = -1;
+        int64_t bestPriority = -1;
+        for(uint32_t v : candidates)
+        {
+            if(live[v] == 0)
+            {
+                continue;
+            }
+
+            int64_t priority = 0;
+            if(timestamp - cacheTime[v] + 2 * live[v] <= cacheSize)
+            {
+                priority = timestamp - cacheTime[v];
+            }
+
+            if(priority > bestPriority)
+            {
+                best = v;
+                bestPriority = priority;
+            }
+        }
+
+        if(best < 0)
+        {
+            // 缓存断点, 也作为overdraw排序的簇边界
+            while(!deadEnd.empty() && best < 0)
+            {
+                uint32_t v = deadEnd.back();
+                deadEnd.pop_back();
+                if(live[v] > 0)
+                {
+                    best = v;
+                }
+            }
+
+            while(cursor < vertexCount && best < 0)
+            {
+                if(live[cursor] > 0)
+                {
+                    best = cursor;
+                }
+                cursor++;
+            }
+
+            if(clusters && best >= 0 && clusters->back() != output.size() / 3)
+            {
+                clusters->push_back(static_cast<uint32_t>(output.size() / 3));
+            }
+        }
+
+        fanning = best;
+    }
+
+    assert(output.size() == triangleCount * 3);
+    memcpy(indices, output.data(), output.size() * sizeof(uint32_t));
+}
+
+void MeshOptimizer::optimizeOverdraw(uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, const std::vector<uint32_t>& clusters, float threshold)
+{
+    size_t triangleCount = indexCount / 3;
+    if(clusters.size() < 2)
+    {
+        return ;
+    }
+
+    glm::vec3 meshCentroid = glm::vec3(0.0f);
+    for(size_t i = 0; i < triangleCount * 3; ++i)
+    {
+        meshCentroid += vertices[indices[i]].m_position;
+    }
+    meshCentroid /= static_cast<float>(triangleCount * 3);
+
+    // 簇越朝外越先画, 外面的面先写入深度, 后面被遮挡的片元可以提前剔除
+    struct ClusterSort {
+        uint32_t begin;
+        uint32_t end;
+        float key;
+    };
+
+    std::vector<ClusterSort> sorts;
+    for(size_t c = 0; c < clusters.size(); ++c)
+    {
+        ClusterSort cluster = {};
+        cluster.begin = clusters[c];
+        cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : static_cast<uint32_t>(triangleCount);
+
+        glm::vec3 centroid = glm::vec3(0.0f);
+        glm::vec3 normal = glm::vec3(0.0f);
+        float area = 0.0f;
+        for(uint32_t t = cluster.begin; t < cluster.end; ++t)
+        {
+            const glm::vec3& p0 = vertices[indices[t * 3 + 0]].m_position;
+            const glm::vec3& p1 = vertices[indices[t * 3 + 1]].m_position;
+            const glm::vec3& p2 = vertices[indices[t * 3 + 2]].m_position;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float a = glm::length(n);
+            centroid += (p0 + p1 + p2) * (a / 3.0f);
+            normal += n;
+            area += a;
+        }
+
+        if(area > 0.0f)
+        {
+            centroid /= area;
+        }
+        float length = glm::length(normal);
+        if(length > 0.0f)
+        {
+            normal /= length;
+        }
+
+        cluster.key = glm::dot(centroid - meshCentroid, normal);
+        sorts.push_back(cluster);
+    }
+
+    std::stable_sort(sorts.begin(), sorts.end(), [](const ClusterSort& a, const ClusterSort& b) {
+        return a.key > b.key;
+    });
+
+    std::vector<uint32_t> output;
+    output.reserve(triangleCount * 3);
+    for(const ClusterSort& cluster : sorts)
+    {
+        output.insert(output.end(), indices + cluster.begin * 3, indices + cluster.end * 3);
+    }
+
+    // 簇边界都在缓存断点上, 正常情况下ACMR几乎不变, 超过阈值则放弃
+    float before = analyzeVertexCache(indices, triangleCount * 3, vertexCount).acmr();
+    float after = analyzeVertexCache(output.data(), output.size(), vertexCount).acmr();
+    if(after <= before * threshold)
+    {
+        memcpy(indices, output.data(), output.size() * sizeof(uint32_t));
+    }
+}
+
+void MeshOptimizer::optimizeVertexFetch(Vertex* vertices, size_t vertexCount, uint32_t* indices, size_t indexCount)
+{
+    const uint32_t unused = ~0u;
+    std::vector<uint32_t> remap(vertexCount, unused);
+    uint32_t next = 0;
+
+    for(size_t i = 0; i < indexCount; ++i)
+    {
+        uint32_t& v = indices[i];
+        if(remap[v] == unused)
+        {
+            remap[v] = next++;
+        }
+        v = remap[v];
+    }
+
+    // 没被引用的顶点放在最后
+    for(size_t v = 0; v < vertexCount; ++v)
+    {
+        if(remap[v] == unused)
+        {
+            remap[v] = next++;
+        }
+    }
+
+    std::vector<Vertex> reordered(vertexCount);
+    for(size_t v = 0; v < vertexCount; ++v)
+    {
+        reordered[remap[v]] = vertices[v];
+    }
+    std::copy(reordered.begin(), reordered.end(), vertices);
+}
+
+void MeshOptimizer::optimize(Vertex* vertices, size_t vertexCount, uint32_t* indices, size_t indexCount)
+{
+    std::vector<uint32_t> clusters;
+    optimizeVertexCache(indices, indexCount, vertexCount, &clusters);
+    optimizeOverdraw(indices, indexCount, vertices, vertexCount, clusters);
+    optimizeVertexFetch(vertices, vertexCount, indices, indexCount);
+}
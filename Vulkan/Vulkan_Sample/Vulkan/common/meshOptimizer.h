@@ -0,0 +1,35 @@
+
+#pragma once
+
+#include "tools.h"
+#include "vertex.h"
+
+// 加载时按primitive优化索引和顶点顺序:
+// 1. Tipsify 顶点缓存优化 (Sander 2007, Fast Triangle Reordering for Vertex Locality and Reduced Overdraw)
+// 2. 以Tipsify的缓存断点分簇, 按簇朝外程度排序以减少overdraw
+// 3. 按索引首次出现顺序重排顶点, 提高vertex fetch的局部性
+// 索引都是相对于传入顶点数组的局部索引
+class MeshOptimizer
+{
+public:
+    struct Statistics {
+        uint32_t triangleCount = 0;
+        uint32_t vertexCount = 0;       //被引用到的顶点
+        uint32_t transformedCount = 0;  //缓存未命中, 即vertex shader调用次数
+
+        float acmr() const { return triangleCount > 0 ? 1.0f * transformedCount / triangleCount : 0.0f; }
+        float atvr() const { return vertexCount > 0 ? 1.0f * transformedCount / vertexCount : 0.0f; }
+        Statistics& operator+=(const Statistics& other);
+    };
+
+    static Statistics analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = m_cacheSize);
+    static void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount, std::vector<uint32_t>* clusters = nullptr, uint32_t cacheSize = m_cacheSize);
+    static void optimizeOverdraw(uint32_t* indices, size_t indexCount, const Vertex* vertices, size_t vertexCount, const std::vector<uint32_t>& clusters, float threshold = 1.05f);
+    static void optimizeVertexFetch(Vertex* vertices, size_t vertexCount, uint32_t* indices, size_t indexCount);
+
+    // 依次执行以上三步
+    static void optimize(Vertex* vertices, size_t vertexCount, uint32_t* indices, size_t indexCount);
+
+public:
+    static const uint32_t m_cacheSize = 16;
+};
@@ -0,0 +1,274 @@
+
+#include "meshSimplifier.h"
+#include <algorithm>
+
+void MeshSimplifier::Quadric::addPlane(const glm::dvec3& n, double d, double weight)
+{
+    a00 += weight * n.x * n.x;
+    a01 += weight * n.x * n.y;
+    a02 += weight * n.x * n.z;
+    a11 += weight * n.y * n.y;
+    a12 += weight * n.y * n.z;
+    a22 += weight * n.z * n.z;
+    b0 += weight * n.x * d;
+    b1 += weight * n.y * d;
+    b2 += weight * n.z * d;
+    c += weight * d * d;
+    w += weight;
+}
+
+void MeshSimplifier::Quadric::add(const Quadric& other)
+{
+    a00 += other.a00;
+    a01 += other.a01;
+    a02 += other.a02;
+    a11 += other.a11;
+    a12 += other.a12;
+    a22 += other.a22;
+    b0 += other.b0;
+    b1 += other.b1;
+    b2 += other.b2;
+    c += other.c;
+    w += other.w;
+}
+
+// (p^T A p + 2 b^T p + c) / w, 除以权重后和坐标的平方同一量纲
+double MeshSimplifier::Quadric::evaluate(const glm::vec3& p) const
+{
+    if(w == 0.0)
+    {
+        return 0.0;
+    }
+
+    double x = p.x, y = p.y, z = p.z;
+    double r = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + a11 * y * y + 2.0 * a12 * y * z + a22 * z * z;
+    r += 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+    return std::max(r / w, 0.0);
+}
+
+bool MeshSimplifier::flipsTriangle(const Vertex* vertices, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& adjacencyOffset,
+                                   const std::vector<uint32_t>& adjacency, uint32_t from, uint32_t to)
+{
+    for(uint32_t a = adjacencyOffset[from]; a < adjacencyOffset[from + 1]; ++a)
+    {
+        uint32_t t = adjacency[a];
+        uint32_t i0 = indices[t * 3 + 0];
+        uint32_t i1 = indices[t * 3 + 1];
+        uint32_t i2 = indices[t * 3 + 2];
+
+        // 包含这条边的三角形会退化被删除
+        if(i0 == to || i1 == to || i2 == to)
+        {
+            continue;
+        }
+
+        glm::vec3 p0 = vertices[i0].m_position;
+        glm::vec3 p1 = vertices[i1].m_position;
+        glm::vec3 p2 = vertices[i2].m_position;
+        glm::vec3 before = glm::cross(p1 - p0, p2 - p0);
+
+        glm::vec3 q0 = vertices[i0 == from ? to : i0].m_position;
+        glm::vec3 q1 = vertices[i1 == from ? to : i1].m_position;
+        glm::vec3 q2 = vertices[i2 == from ? to : i2].m_position;
+        glm::vec3 after = glm::cross(q1 - q0, q2 - q0);
+
+        if(glm::dot(before, after) <= 0.0f)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<uint32_t> MeshSimplifier::simplify(const Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount,
+                                               size_t targetIndexCount, float targetError, float* resultError)
+{
+    std::vector<uint32_t> result(indices, indices + indexCount);
+    double maxCost = static_cast<double>(targetError) * targetError;
+    double appliedCost = 0.0;
+
+    // 每个顶点的误差二次型, 按三角形面积加权
+    std::vector<Quadric> quadrics(vertexCount, Quadric{});
+    for(size_t t = 0; t < indexCount / 3; ++t)
+    {
+        glm::dvec3 p0 = vertices[indices[t * 3 + 0]].m_position;
+        glm::dvec3 p1 = vertices[indices[t * 3 + 1]].m_position;
+        glm::dvec3 p2 = vertices[indices[t * 3 + 2]].m_position;
+        glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+        double area = glm::length(n);
+        if(area == 0.0)
+        {
+            continue;
+        }
+        n /= area;
+        double d = -glm::dot(n, p0);
+        for(uint32_t k = 0; k < 3; ++k)
+        {
+            quadrics[indices[t * 3 + k]].addPlane(n, d, area * 0.5);
+        }
+    }
+
+    // 只被一个三角形使用的边是边界, 端点锁定
+    std::vector<bool> locked(vertexCount, false);
+    {
+        std::vector<uint64_t> edges;
+        edges.reserve(indexCount);
+        for(size_t t = 0; t < indexCount / 3; ++t)
+        {
+            for(uint32_t k = 0; k < 3; ++k)
+            {
+                uint64_t a = indices[t * 3 + k];
+                uint64_t b = indices[t * 3 + (k + 1) % 3];
+                edges.push_back(a < b ? (a << 32 | b) : (b << 32 | a));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        for(size_t i = 0; i < edges.size(); )
+        {
+            size_t j = i;
+            while(j < edges.size() && edges[j] == edges[i])
+            {
+                j++;
+            }
+            if(j - i == 1)
+            {
+                locked[edges[i] >> 32] = true;
+                locked[edges[i] & 0xFFFFFFFFu] = true;
+            }
+            i = j;
+        }
+    }
+
+    std::vector<uint32_t> adjacencyOffset(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> collapses;
+    std::vector<bool> touched(vertexCount);
+    std::vector<uint32_t> remap(vertexCount);
+
+    while(result.size() > targetIndexCount)
+    {
+        size_t triangleCount = result.size() / 3;
+
+        // 顶点 -> 相邻三角形
+        std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+        for(uint32_t v : result)
+        {
+            adjacencyOffset[v + 1]++;
+        }
+        for(size_t v = 0; v < vertexCount; ++v)
+        {
+            adjacencyOffset[v + 1] += adjacencyOffset[v];
+        }
+        adjacency.resize(result.size());
+        std::vector<uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for(size_t t = 0; t < triangleCount; ++t)
+        {
+            for(uint32_t k = 0; k < 3; ++k)
+            {
+                adjacency[fill[result[t * 3 + k]]++] = static_cast<uint32_t>(t);
+            }
+        }
+
+        // 每条半边一个候选, from折叠到to的位置
+        collapses.clear();
+        for(size_t t = 0; t < triangleCount; ++t)
+        {
+            for(uint32_t k = 0; k < 3; ++k)
+            {
+                uint32_t from = result[t * 3 + k];
+                uint32_t to = result[t * 3 + (k + 1) % 3];
+                if(locked[from])
+                {
+                    continue;
+                }
+
+                Quadric q = quadrics[from];
+                q.add(quadrics[to]);
+                double cost = q.evaluate(vertices[to].m_position);
+                if(cost <= maxCost)
+                {
+                    collapses.push_back({from, to, cost});
+                }
+            }
+        }
+
+        if(collapses.empty())
+        {
+            break;
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.cost < b.cost;
+        });
+
+        // 一轮里每个顶点只参与一次折叠, 折叠数量限制在剩余目标以内
+        size_t trianglesToRemove = (result.size() - targetIndexCount) / 3;
+        size_t removed = 0;
+        std::fill(touched.begin(), touched.end(), false);
+        for(uint32_t v = 0; v < vertexCount; ++v)
+        {
+            remap[v] = v;
+        }
+
+        for(const Collapse& collapse : collapses)
+        {
+            if(removed >= trianglesToRemove)
+            {
+                break;
+            }
+            if(touched[collapse.from] || touched[collapse.to])
+            {
+                continue;
+            }
+            if(flipsTriangle(vertices, result, adjacencyOffset, adjacency, collapse.from, collapse.to))
+            {
+                continue;
+            }
+
+            // 和from相邻的顶点都标记, 保证本轮的翻转检测依然有效
+            for(uint32_t a = adjacencyOffset[collapse.from]; a < adjacencyOffset[collapse.from + 1]; ++a)
+            {
+                uint32_t t = adjacency[a];
+                for(uint32_t k = 0; k < 3; ++k)
+                {
+                    touched[result[t * 3 + k]] = true;
+                }
+                if(result[t * 3 + 0] == collapse.to || result[t * 3 + 1] == collapse.to || result[t * 3 + 2] == collapse.to)
+                {
+                    removed++;
+                }
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            appliedCost = std::max(appliedCost, collapse.cost);
+        }
+
+        size_t write = 0;
+        for(size_t t = 0; t < triangleCount; ++t)
+        {
+            uint32_t i0 = remap[result[t * 3 + 0]];
+            uint32_t i1 = remap[result[t * 3 + 1]];
+            uint32_t i2 = remap[result[t * 3 + 2]];
+            if(i0 == i1 || i1 == i2 || i2 == i0)
+            {
+                continue;
+            }
+            result[write++] = i0;
+            result[write++] = i1;
+            result[write++] = i2;
+        }
+
+        if(write == result.size())
+        {
+            break;
+        }
+        result.resize(write);
+    }
+
+    if(resultError)
+    {
+        *resultError = static_cast<float>(sqrt(appliedCost));
+    }
+    return result;
+}
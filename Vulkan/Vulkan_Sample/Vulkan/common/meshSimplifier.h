@@ -0,0 +1,37 @@
+
+#pragma once
+
+#include "tools.h"
+#include "vertex.h"
+
+// 二次误差度量(Garland & Heckbert 1997, Surface Simplification Using Quadric Error Metrics)的边折叠简化.
+// 只把顶点折叠到已有顶点上, 简化后的索引可以和原始索引共用同一个顶点buffer.
+// 边界边上的顶点(包括uv/法线接缝处拆开的顶点)保持不动, 避免出现裂缝
+class MeshSimplifier
+{
+public:
+    // indices为局部索引, 返回简化后的索引, resultError为折叠产生的最大几何误差(和顶点坐标同一空间)
+    static std::vector<uint32_t> simplify(const Vertex* vertices, size_t vertexCount, const uint32_t* indices, size_t indexCount,
+                                          size_t targetIndexCount, float targetError, float* resultError);
+
+private:
+    struct Quadric {
+        double a00, a01, a02, a11, a12, a22;
+        double b0, b1, b2;
+        double c;
+        double w;   //平面权重之和
+
+        void addPlane(const glm::dvec3& n, double d, double weight);
+        void add(const Quadric& other);
+        double evaluate(const glm::vec3& p) const;   //加权平均的距离平方
+    };
+
+    struct Collapse {
+        uint32_t from;
+        uint32_t to;
+        double cost;
+    };
+
+    static bool flipsTriangle(const Vertex* vertices, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& adjacencyOffset,
+                              const std::vector<uint32_t>& adjacency, uint32_t from, uint32_t to);
+};
@@ -0,0 +1,125 @@
+
+#include "meshlet.h"
+
+void MeshletBuilder::build(const Vertex* vertexData, const uint32_t* indexData, const Primitive* primitive, const glm::mat4& worldMatrix,
+                           bool coneCulling, uint32_t vertexOffset, uint32_t drawIndex, std::vector<Meshlet>& meshlets)
+{
+    // 记录顶点最后一次被哪个簇使用, 避免每个簇都清空集合
+    std::vector<uint32_t> stamp(primitive->m_vertexCount, ~0u);
+    uint32_t meshletId = 0;
+    uint32_t uniqueVertices = 0;
+    uint32_t begin = primitive->m_indexOffset;
+    uint32_t end = primitive->m_indexOffset + primitive->m_indexCount;
+    uint32_t meshletBegin = begin;
+
+    auto flush = [&](uint32_t meshletEnd) {
+        if(meshletEnd > meshletBegin)
+        {
+            Meshlet meshlet = computeBounds(vertexData, indexData, meshletBegin, meshletEnd - meshletBegin, worldMatrix, coneCulling);
+            meshlet.vertexOffset = vertexOffset;
+            meshlet.drawIndex = drawIndex;
+            meshlets.push_back(meshlet);
+        }
+        meshletBegin = meshletEnd;
+        meshletId++;
+        uniqueVertices = 0;
+    };
+
+    for(uint32_t i = begin; i + 2 < end; i += 3)
+    {
+        uint32_t newVertices = 0;
+        for(uint32_t k = 0; k < 3; ++k)
+        {
+            uint32_t local = indexData[i + k] - primitive->m_vertexOffset;
+            newVertices += stamp[local] != meshletId ? 1 : 0;
+        }
+
+        uint32_t triangleCount = (i - meshletBegin) / 3;
+        if(uniqueVertices + newVertices > m_maxVertices || triangleCount >= m_maxTriangles)
+        {
+            flush(i);
+        }
+
+        for(uint32_t k = 0; k < 3; ++k)
+        {
+            uint32_t local = indexData[i + k] - primitive->m_vertexOffset;
+            if(stamp[local] != meshletId)
+            {
+                stamp[local] = meshletId;
+                uniqueVertices++;
+            }
+        }
+    }
+
+    flush(end - (end - begin) % 3);
+}
+
+MeshletBuilder::Meshlet MeshletBuilder::computeBounds(const Vertex* vertexData, const uint32_t* indexData, uint32_t indexOffset, uint32_t indexCount,
+                                                      const glm::mat4& worldMatrix, bool coneCulling)
+{
+    Meshlet meshlet = {};
+    meshlet.indexOffset = indexOffset;
+    meshlet.indexCount = indexCount;
+
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+    for(uint32_t i = 0; i < indexCount; ++i)
+    {
+        glm::vec3 p = glm::vec3(worldMatrix * glm::vec4(vertexData[indexData[indexOffset + i]].m_position, 1.0f));
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    glm::vec3 center = (min + max) * 0.5f;
+    float radius = 0.0f;
+    for(uint32_t i = 0; i < indexCount; ++i)
+    {
+        glm::vec3 p = glm::vec3(worldMatrix * glm::vec4(vertexData[indexData[indexOffset + i]].m_position, 1.0f));
+        radius = std::max(radius, glm::distance(center, p));
+    }
+    meshlet.sphere = glm::vec4(center, radius);
+
+    // 法线锥, 镜像变换会翻转绕序
+    meshlet.cone = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    if(coneCulling == false)
+    {
+        return meshlet;
+    }
+
+    float windingSign = glm::determinant(glm::mat3(worldMatrix)) < 0.0f ? -1.0f : 1.0f;
+    std::vector<glm::vec3> normals;
+    glm::vec3 axis = glm::vec3(0.0f);
+    for(uint32_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        glm::vec3 p0 = glm::vec3(worldMatrix * glm::vec4(vertexData[indexData[indexOffset + i + 0]].m_position, 1.0f));
+        glm::vec3 p1 = glm::vec3(worldMatrix * glm::vec4(vertexData[indexData[indexOffset + i + 1]].m_position, 1.0f));
+        glm::vec3 p2 = glm::vec3(worldMatrix * glm::vec4(vertexData[indexData[indexOffset + i + 2]].m_position, 1.0f));
+        glm::vec3 n = glm::cross(p1 - p0, p2 - p0) * windingSign;
+        float length = glm::length(n);
+        if(length > 0.0f)
+        {
+            normals.push_back(n / length);
+            axis += n / length;
+        }
+    }
+
+    float axisLength = glm::length(axis);
+    if(normals.empty() || axisLength == 0.0f)
+    {
+        return meshlet;
+    }
+    axis /= axisLength;
+
+    float minDot = 1.0f;
+    for(const glm::vec3& n : normals)
+    {
+        minDot = std::min(minDot, glm::dot(n, axis));
+    }
+
+    // 法线张角超过90度无法剔除
+    if(minDot > 0.0f)
+    {
+        meshlet.cone = glm::vec4(axis, sqrtf(1.0f - minDot * minDot));
+    }
+    return meshlet;
+}
@@ -0,0 +1,33 @@
+
+#pragma once
+
+#include "tools.h"
+#include "vertex.h"
+#include "primitive.h"
+
+// 把primitive的索引按顺序切成小簇(最多64个顶点, 124个三角形),
+// 每个簇带世界空间的包围球和法线锥, 供compute shader做视锥和背面剔除
+class MeshletBuilder
+{
+public:
+    // GPU端布局, std430
+    struct Meshlet {
+        glm::vec4 sphere;           // xyz中心, w半径
+        glm::vec4 cone;             // xyz轴, w为cutoff, 1表示不做背面剔除
+        uint32_t indexOffset;
+        uint32_t indexCount;
+        uint32_t vertexOffset;      // 源索引是局部索引时需要加上
+        uint32_t drawIndex;         // 所属primitive的间接绘制命令
+    };
+
+    static void build(const Vertex* vertexData, const uint32_t* indexData, const Primitive* primitive, const glm::mat4& worldMatrix,
+                      bool coneCulling, uint32_t vertexOffset, uint32_t drawIndex, std::vector<Meshlet>& meshlets);
+
+public:
+    static const uint32_t m_maxVertices = 64;
+    static const uint32_t m_maxTriangles = 124;
+
+private:
+    static Meshlet computeBounds(const Vertex* vertexData, const uint32_t* indexData, uint32_t indexOffset, uint32_t indexCount,
+                                 const glm::mat4& worldMatrix, bool coneCulling);
+};
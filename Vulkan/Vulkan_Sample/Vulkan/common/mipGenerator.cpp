@@ -0,0 +1,433 @@
+
+#include "mipGenerator.h"
+#include "texture.h"
+
+MipGenerator* MipGenerator::m_pShared = nullptr;
+
+MipGenerator::MipGenerator()
+{
+}
+
+MipGenerator::~MipGenerator()
+{}
+
+void MipGenerator::prepare(VkPipelineCache pipelineCache)
+{
+    createDescriptorSetLayout();
+    createComputePipeline(pipelineCache, "base/mipgen.comp.spv", m_pipeline);
+    createComputePipeline(pipelineCache, "base/mipcoverage.comp.spv", m_coveragePipeline);
+    Tools::createTextureSampler(VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, 1, m_sampler);
+}
+
+void MipGenerator::clear()
+{
+    reset();
+    m_requests.clear();
+
+    vkDestroySampler(Tools::m_device, m_sampler, nullptr);
+    vkDestroyPipeline(Tools::m_device, m_coveragePipeline, nullptr);
+    vkDestroyPipeline(Tools::m_device, m_pipeline, nullptr);
+    vkDestroyPipelineLayout(Tools::m_device, m_pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(Tools::m_device, m_descriptorSetLayout, nullptr);
+}
+
+bool MipGenerator::isSupported(VkFormat format, uint32_t width, uint32_t height)
+{
+    if(format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB)
+    {
+        return false;
+    }
+
+    if(std::max(width, height) > (1u << (m_maxMipLevels - 1)))
+    {
+        return false;
+    }
+
+    if(!Tools::m_deviceEnabledFeatures.shaderSampledImageArrayDynamicIndexing || !Tools::m_deviceEnabledFeatures.shaderStorageImageArrayDynamicIndexing)
+    {
+        return false;
+    }
+
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(Tools::m_physicalDevice, VK_FORMAT_R8G8B8A8_UNORM, &formatProperties);
+    VkFormatFeatureFlags features = VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    return (formatProperties.optimalTilingFeatures & features) == features;
+}
+
+VkFormat MipGenerator::getImageFormat(VkFormat format)
+{
+    return format == VK_FORMAT_R8G8B8A8_SRGB ? VK_FORMAT_R8G8B8A8_UNORM : format;
+}
+
+VkImageCreateFlags MipGenerator::getImageCreateFlags(VkFormat format)
+{
+    return format == VK_FORMAT_R8G8B8A8_SRGB ? VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT : 0;
+}
+
+bool MipGenerator::isBlitSupported(VkFormat format)
+{
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(Tools::m_physicalDevice, format, &formatProperties);
+    VkFormatFeatureFlags features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (formatProperties.optimalTilingFeatures & features) == features;
+}
+
+void MipGenerator::createDescriptorSetLayout()
+{
+    std::array<VkDescriptorSetLayoutBinding, 4> bindings;
+    bindings[0] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_COMPUTE_BIT, 0, m_maxBatchSize);
+    bindings[1] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT, 1, m_maxBatchSize * (m_maxMipLevels - 1));
+    bindings[2] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 2);
+    bindings[3] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 3);
+    VkDescriptorSetLayoutCreateInfo layoutInfo = Tools::getDescriptorSetLayoutCreateInfo(bindings.data(), static_cast<uint32_t>(bindings.size()));
+    VK_CHECK_RESULT(vkCreateDescriptorSetLayout(Tools::m_device, &layoutInfo, nullptr, &m_descriptorSetLayout));
+
+    VkPushConstantRange pushConstantRange = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstant)};
+
+    VkPipelineLayoutCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    createInfo.setLayoutCount = 1;
+    createInfo.pSetLayouts = &m_descriptorSetLayout;
+    createInfo.pushConstantRangeCount = 1;
+    createInfo.pPushConstantRanges = &pushConstantRange;
+    VK_CHECK_RESULT(vkCreatePipelineLayout(Tools::m_device, &createInfo, nullptr, &m_pipelineLayout));
+}
+
+void MipGenerator::createComputePipeline(VkPipelineCache pipelineCache, const std::string& shaderName, VkPipeline& pipeline)
+{
+    VkShaderModule compModule = Tools::createShaderModule( Tools::getShaderPath() + shaderName);
+
+    VkComputePipelineCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    createInfo.layout = m_pipelineLayout;
+    createInfo.flags = 0;
+    createInfo.stage = Tools::getPipelineShaderStageCreateInfo(compModule, VK_SHADER_STAGE_COMPUTE_BIT);
+
+    if( vkCreateComputePipelines(Tools::m_device, pipelineCache, 1, &createInfo, nullptr, &pipeline) != VK_SUCCESS )
+    {
+        throw std::runtime_error("failed to create mip generator pipeline!");
+    }
+
+    vkDestroyShaderModule(Tools::m_device, compModule, nullptr);
+}
+
+void MipGenerator::add(VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageLayout oldLayout, VkImageLayout finalLayout, uint32_t flags, float alphaCutoff)
+{
+    assert(isSupported(format, width, height));
+    assert(mipLevels <= m_maxMipLevels);
+    if(mipLevels <= 1)
+    {
+        return ;
+    }
+
+    if(format == VK_FORMAT_R8G8B8A8_SRGB)
+    {
+        flags |= Srgb;
+    }
+
+    Request request = {image, format, width, height, mipLevels, oldLayout, finalLayout, flags, alphaCutoff};
+    m_requests.push_back(request);
+}
+
+void MipGenerator::generate(VkCommandBuffer commandBuffer)
+{
+    if(m_requests.empty())
+    {
+        return ;
+    }
+
+    // 上一次generate之后还没有reset
+    assert(m_descriptorPool == VK_NULL_HANDLE);
+
+    // 尺寸相近的放在同一批, 减少空跑的工作组
+    std::stable_sort(m_requests.begin(), m_requests.end(), [](const Request& a, const Request& b){
+        return std::max(a.width, a.height) > std::max(b.width, b.height);
+    });
+
+    uint32_t requestCount = static_cast<uint32_t>(m_requests.size());
+    uint32_t batchCount = (requestCount + m_maxBatchSize - 1) / m_maxBatchSize;
+
+    std::vector<TextureInfo> infos(requestCount);
+    uint32_t histogramCount = 0;
+    bool preserveCoverage = false;
+    for(uint32_t i = 0; i < requestCount; ++i)
+    {
+        const Request& request = m_requests[i];
+        TextureInfo& info = infos[i];
+        info.size = glm::ivec2(request.width, request.height);
+        info.mipLevels = request.mipLevels;
+        info.flags = request.flags;
+        info.alphaCutoff = request.alphaCutoff;
+        info.histogramOffset = 0;
+        info.tileCount = ((request.width + m_tileSize - 1) / m_tileSize) * ((request.height + m_tileSize - 1) / m_tileSize);
+        info.counter = 0;
+
+        if(request.flags & PreserveCoverage)
+        {
+            info.histogramOffset = histogramCount;
+            histogramCount += m_maxMipLevels * m_histogramBins;
+            preserveCoverage = true;
+        }
+    }
+
+    // TextureInfo和直方图放在同一个buffer, 直方图按storage buffer的偏移对齐
+    VkDeviceSize alignment = std::max<VkDeviceSize>(Tools::m_deviceProperties.limits.minStorageBufferOffsetAlignment, 4);
+    VkDeviceSize infoSize = sizeof(TextureInfo) * requestCount;
+    VkDeviceSize histogramOffset = (infoSize + alignment - 1) / alignment * alignment;
+    VkDeviceSize histogramSize = sizeof(uint32_t) * std::max(histogramCount, 1u);
+    Tools::createBufferAndMemoryThenBind(histogramOffset + histogramSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_buffer, m_memory);
+
+    // vkCmdUpdateBuffer一次最多65536字节
+    for(VkDeviceSize offset = 0; offset < infoSize; offset += 65536)
+    {
+        VkDeviceSize size = std::min<VkDeviceSize>(65536, infoSize - offset);
+        vkCmdUpdateBuffer(commandBuffer, m_buffer, offset, size, reinterpret_cast<const uint8_t*>(infos.data()) + offset);
+    }
+    vkCmdFillBuffer(commandBuffer, m_buffer, histogramOffset, histogramSize, 0);
+
+    std::array<VkDescriptorPoolSize, 3> poolSizes;
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[0].descriptorCount = batchCount * m_maxBatchSize;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[1].descriptorCount = batchCount * m_maxBatchSize * (m_maxMipLevels - 1);
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[2].descriptorCount = batchCount * 2;
+
+    VkDescriptorPoolCreateInfo poolInfo = {};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.flags = 0;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = batchCount;
+    VK_CHECK_RESULT(vkCreateDescriptorPool(Tools::m_device, &poolInfo, nullptr, &m_descriptorPool));
+
+    // 第0级用采样的view读, 其余每级一个storage view. sRGB图都用UNORM的view, 编解码在着色器里做
+    std::vector<VkImageMemoryBarrier> barriers;
+    std::vector<VkDescriptorSet> descriptorSets(batchCount);
+    for(uint32_t batch = 0; batch < batchCount; ++batch)
+    {
+        uint32_t first = batch * m_maxBatchSize;
+        uint32_t count = std::min(m_maxBatchSize, requestCount - first);
+
+        std::vector<VkDescriptorImageInfo> srcInfos(m_maxBatchSize);
+        std::vector<VkDescriptorImageInfo> dstInfos(m_maxBatchSize * (m_maxMipLevels - 1));
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            const Request& request = m_requests[first + i];
+
+            VkImageViewCreateInfo createInfo = {};
+            createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            createInfo.image = request.image;
+            createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            createInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+            createInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+
+            VkImageView view;
+            VK_CHECK_RESULT(vkCreateImageView(Tools::m_device, &createInfo, nullptr, &view));
+            m_views.push_back(view);
+            srcInfos[i] = {m_sampler, view, VK_IMAGE_LAYOUT_GENERAL};
+
+            for(uint32_t level = 1; level < m_maxMipLevels; ++level)
+            {
+                if(level < request.mipLevels)
+                {
+                    createInfo.subresourceRange.baseMipLevel = level;
+                    VK_CHECK_RESULT(vkCreateImageView(Tools::m_device, &createInfo, nullptr, &view));
+                    m_views.push_back(view);
+                }
+                //纹理没有的级用已有的最后一级填充, 着色器不会访问
+                dstInfos[i * (m_maxMipLevels - 1) + level - 1] = {VK_NULL_HANDLE, view, VK_IMAGE_LAYOUT_GENERAL};
+            }
+
+            VkImageMemoryBarrier barrier = {};
+            barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            barrier.oldLayout = request.oldLayout;
+            barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.image = request.image;
+            barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+            barriers.push_back(barrier);
+
+            barrier.srcAccessMask = 0;
+            barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+            barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 1, request.mipLevels - 1, 0, 1};
+            barriers.push_back(barrier);
+        }
+
+        //批次不满时空位填第一张, 工作组会直接返回
+        for(uint32_t i = count; i < m_maxBatchSize; ++i)
+        {
+            srcInfos[i] = srcInfos[0];
+            std::copy(dstInfos.begin(), dstInfos.begin() + m_maxMipLevels - 1, dstInfos.begin() + i * (m_maxMipLevels - 1));
+        }
+
+        VkDescriptorBufferInfo infoBuffer = {m_buffer, 0, infoSize};
+        VkDescriptorBufferInfo histogramBuffer = {m_buffer, histogramOffset, histogramSize};
+
+        Tools::allocateDescriptorSets(m_descriptorPool, &m_descriptorSetLayout, 1, descriptorSets[batch]);
+        std::array<VkWriteDescriptorSet, 4> writes;
+        writes[0] = Tools::getWriteDescriptorSet(descriptorSets[batch], VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, srcInfos.data(), static_cast<uint32_t>(srcInfos.size()));
+        writes[1] = Tools::getWriteDescriptorSet(descriptorSets[batch], VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, dstInfos.data(), static_cast<uint32_t>(dstInfos.size()));
+        writes[2] = Tools::getWriteDescriptorSet(descriptorSets[batch], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2, &infoBuffer);
+        writes[3] = Tools::getWriteDescriptorSet(descriptorSets[batch], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3, &histogramBuffer);
+        vkUpdateDescriptorSets(Tools::m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+    }
+
+    VkMemoryBarrier bufferBarrier = {};
+    bufferBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    bufferBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    bufferBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &bufferBarrier, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    //批次之间没有依赖, 中间不需要barrier
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+    for(uint32_t batch = 0; batch < batchCount; ++batch)
+    {
+        uint32_t first = batch * m_maxBatchSize;
+        uint32_t count = std::min(m_maxBatchSize, requestCount - first);
+        uint32_t tilesX = 0;
+        uint32_t tilesY = 0;
+        for(uint32_t i = first; i < first + count; ++i)
+        {
+            tilesX = std::max(tilesX, (m_requests[i].width + m_tileSize - 1) / m_tileSize);
+            tilesY = std::max(tilesY, (m_requests[i].height + m_tileSize - 1) / m_tileSize);
+        }
+
+        PushConstant pushConstant = {first};
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &descriptorSets[batch], 0, nullptr);
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstant), &pushConstant);
+        vkCmdDispatch(commandBuffer, tilesX, tilesY, count);
+        m_dispatchCount++;
+    }
+
+    if(preserveCoverage)
+    {
+        VkMemoryBarrier memoryBarrier = {};
+        memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, nullptr, 0, nullptr);
+
+        //每个线程处理每级的一个texel, 网格按第1级的大小
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_coveragePipeline);
+        for(uint32_t batch = 0; batch < batchCount; ++batch)
+        {
+            uint32_t first = batch * m_maxBatchSize;
+            uint32_t count = std::min(m_maxBatchSize, requestCount - first);
+            uint32_t width = 0;
+            uint32_t height = 0;
+            bool hasCoverage = false;
+            for(uint32_t i = first; i < first + count; ++i)
+            {
+                if(m_requests[i].flags & PreserveCoverage)
+                {
+                    width = std::max(width, std::max(1u, m_requests[i].width >> 1));
+                    height = std::max(height, std::max(1u, m_requests[i].height >> 1));
+                    hasCoverage = true;
+                }
+            }
+
+            if(!hasCoverage)
+            {
+                continue;
+            }
+
+            PushConstant pushConstant = {first};
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &descriptorSets[batch], 0, nullptr);
+            vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstant), &pushConstant);
+            vkCmdDispatch(commandBuffer, (width + 15) / 16, (height + 15) / 16, count);
+            m_dispatchCount++;
+        }
+    }
+
+    barriers.clear();
+    for(const Request& request : m_requests)
+    {
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.newLayout = request.finalLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = request.image;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, request.mipLevels, 0, 1};
+        barriers.push_back(barrier);
+    }
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    m_requests.clear();
+}
+
+void MipGenerator::reset()
+{
+    for(VkImageView view : m_views)
+    {
+        vkDestroyImageView(Tools::m_device, view, nullptr);
+    }
+    m_views.clear();
+
+    vkDestroyDescriptorPool(Tools::m_device, m_descriptorPool, nullptr);
+    m_descriptorPool = VK_NULL_HANDLE;
+    vkDestroyBuffer(Tools::m_device, m_buffer, nullptr);
+    m_buffer = VK_NULL_HANDLE;
+    vkFreeMemory(Tools::m_device, m_memory, nullptr);
+    m_memory = VK_NULL_HANDLE;
+}
+
+void MipGenerator::generateOnCpu(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t mipLevels, std::vector<uint8_t>& data)
+{
+    Texture::generateMipChain(rgba, width, height, mipLevels, data);
+}
+
+void MipGenerator::generateWithBlit(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageLayout oldLayout, VkImageLayout finalLayout)
+{
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.oldLayout = oldLayout;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    for(uint32_t i = 1; i < mipLevels; ++i)
+    {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.subresourceRange.baseMipLevel = i;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        VkImageBlit imageBlit = {};
+        imageBlit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i - 1, 0, 1};
+        imageBlit.srcOffsets[1] = {static_cast<int32_t>(std::max(1u, width >> (i - 1))), static_cast<int32_t>(std::max(1u, height >> (i - 1))), 1};
+        imageBlit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, i, 0, 1};
+        imageBlit.dstOffsets[1] = {static_cast<int32_t>(std::max(1u, width >> i)), static_cast<int32_t>(std::max(1u, height >> i)), 1};
+        vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+
+        //下一级从这一级读
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    }
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = finalLayout;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+}
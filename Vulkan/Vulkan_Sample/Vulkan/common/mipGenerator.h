@@ -0,0 +1,97 @@
+
+#pragma once
+
+#include "tools.h"
+
+// 单次dispatch生成mip: 每个工作组在共享内存里把第0级的64x64块缩到第6级, 最后完成的工作组(全局原子计数)再从第6级缩到第12级,
+// 级与级之间不需要barrier. 一次dispatch处理一批纹理, 用gl_WorkGroupID.z区分.
+// 只支持R8G8B8A8_UNORM/SRGB, 边长不超过4096, 2x2盒式滤波, 尺寸和blit一致(奇数边的最后一行/列被丢掉).
+// 用UNORM的view读写, sRGB纹理的image要用getImageFormat和getImageCreateFlags创建, 采样时再建sRGB的view. 描述符数组用动态下标,
+// 需要开启shaderSampledImageArrayDynamicIndexing和shaderStorageImageArrayDynamicIndexing, 不满足时isSupported返回false, 由调用者退回blit
+class MipGenerator
+{
+public:
+    enum Flags {
+        None = 0,
+        Srgb = 0x1,                 //在线性空间平均, 存储时再编码
+        PreserveCoverage = 0x2,     //alpha测试的覆盖率和第0级一致, 多一次dispatch缩放alpha
+    };
+
+    // 和mipgen.comp里的TextureInfo一致
+    struct TextureInfo {
+        glm::ivec2 size;
+        uint32_t mipLevels;
+        uint32_t flags;
+        float alphaCutoff;
+        uint32_t histogramOffset;
+        uint32_t tileCount;
+        uint32_t counter;
+    };
+
+    struct PushConstant {
+        uint32_t firstInfo;
+    };
+
+    MipGenerator();
+    ~MipGenerator();
+    void prepare(VkPipelineCache pipelineCache);
+    void clear();
+
+    static bool isSupported(VkFormat format, uint32_t width, uint32_t height);
+    // Vulkan 1.0里sRGB格式的image一般不能带STORAGE用途, 所以image用UNORM格式并允许建其它格式的view
+    static VkFormat getImageFormat(VkFormat format);
+    static VkImageCreateFlags getImageCreateFlags(VkFormat format);
+    static bool isBlitSupported(VkFormat format);
+
+    // image需要SAMPLED和STORAGE用途, format是采样时的格式. 第0级在oldLayout, 完成后所有级转到finalLayout
+    void add(VkImage image, VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageLayout oldLayout, VkImageLayout finalLayout, uint32_t flags = None, float alphaCutoff = 0.5f);
+    // 录制所有add的请求, 每批最多m_maxBatchSize张. 命令执行完之后调用reset释放这次用到的view和buffer
+    void generate(VkCommandBuffer commandBuffer);
+    void reset();
+
+    // 逐级blit, 不支持compute时的退路, 也是benchmark的对照. 第0级在oldLayout, 完成后所有级转到finalLayout
+    static void generateWithBlit(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels, VkImageLayout oldLayout, VkImageLayout finalLayout);
+    // 格式连blit都不支持时在CPU上生成RGBA8的所有级, 同Texture::generateMipChain
+    static void generateOnCpu(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t mipLevels, std::vector<uint8_t>& data);
+
+private:
+    struct Request {
+        VkImage image;
+        VkFormat format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipLevels;
+        VkImageLayout oldLayout;
+        VkImageLayout finalLayout;
+        uint32_t flags;
+        float alphaCutoff;
+    };
+
+    void createDescriptorSetLayout();
+    void createComputePipeline(VkPipelineCache pipelineCache, const std::string& shaderName, VkPipeline& pipeline);
+
+public:
+    static const uint32_t m_maxBatchSize = 16;
+    static const uint32_t m_maxMipLevels = 13;      //包括第0级
+    static const uint32_t m_tileSize = 64;
+    static const uint32_t m_histogramBins = 256;
+
+    uint32_t m_dispatchCount = 0;                   //累计的dispatch次数
+
+    // 由程序设置, 不为空时Texture::fillTextrue和vkglTF::Texture::fromglTfImage用它生成mip, 否则逐级blit
+    static MipGenerator* m_pShared;
+
+private:
+    VkDescriptorSetLayout m_descriptorSetLayout = VK_NULL_HANDLE;
+    VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    VkPipeline m_coveragePipeline = VK_NULL_HANDLE;
+    VkSampler m_sampler = VK_NULL_HANDLE;
+    std::vector<Request> m_requests;
+
+    // 一次generate用到的资源, reset时释放
+    std::vector<VkImageView> m_views;
+    VkDescriptorPool m_descriptorPool = VK_NULL_HANDLE;
+    VkBuffer m_buffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_memory = VK_NULL_HANDLE;
+};
@@ -1,5 +1,6 @@
 
 #include "objLoader.h"
+#include "meshOptimizer.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
@@ -66,6 +67,8 @@ void ObjLoader::loadFromFile(std::string filename)
             m_indexData.push_back(uniqueVertices[vertex]);
         }
     }
+    
+    optimize();
 }
 
 void ObjLoader::createVertexAndIndexBuffer()
@@ -75,14 +78,26 @@ void ObjLoader::createVertexAndIndexBuffer()
     VkDeviceMemory vertexStagingMemory;
     VkDeviceMemory indexStagingMemory;
     size_t vertexBufferSize = m_vertexData.size() * sizeof(Vertex);
+    
+    //顶点数不超过65536时用16位索引
+    std::vector<uint16_t> shortIndexData;
+    void* pIndexData = m_indexData.data();
     size_t indexBufferSize = m_indexData.size() * sizeof(uint32_t);
+    m_indexType = VK_INDEX_TYPE_UINT32;
+    if(m_vertexData.size() <= 65536)
+    {
+        shortIndexData.assign(m_indexData.begin(), m_indexData.end());
+        pIndexData = shortIndexData.data();
+        indexBufferSize = shortIndexData.size() * sizeof(uint16_t);
+        m_indexType = VK_INDEX_TYPE_UINT16;
+    }
     
     Tools::createBufferAndMemoryThenBind(vertexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, vertexStagingBuffer, vertexStagingMemory);
     Tools::mapMemory(vertexStagingMemory, vertexBufferSize, m_vertexData.data());
     Tools::createBufferAndMemoryThenBind(vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,  m_vertexBuffer, m_vertexMemory);
     
     Tools::createBufferAndMemoryThenBind(indexBufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, indexStagingBuffer, indexStagingMemory);
-    Tools::mapMemory(indexStagingMemory, indexBufferSize, m_indexData.data());
+    Tools::mapMemory(indexStagingMemory, indexBufferSize, pIndexData);
     Tools::createBufferAndMemoryThenBind(indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_indexBuffer, m_indexMemory);
     
     VkCommandBuffer copyCmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
@@ -103,7 +118,7 @@ void ObjLoader::bindBuffers(VkCommandBuffer commandBuffer)
 {
     const VkDeviceSize offsets[1] = {0};
     vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_vertexBuffer, offsets);
-    vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, m_indexType);
 }
 
 void ObjLoader::draw(VkCommandBuffer commandBuffer)
@@ -112,6 +127,14 @@ void ObjLoader::draw(VkCommandBuffer commandBuffer)
 }
 
 
+//加载obj之后, createVertexAndIndexBuffer之前调用
+void ObjLoader::optimize()
+{
+    m_cacheStatsBefore = MeshOptimizer::analyzeVertexCache(m_indexData.data(), m_indexData.size(), m_vertexData.size());
+    MeshOptimizer::optimize(m_vertexData.data(), m_vertexData.size(), m_indexData.data(), m_indexData.size());
+    m_cacheStatsAfter = MeshOptimizer::analyzeVertexCache(m_indexData.data(), m_indexData.size(), m_vertexData.size());
+}
+
 void ObjLoader::loadFromFile2(std::string filename)
 {
     tinyobj::ObjReader       reader;
@@ -260,6 +283,8 @@ void ObjLoader::loadFromFile2(std::string filename)
     {
         m_indexData.push_back(static_cast<uint32_t>(i));
     }
+    
+    optimize();
 }
 
 void ObjLoader::loadCustomSphere()
@@ -3,6 +3,7 @@
 
 #include "tools.h"
 #include "vertex.h"
+#include "meshOptimizer.h"
 
 class ObjLoader
 {
@@ -14,12 +15,19 @@ public:
     void createVertexAndIndexBuffer();
     void bindBuffers(VkCommandBuffer commandBuffer);
     void draw(VkCommandBuffer commandBuffer);
+    
+    //加载时优化前后的顶点缓存统计
+    MeshOptimizer::Statistics m_cacheStatsBefore;
+    MeshOptimizer::Statistics m_cacheStatsAfter;
 
 private:
+    void optimize();
+    
     VkBuffer m_vertexBuffer;
     VkDeviceMemory m_vertexMemory;
     VkBuffer m_indexBuffer;
     VkDeviceMemory m_indexMemory;
+    VkIndexType m_indexType = VK_INDEX_TYPE_UINT32;
     
 private:
     std::vector<Vertex> m_vertexData;
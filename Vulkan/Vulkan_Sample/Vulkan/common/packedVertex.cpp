@@ -0,0 +1,158 @@
+
+#include "packedVertex.h"
+#include <glm/gtc/packing.hpp>
+
+void PackedVertexLayout::build(const std::vector<VertexComponent>& components, bool wideJointIndex)
+{
+    m_components = components;
+    m_wideJointIndex = wideJointIndex;
+    m_offsets.clear();
+    m_formats.clear();
+    m_stride = 0;
+
+    for(VertexComponent component : components)
+    {
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        uint32_t size = 0;
+        switch (component) {
+            case VertexComponent::Position:
+                format = VK_FORMAT_R16G16B16A16_SNORM;
+                size = 8;
+                break;
+            case VertexComponent::Normal:
+            case VertexComponent::Tangent:
+                format = VK_FORMAT_R16G16_SNORM;
+                size = 4;
+                break;
+            case VertexComponent::UV:
+                format = VK_FORMAT_R16G16_SFLOAT;
+                size = 4;
+                break;
+            case VertexComponent::Color:
+            case VertexComponent::JointWeight:
+                format = VK_FORMAT_R8G8B8A8_UNORM;
+                size = 4;
+                break;
+            case VertexComponent::JointIndex:
+                format = wideJointIndex ? VK_FORMAT_R16G16B16A16_UINT : VK_FORMAT_R8G8B8A8_UINT;
+                size = wideJointIndex ? 8 : 4;
+                break;
+            default:
+                break;
+        }
+
+        m_offsets.push_back(m_stride);
+        m_formats.push_back(format);
+        m_stride += size;
+    }
+}
+
+void PackedVertexLayout::setVertexInputDescription(uint32_t binding) const
+{
+    Vertex::m_vertexInputBindingDescription = Tools::getVertexInputBindingDescription(binding, m_stride);
+    Vertex::m_vertexInputAttributeDescriptions.clear();
+    for(uint32_t location = 0; location < m_components.size(); ++location)
+    {
+        Vertex::m_vertexInputAttributeDescriptions.push_back(Tools::getVertexInputAttributeDescription(binding, location, m_formats[location], m_offsets[location]));
+    }
+}
+
+void PackedVertexLayout::pack(const Vertex& vertex, const glm::vec4& dequant, uint8_t* dst) const
+{
+    for(size_t i = 0; i < m_components.size(); ++i)
+    {
+        uint8_t* p = dst + m_offsets[i];
+        switch (m_components[i]) {
+            case VertexComponent::Position:
+            {
+                glm::vec3 pos = (vertex.m_position - glm::vec3(dequant)) / dequant.w;
+                float sign = vertex.m_tangent.w < 0.0f ? -1.0f : 1.0f;
+                uint16_t v[4] = {glm::packSnorm1x16(pos.x), glm::packSnorm1x16(pos.y), glm::packSnorm1x16(pos.z), glm::packSnorm1x16(sign)};
+                memcpy(p, v, sizeof(v));
+                break;
+            }
+            case VertexComponent::Normal:
+            {
+                uint32_t v = glm::packSnorm2x16(octEncode(vertex.m_normal));
+                memcpy(p, &v, sizeof(v));
+                break;
+            }
+            case VertexComponent::Tangent:
+            {
+                uint32_t v = glm::packSnorm2x16(octEncode(glm::vec3(vertex.m_tangent)));
+                memcpy(p, &v, sizeof(v));
+                break;
+            }
+            case VertexComponent::UV:
+            {
+                uint32_t v = glm::packHalf2x16(vertex.m_uv);
+                memcpy(p, &v, sizeof(v));
+                break;
+            }
+            case VertexComponent::Color:
+            {
+                uint32_t v = glm::packUnorm4x8(vertex.m_color);
+                memcpy(p, &v, sizeof(v));
+                break;
+            }
+            case VertexComponent::JointWeight:
+            {
+                uint32_t v = glm::packUnorm4x8(vertex.m_jointWeight);
+                memcpy(p, &v, sizeof(v));
+                break;
+            }
+            case VertexComponent::JointIndex:
+            {
+                if(m_wideJointIndex)
+                {
+                    uint16_t v[4] = {};
+                    for(int j = 0; j < 4; ++j)
+                    {
+                        v[j] = static_cast<uint16_t>(vertex.m_jointIndex[j]);
+                    }
+                    memcpy(p, v, sizeof(v));
+                }
+                else
+                {
+                    for(int j = 0; j < 4; ++j)
+                    {
+                        p[j] = static_cast<uint8_t>(vertex.m_jointIndex[j]);
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+glm::vec4 PackedVertexLayout::computeDequant(const glm::vec3& min, const glm::vec3& max)
+{
+    glm::vec3 center = (min + max) * 0.5f;
+    glm::vec3 extent = (max - min) * 0.5f;
+    float scale = std::max(std::max(extent.x, extent.y), extent.z);
+    return glm::vec4(center, std::max(scale, 1e-6f));
+}
+
+glm::mat4 PackedVertexLayout::getDequantMatrix(const glm::vec4& dequant)
+{
+    return glm::translate(glm::mat4(1.0f), glm::vec3(dequant)) * glm::scale(glm::mat4(1.0f), glm::vec3(dequant.w));
+}
+
+glm::vec2 PackedVertexLayout::octEncode(const glm::vec3& v)
+{
+    float l1 = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+    if(l1 == 0.0f)
+    {
+        return glm::vec2(0.0f);
+    }
+
+    glm::vec3 n = v / l1;
+    if(n.z < 0.0f)
+    {
+        glm::vec2 s = glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+        return (glm::vec2(1.0f) - glm::abs(glm::vec2(n.y, n.x))) * s;
+    }
+    return glm::vec2(n.x, n.y);
+}
@@ -0,0 +1,33 @@
+
+#pragma once
+
+#include "tools.h"
+#include "vertex.h"
+
+// 压缩后的顶点布局, 只包含pipeline用到的分量:
+// Position    R16G16B16A16_SNORM, 按primitive包围盒反量化, w存切线的符号
+// Normal      R16G16_SNORM 八面体编码
+// UV          R16G16_SFLOAT
+// Color       R8G8B8A8_UNORM
+// Tangent     R16G16_SNORM 八面体编码
+// JointIndex  R8G8B8A8_UINT, 骨骼数超过256时用R16G16B16A16_UINT
+// JointWeight R8G8B8A8_UNORM
+class PackedVertexLayout
+{
+public:
+    void build(const std::vector<VertexComponent>& components, bool wideJointIndex);
+    void setVertexInputDescription(uint32_t binding) const;
+    void pack(const Vertex& vertex, const glm::vec4& dequant, uint8_t* dst) const;
+
+    // xyz为中心, w为统一缩放, 统一缩放保证法线变换不变形
+    static glm::vec4 computeDequant(const glm::vec3& min, const glm::vec3& max);
+    static glm::mat4 getDequantMatrix(const glm::vec4& dequant);
+    static glm::vec2 octEncode(const glm::vec3& v);
+
+public:
+    uint32_t m_stride = 0;
+    bool m_wideJointIndex = false;
+    std::vector<VertexComponent> m_components;
+    std::vector<uint32_t> m_offsets;
+    std::vector<VkFormat> m_formats;
+};
@@ -0,0 +1,896 @@
+
+#include "pixelConvert.h"
+#include <chrono>
+#include <random>
+
+#if defined(__SSE2__) || defined(__x86_64__)
+#define PIXEL_USE_SSE 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define PIXEL_USE_NEON 1
+#include <arm_neon.h>
+#endif
+
+bool PixelConvert::m_useSimd = true;
+
+namespace
+{
+    inline uint32_t floatBits(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    inline float bitsFloat(uint32_t bits)
+    {
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    // NaN和负数都截成0
+    inline float saturate(float value)
+    {
+        return value > 0.0f ? (value < 1.0f ? value : 1.0f) : 0.0f;
+    }
+
+    inline uint8_t toUnorm8(float value)
+    {
+        return static_cast<uint8_t>(saturate(value) * 255.0f + 0.5f);
+    }
+
+    inline float toneMapValue(float value, PixelConvert::ToneMap toneMap)
+    {
+        value = value > 0.0f ? value : 0.0f;
+        if(toneMap == PixelConvert::ToneMap::Reinhard)
+        {
+            value = value / (1.0f + value);
+        }
+        else if(toneMap == PixelConvert::ToneMap::Aces)
+        {
+            value = (value * (2.51f * value + 0.03f)) / (value * (2.43f * value + 0.59f) + 0.14f);
+        }
+        return value < 1.0f ? value : 1.0f;
+    }
+
+    const float* srgbDecodeTable()
+    {
+        static const std::vector<float> table = [] {
+            std::vector<float> values(256);
+            for(uint32_t i = 0; i < 256; ++i)
+            {
+                float c = i / 255.0f;
+                values[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+            }
+            return values;
+        }();
+        return table.data();
+    }
+
+    // 线性值量化到16位再查表, 0附近的斜率最大, 16位的步长也只差0.05个8位单位
+    const uint8_t* srgbEncodeTable()
+    {
+        static const std::vector<uint8_t> table = [] {
+            std::vector<uint8_t> values(65536);
+            for(uint32_t i = 0; i < 65536; ++i)
+            {
+                float c = i / 65535.0f;
+                float s = c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+                values[i] = toUnorm8(s);
+            }
+            return values;
+        }();
+        return table.data();
+    }
+
+    inline uint8_t encodeSrgb(const uint8_t* table, float value)
+    {
+        return table[static_cast<uint32_t>(saturate(value) * 65535.0f + 0.5f)];
+    }
+
+    // 缺的颜色通道填0, 缺的alpha填1
+    void expandToRgba(const float* src, uint32_t channels, float* rgba, size_t pixelCount)
+    {
+        for(size_t i = 0; i < pixelCount; ++i)
+        {
+            for(uint32_t c = 0; c < 3; ++c)
+            {
+                rgba[i * 4 + c] = c < channels ? src[i * channels + c] : 0.0f;
+            }
+            rgba[i * 4 + 3] = channels == 4 ? src[i * channels + 3] : 1.0f;
+        }
+    }
+
+#if PIXEL_USE_SSE
+    bool hasSsse3()
+    {
+        static const bool supported = __builtin_cpu_supports("ssse3");
+        return supported;
+    }
+
+    bool hasAvx2()
+    {
+        static const bool supported = __builtin_cpu_supports("avx2");
+        return supported;
+    }
+
+    bool hasF16c()
+    {
+        static const bool supported = __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+        return supported;
+    }
+
+    // 每次读16字节只用前12字节, 循环条件留出越界的余量, 剩下的交给逐像素的写法
+    __attribute__((target("ssse3")))
+    size_t rgbToRgbaSsse3(const uint8_t* src, uint8_t* dst, size_t pixelCount, uint8_t alpha)
+    {
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+        const __m128i alphaBits = _mm_set1_epi32(static_cast<int>(static_cast<uint32_t>(alpha) << 24));
+        size_t i = 0;
+        for(; i + 6 <= pixelCount; i += 4)
+        {
+            __m128i rgb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), alphaBits));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    size_t rgbToRgbaAvx2(const uint8_t* src, uint8_t* dst, size_t pixelCount, uint8_t alpha)
+    {
+        const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1));
+        const __m256i alphaBits = _mm256_set1_epi32(static_cast<int>(static_cast<uint32_t>(alpha) << 24));
+        size_t i = 0;
+        for(; i + 10 <= pixelCount; i += 8)
+        {
+            __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+            __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 12));
+            __m256i rgb = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(rgb, shuffle), alphaBits));
+        }
+        return i;
+    }
+
+    // 每次写16字节只有前12字节有效, 下一次会覆盖后4字节
+    __attribute__((target("ssse3")))
+    size_t rgbaToRgbSsse3(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+    {
+        const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        size_t i = 0;
+        for(; i + 6 <= pixelCount; i += 4)
+        {
+            __m128i rgba = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3), _mm_shuffle_epi8(rgba, shuffle));
+        }
+        return i;
+    }
+
+    __attribute__((target("ssse3")))
+    size_t swizzleRBSsse3(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+    {
+        const __m128i shuffle = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+        size_t i = 0;
+        for(; i + 4 <= pixelCount; i += 4)
+        {
+            __m128i bgra = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_shuffle_epi8(bgra, shuffle));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx2")))
+    size_t swizzleRBAvx2(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+    {
+        const __m256i shuffle = _mm256_broadcastsi128_si256(_mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15));
+        size_t i = 0;
+        for(; i + 8 <= pixelCount; i += 8)
+        {
+            __m256i bgra = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_shuffle_epi8(bgra, shuffle));
+        }
+        return i;
+    }
+
+    // 指数加偏移后乘2^112, 非规格化数由浮点乘法处理, Inf/NaN单独补指数位, NaN和F16C一样置quiet位
+    inline __m128 halfToFloatSse2(__m128i half)
+    {
+        const __m128i noSign = _mm_set1_epi32(0x7FFF);
+        const __m128 magic = _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23));
+        const __m128i wasInfNan = _mm_set1_epi32(0x7BFF);
+        const __m128i infinity = _mm_set1_epi32(0x7C00);
+        const __m128 expInfNan = _mm_castsi128_ps(_mm_set1_epi32(255 << 23));
+        const __m128 quietNan = _mm_castsi128_ps(_mm_set1_epi32(0x00400000));
+
+        __m128i expMantissa = _mm_and_si128(noSign, half);
+        __m128i sign = _mm_slli_epi32(_mm_xor_si128(half, expMantissa), 16);
+        __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMantissa, 13)), magic);
+        __m128 infNan = _mm_and_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(expMantissa, wasInfNan)), expInfNan);
+        __m128 nan = _mm_and_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(expMantissa, infinity)), quietNan);
+        return _mm_or_ps(_mm_or_ps(scaled, nan), _mm_or_ps(_mm_castsi128_ps(sign), infNan));
+    }
+
+    size_t halfToFloatSse(const uint16_t* src, float* dst, size_t count)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_ps(dst + i, halfToFloatSse2(_mm_unpacklo_epi16(half, zero)));
+            _mm_storeu_ps(dst + i + 4, halfToFloatSse2(_mm_unpackhi_epi16(half, zero)));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx,f16c")))
+    size_t halfToFloatF16c(const uint16_t* src, float* dst, size_t count)
+    {
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+        }
+        return i;
+    }
+
+    __attribute__((target("avx,f16c")))
+    size_t floatToHalfF16c(const float* src, uint16_t* dst, size_t count)
+    {
+        size_t i = 0;
+        for(; i + 8 <= count; i += 8)
+        {
+            __m128i half = _mm256_cvtps_ph(_mm256_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), half);
+        }
+        return i;
+    }
+
+    // 一个寄存器是一个RGBA像素, alpha通道只截断不做色调映射
+    inline __m128 toneMapSse(__m128 color, PixelConvert::ToneMap toneMap)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 alphaMask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+
+        __m128 c = _mm_max_ps(color, zero);
+        __m128 t = c;
+        if(toneMap == PixelConvert::ToneMap::Reinhard)
+        {
+            t = _mm_div_ps(c, _mm_add_ps(one, c));
+        }
+        else if(toneMap == PixelConvert::ToneMap::Aces)
+        {
+            __m128 numerator = _mm_mul_ps(c, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.51f), c), _mm_set1_ps(0.03f)));
+            __m128 denominator = _mm_add_ps(_mm_mul_ps(c, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.43f), c), _mm_set1_ps(0.59f))), _mm_set1_ps(0.14f));
+            t = _mm_div_ps(numerator, denominator);
+        }
+        return _mm_min_ps(_mm_or_ps(_mm_and_ps(alphaMask, c), _mm_andnot_ps(alphaMask, t)), one);
+    }
+
+    // 和toUnorm8一样先加0.5再截断
+    inline __m128i rgbaToUnormSse(__m128 color, PixelConvert::ToneMap toneMap)
+    {
+        return _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(toneMapSse(color, toneMap), _mm_set1_ps(255.0f)), _mm_set1_ps(0.5f)));
+    }
+
+    size_t toneMapRgbaSse(const float* src, float* dst, size_t pixelCount, PixelConvert::ToneMap toneMap)
+    {
+        for(size_t i = 0; i < pixelCount; ++i)
+        {
+            _mm_storeu_ps(dst + i * 4, toneMapSse(_mm_loadu_ps(src + i * 4), toneMap));
+        }
+        return pixelCount;
+    }
+
+    size_t rgbaFloatToUnormSse(const float* src, uint8_t* dst, size_t pixelCount, PixelConvert::ToneMap toneMap)
+    {
+        size_t i = 0;
+        for(; i + 4 <= pixelCount; i += 4)
+        {
+            __m128i p0 = rgbaToUnormSse(_mm_loadu_ps(src + i * 4), toneMap);
+            __m128i p1 = rgbaToUnormSse(_mm_loadu_ps(src + i * 4 + 4), toneMap);
+            __m128i p2 = rgbaToUnormSse(_mm_loadu_ps(src + i * 4 + 8), toneMap);
+            __m128i p3 = rgbaToUnormSse(_mm_loadu_ps(src + i * 4 + 12), toneMap);
+            __m128i packed = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), packed);
+        }
+        return i;
+    }
+#elif PIXEL_USE_NEON
+    size_t rgbToRgbaNeon(const uint8_t* src, uint8_t* dst, size_t pixelCount, uint8_t alpha)
+    {
+        size_t i = 0;
+        for(; i + 16 <= pixelCount; i += 16)
+        {
+            uint8x16x3_t rgb = vld3q_u8(src + i * 3);
+            uint8x16x4_t rgba = {{rgb.val[0], rgb.val[1], rgb.val[2], vdupq_n_u8(alpha)}};
+            vst4q_u8(dst + i * 4, rgba);
+        }
+        return i;
+    }
+
+    size_t rgbaToRgbNeon(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+    {
+        size_t i = 0;
+        for(; i + 16 <= pixelCount; i += 16)
+        {
+            uint8x16x4_t rgba = vld4q_u8(src + i * 4);
+            uint8x16x3_t rgb = {{rgba.val[0], rgba.val[1], rgba.val[2]}};
+            vst3q_u8(dst + i * 3, rgb);
+        }
+        return i;
+    }
+
+    size_t swizzleRBNeon(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+    {
+        size_t i = 0;
+        for(; i + 16 <= pixelCount; i += 16)
+        {
+            uint8x16x4_t bgra = vld4q_u8(src + i * 4);
+            std::swap(bgra.val[0], bgra.val[2]);
+            vst4q_u8(dst + i * 4, bgra);
+        }
+        return i;
+    }
+
+    size_t halfToFloatNeon(const uint16_t* src, float* dst, size_t count)
+    {
+        size_t i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            vst1q_f32(dst + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(src + i))));
+        }
+        return i;
+    }
+
+    size_t floatToHalfNeon(const float* src, uint16_t* dst, size_t count)
+    {
+        size_t i = 0;
+        for(; i + 4 <= count; i += 4)
+        {
+            vst1_u16(dst + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(src + i))));
+        }
+        return i;
+    }
+
+    inline float32x4_t toneMapNeon(float32x4_t color, PixelConvert::ToneMap toneMap)
+    {
+        const float32x4_t one = vdupq_n_f32(1.0f);
+        const uint32_t alphaLanes[4] = {0, 0, 0, 0xFFFFFFFF};
+        const uint32x4_t alphaMask = vld1q_u32(alphaLanes);
+
+        float32x4_t c = vmaxnmq_f32(color, vdupq_n_f32(0.0f));
+        float32x4_t t = c;
+        if(toneMap == PixelConvert::ToneMap::Reinhard)
+        {
+            t = vdivq_f32(c, vaddq_f32(one, c));
+        }
+        else if(toneMap == PixelConvert::ToneMap::Aces)
+        {
+            float32x4_t numerator = vmulq_f32(c, vaddq_f32(vmulq_n_f32(c, 2.51f), vdupq_n_f32(0.03f)));
+            float32x4_t denominator = vaddq_f32(vmulq_f32(c, vaddq_f32(vmulq_n_f32(c, 2.43f), vdupq_n_f32(0.59f))), vdupq_n_f32(0.14f));
+            t = vdivq_f32(numerator, denominator);
+        }
+        return vminq_f32(vbslq_f32(alphaMask, c, t), one);
+    }
+
+    inline uint32x4_t rgbaToUnormNeon(float32x4_t color, PixelConvert::ToneMap toneMap)
+    {
+        return vcvtq_u32_f32(vaddq_f32(vmulq_n_f32(toneMapNeon(color, toneMap), 255.0f), vdupq_n_f32(0.5f)));
+    }
+
+    size_t toneMapRgbaNeon(const float* src, float* dst, size_t pixelCount, PixelConvert::ToneMap toneMap)
+    {
+        for(size_t i = 0; i < pixelCount; ++i)
+        {
+            vst1q_f32(dst + i * 4, toneMapNeon(vld1q_f32(src + i * 4), toneMap));
+        }
+        return pixelCount;
+    }
+
+    size_t rgbaFloatToUnormNeon(const float* src, uint8_t* dst, size_t pixelCount, PixelConvert::ToneMap toneMap)
+    {
+        size_t i = 0;
+        for(; i + 4 <= pixelCount; i += 4)
+        {
+            uint16x8_t low = vcombine_u16(vmovn_u32(rgbaToUnormNeon(vld1q_f32(src + i * 4), toneMap)), vmovn_u32(rgbaToUnormNeon(vld1q_f32(src + i * 4 + 4), toneMap)));
+            uint16x8_t high = vcombine_u16(vmovn_u32(rgbaToUnormNeon(vld1q_f32(src + i * 4 + 8), toneMap)), vmovn_u32(rgbaToUnormNeon(vld1q_f32(src + i * 4 + 12), toneMap)));
+            vst1q_u8(dst + i * 4, vcombine_u8(vmovn_u16(low), vmovn_u16(high)));
+        }
+        return i;
+    }
+#endif
+
+    void rgbaFloatToRgba8(const float* src, uint8_t* dst, size_t pixelCount, PixelConvert::ToneMap toneMap, bool srgb)
+    {
+        const uint8_t* encodeTable = srgb ? srgbEncodeTable() : nullptr;
+        size_t i = 0;
+        if(PixelConvert::m_useSimd && !srgb)
+        {
+#if PIXEL_USE_SSE
+            i = rgbaFloatToUnormSse(src, dst, pixelCount, toneMap);
+#elif PIXEL_USE_NEON
+            i = rgbaFloatToUnormNeon(src, dst, pixelCount, toneMap);
+#endif
+        }
+#if PIXEL_USE_SSE || PIXEL_USE_NEON
+        else if(PixelConvert::m_useSimd)
+        {
+            // 色调映射用SIMD分块算好, sRGB编码逐个查表
+            const size_t chunkSize = 256;
+            float mapped[chunkSize * 4];
+            for(; i < pixelCount; i += chunkSize)
+            {
+                size_t count = std::min(chunkSize, pixelCount - i);
+#if PIXEL_USE_SSE
+                toneMapRgbaSse(src + i * 4, mapped, count, toneMap);
+#else
+                toneMapRgbaNeon(src + i * 4, mapped, count, toneMap);
+#endif
+                for(size_t j = 0; j < count; ++j)
+                {
+                    uint8_t* pixel = dst + (i + j) * 4;
+                    pixel[0] = encodeTable[static_cast<uint32_t>(mapped[j * 4] * 65535.0f + 0.5f)];
+                    pixel[1] = encodeTable[static_cast<uint32_t>(mapped[j * 4 + 1] * 65535.0f + 0.5f)];
+                    pixel[2] = encodeTable[static_cast<uint32_t>(mapped[j * 4 + 2] * 65535.0f + 0.5f)];
+                    pixel[3] = static_cast<uint8_t>(mapped[j * 4 + 3] * 255.0f + 0.5f);
+                }
+            }
+        }
+#endif
+
+        for(; i < pixelCount; ++i)
+        {
+            for(uint32_t c = 0; c < 3; ++c)
+            {
+                float value = toneMapValue(src[i * 4 + c], toneMap);
+                dst[i * 4 + c] = srgb ? encodeTable[static_cast<uint32_t>(value * 65535.0f + 0.5f)] : toUnorm8(value);
+            }
+            dst[i * 4 + 3] = toUnorm8(src[i * 4 + 3]);
+        }
+    }
+}
+
+void PixelConvert::rgbToRgba(const uint8_t* src, uint8_t* dst, size_t pixelCount, uint8_t alpha)
+{
+    size_t i = 0;
+    if(m_useSimd)
+    {
+#if PIXEL_USE_SSE
+        if(hasAvx2())
+        {
+            i = rgbToRgbaAvx2(src, dst, pixelCount, alpha);
+        }
+        else if(hasSsse3())
+        {
+            i = rgbToRgbaSsse3(src, dst, pixelCount, alpha);
+        }
+#elif PIXEL_USE_NEON
+        i = rgbToRgbaNeon(src, dst, pixelCount, alpha);
+#endif
+    }
+
+    for(; i < pixelCount; ++i)
+    {
+        dst[i * 4] = src[i * 3];
+        dst[i * 4 + 1] = src[i * 3 + 1];
+        dst[i * 4 + 2] = src[i * 3 + 2];
+        dst[i * 4 + 3] = alpha;
+    }
+}
+
+void PixelConvert::rgbaToRgb(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    size_t i = 0;
+    if(m_useSimd)
+    {
+#if PIXEL_USE_SSE
+        if(hasSsse3())
+        {
+            i = rgbaToRgbSsse3(src, dst, pixelCount);
+        }
+#elif PIXEL_USE_NEON
+        i = rgbaToRgbNeon(src, dst, pixelCount);
+#endif
+    }
+
+    for(; i < pixelCount; ++i)
+    {
+        dst[i * 3] = src[i * 4];
+        dst[i * 3 + 1] = src[i * 4 + 1];
+        dst[i * 3 + 2] = src[i * 4 + 2];
+    }
+}
+
+void PixelConvert::swizzleRB(const uint8_t* src, uint8_t* dst, size_t pixelCount)
+{
+    size_t i = 0;
+    if(m_useSimd)
+    {
+#if PIXEL_USE_SSE
+        if(hasAvx2())
+        {
+            i = swizzleRBAvx2(src, dst, pixelCount);
+        }
+        else if(hasSsse3())
+        {
+            i = swizzleRBSsse3(src, dst, pixelCount);
+        }
+#elif PIXEL_USE_NEON
+        i = swizzleRBNeon(src, dst, pixelCount);
+#endif
+    }
+
+    for(; i < pixelCount; ++i)
+    {
+        uint8_t r = src[i * 4 + 2];
+        uint8_t b = src[i * 4];
+        dst[i * 4] = r;
+        dst[i * 4 + 1] = src[i * 4 + 1];
+        dst[i * 4 + 2] = b;
+        dst[i * 4 + 3] = src[i * 4 + 3];
+    }
+}
+
+float PixelConvert::halfToFloat(uint16_t value)
+{
+    uint32_t expMantissa = value & 0x7FFF;
+    uint32_t bits = floatBits(bitsFloat(expMantissa << 13) * bitsFloat((254 - 15) << 23));
+    if(expMantissa > 0x7BFF)
+    {
+        bits |= 255 << 23;
+    }
+    if(expMantissa > 0x7C00)
+    {
+        bits |= 0x00400000;
+    }
+    bits |= static_cast<uint32_t>(value & 0x8000) << 16;
+    return bitsFloat(bits);
+}
+
+// 就近舍入到偶数, 和F16C/NEON的硬件转换一致
+uint16_t PixelConvert::floatToHalf(float value)
+{
+    const uint32_t infinity = 255 << 23;
+    const uint32_t halfMax = (127 + 16) << 23;
+    const uint32_t denormMagic = ((127 - 15) + (23 - 10) + 1) << 23;
+
+    uint32_t bits = floatBits(value);
+    uint32_t sign = bits & 0x80000000;
+    bits ^= sign;
+
+    uint32_t half = 0;
+    if(bits >= halfMax)
+    {
+        half = bits > infinity ? 0x7E00 : 0x7C00;
+    }
+    else if(bits < (113 << 23))
+    {
+        half = floatBits(bitsFloat(bits) + bitsFloat(denormMagic)) - denormMagic;
+    }
+    else
+    {
+        uint32_t mantissaOdd = (bits >> 13) & 1;
+        bits += (static_cast<uint32_t>(15 - 127) << 23) + 0xFFF;
+        bits += mantissaOdd;
+        half = bits >> 13;
+    }
+    return static_cast<uint16_t>(half | (sign >> 16));
+}
+
+void PixelConvert::halfToFloat(const uint16_t* src, float* dst, size_t count)
+{
+    size_t i = 0;
+    if(m_useSimd)
+    {
+#if PIXEL_USE_SSE
+        i = hasF16c() ? halfToFloatF16c(src, dst, count) : halfToFloatSse(src, dst, count);
+#elif PIXEL_USE_NEON
+        i = halfToFloatNeon(src, dst, count);
+#endif
+    }
+
+    for(; i < count; ++i)
+    {
+        dst[i] = halfToFloat(src[i]);
+    }
+}
+
+void PixelConvert::floatToHalf(const float* src, uint16_t* dst, size_t count)
+{
+    size_t i = 0;
+    if(m_useSimd)
+    {
+#if PIXEL_USE_SSE
+        if(hasF16c())
+        {
+            i = floatToHalfF16c(src, dst, count);
+        }
+#elif PIXEL_USE_NEON
+        i = floatToHalfNeon(src, dst, count);
+#endif
+    }
+
+    for(; i < count; ++i)
+    {
+        dst[i] = floatToHalf(src[i]);
+    }
+}
+
+float PixelConvert::srgbToLinear(uint8_t value)
+{
+    return srgbDecodeTable()[value];
+}
+
+uint8_t PixelConvert::linearToSrgb(float value)
+{
+    return encodeSrgb(srgbEncodeTable(), value);
+}
+
+void PixelConvert::srgbToLinear(const uint8_t* rgba, float* dst, size_t pixelCount)
+{
+    const float* table = srgbDecodeTable();
+    for(size_t i = 0; i < pixelCount; ++i)
+    {
+        dst[i * 4] = table[rgba[i * 4]];
+        dst[i * 4 + 1] = table[rgba[i * 4 + 1]];
+        dst[i * 4 + 2] = table[rgba[i * 4 + 2]];
+        dst[i * 4 + 3] = rgba[i * 4 + 3] / 255.0f;
+    }
+}
+
+void PixelConvert::linearToSrgb(const float* rgba, uint8_t* dst, size_t pixelCount)
+{
+    const uint8_t* table = srgbEncodeTable();
+    for(size_t i = 0; i < pixelCount; ++i)
+    {
+        dst[i * 4] = encodeSrgb(table, rgba[i * 4]);
+        dst[i * 4 + 1] = encodeSrgb(table, rgba[i * 4 + 1]);
+        dst[i * 4 + 2] = encodeSrgb(table, rgba[i * 4 + 2]);
+        dst[i * 4 + 3] = toUnorm8(rgba[i * 4 + 3]);
+    }
+}
+
+void PixelConvert::floatToRgba8(const float* src, uint32_t channels, uint8_t* dst, size_t pixelCount, ToneMap toneMap, bool srgb)
+{
+    assert(channels >= 1 && channels <= 4);
+    if(channels == 4)
+    {
+        rgbaFloatToRgba8(src, dst, pixelCount, toneMap, srgb);
+        return;
+    }
+
+    const size_t chunkSize = 256;
+    float rgba[chunkSize * 4];
+    for(size_t begin = 0; begin < pixelCount; begin += chunkSize)
+    {
+        size_t count = std::min(chunkSize, pixelCount - begin);
+        expandToRgba(src + begin * channels, channels, rgba, count);
+        rgbaFloatToRgba8(rgba, dst + begin * 4, count, toneMap, srgb);
+    }
+}
+
+void PixelConvert::halfToRgba8(const uint16_t* src, uint32_t channels, uint8_t* dst, size_t pixelCount, ToneMap toneMap, bool srgb)
+{
+    assert(channels >= 1 && channels <= 4);
+
+    // 分块转换, 中间结果留在缓存里
+    const size_t chunkSize = 256;
+    float values[chunkSize * 4];
+    float rgba[chunkSize * 4];
+    for(size_t begin = 0; begin < pixelCount; begin += chunkSize)
+    {
+        size_t count = std::min(chunkSize, pixelCount - begin);
+        halfToFloat(src + begin * channels, values, count * channels);
+        if(channels != 4)
+        {
+            expandToRgba(values, channels, rgba, count);
+        }
+        rgbaFloatToRgba8(channels == 4 ? values : rgba, dst + begin * 4, count, toneMap, srgb);
+    }
+}
+
+void PixelConvert::copyRows(const void* src, size_t srcRowPitch, void* dst, size_t dstRowPitch, size_t rowBytes, uint32_t rowCount)
+{
+    if(srcRowPitch == rowBytes && dstRowPitch == rowBytes)
+    {
+        memcpy(dst, src, rowBytes * rowCount);
+        return;
+    }
+
+    const uint8_t* pSrc = static_cast<const uint8_t*>(src);
+    uint8_t* pDst = static_cast<uint8_t*>(dst);
+    for(uint32_t y = 0; y < rowCount; ++y)
+    {
+        memcpy(pDst + y * dstRowPitch, pSrc + y * srcRowPitch, rowBytes);
+    }
+}
+
+bool PixelConvert::toRgba8(VkFormat format, const void* src, size_t srcRowPitch, uint32_t width, uint32_t height, uint8_t* dst, size_t dstRowPitch, ToneMap toneMap)
+{
+    const uint8_t* pSrc = static_cast<const uint8_t*>(src);
+    switch(format)
+    {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+            copyRows(src, srcRowPitch, dst, dstRowPitch, width * 4, height);
+            return true;
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+            for(uint32_t y = 0; y < height; ++y)
+            {
+                swizzleRB(pSrc + y * srcRowPitch, dst + y * dstRowPitch, width);
+            }
+            return true;
+        case VK_FORMAT_R8G8B8_UNORM:
+        case VK_FORMAT_R8G8B8_SRGB:
+            for(uint32_t y = 0; y < height; ++y)
+            {
+                rgbToRgba(pSrc + y * srcRowPitch, dst + y * dstRowPitch, width);
+            }
+            return true;
+        case VK_FORMAT_R16_SFLOAT:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        {
+            uint32_t channels = format == VK_FORMAT_R16_SFLOAT ? 1 : (format == VK_FORMAT_R16G16_SFLOAT ? 2 : 4);
+            for(uint32_t y = 0; y < height; ++y)
+            {
+                halfToRgba8(reinterpret_cast<const uint16_t*>(pSrc + y * srcRowPitch), channels, dst + y * dstRowPitch, width, toneMap);
+            }
+            return true;
+        }
+        case VK_FORMAT_R32_SFLOAT:
+        case VK_FORMAT_R32G32_SFLOAT:
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+        {
+            uint32_t channels = format == VK_FORMAT_R32_SFLOAT ? 1 : (format == VK_FORMAT_R32G32_SFLOAT ? 2 : 4);
+            for(uint32_t y = 0; y < height; ++y)
+            {
+                floatToRgba8(reinterpret_cast<const float*>(pSrc + y * srcRowPitch), channels, dst + y * dstRowPitch, width, toneMap);
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+uint32_t PixelConvert::getPixelSize(VkFormat format)
+{
+    switch(format)
+    {
+        case VK_FORMAT_R8G8B8_UNORM:
+        case VK_FORMAT_R8G8B8_SRGB:
+            return 3;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R32_SFLOAT:
+            return 4;
+        case VK_FORMAT_R16_SFLOAT:
+            return 2;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R32G32_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+void PixelConvert::benchmark(uint32_t width, uint32_t height)
+{
+    size_t pixelCount = static_cast<size_t>(width) * height;
+    std::default_random_engine engine(1);
+    std::uniform_int_distribution<uint32_t> byteValue(0, 255);
+    std::uniform_real_distribution<float> hdrValue(0.0f, 4.0f);
+
+    std::vector<uint8_t> rgb(pixelCount * 3);
+    std::vector<uint8_t> rgba(pixelCount * 4);
+    std::vector<float> floats(pixelCount * 4);
+    std::vector<uint16_t> halves(pixelCount * 4);
+    for(uint8_t& value : rgb)
+    {
+        value = static_cast<uint8_t>(byteValue(engine));
+    }
+    for(uint8_t& value : rgba)
+    {
+        value = static_cast<uint8_t>(byteValue(engine));
+    }
+    for(size_t i = 0; i < floats.size(); ++i)
+    {
+        floats[i] = hdrValue(engine);
+        halves[i] = floatToHalf(floats[i]);
+    }
+
+    auto measure = [](const std::function<void()>& function) {
+        const uint32_t repeat = 10;
+        function();
+        auto tStart = std::chrono::high_resolution_clock::now();
+        for(uint32_t r = 0; r < repeat; ++r)
+        {
+            function();
+        }
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(tEnd - tStart).count() / repeat;
+    };
+
+    // 同一个函数分别走逐像素和SIMD的写法, 比较耗时和输出. legacy是原来代码里的写法
+    std::vector<uint8_t> scalarOutput;
+    auto compare = [&](const char* name, const void* output, size_t outputBytes, const std::function<void()>& function, const std::function<void()>& legacy) {
+        m_useSimd = false;
+        double scalarTime = measure(function);
+        scalarOutput.assign(static_cast<const uint8_t*>(output), static_cast<const uint8_t*>(output) + outputBytes);
+        m_useSimd = true;
+        double simdTime = measure(function);
+
+        size_t mismatch = 0;
+        for(size_t i = 0; i < outputBytes; ++i)
+        {
+            mismatch += scalarOutput[i] != static_cast<const uint8_t*>(output)[i] ? 1 : 0;
+        }
+
+        std::cout << name << ": ";
+        if(legacy)
+        {
+            std::cout << "legacy " << measure(legacy) << " ms, ";
+        }
+        std::cout << "scalar " << scalarTime << " ms, simd " << simdTime << " ms (" << outputBytes / (simdTime * 1000.0) << " MB/s), "
+                  << mismatch << " mismatched bytes" << std::endl;
+    };
+
+    // 原来Tools::float16的写法, 每个通道一次pow
+    auto legacyHalf = [](uint16_t half) {
+        int exp = ((half >> 10) & 0x1F) - 15;
+        float p = (1 + (half & 0x3FF) * 1.0f / 1024) * pow(2.0f, exp);
+        return (half & 0x8000) ? -p : p;
+    };
+
+    std::cout << "pixel convert " << width << "x" << height << std::endl;
+    std::vector<uint8_t> rgbaOutput(pixelCount * 4);
+    std::vector<uint8_t> rgbOutput(pixelCount * 3);
+    std::vector<float> floatOutput(pixelCount * 4);
+    std::vector<uint16_t> halfOutput(pixelCount * 4);
+
+    compare("rgb -> rgba", rgbaOutput.data(), rgbaOutput.size(), [&] { rgbToRgba(rgb.data(), rgbaOutput.data(), pixelCount); }, [&] {
+        for(size_t i = 0; i < pixelCount; ++i)
+        {
+            for(int32_t j = 0; j < 3; ++j)
+            {
+                rgbaOutput[i * 4 + j] = rgb[i * 3 + j];
+            }
+        }
+    });
+    compare("rgba -> rgb", rgbOutput.data(), rgbOutput.size(), [&] { rgbaToRgb(rgba.data(), rgbOutput.data(), pixelCount); }, nullptr);
+    compare("bgra -> rgba", rgbaOutput.data(), rgbaOutput.size(), [&] { swizzleRB(rgba.data(), rgbaOutput.data(), pixelCount); }, [&] {
+        for(size_t i = 0; i < pixelCount; ++i)
+        {
+            rgbaOutput[i * 4] = rgba[i * 4 + 2];
+            rgbaOutput[i * 4 + 1] = rgba[i * 4 + 1];
+            rgbaOutput[i * 4 + 2] = rgba[i * 4];
+            rgbaOutput[i * 4 + 3] = rgba[i * 4 + 3];
+        }
+    });
+    compare("half -> float", floatOutput.data(), floatOutput.size() * sizeof(float), [&] { halfToFloat(halves.data(), floatOutput.data(), halves.size()); }, [&] {
+        for(size_t i = 0; i < halves.size(); ++i)
+        {
+            floatOutput[i] = legacyHalf(halves[i]);
+        }
+    });
+    compare("float -> half", halfOutput.data(), halfOutput.size() * sizeof(uint16_t), [&] { floatToHalf(floats.data(), halfOutput.data(), floats.size()); }, nullptr);
+    compare("rgba16f -> rgba8 clamp", rgbaOutput.data(), rgbaOutput.size(), [&] { halfToRgba8(halves.data(), 4, rgbaOutput.data(), pixelCount); }, [&] {
+        for(size_t i = 0; i < pixelCount * 4; ++i)
+        {
+            float value = legacyHalf(halves[i]);
+            rgbaOutput[i] = static_cast<uint8_t>((value > 1 ? 1 : value) * 255);
+        }
+    });
+    compare("rgba16f -> rgba8 aces", rgbaOutput.data(), rgbaOutput.size(), [&] { halfToRgba8(halves.data(), 4, rgbaOutput.data(), pixelCount, ToneMap::Aces); }, nullptr);
+    compare("rgba32f -> srgb8 reinhard", rgbaOutput.data(), rgbaOutput.size(), [&] { floatToRgba8(floats.data(), 4, rgbaOutput.data(), pixelCount, ToneMap::Reinhard, true); }, nullptr);
+    compare("srgb8 -> linear", floatOutput.data(), floatOutput.size() * sizeof(float), [&] { srgbToLinear(rgba.data(), floatOutput.data(), pixelCount); }, nullptr);
+}
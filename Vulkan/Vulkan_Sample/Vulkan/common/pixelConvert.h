@@ -0,0 +1,51 @@
+
+#pragma once
+
+#include "tools.h"
+
+// 像素格式转换, 加载和回读共用. x86上SSE2是基线, SSSE3/AVX2/F16C在运行时检测, ARM64上用NEON, 其它平台逐像素转换.
+// 除了swizzleRB, src和dst不能重叠. 16位浮点按本机字节序读写(和GPU一样是小端)
+class PixelConvert
+{
+public:
+    enum class ToneMap {
+        Clamp = 0,          //直接截断到[0,1]
+        Reinhard = 1,       //x / (1 + x)
+        Aces = 2,           //ACES filmic的拟合曲线
+    };
+
+    // RGB8 -> RGBA8, alpha填固定值
+    static void rgbToRgba(const uint8_t* src, uint8_t* dst, size_t pixelCount, uint8_t alpha = 255);
+    // RGBA8 -> RGB8, 丢掉alpha
+    static void rgbaToRgb(const uint8_t* src, uint8_t* dst, size_t pixelCount);
+    // BGRA8 <-> RGBA8, 交换R和B, 允许src == dst
+    static void swizzleRB(const uint8_t* src, uint8_t* dst, size_t pixelCount);
+
+    static void halfToFloat(const uint16_t* src, float* dst, size_t count);
+    static void floatToHalf(const float* src, uint16_t* dst, size_t count);
+    static float halfToFloat(uint16_t value);
+    static uint16_t floatToHalf(float value);
+
+    // sRGB和线性空间互转, 查表. alpha不做转换
+    static void srgbToLinear(const uint8_t* rgba, float* dst, size_t pixelCount);
+    static void linearToSrgb(const float* rgba, uint8_t* dst, size_t pixelCount);
+    static float srgbToLinear(uint8_t value);
+    static uint8_t linearToSrgb(float value);
+
+    // HDR转RGBA8, channels为1到4, 缺的颜色通道填0, 缺的alpha填1. 色调映射不作用于alpha, srgb为true时颜色再做sRGB编码
+    static void floatToRgba8(const float* src, uint32_t channels, uint8_t* dst, size_t pixelCount, ToneMap toneMap = ToneMap::Clamp, bool srgb = false);
+    static void halfToRgba8(const uint16_t* src, uint32_t channels, uint8_t* dst, size_t pixelCount, ToneMap toneMap = ToneMap::Clamp, bool srgb = false);
+
+    // 按行拷贝, 行距相同且等于rowBytes时合成一次memcpy
+    static void copyRows(const void* src, size_t srcRowPitch, void* dst, size_t dstRowPitch, size_t rowBytes, uint32_t rowCount);
+    // 把一张图按行转成RGBA8, 用于回读和保存截图. 支持RGBA8/BGRA8(含SRGB), RGB8, R16G16/R16G16B16A16_SFLOAT, R32G32B32A32_SFLOAT, 其它格式返回false
+    static bool toRgba8(VkFormat format, const void* src, size_t srcRowPitch, uint32_t width, uint32_t height, uint8_t* dst, size_t dstRowPitch, ToneMap toneMap = ToneMap::Clamp);
+    // toRgba8支持的格式每个像素的字节数, 不支持时返回0
+    static uint32_t getPixelSize(VkFormat format);
+
+    // 和逐像素的写法对比吞吐量, 输出到std::cout
+    static void benchmark(uint32_t width, uint32_t height);
+
+public:
+    static bool m_useSimd;      //false时全部走逐像素的写法, benchmark用来对比
+};
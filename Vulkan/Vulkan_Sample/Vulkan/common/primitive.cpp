@@ -7,3 +7,19 @@ Primitive::Primitive()
 
 Primitive::~Primitive()
 {}
+
+// 选择投影到屏幕上的误差不超过maxPixelError的最简一级
+uint32_t Primitive::selectLod(float distance, float pixelsPerUnit, float maxPixelError) const
+{
+    uint32_t lod = 0;
+    distance = std::max(distance, 1e-4f);
+    for(uint32_t i = 1; i < m_lods.size(); ++i)
+    {
+        if(m_lods[i].error * pixelsPerUnit / distance > maxPixelError)
+        {
+            break;
+        }
+        lod = i;
+    }
+    return lod;
+}
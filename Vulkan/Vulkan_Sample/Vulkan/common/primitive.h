@@ -7,8 +7,18 @@
 class Primitive
 {
 public:
+    // 共用顶点buffer的一段索引, error为相对原始网格的几何误差(顶点坐标空间)
+    struct Lod {
+        uint32_t indexOffset;
+        uint32_t indexCount;
+        float error;
+    };
+    
     Primitive();
     ~Primitive();
+    
+    // pixelsPerUnit为距离1处一个单位长度在屏幕上的像素数, 即 projMat[1][1] * 屏幕高度 / 2
+    uint32_t selectLod(float distance, float pixelsPerUnit, float maxPixelError) const;
 
 public:
     uint32_t m_vertexOffset;
@@ -18,4 +28,7 @@ public:
     Material* m_material;
     glm::vec3 m_min;
     glm::vec3 m_max;
+    glm::vec4 m_dequant = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    glm::mat4 m_dequantMatrix = glm::mat4(1.0f);
+    std::vector<Lod> m_lods;    //GenerateLods时第0级为原始索引
 };
@@ -0,0 +1,204 @@
+
+#include "renderList.h"
+#include "gltfLoader.h"
+
+void RenderList::BindState::bindPipeline(VkCommandBuffer commandBuffer, VkPipeline pipeline)
+{
+    if(pipeline == m_pipeline)
+    {
+        m_skippedCount++;
+        return ;
+    }
+
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+    m_pipeline = pipeline;
+    m_bindCount++;
+}
+
+void RenderList::BindState::bindDescriptorSet(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set, VkDescriptorSet descriptorSet)
+{
+    assert(set < 4);
+    if(descriptorSet == m_descriptorSets[set])
+    {
+        m_skippedCount++;
+        return ;
+    }
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, set, 1, &descriptorSet, 0, nullptr);
+    m_descriptorSets[set] = descriptorSet;
+    m_bindCount++;
+}
+
+void RenderList::BindState::pushMatrix(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, const glm::mat4& matrix)
+{
+    if(m_hasMatrix && matrix == m_matrix)
+    {
+        m_skippedCount++;
+        return ;
+    }
+
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::mat4), &matrix);
+    m_matrix = matrix;
+    m_hasMatrix = true;
+    m_bindCount++;
+}
+
+void RenderList::build(const std::vector<GltfNode*>& linearNodes, const std::vector<Material*>& materials, uint32_t loadFlags)
+{
+    clear();
+    m_loadFlags = loadFlags;
+
+    const bool preTransform = loadFlags & GltfFileLoadFlags::PreTransformVertices;
+    const bool flipY = loadFlags & GltfFileLoadFlags::FlipY;
+
+    std::vector<VkPipeline> pipelines;
+    for (GltfNode* node : linearNodes)
+    {
+        if (node->m_mesh == nullptr)
+        {
+            continue;
+        }
+
+        for (Primitive* primitive : node->m_mesh->m_primitives)
+        {
+            DrawItem item = {};
+            item.primitive = primitive;
+            item.node = node;
+            item.center = (primitive->m_min + primitive->m_max) * 0.5f;
+            //预变换时顶点已经在世界空间, 中心在这里变换一次, 每帧updateKey不再乘结点矩阵
+            if (preTransform)
+            {
+                item.center = glm::vec3(node->m_worldMatrix * glm::vec4(item.center, 1.0f));
+            }
+            //不预变换时顶点在局部空间翻转, 预变换时在世界空间翻转, 见transformVertices
+            if (flipY)
+            {
+                item.center.y = -item.center.y;
+            }
+
+            Material* mat = primitive->m_material;
+            if (mat)
+            {
+                item.pass = mat->m_alphaMode == Material::BLEND ? Pass::Blend : (mat->m_alphaMode == Material::MASK ? Pass::Mask : Pass::Opaque);
+
+                auto it = std::find(materials.begin(), materials.end(), mat);
+                item.materialId = static_cast<uint32_t>(it - materials.begin()) & 0xffff;
+
+                auto pipelineIt = std::find(pipelines.begin(), pipelines.end(), mat->m_graphicsPipeline);
+                if (pipelineIt == pipelines.end())
+                {
+                    pipelines.push_back(mat->m_graphicsPipeline);
+                    pipelineIt = pipelines.end() - 1;
+                }
+                item.pipelineId = static_cast<uint32_t>(pipelineIt - pipelines.begin()) & 0xfff;
+            }
+
+            m_items.push_back(item);
+        }
+    }
+
+    sort(glm::vec3(0.0f));
+}
+
+void RenderList::updateKey(DrawItem& item, const glm::vec3& viewPos)
+{
+    const bool preTransform = m_loadFlags & GltfFileLoadFlags::PreTransformVertices;
+    glm::vec3 center = preTransform ? item.center : glm::vec3(item.node->m_worldMatrix * glm::vec4(item.center, 1.0f));
+
+    //非负浮点数的位模式和数值同序, 可以直接当整数比较
+    glm::vec3 offset = center - viewPos;
+    float distance = glm::dot(offset, offset);
+    uint32_t depth;
+    memcpy(&depth, &distance, sizeof(uint32_t));
+
+    uint64_t pass = item.pass;
+    uint64_t pipeline = item.pipelineId;
+    uint64_t material = item.materialId;
+    if (item.pass == Pass::Blend)
+    {
+        item.key = (pass << 62) | (static_cast<uint64_t>(~depth) << 28) | (pipeline << 16) | material;
+    }
+    else
+    {
+        item.key = (pass << 62) | (pipeline << 50) | (material << 34) | depth;
+    }
+}
+
+void RenderList::sort(const glm::vec3& viewPos)
+{
+    //上一帧的顺序作为输入, 排序是稳定的
+    if (m_entries.size() != m_items.size())
+    {
+        m_entries.resize(m_items.size());
+        for (uint32_t i = 0; i < m_items.size(); ++i)
+        {
+            m_entries[i].second = i;
+        }
+    }
+
+    for (auto& entry : m_entries)
+    {
+        DrawItem& item = m_items[entry.second];
+        updateKey(item, viewPos);
+        entry.first = item.key;
+    }
+
+    radixSort(m_entries, m_scratch);
+
+    m_sortedItems.resize(m_entries.size());
+    for (size_t i = 0; i < m_entries.size(); ++i)
+    {
+        m_sortedItems[i] = &m_items[m_entries[i].second];
+    }
+}
+
+void RenderList::clear()
+{
+    m_items.clear();
+    m_sortedItems.clear();
+    m_entries.clear();
+}
+
+void RenderList::radixSort(std::vector<std::pair<uint64_t, uint32_t>>& entries, std::vector<std::pair<uint64_t, uint32_t>>& scratch)
+{
+    const size_t count = entries.size();
+    if (count < 2)
+    {
+        return ;
+    }
+
+    //一次遍历统计8个字节的直方图
+    std::vector<uint32_t> histograms(8 * 256, 0);
+    for (const auto& entry : entries)
+    {
+        for (uint32_t pass = 0; pass < 8; ++pass)
+        {
+            histograms[pass * 256 + ((entry.first >> (pass * 8)) & 0xff)]++;
+        }
+    }
+
+    scratch.resize(count);
+    for (uint32_t pass = 0; pass < 8; ++pass)
+    {
+        uint32_t* histogram = &histograms[pass * 256];
+        const uint32_t shift = pass * 8;
+        if (histogram[(entries[0].first >> shift) & 0xff] == count)
+        {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t n = histogram[i];
+            histogram[i] = offset;
+            offset += n;
+        }
+
+        for (const auto& entry : entries)
+        {
+            scratch[histogram[(entry.first >> shift) & 0xff]++] = entry;
+        }
+        entries.swap(scratch);
+    }
+}
@@ -0,0 +1,70 @@
+
+#pragma once
+
+#include "tools.h"
+#include "gltfNode.h"
+#include "mesh.h"
+
+// 扁平的绘制列表, 代替每帧递归遍历结点树. 每个primitive一项, 64位排序键:
+//   不透明/alpha测试: pass(2) | pipeline(12) | material(16) | 空(2) | 深度(32), 同材质内从近到远, 利于early-Z
+//   半透明:           pass(2) | 空(2) | 反转深度(32) | pipeline(12) | material(16), 从远到近
+// 结点和材质分组只在build时计算一次, 之后每帧只刷新深度并基数排序
+class RenderList
+{
+public:
+    enum Pass { Opaque = 0, Mask = 1, Blend = 2 };
+    enum PassFlags { OpaquePass = 0x1, MaskPass = 0x2, BlendPass = 0x4, AllPasses = 0x7 };
+
+    struct DrawItem {
+        uint64_t key;
+        Primitive* primitive;
+        GltfNode* node;
+        glm::vec3 center;       //包围盒中心, 已处理FlipY. 预变换时在世界空间, 否则在结点局部空间
+        uint32_t pass;
+        uint32_t pipelineId;
+        uint32_t materialId;
+        bool isVisible = true;  //CPU遮挡剔除的结果, 不可见时draw跳过
+    };
+
+    // 过滤重复的绑定, 只在状态变化时才录制命令
+    class BindState
+    {
+    public:
+        void bindPipeline(VkCommandBuffer commandBuffer, VkPipeline pipeline);
+        void bindDescriptorSet(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, uint32_t set, VkDescriptorSet descriptorSet);
+        void pushMatrix(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, const glm::mat4& matrix);
+
+    public:
+        uint32_t m_bindCount = 0;
+        uint32_t m_skippedCount = 0;
+
+    private:
+        VkPipeline m_pipeline = VK_NULL_HANDLE;
+        VkDescriptorSet m_descriptorSets[4] = {};
+        glm::mat4 m_matrix;
+        bool m_hasMatrix = false;
+    };
+
+public:
+    // pipeline取自Material::m_graphicsPipeline, 材质的pipeline重建后需要clear再build
+    void build(const std::vector<GltfNode*>& linearNodes, const std::vector<Material*>& materials, uint32_t loadFlags);
+    // 按相机位置刷新深度并重新排序, 不调用时保持build时的分组顺序
+    void sort(const glm::vec3& viewPos);
+    void clear();
+    bool isEmpty() const { return m_items.empty(); }
+
+    // 对(键, 下标)做LSD基数排序, 每轮8位, 所有键在某个字节上都相同时跳过该轮
+    static void radixSort(std::vector<std::pair<uint64_t, uint32_t>>& entries, std::vector<std::pair<uint64_t, uint32_t>>& scratch);
+
+private:
+    void updateKey(DrawItem& item, const glm::vec3& viewPos);
+
+public:
+    std::vector<DrawItem> m_items;
+    std::vector<const DrawItem*> m_sortedItems;
+
+private:
+    uint32_t m_loadFlags = 0;
+    std::vector<std::pair<uint64_t, uint32_t>> m_entries;
+    std::vector<std::pair<uint64_t, uint32_t>> m_scratch;
+};
@@ -0,0 +1,252 @@
+
+#include "resourceCache.h"
+#include <climits>
+#include <cstdlib>
+
+std::map<std::string, ResourceCache::Entry<Texture*>> ResourceCache::m_textures;
+std::map<std::string, ResourceCache::Entry<GltfLoader*>> ResourceCache::m_models;
+std::map<ResourceCache::SamplerKey, ResourceCache::Entry<VkSampler>> ResourceCache::m_samplers;
+std::map<std::string, ResourceCache::Entry<VkShaderModule>> ResourceCache::m_shaderModules;
+ResourceCache::Statistics ResourceCache::m_statistics;
+
+std::string ResourceCache::getCanonicalPath(const std::string& fileName)
+{
+    char path[PATH_MAX];
+    if(realpath(fileName.c_str(), path))
+    {
+        return std::string(path);
+    }
+    return fileName;
+}
+
+template <typename K, typename T> bool ResourceCache::release(std::map<K, Entry<T>>& entries, T object)
+{
+    for(auto it = entries.begin(); it != entries.end(); ++it)
+    {
+        if(it->second.object == object)
+        {
+            if(--it->second.refCount > 0)
+            {
+                return false;
+            }
+            entries.erase(it);
+            return true;
+        }
+    }
+    return true;
+}
+
+Texture* ResourceCache::acquireTexture(const std::string& fileName, VkQueue transferQueue, VkFormat format, TextureCopyRegion copyRegion, VkImageLayout imageLayout)
+{
+    std::string key = getCanonicalPath(fileName) + "|" + std::to_string(format) + "|" + std::to_string(copyRegion) + "|" + std::to_string(imageLayout);
+    auto it = m_textures.find(key);
+    if(it != m_textures.end())
+    {
+        it->second.refCount++;
+        m_statistics.textureHits++;
+        m_statistics.savedTextureBytes += it->second.size;
+        return it->second.object;
+    }
+
+    Texture* texture = Texture::loadTextrue2D(fileName, transferQueue, format, copyRegion, imageLayout);
+    VkDeviceSize size = 0;
+    for(uint32_t level = 0; level < texture->m_mipLevels; level++)
+    {
+        size += Texture::getLevelSize(texture->m_fromat, std::max(1u, texture->m_width >> level), std::max(1u, texture->m_height >> level)) * texture->m_layerCount;
+    }
+    m_textures[key] = {texture, 1, size};
+    return texture;
+}
+
+Texture* ResourceCache::acquireEmptyTexture(VkQueue transferQueue)
+{
+    const std::string key = "<empty>";
+    auto it = m_textures.find(key);
+    if(it != m_textures.end())
+    {
+        it->second.refCount++;
+        m_statistics.textureHits++;
+        m_statistics.savedTextureBytes += it->second.size;
+        return it->second.object;
+    }
+
+    Texture* texture = Texture::loadTextureEmpty(transferQueue);
+    m_textures[key] = {texture, 1, 4};
+    return texture;
+}
+
+void ResourceCache::releaseTexture(Texture* texture)
+{
+    if(texture && release(m_textures, texture))
+    {
+        texture->clear();
+        delete texture;
+    }
+}
+
+GltfLoader* ResourceCache::acquireModel(const std::string& fileName, VkQueue transferQueue, uint32_t loadFlags, const std::vector<VertexComponent>& components)
+{
+    std::string key = getCanonicalPath(fileName) + "|" + std::to_string(loadFlags);
+    for(VertexComponent component : components)
+    {
+        key += "|" + std::to_string(static_cast<int>(component));
+    }
+
+    auto it = m_models.find(key);
+    if(it != m_models.end())
+    {
+        it->second.refCount++;
+        m_statistics.modelHits++;
+        m_statistics.savedModelBytes += it->second.size;
+        return it->second.object;
+    }
+
+    GltfLoader* loader = new GltfLoader();
+    loader->loadFromFile(fileName, transferQueue, loadFlags);
+    loader->setVertexBindingAndAttributeDescription(components);
+    loader->createVertexAndIndexBuffer();
+
+    VkMemoryRequirements vertexRequirements, indexRequirements;
+    vkGetBufferMemoryRequirements(Tools::m_device, loader->m_vertexBuffer, &vertexRequirements);
+    vkGetBufferMemoryRequirements(Tools::m_device, loader->m_indexBuffer, &indexRequirements);
+    m_models[key] = {loader, 1, vertexRequirements.size + indexRequirements.size};
+    return loader;
+}
+
+void ResourceCache::releaseModel(GltfLoader* loader)
+{
+    if(loader && release(m_models, loader))
+    {
+        loader->clear();
+        delete loader;
+    }
+}
+
+ResourceCache::SamplerKey ResourceCache::getSamplerKey(const VkSamplerCreateInfo& createInfo)
+{
+    //浮点按位比较
+    auto bits = [](float value) {
+        uint32_t result;
+        memcpy(&result, &value, sizeof(result));
+        return result;
+    };
+
+    SamplerKey key = {
+        createInfo.flags, static_cast<uint32_t>(createInfo.magFilter), static_cast<uint32_t>(createInfo.minFilter),
+        static_cast<uint32_t>(createInfo.mipmapMode), static_cast<uint32_t>(createInfo.addressModeU),
+        static_cast<uint32_t>(createInfo.addressModeV), static_cast<uint32_t>(createInfo.addressModeW),
+        bits(createInfo.mipLodBias), createInfo.anisotropyEnable, bits(createInfo.maxAnisotropy),
+        createInfo.compareEnable, static_cast<uint32_t>(createInfo.compareOp), bits(createInfo.minLod),
+        bits(createInfo.maxLod), static_cast<uint32_t>(createInfo.borderColor), createInfo.unnormalizedCoordinates
+    };
+    return key;
+}
+
+VkSampler ResourceCache::acquireSampler(const VkSamplerCreateInfo& createInfo)
+{
+    assert(createInfo.pNext == nullptr);
+    SamplerKey key = getSamplerKey(createInfo);
+    auto it = m_samplers.find(key);
+    if(it != m_samplers.end())
+    {
+        it->second.refCount++;
+        m_statistics.samplerHits++;
+        return it->second.object;
+    }
+
+    VkSampler sampler;
+    VK_CHECK_RESULT(vkCreateSampler(Tools::m_device, &createInfo, nullptr, &sampler));
+    m_samplers[key] = {sampler, 1, 0};
+    return sampler;
+}
+
+void ResourceCache::acquireTextureSampler(VkFilter filter, VkSamplerAddressMode addressMode, uint32_t maxLod, VkSampler& sampler)
+{
+    sampler = acquireSampler(Tools::getSamplerCreateInfo(filter, addressMode, maxLod));
+}
+
+void ResourceCache::releaseSampler(VkSampler sampler)
+{
+    if(sampler != VK_NULL_HANDLE && release(m_samplers, sampler))
+    {
+        vkDestroySampler(Tools::m_device, sampler, nullptr);
+    }
+}
+
+VkShaderModule ResourceCache::acquireShaderModule(const std::string& fileName)
+{
+    std::string key = getCanonicalPath(fileName);
+    auto it = m_shaderModules.find(key);
+    if(it != m_shaderModules.end())
+    {
+        it->second.refCount++;
+        m_statistics.shaderHits++;
+        return it->second.object;
+    }
+
+    VkShaderModule shaderModule = Tools::createShaderModule(fileName);
+    m_shaderModules[key] = {shaderModule, 1, 0};
+    return shaderModule;
+}
+
+void ResourceCache::releaseShaderModule(VkShaderModule shaderModule)
+{
+    if(shaderModule != VK_NULL_HANDLE && release(m_shaderModules, shaderModule))
+    {
+        vkDestroyShaderModule(Tools::m_device, shaderModule, nullptr);
+    }
+}
+
+void ResourceCache::clear()
+{
+    getStatistics();
+    std::cout << "resource cache: textures " << m_statistics.textureHits << " hits (" << m_statistics.savedTextureBytes / 1024 << " KB saved), models "
+              << m_statistics.modelHits << " hits (" << m_statistics.savedModelBytes / 1024 << " KB saved), samplers " << m_statistics.samplerHits
+              << " hits, shaders " << m_statistics.shaderHits << " hits" << std::endl;
+
+    //模型和纹理释放时会归还它们引用的纹理和采样器, 剩下的才是没有配对release的
+    size_t leakedCount = m_textures.size() + m_models.size();
+    while(!m_models.empty())
+    {
+        GltfLoader* loader = m_models.begin()->second.object;
+        m_models.erase(m_models.begin());
+        loader->clear();
+        delete loader;
+    }
+    while(!m_textures.empty())
+    {
+        Texture* texture = m_textures.begin()->second.object;
+        m_textures.erase(m_textures.begin());
+        texture->clear();
+        delete texture;
+    }
+    leakedCount += m_samplers.size() + m_shaderModules.size();
+    if(leakedCount > 0)
+    {
+        std::cout << "resource cache: " << leakedCount << " objects still referenced, destroy them" << std::endl;
+    }
+    
+    for(auto& it : m_samplers)
+    {
+        vkDestroySampler(Tools::m_device, it.second.object, nullptr);
+    }
+    for(auto& it : m_shaderModules)
+    {
+        vkDestroyShaderModule(Tools::m_device, it.second.object, nullptr);
+    }
+
+    m_models.clear();
+    m_textures.clear();
+    m_samplers.clear();
+    m_shaderModules.clear();
+    m_statistics = Statistics();
+}
+
+const ResourceCache::Statistics& ResourceCache::getStatistics()
+{
+    m_statistics.textureCount = static_cast<uint32_t>(m_textures.size());
+    m_statistics.modelCount = static_cast<uint32_t>(m_models.size());
+    m_statistics.samplerCount = static_cast<uint32_t>(m_samplers.size());
+    m_statistics.shaderCount = static_cast<uint32_t>(m_shaderModules.size());
+    return m_statistics;
+}
@@ -0,0 +1,71 @@
+
+#pragma once
+
+#include "tools.h"
+#include "texture.h"
+#include "gltfLoader.h"
+#include "vertex.h"
+#include <map>
+
+// 进程内共享的资源缓存. 纹理和模型按规范化路径加加载参数, 采样器按创建参数, shader按路径去重,
+// 同样的资源只加载和上传一次, 引用计数归零时销毁. acquire和release要成对, 只在主线程调用.
+// release传入不是从缓存拿到的对象时直接销毁, 所以Texture::clear可以统一释放采样器
+class ResourceCache
+{
+public:
+    struct Statistics {
+        uint32_t textureCount = 0;          //缓存里的对象数
+        uint32_t modelCount = 0;
+        uint32_t samplerCount = 0;
+        uint32_t shaderCount = 0;
+        uint32_t textureHits = 0;           //累计命中次数
+        uint32_t modelHits = 0;
+        uint32_t samplerHits = 0;
+        uint32_t shaderHits = 0;
+        VkDeviceSize savedTextureBytes = 0; //命中时省下的显存, 按所有mip和layer估算
+        VkDeviceSize savedModelBytes = 0;   //顶点和索引缓冲
+    };
+
+    static Texture* acquireTexture(const std::string& fileName, VkQueue transferQueue, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, TextureCopyRegion copyRegion = TextureCopyRegion::MipLevel, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    // 1x1全0的纹理, 作为缺省贴图和占位共用
+    static Texture* acquireEmptyTexture(VkQueue transferQueue);
+    static void releaseTexture(Texture* texture);
+
+    // 已经创建好顶点和索引缓冲的模型, 不能再调用clear. 描述符由使用者创建, createDescriptorPoolAndLayout只生效一次
+    static GltfLoader* acquireModel(const std::string& fileName, VkQueue transferQueue, uint32_t loadFlags, const std::vector<VertexComponent>& components);
+    static void releaseModel(GltfLoader* loader);
+
+    // createInfo的pNext必须为空
+    static VkSampler acquireSampler(const VkSamplerCreateInfo& createInfo);
+    // 和Tools::createTextureSampler参数一样
+    static void acquireTextureSampler(VkFilter filter, VkSamplerAddressMode addressMode, uint32_t maxLod, VkSampler& sampler);
+    static void releaseSampler(VkSampler sampler);
+
+    static VkShaderModule acquireShaderModule(const std::string& fileName);
+    static void releaseShaderModule(VkShaderModule shaderModule);
+
+    // 在销毁设备之前调用, 输出统计, 还有引用的对象直接销毁
+    static void clear();
+    static const Statistics& getStatistics();
+    static std::string getCanonicalPath(const std::string& fileName);
+
+private:
+    template <typename T> struct Entry {
+        T object;
+        uint32_t refCount;
+        VkDeviceSize size;
+    };
+
+    typedef std::array<uint32_t, 16> SamplerKey;
+    static SamplerKey getSamplerKey(const VkSamplerCreateInfo& createInfo);
+
+    // 减少引用, 返回true时调用者销毁对象(引用归零或者不在缓存里)
+    template <typename K, typename T> static bool release(std::map<K, Entry<T>>& entries, T object);
+
+private:
+    static std::map<std::string, Entry<Texture*>> m_textures;
+    static std::map<std::string, Entry<GltfLoader*>> m_models;
+    static std::map<SamplerKey, Entry<VkSampler>> m_samplers;
+    static std::map<std::string, Entry<VkShaderModule>> m_shaderModules;
+    static Statistics m_statistics;
+};
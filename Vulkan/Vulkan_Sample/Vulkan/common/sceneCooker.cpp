@@ -0,0 +1,627 @@
+
+#include "sceneCooker.h"
+#include "textureCompressor.h"
+#include "pixelConvert.h"
+#include "resourceCache.h"
+#include <chrono>
+#include <fstream>
+#include <unordered_map>
+#include <sys/stat.h>
+
+static size_t alignSize(size_t size)
+{
+    return (size + 15) & ~static_cast<size_t>(15);
+}
+
+template<typename T>
+static void appendSection(std::vector<uint8_t>& body, SceneCooker::Header& header, SceneCooker::SectionType type, const T* data, size_t count)
+{
+    size_t offset = alignSize(body.size());
+    size_t size = count * sizeof(T);
+    body.resize(offset + size, 0);
+    if(size > 0)
+    {
+        memcpy(body.data() + offset, data, size);
+    }
+    header.sections[type].offset = sizeof(SceneCooker::Header) + offset;
+    header.sections[type].size = size;
+}
+
+uint32_t SceneCooker::addString(std::vector<char>& strings, const std::string& value)
+{
+    uint32_t offset = static_cast<uint32_t>(strings.size());
+    strings.insert(strings.end(), value.begin(), value.end());
+    strings.push_back('\0');
+    return offset;
+}
+
+bool SceneCooker::cook(const std::string& inputFile, const std::string& outputFile, uint32_t loadFlags, uint32_t lodCount)
+{
+    auto tStart = std::chrono::high_resolution_clock::now();
+
+    GltfLoader loader;
+    loader.m_isCooking = true;
+    loader.m_lodCount = lodCount;
+    loader.loadFromFile(inputFile, VK_NULL_HANDLE, loadFlags & m_cookedFlagMask);
+    const tinygltf::Model& model = loader.m_gltfModel;
+
+    Header header = {};
+    header.magic = m_magic;
+    header.version = m_version;
+    header.loadFlags = loadFlags & m_cookedFlagMask;
+    header.lodCount = lodCount;
+    header.min = glm::vec4(loader.m_min, loader.m_radius);
+    header.max = glm::vec4(loader.m_max, loader.m_radius);
+
+    std::vector<char> strings;
+    addString(strings, "");
+
+    std::unordered_map<GltfNode*, uint32_t> nodeIndices;
+    for(uint32_t i = 0; i < loader.m_linearNodes.size(); ++i)
+    {
+        nodeIndices[loader.m_linearNodes[i]] = i;
+    }
+
+    std::unordered_map<::Material*, uint32_t> materialIndices;
+    for(uint32_t i = 0; i < loader.m_materials.size(); ++i)
+    {
+        materialIndices[loader.m_materials[i]] = i;
+    }
+
+    // 结点和primitive
+    std::vector<Node> nodes;
+    std::vector<Primitive> primitives;
+    std::vector<::Primitive::Lod> lods;
+    for(GltfNode* source : loader.m_linearNodes)
+    {
+        Node node = {};
+        node.parent = source->m_parent ? static_cast<int32_t>(nodeIndices[source->m_parent]) : -1;
+        node.indexAtScene = source->m_indexAtScene;
+        node.name = addString(strings, source->m_name);
+        node.skinIndex = static_cast<int32_t>(source->m_skinIndex);
+        node.translation = glm::vec4(source->m_translation, 0.0f);
+        node.rotation = glm::vec4(source->m_rotation.x, source->m_rotation.y, source->m_rotation.z, source->m_rotation.w);
+        node.scale = glm::vec4(source->m_scale, 0.0f);
+        node.originMat = source->m_originMat;
+
+        if(source->m_mesh)
+        {
+            node.hasMesh = 1;
+            node.meshName = addString(strings, source->m_mesh->m_name);
+            node.firstPrimitive = static_cast<uint32_t>(primitives.size());
+            node.primitiveCount = static_cast<uint32_t>(source->m_mesh->m_primitives.size());
+            for(::Primitive* sourcePrimitive : source->m_mesh->m_primitives)
+            {
+                Primitive primitive = {};
+                primitive.vertexOffset = sourcePrimitive->m_vertexOffset;
+                primitive.vertexCount = sourcePrimitive->m_vertexCount;
+                primitive.indexOffset = sourcePrimitive->m_indexOffset;
+                primitive.indexCount = sourcePrimitive->m_indexCount;
+                primitive.material = materialIndices[sourcePrimitive->m_material];
+                primitive.firstLod = static_cast<uint32_t>(lods.size());
+                primitive.lodCount = static_cast<uint32_t>(sourcePrimitive->m_lods.size());
+                primitive.min = glm::vec4(sourcePrimitive->m_min, 0.0f);
+                primitive.max = glm::vec4(sourcePrimitive->m_max, 0.0f);
+                lods.insert(lods.end(), sourcePrimitive->m_lods.begin(), sourcePrimitive->m_lods.end());
+                primitives.push_back(primitive);
+            }
+        }
+        nodes.push_back(node);
+    }
+
+    // 材质, 纹理下标直接从glTF里取
+    std::vector<Material> materials;
+    for(uint32_t i = 0; i < loader.m_materials.size(); ++i)
+    {
+        const ::Material* source = loader.m_materials[i];
+        Material material = {};
+        material.alphaMode = source->m_alphaMode;
+        material.alphaCutoff = source->m_alphaCutoff;
+        material.doubleSided = source->m_doubleSided ? 1 : 0;
+        material.metallic = source->m_metallic;
+        material.roughness = source->m_roughness;
+        material.baseColor = source->m_baseColor;
+        material.baseColorTexture = -1;
+        material.normalTexture = -1;
+        if(i < model.materials.size())
+        {
+            const tinygltf::Material& mat = model.materials[i];
+            auto baseColor = mat.values.find("baseColorTexture");
+            if(baseColor != mat.values.end())
+            {
+                material.baseColorTexture = model.textures[baseColor->second.TextureIndex()].source;
+            }
+            auto normal = mat.additionalValues.find("normalTexture");
+            if(normal != mat.additionalValues.end())
+            {
+                material.normalTexture = model.textures[normal->second.TextureIndex()].source;
+            }
+        }
+        materials.push_back(material);
+    }
+
+    // 图片, 和Texture::loadTexture2D的处理保持一致
+    std::vector<Texture> textures;
+    std::vector<uint8_t> textureData;
+    ThreadPool threadPool;
+    if(loadFlags & GltfFileLoadFlags::CompressTextures)
+    {
+        threadPool.setThreadCount(std::max(1u, std::thread::hardware_concurrency()));
+    }
+    for(const tinygltf::Image& image : model.images)
+    {
+        Texture texture = {};
+        texture.name = addString(strings, image.uri);
+
+        std::vector<uint8_t> data;
+        size_t dot = image.uri.find_last_of(".");
+        if(dot != std::string::npos && image.uri.substr(dot + 1) == "ktx")
+        {
+            std::vector<char> file = Tools::readFile(loader.m_modelPath + "/" + image.uri);
+            data.assign(file.begin(), file.end());
+            texture.type = TextureType::Ktx;
+        }
+        else
+        {
+            // 统一转成RGBA8, 灰度复制到rgb, 16位取高字节. 图片缺失时用1x1白色代替
+            size_t pixelCount = 0;
+            uint32_t bytesPerChannel = 1;
+            if(image.image.empty())
+            {
+                std::cout << "cook " << image.uri << " is missing, use white instead" << std::endl;
+            }
+            else if((image.bits != 8 && image.bits != 16) || image.component < 1 || image.component > 4)
+            {
+                std::cout << "cook " << image.uri << " failed, unsupported image format" << std::endl;
+                return false;
+            }
+            else
+            {
+                pixelCount = static_cast<size_t>(image.width) * image.height;
+                bytesPerChannel = image.bits / 8;
+            }
+            std::vector<uint8_t> rgba(std::max<size_t>(pixelCount, 1) * 4, 255);
+            if(bytesPerChannel == 1 && image.component == 3)
+            {
+                PixelConvert::rgbToRgba(image.image.data(), rgba.data(), pixelCount);
+            }
+            else if(bytesPerChannel == 1 && image.component == 4)
+            {
+                memcpy(rgba.data(), image.image.data(), pixelCount * 4);
+            }
+            else
+            {
+                for(size_t i = 0; i < pixelCount; ++i)
+                {
+                    const uint8_t* src = &image.image[i * image.component * bytesPerChannel];
+                    uint8_t channels[4];
+                    for(int32_t j = 0; j < image.component; ++j)
+                    {
+                        channels[j] = src[j * bytesPerChannel + bytesPerChannel - 1];
+                    }
+                    uint8_t* dst = &rgba[i * 4];
+                    if(image.component <= 2)
+                    {
+                        dst[0] = dst[1] = dst[2] = channels[0];
+                        dst[3] = image.component == 2 ? channels[1] : 255;
+                    }
+                    else
+                    {
+                        memcpy(dst, channels, image.component);
+                    }
+                }
+            }
+
+            texture.type = TextureType::Rgba8Mips;
+            texture.width = pixelCount > 0 ? image.width : 1;
+            texture.height = pixelCount > 0 ? image.height : 1;
+            texture.mipLevels = static_cast<uint32_t>(floor(log2(std::max(texture.width, texture.height))) + 1.0);
+            ::Texture::generateMipChain(rgba.data(), texture.width, texture.height, texture.mipLevels, data);
+
+            if(loadFlags & GltfFileLoadFlags::CompressTextures)
+            {
+                ::TextureData source;
+                source.m_width = texture.width;
+                source.m_height = texture.height;
+                source.m_mipLevels = texture.mipLevels;
+                VkDeviceSize offset = 0;
+                for(uint32_t level = 0; level < texture.mipLevels; ++level)
+                {
+                    source.m_mipOffsets.push_back(offset);
+                    offset += ::Texture::getLevelSize(VK_FORMAT_R8G8B8A8_UNORM, std::max(1u, texture.width >> level), std::max(1u, texture.height >> level));
+                }
+                source.m_data.swap(data);
+
+                uint32_t imageIndex = static_cast<uint32_t>(textures.size());
+                bool isNormalMap = std::any_of(materials.begin(), materials.end(), [imageIndex](const Material& material) {
+                    return material.normalTexture == static_cast<int32_t>(imageIndex);
+                });
+                VkFormat format = TextureCompressor::chooseFormat(source, isNormalMap);
+                TextureCompressor::compress(source, format, &threadPool);
+                data.swap(source.m_data);
+                texture.type = TextureType::Compressed;
+                texture.format = format;
+            }
+        }
+
+        texture.dataOffset = alignSize(textureData.size());
+        texture.dataSize = data.size();
+        textureData.resize(texture.dataOffset + data.size());
+        memcpy(textureData.data() + texture.dataOffset, data.data(), data.size());
+        textures.push_back(texture);
+    }
+
+    // 蒙皮
+    std::vector<Skin> skins;
+    std::vector<uint32_t> joints;
+    std::vector<glm::mat4> inverseBindMatrices;
+    for(::Skin* source : loader.m_skins)
+    {
+        Skin skin = {};
+        skin.name = addString(strings, source->m_name);
+        skin.rootSkeleton = source->m_pRootSkeleton ? static_cast<int32_t>(nodeIndices[source->m_pRootSkeleton]) : -1;
+        skin.firstJoint = static_cast<uint32_t>(joints.size());
+        skin.jointCount = static_cast<uint32_t>(source->m_joints.size());
+        skin.firstInverseBindMatrix = static_cast<uint32_t>(inverseBindMatrices.size());
+        skin.inverseBindMatrixCount = static_cast<uint32_t>(source->m_inverseBindMatrices.size());
+        for(GltfNode* joint : source->m_joints)
+        {
+            joints.push_back(nodeIndices[joint]);
+        }
+        inverseBindMatrices.insert(inverseBindMatrices.end(), source->m_inverseBindMatrices.begin(), source->m_inverseBindMatrices.end());
+        skins.push_back(skin);
+    }
+
+    // 动画
+    std::vector<Animation> animations;
+    std::vector<Sampler> samplers;
+    std::vector<Channel> channels;
+    std::vector<float> keyFrames;
+    std::vector<glm::vec4> values;
+    for(::Animation* source : loader.m_animations)
+    {
+        Animation animation = {};
+        animation.name = addString(strings, source->m_name);
+        animation.start = source->m_start;
+        animation.end = source->m_end;
+        animation.firstSampler = static_cast<uint32_t>(samplers.size());
+        animation.samplerCount = static_cast<uint32_t>(source->m_samplers.size());
+        animation.firstChannel = static_cast<uint32_t>(channels.size());
+        animation.channelCount = static_cast<uint32_t>(source->m_channels.size());
+
+        for(const AnimationSampler& sourceSampler : source->m_samplers)
+        {
+            Sampler sampler = {};
+            sampler.type = sourceSampler.m_samplerType;
+            sampler.firstKeyFrame = static_cast<uint32_t>(keyFrames.size());
+            sampler.keyFrameCount = static_cast<uint32_t>(sourceSampler.m_keyFrames.size());
+            sampler.firstValue = static_cast<uint32_t>(values.size());
+            sampler.valueCount = static_cast<uint32_t>(sourceSampler.m_values.size());
+            keyFrames.insert(keyFrames.end(), sourceSampler.m_keyFrames.begin(), sourceSampler.m_keyFrames.end());
+            values.insert(values.end(), sourceSampler.m_values.begin(), sourceSampler.m_values.end());
+            samplers.push_back(sampler);
+        }
+
+        for(const AnimationChannel& sourceChannel : source->m_channels)
+        {
+            Channel channel = {};
+            channel.type = sourceChannel.m_channelType;
+            channel.node = nodeIndices[sourceChannel.m_node];
+            channel.samplerIndex = sourceChannel.m_samplerIndex;
+            channels.push_back(channel);
+        }
+        animations.push_back(animation);
+    }
+
+    std::vector<uint8_t> body;
+    appendSection(body, header, SectionType::Strings, strings.data(), strings.size());
+    appendSection(body, header, SectionType::Vertices, loader.m_vertexData.data(), loader.m_vertexData.size());
+    appendSection(body, header, SectionType::Indices, loader.m_indexData.data(), loader.m_indexData.size());
+    appendSection(body, header, SectionType::Nodes, nodes.data(), nodes.size());
+    appendSection(body, header, SectionType::Primitives, primitives.data(), primitives.size());
+    appendSection(body, header, SectionType::Lods, lods.data(), lods.size());
+    appendSection(body, header, SectionType::Materials, materials.data(), materials.size());
+    appendSection(body, header, SectionType::Textures, textures.data(), textures.size());
+    appendSection(body, header, SectionType::TextureData, textureData.data(), textureData.size());
+    appendSection(body, header, SectionType::Skins, skins.data(), skins.size());
+    appendSection(body, header, SectionType::Joints, joints.data(), joints.size());
+    appendSection(body, header, SectionType::InverseBindMatrices, inverseBindMatrices.data(), inverseBindMatrices.size());
+    appendSection(body, header, SectionType::Animations, animations.data(), animations.size());
+    appendSection(body, header, SectionType::Samplers, samplers.data(), samplers.size());
+    appendSection(body, header, SectionType::Channels, channels.data(), channels.size());
+    appendSection(body, header, SectionType::KeyFrames, keyFrames.data(), keyFrames.size());
+    appendSection(body, header, SectionType::Values, values.data(), values.size());
+
+    std::ofstream file(outputFile, std::ios::binary | std::ios::trunc);
+    if(!file.is_open())
+    {
+        std::cout << "failed to open " << outputFile << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+    file.write(reinterpret_cast<const char*>(body.data()), body.size());
+    file.close();
+
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    std::cout << "cook " << inputFile << " -> " << outputFile << ", " << (sizeof(Header) + body.size()) / 1024 << " KB, "
+              << std::chrono::duration<double, std::milli>(tEnd - tStart).count() << " ms" << std::endl;
+    return true;
+}
+
+bool SceneCooker::isOutdated(const std::string& cookedFile, const MappedFile& file, const Header* header)
+{
+    struct stat cookedStat, sourceStat;
+    if(stat(cookedFile.c_str(), &cookedStat) != 0)
+    {
+        return true;
+    }
+
+    const std::string suffix = ".cooked";
+    if(cookedFile.size() > suffix.size() && cookedFile.compare(cookedFile.size() - suffix.size(), suffix.size(), suffix) == 0)
+    {
+        std::string sourceFile = cookedFile.substr(0, cookedFile.size() - suffix.size());
+        if(stat(sourceFile.c_str(), &sourceStat) == 0 && sourceStat.st_mtime > cookedStat.st_mtime)
+        {
+            return true;
+        }
+    }
+
+    // 纹理名是图片的uri, 内嵌的图片跟着glTF一起比较
+    std::string modelPath = cookedFile.substr(0, cookedFile.find_last_of('/'));
+    uint32_t count = 0;
+    const char* strings = getSection<char>(file, header, SectionType::Strings, count);
+    const Texture* textures = getSection<Texture>(file, header, SectionType::Textures, count);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        std::string uri = strings + textures[i].name;
+        if(uri.empty() || uri.compare(0, 5, "data:") == 0)
+        {
+            continue;
+        }
+        if(stat((modelPath + "/" + uri).c_str(), &sourceStat) == 0 && sourceStat.st_mtime > cookedStat.st_mtime)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SceneCooker::load(GltfLoader* pLoader, const std::string& cookedFile)
+{
+    // 顶点和索引直接引用映射的文件, 映射保留到GltfLoader::clear, createVertexAndIndexBuffer从映射拷贝到staging buffer
+    MappedFile& file = pLoader->m_cookedFile;
+    if(!file.open(cookedFile) || file.m_size < sizeof(Header))
+    {
+        file.close();
+        return false;
+    }
+
+    const Header* header = reinterpret_cast<const Header*>(file.m_data);
+    if(header->magic != m_magic || header->version != m_version)
+    {
+        std::cout << cookedFile << " version mismatch, load gltf instead" << std::endl;
+        file.close();
+        return false;
+    }
+
+    uint32_t loadFlags = pLoader->m_loadFlags & m_cookedFlagMask;
+    if(header->loadFlags != loadFlags || ((loadFlags & GltfFileLoadFlags::GenerateLods) && header->lodCount != pLoader->m_lodCount))
+    {
+        std::cout << cookedFile << " was cooked with other load flags, load gltf instead" << std::endl;
+        file.close();
+        return false;
+    }
+
+    for(uint32_t i = 0; i < SectionType::SectionCount; ++i)
+    {
+        if(header->sections[i].offset + header->sections[i].size > file.m_size)
+        {
+            std::cout << cookedFile << " is truncated, load gltf instead" << std::endl;
+            file.close();
+            return false;
+        }
+    }
+
+    if(isOutdated(cookedFile, file, header))
+    {
+        std::cout << cookedFile << " is older than its source, load gltf instead" << std::endl;
+        file.close();
+        return false;
+    }
+
+    size_t pos = cookedFile.find_last_of('/');
+    pLoader->m_modelPath = cookedFile.substr(0, pos);
+
+    uint32_t count = 0;
+    const char* strings = getSection<char>(file, header, SectionType::Strings, count);
+
+    const Vertex* vertices = getSection<Vertex>(file, header, SectionType::Vertices, count);
+    pLoader->m_pCookedVertices = vertices;
+    pLoader->m_cookedVertexCount = count;
+    const uint32_t* indices = getSection<uint32_t>(file, header, SectionType::Indices, count);
+    pLoader->m_pCookedIndices = indices;
+    pLoader->m_cookedIndexCount = count;
+
+    // 纹理
+    if(!(pLoader->m_loadFlags & GltfFileLoadFlags::DontLoadImages))
+    {
+        const Texture* textures = getSection<Texture>(file, header, SectionType::Textures, count);
+        const uint8_t* textureData = file.m_data + header->sections[SectionType::TextureData].offset;
+        for(uint32_t i = 0; i < count; ++i)
+        {
+            const Texture& texture = textures[i];
+            ::Texture* newTexture = nullptr;
+            if(texture.type == TextureType::Ktx)
+            {
+                newTexture = ::Texture::loadTextrue2DFromKtxMemory(textureData + texture.dataOffset, texture.dataSize, pLoader->m_graphicsQueue);
+            }
+            else if(texture.type == TextureType::Compressed)
+            {
+                newTexture = ::Texture::loadTextrue2DWithMips(textureData + texture.dataOffset, texture.dataSize, texture.width, texture.height,
+                                                              texture.mipLevels, static_cast<VkFormat>(texture.format), pLoader->m_graphicsQueue);
+            }
+            else
+            {
+                newTexture = ::Texture::loadTextrue2DWithMips(textureData + texture.dataOffset, texture.dataSize, texture.width, texture.height,
+                                                              texture.mipLevels, VK_FORMAT_R8G8B8A8_UNORM, pLoader->m_graphicsQueue);
+            }
+            newTexture->m_name = strings + texture.name;
+            pLoader->m_textures.push_back(newTexture);
+        }
+        pLoader->m_emptyTexture = ResourceCache::acquireEmptyTexture(pLoader->m_graphicsQueue);
+    }
+
+    // 材质
+    const Material* materials = getSection<Material>(file, header, SectionType::Materials, count);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        const Material& material = materials[i];
+        ::Material* newMat = new ::Material();
+        newMat->m_alphaMode = static_cast<::Material::AlphaMode>(material.alphaMode);
+        newMat->m_alphaCutoff = material.alphaCutoff;
+        newMat->m_doubleSided = material.doubleSided != 0;
+        newMat->m_metallic = material.metallic;
+        newMat->m_roughness = material.roughness;
+        newMat->m_baseColor = material.baseColor;
+        int32_t textureCount = static_cast<int32_t>(pLoader->m_textures.size());
+        if(material.baseColorTexture > -1 && material.baseColorTexture < textureCount)
+        {
+            newMat->m_pBaseColorTexture = pLoader->m_textures[material.baseColorTexture];
+        }
+        if(material.normalTexture > -1 && material.normalTexture < textureCount)
+        {
+            newMat->m_pNormalTexture = pLoader->m_textures[material.normalTexture];
+        }
+        else
+        {
+            newMat->m_pNormalTexture = pLoader->m_emptyTexture;
+        }
+        pLoader->m_materials.push_back(newMat);
+    }
+
+    // 结点, 先全部创建再连接父子关系. 线性顺序里子结点在父结点之前, 顺序添加即保持原来的子结点顺序
+    uint32_t primitiveCount = 0;
+    uint32_t lodCount = 0;
+    const Primitive* primitives = getSection<Primitive>(file, header, SectionType::Primitives, primitiveCount);
+    const ::Primitive::Lod* lods = getSection<::Primitive::Lod>(file, header, SectionType::Lods, lodCount);
+    const Node* nodes = getSection<Node>(file, header, SectionType::Nodes, count);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        pLoader->m_linearNodes.push_back(new GltfNode());
+    }
+
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        const Node& node = nodes[i];
+        GltfNode* newNode = pLoader->m_linearNodes[i];
+        newNode->m_parent = node.parent > -1 ? pLoader->m_linearNodes[node.parent] : nullptr;
+        newNode->m_indexAtScene = node.indexAtScene;
+        newNode->m_name = strings + node.name;
+        newNode->m_skinIndex = static_cast<uint32_t>(node.skinIndex);
+        newNode->m_translation = glm::vec3(node.translation);
+        newNode->m_rotation.x = node.rotation.x;
+        newNode->m_rotation.y = node.rotation.y;
+        newNode->m_rotation.z = node.rotation.z;
+        newNode->m_rotation.w = node.rotation.w;
+        newNode->m_scale = glm::vec3(node.scale);
+        newNode->m_originMat = node.originMat;
+
+        if(node.hasMesh)
+        {
+            Mesh* newMesh = new Mesh();
+            newMesh->m_name = strings + node.meshName;
+            newMesh->m_matrix = node.originMat;
+            for(uint32_t j = node.firstPrimitive; j < node.firstPrimitive + node.primitiveCount && j < primitiveCount; ++j)
+            {
+                const Primitive& primitive = primitives[j];
+                ::Primitive* newPrimitive = new ::Primitive();
+                newPrimitive->m_vertexOffset = primitive.vertexOffset;
+                newPrimitive->m_vertexCount = primitive.vertexCount;
+                newPrimitive->m_indexOffset = primitive.indexOffset;
+                newPrimitive->m_indexCount = primitive.indexCount;
+                newPrimitive->m_material = pLoader->m_materials.at(primitive.material);
+                newPrimitive->m_min = glm::vec3(primitive.min);
+                newPrimitive->m_max = glm::vec3(primitive.max);
+                if(primitive.firstLod + primitive.lodCount <= lodCount)
+                {
+                    newPrimitive->m_lods.assign(lods + primitive.firstLod, lods + primitive.firstLod + primitive.lodCount);
+                }
+                newMesh->m_primitives.push_back(newPrimitive);
+            }
+            newNode->m_mesh = newMesh;
+        }
+
+        if(newNode->m_parent)
+        {
+            newNode->m_parent->m_children.push_back(newNode);
+        }
+        else
+        {
+            pLoader->m_treeNodes.push_back(newNode);
+        }
+    }
+
+    for(GltfNode* node : pLoader->m_linearNodes)
+    {
+        if(node->m_mesh)
+        {
+            node->m_worldMatrix = node->worldMatrix();
+        }
+    }
+
+    // 蒙皮
+    const uint32_t* joints = getSection<uint32_t>(file, header, SectionType::Joints, count);
+    const glm::mat4* inverseBindMatrices = getSection<glm::mat4>(file, header, SectionType::InverseBindMatrices, count);
+    const Skin* skins = getSection<Skin>(file, header, SectionType::Skins, count);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        const Skin& skin = skins[i];
+        ::Skin* newSkin = new ::Skin();
+        newSkin->m_name = strings + skin.name;
+        newSkin->m_pRootSkeleton = skin.rootSkeleton > -1 ? pLoader->m_linearNodes[skin.rootSkeleton] : nullptr;
+        for(uint32_t j = 0; j < skin.jointCount; ++j)
+        {
+            newSkin->m_joints.push_back(pLoader->m_linearNodes[joints[skin.firstJoint + j]]);
+        }
+        newSkin->m_inverseBindMatrices.assign(inverseBindMatrices + skin.firstInverseBindMatrix,
+                                              inverseBindMatrices + skin.firstInverseBindMatrix + skin.inverseBindMatrixCount);
+        pLoader->m_skins.push_back(newSkin);
+    }
+
+    // 动画
+    const Sampler* samplers = getSection<Sampler>(file, header, SectionType::Samplers, count);
+    const Channel* channels = getSection<Channel>(file, header, SectionType::Channels, count);
+    const float* keyFrames = getSection<float>(file, header, SectionType::KeyFrames, count);
+    const glm::vec4* values = getSection<glm::vec4>(file, header, SectionType::Values, count);
+    const Animation* animations = getSection<Animation>(file, header, SectionType::Animations, count);
+    for(uint32_t i = 0; i < count; ++i)
+    {
+        const Animation& animation = animations[i];
+        ::Animation* newAnimation = new ::Animation();
+        newAnimation->m_name = strings + animation.name;
+        newAnimation->m_start = animation.start;
+        newAnimation->m_end = animation.end;
+        for(uint32_t j = animation.firstSampler; j < animation.firstSampler + animation.samplerCount; ++j)
+        {
+            AnimationSampler sampler = {};
+            sampler.m_samplerType = static_cast<AnimationSamplerType>(samplers[j].type);
+            sampler.m_keyFrames.assign(keyFrames + samplers[j].firstKeyFrame, keyFrames + samplers[j].firstKeyFrame + samplers[j].keyFrameCount);
+            sampler.m_values.assign(values + samplers[j].firstValue, values + samplers[j].firstValue + samplers[j].valueCount);
+            newAnimation->m_samplers.push_back(sampler);
+        }
+        for(uint32_t j = animation.firstChannel; j < animation.firstChannel + animation.channelCount; ++j)
+        {
+            AnimationChannel channel = {};
+            channel.m_channelType = static_cast<AnimationChannelType>(channels[j].type);
+            channel.m_node = pLoader->m_linearNodes[channels[j].node];
+            channel.m_samplerIndex = channels[j].samplerIndex;
+            newAnimation->m_channels.push_back(channel);
+        }
+        pLoader->m_animations.push_back(newAnimation);
+    }
+
+    pLoader->m_min = glm::vec3(header->min);
+    pLoader->m_max = glm::vec3(header->max);
+    pLoader->m_radius = header->min.w;
+    return true;
+}
@@ -0,0 +1,147 @@
+
+#pragma once
+
+#include "tools.h"
+#include "gltfLoader.h"
+#include "mappedFile.h"
+
+// 离线把glTF烘焙成二进制场景文件(<file>.gltf.cooked), 运行时mmap后直接拷贝, 不再解析json和解码图片.
+// 文件由Header和若干16字节对齐的段组成, 段内都是POD数组, 结点/材质/纹理之间用数组下标引用,
+// 名字放在字符串段里. 普通图片存RGBA8和CPU生成的完整mip链, 带CompressTextures时再压缩成BC块, ktx图片原样内嵌
+class SceneCooker
+{
+public:
+    static const uint32_t m_magic = 0x53434947;     // "GICS"
+    static const uint32_t m_version = 2;
+    // 影响烘焙结果的加载选项, 其它选项在运行时处理
+    static const uint32_t m_cookedFlagMask = GltfFileLoadFlags::PreTransformVertices | GltfFileLoadFlags::PreMultiplyVertexColors |
+                                             GltfFileLoadFlags::FlipY | GltfFileLoadFlags::OptimizeMesh | GltfFileLoadFlags::GenerateLods |
+                                             GltfFileLoadFlags::CompressTextures;
+
+    enum SectionType {
+        Strings, Vertices, Indices, Nodes, Primitives, Lods, Materials, Textures, TextureData,
+        Skins, Joints, InverseBindMatrices, Animations, Samplers, Channels, KeyFrames, Values,
+        SectionCount
+    };
+
+    struct Section {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t loadFlags;
+        uint32_t lodCount;
+        glm::vec4 min;      //w为包围球半径
+        glm::vec4 max;
+        Section sections[SectionCount];
+    };
+
+    struct Node {
+        int32_t parent;         //m_linearNodes中的下标, -1为根结点
+        uint32_t indexAtScene;
+        uint32_t name;          //字符串段中的偏移
+        int32_t skinIndex;
+        glm::vec4 translation;
+        glm::vec4 rotation;     //xyzw
+        glm::vec4 scale;
+        glm::mat4 originMat;
+        uint32_t hasMesh;
+        uint32_t meshName;
+        uint32_t firstPrimitive;
+        uint32_t primitiveCount;
+    };
+
+    struct Primitive {
+        uint32_t vertexOffset;
+        uint32_t vertexCount;
+        uint32_t indexOffset;
+        uint32_t indexCount;
+        uint32_t material;
+        uint32_t firstLod;
+        uint32_t lodCount;
+        uint32_t padding;
+        glm::vec4 min;
+        glm::vec4 max;
+    };
+
+    struct Material {
+        uint32_t alphaMode;
+        float alphaCutoff;
+        uint32_t doubleSided;
+        float metallic;
+        float roughness;
+        int32_t baseColorTexture;   //m_textures中的下标, -1为没有
+        int32_t normalTexture;
+        uint32_t padding;
+        glm::vec4 baseColor;
+    };
+
+    enum TextureType { Rgba8Mips, Ktx, Compressed };
+
+    struct Texture {
+        uint32_t type;
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipLevels;
+        uint64_t dataOffset;        //TextureData段中的偏移
+        uint64_t dataSize;
+        uint32_t name;
+        uint32_t format;            //Compressed时的VkFormat
+        uint32_t padding[2];
+    };
+
+    struct Skin {
+        uint32_t name;
+        int32_t rootSkeleton;
+        uint32_t firstJoint;
+        uint32_t jointCount;
+        uint32_t firstInverseBindMatrix;
+        uint32_t inverseBindMatrixCount;
+    };
+
+    struct Animation {
+        uint32_t name;
+        float start;
+        float end;
+        uint32_t firstSampler;
+        uint32_t samplerCount;
+        uint32_t firstChannel;
+        uint32_t channelCount;
+    };
+
+    struct Sampler {
+        uint32_t type;
+        uint32_t firstKeyFrame;
+        uint32_t keyFrameCount;
+        uint32_t firstValue;
+        uint32_t valueCount;
+    };
+
+    struct Channel {
+        uint32_t type;
+        uint32_t node;
+        uint32_t samplerIndex;
+    };
+
+public:
+    // 离线烘焙, 只用到CPU, 不需要创建Vulkan设备
+    static bool cook(const std::string& inputFile, const std::string& outputFile, uint32_t loadFlags, uint32_t lodCount = 4);
+    // 加载选项或版本不匹配, 或者源文件比烘焙文件新时返回false, 由调用者退回到解析glTF
+    static bool load(GltfLoader* pLoader, const std::string& cookedFile);
+
+private:
+    static uint32_t addString(std::vector<char>& strings, const std::string& value);
+    // 源glTF(去掉.cooked后缀)或它引用的图片文件比烘焙文件新. 源文件不存在时不算过期, 烘焙文件可以单独发布
+    static bool isOutdated(const std::string& cookedFile, const MappedFile& file, const Header* header);
+
+    template<typename T>
+    static const T* getSection(const MappedFile& file, const Header* header, SectionType type, uint32_t& count)
+    {
+        const Section& section = header->sections[type];
+        count = static_cast<uint32_t>(section.size / sizeof(T));
+        return reinterpret_cast<const T*>(file.m_data + section.offset);
+    }
+};
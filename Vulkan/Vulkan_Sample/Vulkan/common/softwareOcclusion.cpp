@@ -0,0 +1,429 @@
+
+#include "softwareOcclusion.h"
+#include "bvh.h"
+
+#if defined(__SSE2__) || defined(__x86_64__)
+#define OCCLUSION_USE_SSE 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define OCCLUSION_USE_NEON 1
+#include <arm_neon.h>
+#endif
+
+SoftwareOcclusion::SoftwareOcclusion()
+{
+}
+
+SoftwareOcclusion::~SoftwareOcclusion()
+{}
+
+void SoftwareOcclusion::clear()
+{
+    m_threadPool.m_threads.clear();
+    m_occluders.clear();
+    m_vertices.clear();
+    m_frameTriangles.clear();
+    m_slotTriangles.clear();
+    m_slotBins.clear();
+    m_depth.clear();
+    m_tileMaxDepth.clear();
+}
+
+void SoftwareOcclusion::prepare(GltfLoader* pLoader, uint32_t width, uint32_t height)
+{
+    assert(width % m_tileWidth == 0 && height % m_tileHeight == 0);
+    m_width = width;
+    m_height = height;
+    m_tileCountX = width / m_tileWidth;
+    m_tileCountY = height / m_tileHeight;
+    m_depth.assign(width * height, 1.0f);
+    m_tileMaxDepth.assign(m_tileCountX * m_tileCountY, 1.0f);
+
+    std::vector<Bvh::SceneObject> objects;
+    std::vector<Bvh::Aabb> bounds;
+    Bvh::getSceneBounds(pLoader, objects, bounds);
+
+    Bvh::Aabb sceneBounds;
+    for(const Bvh::Aabb& box : bounds)
+    {
+        sceneBounds.grow(box);
+    }
+    float minDiagonal = glm::distance(sceneBounds.min, sceneBounds.max) * m_occluderSizeRatio;
+
+    bool preTransform = pLoader->getLoadFlags() & GltfFileLoadFlags::PreTransformVertices;
+    m_occluders.clear();
+    m_vertices.clear();
+    for(size_t i = 0; i < objects.size(); ++i)
+    {
+        // alpha测试和半透明的表面有洞, 不能遮挡
+        Material* mat = objects[i].primitive->m_material;
+        if(mat && mat->m_alphaMode != Material::OPAQUE)
+        {
+            continue;
+        }
+
+        if(glm::distance(bounds[i].min, bounds[i].max) < minDiagonal)
+        {
+            continue;
+        }
+
+        Primitive* primitive = objects[i].primitive;
+        // 预变换过的顶点已经在世界空间
+        glm::mat4 worldMatrix = preTransform ? glm::mat4(1.0f) : objects[i].node->m_worldMatrix;
+
+        Occluder occluder = {};
+        occluder.firstVertex = static_cast<uint32_t>(m_vertices.size());
+        occluder.triangleCount = primitive->m_indexCount / 3;
+        occluder.min = bounds[i].min;
+        occluder.max = bounds[i].max;
+        for(uint32_t j = 0; j < occluder.triangleCount * 3; ++j)
+        {
+            uint32_t index = pLoader->getIndices()[primitive->m_indexOffset + j];
+            m_vertices.push_back(glm::vec3(worldMatrix * glm::vec4(pLoader->getVertices()[index].m_position, 1.0f)));
+        }
+        m_occluders.push_back(occluder);
+    }
+
+    m_threadPool.setThreadCount(std::max(1u, std::thread::hardware_concurrency()));
+}
+
+bool SoftwareOcclusion::projectBounds(const glm::vec3& min, const glm::vec3& max, glm::vec4& rect, float& minDepth) const
+{
+    rect = glm::vec4(FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX);
+    minDepth = FLT_MAX;
+    for(uint32_t i = 0; i < 8; ++i)
+    {
+        glm::vec3 corner = glm::vec3((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+        glm::vec4 clip = m_viewProjMatrix * glm::vec4(corner, 1.0f);
+        // 跨过近平面时无法得到屏幕矩形
+        if(clip.w <= 1e-4f || clip.z < 0.0f)
+        {
+            return false;
+        }
+
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        float x = (ndc.x * 0.5f + 0.5f) * m_width;
+        float y = (ndc.y * 0.5f + 0.5f) * m_height;
+        rect = glm::vec4(std::min(rect.x, x), std::min(rect.y, y), std::max(rect.z, x), std::max(rect.w, y));
+        minDepth = std::min(minDepth, ndc.z);
+    }
+    return true;
+}
+
+void SoftwareOcclusion::render(const glm::mat4& viewProjMatrix)
+{
+    m_viewProjMatrix = viewProjMatrix;
+    m_frustum.update(viewProjMatrix);
+    std::fill(m_depth.begin(), m_depth.end(), 1.0f);
+
+    // 视锥外和投影太小的遮挡体不画
+    float minArea = m_minOccluderScreenArea * m_width * m_height;
+    m_frameTriangles.clear();
+    m_occluderDrawCount = 0;
+    for(const Occluder& occluder : m_occluders)
+    {
+        glm::vec3 center = (occluder.min + occluder.max) * 0.5f;
+        glm::vec3 extents = (occluder.max - occluder.min) * 0.5f;
+        bool inside = true;
+        for(uint32_t i = 0; i < 6 && inside; ++i)
+        {
+            const glm::vec4& plane = m_frustum.m_planes[i];
+            inside = glm::dot(glm::vec3(plane), center) + plane.w + glm::dot(glm::abs(glm::vec3(plane)), extents) > 0.0f;
+        }
+        if(!inside)
+        {
+            continue;
+        }
+
+        glm::vec4 rect;
+        float minDepth;
+        if(projectBounds(occluder.min, occluder.max, rect, minDepth) && (rect.z - rect.x) * (rect.w - rect.y) < minArea)
+        {
+            continue;
+        }
+
+        for(uint32_t i = 0; i < occluder.triangleCount; ++i)
+        {
+            m_frameTriangles.push_back(occluder.firstVertex + i * 3);
+        }
+        m_occluderDrawCount++;
+    }
+    m_triangleDrawCount = static_cast<uint32_t>(m_frameTriangles.size());
+
+    uint32_t triangleCount = m_triangleDrawCount;
+    uint32_t slotCount = std::max(1u, (triangleCount + m_binGrainSize - 1) / m_binGrainSize);
+    if(m_slotTriangles.size() < slotCount)
+    {
+        m_slotTriangles.resize(slotCount);
+        m_slotBins.resize(slotCount);
+    }
+    for(uint32_t slot = 0; slot < m_slotBins.size(); ++slot)
+    {
+        m_slotTriangles[slot].clear();
+        m_slotBins[slot].resize(m_tileCountX * m_tileCountY);
+        for(std::vector<uint32_t>& bin : m_slotBins[slot])
+        {
+            bin.clear();
+        }
+    }
+
+    m_threadPool.parallelFor(triangleCount, m_binGrainSize, [this](uint32_t begin, uint32_t end) {
+        binTriangles(begin / m_binGrainSize, begin, end);
+    });
+
+    // 不同tile写不同的像素, 不需要同步
+    m_threadPool.parallelFor(m_tileCountX * m_tileCountY, 1, [this](uint32_t begin, uint32_t end) {
+        for(uint32_t tile = begin; tile < end; ++tile)
+        {
+            rasterizeTile(tile);
+        }
+    });
+}
+
+void SoftwareOcclusion::binTriangles(uint32_t slot, uint32_t begin, uint32_t end)
+{
+    std::vector<ScreenTriangle>& triangles = m_slotTriangles[slot];
+    std::vector<std::vector<uint32_t>>& bins = m_slotBins[slot];
+    float width = static_cast<float>(m_width);
+    float height = static_cast<float>(m_height);
+
+    for(uint32_t i = begin; i < end; ++i)
+    {
+        const glm::vec3* vertices = &m_vertices[m_frameTriangles[i]];
+        glm::vec2 screen[3];
+        float minDepth = FLT_MAX;
+        float maxDepth = 0.0f;
+        bool clipped = false;
+        for(uint32_t k = 0; k < 3; ++k)
+        {
+            glm::vec4 clip = m_viewProjMatrix * glm::vec4(vertices[k], 1.0f);
+            // 不做近平面裁剪, 跨过近平面的三角形直接丢弃, 少画遮挡体总是安全的
+            if(clip.w <= 1e-4f || clip.z < 0.0f)
+            {
+                clipped = true;
+                break;
+            }
+            float invW = 1.0f / clip.w;
+            screen[k] = glm::vec2((clip.x * invW * 0.5f + 0.5f) * width, (clip.y * invW * 0.5f + 0.5f) * height);
+            minDepth = std::min(minDepth, clip.z * invW);
+            maxDepth = std::max(maxDepth, clip.z * invW);
+        }
+        if(clipped || minDepth >= 1.0f)
+        {
+            continue;
+        }
+
+        glm::vec2 minPos = glm::min(screen[0], glm::min(screen[1], screen[2]));
+        glm::vec2 maxPos = glm::max(screen[0], glm::max(screen[1], screen[2]));
+        if(maxPos.x <= 0.0f || maxPos.y <= 0.0f || minPos.x >= width || minPos.y >= height)
+        {
+            continue;
+        }
+
+        ScreenTriangle triangle;
+        triangle.v0 = screen[0];
+        triangle.v1 = screen[1];
+        triangle.v2 = screen[2];
+        triangle.depth = std::min(maxDepth, 1.0f);
+        uint32_t index = static_cast<uint32_t>(triangles.size());
+        triangles.push_back(triangle);
+
+        uint32_t tileX0 = static_cast<uint32_t>(std::max(0.0f, minPos.x)) / m_tileWidth;
+        uint32_t tileY0 = static_cast<uint32_t>(std::max(0.0f, minPos.y)) / m_tileHeight;
+        uint32_t tileX1 = std::min(m_tileCountX - 1, static_cast<uint32_t>(std::min(maxPos.x, width - 1.0f)) / m_tileWidth);
+        uint32_t tileY1 = std::min(m_tileCountY - 1, static_cast<uint32_t>(std::min(maxPos.y, height - 1.0f)) / m_tileHeight);
+        for(uint32_t ty = tileY0; ty <= tileY1; ++ty)
+        {
+            for(uint32_t tx = tileX0; tx <= tileX1; ++tx)
+            {
+                bins[ty * m_tileCountX + tx].push_back(index);
+            }
+        }
+    }
+}
+
+void SoftwareOcclusion::rasterizeTile(uint32_t tile)
+{
+    int tileX0 = static_cast<int>((tile % m_tileCountX) * m_tileWidth);
+    int tileY0 = static_cast<int>((tile / m_tileCountX) * m_tileHeight);
+    int tileX1 = tileX0 + static_cast<int>(m_tileWidth) - 1;
+    int tileY1 = tileY0 + static_cast<int>(m_tileHeight) - 1;
+
+    for(size_t slot = 0; slot < m_slotBins.size(); ++slot)
+    {
+        const std::vector<ScreenTriangle>& triangles = m_slotTriangles[slot];
+        for(uint32_t index : m_slotBins[slot][tile])
+        {
+            const ScreenTriangle& triangle = triangles[index];
+            glm::vec2 v0 = triangle.v0;
+            glm::vec2 v1 = triangle.v1;
+            glm::vec2 v2 = triangle.v2;
+
+            // 统一成正面积, 不做背面剔除
+            float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+            if(area == 0.0f)
+            {
+                continue;
+            }
+            if(area < 0.0f)
+            {
+                std::swap(v1, v2);
+            }
+
+            // 边函数 E(p) = a * p.x + b * p.y + c, 三角形内部三条边都大于0.
+            // 像素中心正好在边上时只算给共享这条边的一个三角形, 否则两个三角形的公共边会漏掉一排像素
+            float a[3], b[3], c[3];
+            bool inclusive[3];
+            const glm::vec2 edges[3][2] = {{v0, v1}, {v1, v2}, {v2, v0}};
+            for(uint32_t e = 0; e < 3; ++e)
+            {
+                const glm::vec2& p = edges[e][0];
+                const glm::vec2& q = edges[e][1];
+                a[e] = p.y - q.y;
+                b[e] = q.x - p.x;
+                c[e] = p.x * q.y - p.y * q.x;
+                inclusive[e] = a[e] > 0.0f || (a[e] == 0.0f && b[e] > 0.0f);
+            }
+
+            glm::vec2 minPos = glm::min(v0, glm::min(v1, v2));
+            glm::vec2 maxPos = glm::max(v0, glm::max(v1, v2));
+            int minX = std::max(tileX0, static_cast<int>(floorf(minPos.x)));
+            int minY = std::max(tileY0, static_cast<int>(floorf(minPos.y)));
+            int maxX = std::min(tileX1, static_cast<int>(ceilf(maxPos.x)));
+            int maxY = std::min(tileY1, static_cast<int>(ceilf(maxPos.y)));
+            float depth = triangle.depth;
+
+            for(int y = minY; y <= maxY; ++y)
+            {
+                float py = y + 0.5f;
+                float row[3] = {b[0] * py + c[0], b[1] * py + c[1], b[2] * py + c[2]};
+                float* depthRow = &m_depth[y * m_width];
+
+                // tile宽度是4的倍数, 4个像素一组不会越过tile
+                int x = minX & ~3;
+#if OCCLUSION_USE_SSE
+                const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+                const __m128 zero = _mm_setzero_ps();
+                const __m128 triangleDepth = _mm_set1_ps(depth);
+                const __m128 a0 = _mm_set1_ps(a[0]), a1 = _mm_set1_ps(a[1]), a2 = _mm_set1_ps(a[2]);
+                const __m128 row0 = _mm_set1_ps(row[0]), row1 = _mm_set1_ps(row[1]), row2 = _mm_set1_ps(row[2]);
+                const __m128 tie0 = inclusive[0] ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : zero;
+                const __m128 tie1 = inclusive[1] ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : zero;
+                const __m128 tie2 = inclusive[2] ? _mm_castsi128_ps(_mm_set1_epi32(-1)) : zero;
+                for(; x <= maxX; x += 4)
+                {
+                    __m128 px = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+                    __m128 e0 = _mm_add_ps(_mm_mul_ps(a0, px), row0);
+                    __m128 e1 = _mm_add_ps(_mm_mul_ps(a1, px), row1);
+                    __m128 e2 = _mm_add_ps(_mm_mul_ps(a2, px), row2);
+                    __m128 inside = _mm_or_ps(_mm_cmpgt_ps(e0, zero), _mm_and_ps(_mm_cmpeq_ps(e0, zero), tie0));
+                    inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(e1, zero), _mm_and_ps(_mm_cmpeq_ps(e1, zero), tie1)));
+                    inside = _mm_and_ps(inside, _mm_or_ps(_mm_cmpgt_ps(e2, zero), _mm_and_ps(_mm_cmpeq_ps(e2, zero), tie2)));
+                    __m128 old = _mm_loadu_ps(depthRow + x);
+                    __m128 merged = _mm_or_ps(_mm_and_ps(inside, _mm_min_ps(old, triangleDepth)), _mm_andnot_ps(inside, old));
+                    _mm_storeu_ps(depthRow + x, merged);
+                }
+#elif OCCLUSION_USE_NEON
+                const float laneValues[4] = {0.5f, 1.5f, 2.5f, 3.5f};
+                const float32x4_t laneOffsets = vld1q_f32(laneValues);
+                const float32x4_t zero = vdupq_n_f32(0.0f);
+                const float32x4_t triangleDepth = vdupq_n_f32(depth);
+                const uint32x4_t tie0 = vdupq_n_u32(inclusive[0] ? 0xffffffffu : 0u);
+                const uint32x4_t tie1 = vdupq_n_u32(inclusive[1] ? 0xffffffffu : 0u);
+                const uint32x4_t tie2 = vdupq_n_u32(inclusive[2] ? 0xffffffffu : 0u);
+                for(; x <= maxX; x += 4)
+                {
+                    // 和SSE路径一样先乘再加, 保证公共边两侧的值正好相反
+                    float32x4_t px = vaddq_f32(vdupq_n_f32(static_cast<float>(x)), laneOffsets);
+                    float32x4_t e0 = vaddq_f32(vmulq_n_f32(px, a[0]), vdupq_n_f32(row[0]));
+                    float32x4_t e1 = vaddq_f32(vmulq_n_f32(px, a[1]), vdupq_n_f32(row[1]));
+                    float32x4_t e2 = vaddq_f32(vmulq_n_f32(px, a[2]), vdupq_n_f32(row[2]));
+                    uint32x4_t inside = vorrq_u32(vcgtq_f32(e0, zero), vandq_u32(vceqq_f32(e0, zero), tie0));
+                    inside = vandq_u32(inside, vorrq_u32(vcgtq_f32(e1, zero), vandq_u32(vceqq_f32(e1, zero), tie1)));
+                    inside = vandq_u32(inside, vorrq_u32(vcgtq_f32(e2, zero), vandq_u32(vceqq_f32(e2, zero), tie2)));
+                    float32x4_t old = vld1q_f32(depthRow + x);
+                    vst1q_f32(depthRow + x, vbslq_f32(inside, vminq_f32(old, triangleDepth), old));
+                }
+#endif
+                for(; x <= maxX; ++x)
+                {
+                    float px = x + 0.5f;
+                    bool covered = true;
+                    for(uint32_t e = 0; e < 3 && covered; ++e)
+                    {
+                        float value = a[e] * px + row[e];
+                        covered = inclusive[e] ? value >= 0.0f : value > 0.0f;
+                    }
+                    if(covered)
+                    {
+                        depthRow[x] = std::min(depthRow[x], depth);
+                    }
+                }
+            }
+        }
+    }
+
+    float maxDepth = 0.0f;
+    for(int y = tileY0; y <= tileY1; ++y)
+    {
+        const float* depthRow = &m_depth[y * m_width];
+        for(int x = tileX0; x <= tileX1; ++x)
+        {
+            maxDepth = std::max(maxDepth, depthRow[x]);
+        }
+    }
+    m_tileMaxDepth[tile] = maxDepth;
+}
+
+bool SoftwareOcclusion::testAabb(const glm::vec3& min, const glm::vec3& max) const
+{
+    glm::vec4 rect;
+    float minDepth;
+    if(!projectBounds(min, max, rect, minDepth))
+    {
+        return true;
+    }
+
+    // 覆盖到的像素都算, 和屏幕不相交时交给视锥剔除
+    int minX = std::max(0, static_cast<int>(floorf(rect.x)));
+    int minY = std::max(0, static_cast<int>(floorf(rect.y)));
+    int maxX = std::min(static_cast<int>(m_width) - 1, static_cast<int>(ceilf(rect.z)));
+    int maxY = std::min(static_cast<int>(m_height) - 1, static_cast<int>(ceilf(rect.w)));
+    if(minX > maxX || minY > maxY)
+    {
+        return true;
+    }
+
+    // 先用tile的最远深度整块跳过
+    uint32_t tileX0 = minX / m_tileWidth;
+    uint32_t tileY0 = minY / m_tileHeight;
+    uint32_t tileX1 = maxX / m_tileWidth;
+    uint32_t tileY1 = maxY / m_tileHeight;
+    for(uint32_t ty = tileY0; ty <= tileY1; ++ty)
+    {
+        for(uint32_t tx = tileX0; tx <= tileX1; ++tx)
+        {
+            if(m_tileMaxDepth[ty * m_tileCountX + tx] < minDepth)
+            {
+                continue;
+            }
+
+            int x0 = std::max(minX, static_cast<int>(tx * m_tileWidth));
+            int y0 = std::max(minY, static_cast<int>(ty * m_tileHeight));
+            int x1 = std::min(maxX, static_cast<int>((tx + 1) * m_tileWidth) - 1);
+            int y1 = std::min(maxY, static_cast<int>((ty + 1) * m_tileHeight) - 1);
+            for(int y = y0; y <= y1; ++y)
+            {
+                const float* depthRow = &m_depth[y * m_width];
+                for(int x = x0; x <= x1; ++x)
+                {
+                    if(depthRow[x] >= minDepth)
+                    {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
@@ -0,0 +1,75 @@
+
+#pragma once
+
+#include "tools.h"
+#include "gltfLoader.h"
+#include "frustum.h"
+#include "thread.h"
+
+// CPU软件光栅化的遮挡剔除, 当帧得到结果, 不需要GPU回读.
+// 从场景里选出大的不透明primitive作为遮挡体, 每帧在低分辨率深度缓冲上光栅化, 被遮挡物体用屏幕空间包围矩形测试.
+// 遮挡体三角形只写像素中心被覆盖的像素, 深度取三个顶点中最远的, 所以结果是保守的.
+// 三角形先在多个线程里变换并按tile分桶, 再按tile并行光栅化, 每行4个像素一起计算(SSE/NEON).
+// 遮挡体在prepare时变换到世界空间, 只适用于静态场景
+class SoftwareOcclusion
+{
+public:
+    struct Occluder {
+        uint32_t firstVertex;
+        uint32_t triangleCount;
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    // 屏幕空间三角形, depth为三个顶点中最远的深度
+    struct ScreenTriangle {
+        glm::vec2 v0;
+        glm::vec2 v1;
+        glm::vec2 v2;
+        float depth;
+    };
+
+    SoftwareOcclusion();
+    ~SoftwareOcclusion();
+    void clear();
+
+    // 包围盒对角线不小于场景对角线m_occluderSizeRatio的不透明primitive作为遮挡体
+    void prepare(GltfLoader* pLoader, uint32_t width = 320, uint32_t height = 192);
+    void render(const glm::mat4& viewProjMatrix);
+    // 世界空间包围盒, 返回false表示完全被遮挡
+    bool testAabb(const glm::vec3& min, const glm::vec3& max) const;
+
+private:
+    bool projectBounds(const glm::vec3& min, const glm::vec3& max, glm::vec4& rect, float& minDepth) const;
+    void binTriangles(uint32_t slot, uint32_t begin, uint32_t end);
+    void rasterizeTile(uint32_t tile);
+
+public:
+    static const uint32_t m_tileWidth = 32;
+    static const uint32_t m_tileHeight = 16;
+    static const uint32_t m_binGrainSize = 4096;       //每个分桶任务的三角形数
+
+    float m_occluderSizeRatio = 0.05f;
+    float m_minOccluderScreenArea = 0.002f;             //投影矩形占屏幕的比例, 太小的遮挡体跳过
+
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_tileCountX = 0;
+    uint32_t m_tileCountY = 0;
+    std::vector<float> m_depth;
+    std::vector<float> m_tileMaxDepth;
+
+    std::vector<Occluder> m_occluders;
+    std::vector<glm::vec3> m_vertices;                  //世界空间, 每个三角形3个
+    std::vector<uint32_t> m_frameTriangles;             //本帧选中的遮挡体的第一个顶点
+    glm::mat4 m_viewProjMatrix = glm::mat4(1.0f);
+    Frustum m_frustum;
+
+    // 每个分桶任务一份, 任务内按tile存三角形序号
+    std::vector<std::vector<ScreenTriangle>> m_slotTriangles;
+    std::vector<std::vector<std::vector<uint32_t>>> m_slotBins;
+
+    ThreadPool m_threadPool;
+    uint32_t m_occluderDrawCount = 0;
+    uint32_t m_triangleDrawCount = 0;
+};
@@ -1,5 +1,11 @@
 
 #include "texture.h"
+#include "textureCompressor.h"
+#include "mipGenerator.h"
+#include "pixelConvert.h"
+#include "resourceCache.h"
+#include <chrono>
+#include <stb_image.h>
 
 Texture::Texture()
 {
@@ -19,7 +25,8 @@ VkDescriptorImageInfo Texture::getDescriptorImageInfo()
 
 void Texture::clear()
 {
-    vkDestroySampler(Tools::m_device, m_sampler, nullptr);
+    //采样器可能和其它纹理共用
+    ResourceCache::releaseSampler(m_sampler);
     vkDestroyImageView(Tools::m_device, m_imageView, nullptr);
     vkDestroyImage(Tools::m_device, m_image, nullptr);
     vkFreeMemory(Tools::m_device, m_imageMemory, nullptr);
@@ -73,15 +80,7 @@ Texture* Texture::loadTexture2D(tinygltf::Image &gltfimage, std::string path, Vk
             // Most devices don't support RGB only on Vulkan so convert if necessary
             bufferSize = gltfimage.width * gltfimage.height * 4;
             buffer = new unsigned char[bufferSize];
-            unsigned char* rgba = buffer;
-            unsigned char* rgb = &gltfimage.image[0];
-            for (size_t i = 0; i < gltfimage.width * gltfimage.height; ++i) {
-                for (int32_t j = 0; j < 3; ++j) {
-                    rgba[j] = rgb[j];
-                }
-                rgba += 4;
-                rgb += 3;
-            }
+            PixelConvert::rgbToRgba(&gltfimage.image[0], buffer, static_cast<size_t>(gltfimage.width) * gltfimage.height);
             deleteBuffer = true;
         }
         else {
@@ -116,6 +115,274 @@ Texture* Texture::loadTextrue2D(void* buffer, VkDeviceSize bufferSize, uint32_t
     return newTexture;
 }
 
+Texture* Texture::loadTextrue2DWithMips(const void* buffer, VkDeviceSize bufferSize, uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkQueue transferQueue)
+{
+    Texture* newTexture = new Texture();
+    newTexture->m_fromat = format;
+    newTexture->m_imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    newTexture->m_width = width;
+    newTexture->m_height = height;
+    newTexture->m_layerCount = 1;
+    newTexture->m_mipLevels = mipLevels;
+    fillTextrueMips(newTexture, buffer, bufferSize, transferQueue);
+    return newTexture;
+}
+
+Texture* Texture::loadTextrue2DFromKtxMemory(const void* buffer, VkDeviceSize bufferSize, VkQueue transferQueue, VkFormat format)
+{
+    Texture* newTexture = new Texture();
+    newTexture->m_fromat = format;
+    newTexture->m_imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    
+    KtxFile ktxFile;
+    if(ktxFile.parse(static_cast<const uint8_t*>(buffer), bufferSize))
+    {
+        newTexture->m_width = ktxFile.m_width;
+        newTexture->m_height = ktxFile.m_height;
+        newTexture->m_mipLevels = ktxFile.m_levelCount;
+        newTexture->m_layerCount = ktxFile.m_layerCount;
+        fillTextrue(newTexture, ktxFile, transferQueue, TextureCopyRegion::MipLevel);
+        return newTexture;
+    }
+    
+    ktxTexture* ktxTexture;
+    ktxResult result = ktxTexture_CreateFromMemory(static_cast<const ktx_uint8_t*>(buffer), bufferSize, KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &ktxTexture);
+    if(result != KTX_SUCCESS)
+    {
+        delete newTexture;
+        throw std::runtime_error("failed to create ktx texture from memory!");
+    }
+    
+    newTexture->m_width = ktxTexture->baseWidth;
+    newTexture->m_height = ktxTexture->baseHeight;
+    newTexture->m_mipLevels = ktxTexture->numLevels;
+    newTexture->m_layerCount = ktxTexture->numLayers;
+    //fillTextrue里会销毁ktxTexture
+    fillTextrue(newTexture, ktxTexture, transferQueue, TextureCopyRegion::MipLevel);
+    return newTexture;
+}
+
+void Texture::fillTextrueMips(Texture* texture, const void* buffer, VkDeviceSize bufferSize, VkQueue transferQueue)
+{
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    
+    Tools::createBufferAndMemoryThenBind(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                         stagingBuffer, stagingMemory);
+    Tools::mapMemory(stagingMemory, bufferSize, const_cast<void*>(buffer));
+    Tools::createImageAndMemoryThenBind(texture->m_fromat, texture->m_width, texture->m_height, texture->m_mipLevels, texture->m_layerCount,
+                                        VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                        VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                        texture->m_image, texture->m_imageMemory);
+    
+    //所有mip一次拷贝
+    std::vector<VkBufferImageCopy> bufferCopyRegions;
+    VkDeviceSize offset = 0;
+    for (uint32_t level = 0; level < texture->m_mipLevels; level++)
+    {
+        VkBufferImageCopy bufferCopyRegion = {};
+        bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        bufferCopyRegion.imageSubresource.mipLevel = level;
+        bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+        bufferCopyRegion.imageSubresource.layerCount = 1;
+        bufferCopyRegion.imageExtent.width = std::max(1u, texture->m_width >> level);
+        bufferCopyRegion.imageExtent.height = std::max(1u, texture->m_height >> level);
+        bufferCopyRegion.imageExtent.depth = 1;
+        bufferCopyRegion.bufferOffset = offset;
+        bufferCopyRegions.push_back(bufferCopyRegion);
+        offset += getLevelSize(texture->m_fromat, bufferCopyRegion.imageExtent.width, bufferCopyRegion.imageExtent.height);
+    }
+    assert(offset <= bufferSize);
+    
+    VkImageSubresourceRange subresourceRange = {};
+    subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresourceRange.baseMipLevel = 0;
+    subresourceRange.levelCount = texture->m_mipLevels;
+    subresourceRange.baseArrayLayer = 0;
+    subresourceRange.layerCount = texture->m_layerCount;
+    
+    VkCommandBuffer cmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    Tools::setImageLayout(cmd, texture->m_image, VK_IMAGE_LAYOUT_UNDEFINED,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, subresourceRange);
+    vkCmdCopyBufferToImage(cmd, stagingBuffer, texture->m_image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
+    Tools::setImageLayout(cmd, texture->m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          texture->m_imageLayout, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, subresourceRange);
+    Tools::flushCommandBuffer(cmd, transferQueue, true);
+    
+    vkFreeMemory(Tools::m_device, stagingMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, stagingBuffer, nullptr);
+    
+    Tools::createImageView(texture->m_image, texture->m_fromat, VK_IMAGE_ASPECT_COLOR_BIT, texture->m_mipLevels, texture->m_layerCount, texture->m_imageView);
+    ResourceCache::acquireTextureSampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT, texture->m_mipLevels, texture->m_sampler);
+}
+
+void Texture::generateMipChain(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t mipLevels, std::vector<uint8_t>& data)
+{
+    data.assign(rgba, rgba + width * height * 4);
+    size_t srcOffset = 0;
+    for(uint32_t level = 1; level < mipLevels; ++level)
+    {
+        uint32_t srcWidth = std::max(1u, width >> (level - 1));
+        uint32_t srcHeight = std::max(1u, height >> (level - 1));
+        uint32_t dstWidth = std::max(1u, width >> level);
+        uint32_t dstHeight = std::max(1u, height >> level);
+        size_t dstOffset = data.size();
+        data.resize(dstOffset + dstWidth * dstHeight * 4);
+
+        for(uint32_t y = 0; y < dstHeight; ++y)
+        {
+            uint32_t y0 = std::min(y * 2, srcHeight - 1);
+            uint32_t y1 = std::min(y * 2 + 1, srcHeight - 1);
+            for(uint32_t x = 0; x < dstWidth; ++x)
+            {
+                uint32_t x0 = std::min(x * 2, srcWidth - 1);
+                uint32_t x1 = std::min(x * 2 + 1, srcWidth - 1);
+                const uint8_t* p00 = &data[srcOffset + (y0 * srcWidth + x0) * 4];
+                const uint8_t* p01 = &data[srcOffset + (y0 * srcWidth + x1) * 4];
+                const uint8_t* p10 = &data[srcOffset + (y1 * srcWidth + x0) * 4];
+                const uint8_t* p11 = &data[srcOffset + (y1 * srcWidth + x1) * 4];
+                uint8_t* dst = &data[dstOffset + (y * dstWidth + x) * 4];
+                for(uint32_t c = 0; c < 4; ++c)
+                {
+                    dst[c] = static_cast<uint8_t>((p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+                }
+            }
+        }
+        srcOffset = dstOffset;
+    }
+}
+
+VkDeviceSize Texture::getLevelSize(VkFormat format, uint32_t width, uint32_t height)
+{
+    VkDeviceSize pixelCount = static_cast<VkDeviceSize>(width) * height;
+    VkDeviceSize blockCount = static_cast<VkDeviceSize>((width + 3) / 4) * ((height + 3) / 4);
+    switch(format)
+    {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+        case VK_FORMAT_BC4_SNORM_BLOCK:
+            return blockCount * 8;
+        case VK_FORMAT_BC2_UNORM_BLOCK:
+        case VK_FORMAT_BC2_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC5_SNORM_BLOCK:
+        case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+        case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return blockCount * 16;
+        case VK_FORMAT_R8_UNORM:
+            return pixelCount;
+        case VK_FORMAT_R16_UNORM:
+        case VK_FORMAT_R16_SFLOAT:
+            return pixelCount * 2;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+            return pixelCount * 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return pixelCount * 16;
+        default:
+            return pixelCount * 4;
+    }
+}
+
+void Texture::decodeImage(const unsigned char* bytes, size_t size, const std::string& uri, TextureData& textureData)
+{
+    textureData.m_name = uri;
+    textureData.m_format = VK_FORMAT_R8G8B8A8_UNORM;
+    textureData.m_mipOffsets.clear();
+    
+    bool isKtx = false;
+    if (uri.find_last_of(".") != std::string::npos)
+    {
+        isKtx = uri.substr(uri.find_last_of(".") + 1) == "ktx";
+    }
+    
+    if (isKtx && size > 0)
+    {
+        //不经过libktx, 直接从文件内存里按level取出第一个layer和face
+        KtxFile ktxFile;
+        if (ktxFile.parse(bytes, size))
+        {
+            if (ktxFile.m_format != VK_FORMAT_UNDEFINED)
+            {
+                textureData.m_format = ktxFile.m_format;
+            }
+            textureData.m_width = ktxFile.m_width;
+            textureData.m_height = ktxFile.m_height;
+            textureData.m_mipLevels = ktxFile.m_levelCount;
+            
+            VkDeviceSize dataSize = 0;
+            for (uint32_t level = 0; level < ktxFile.m_levelCount; level++)
+            {
+                textureData.m_mipOffsets.push_back(dataSize);
+                dataSize += ktxFile.getImageSize(level);
+            }
+            textureData.m_data.resize(dataSize);
+            for (uint32_t level = 0; level < ktxFile.m_levelCount; level++)
+            {
+                memcpy(textureData.m_data.data() + textureData.m_mipOffsets[level], bytes + ktxFile.getImageOffset(level, 0, 0), ktxFile.getImageSize(level));
+            }
+            return ;
+        }
+        
+        ktxTexture* ktxTexture;
+        if (ktxTexture_CreateFromMemory(bytes, size, KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &ktxTexture) == KTX_SUCCESS)
+        {
+            textureData.m_width = ktxTexture->baseWidth;
+            textureData.m_height = ktxTexture->baseHeight;
+            textureData.m_mipLevels = ktxTexture->numLevels;
+            for (uint32_t level = 0; level < ktxTexture->numLevels; level++)
+            {
+                ktx_size_t offset;
+                ktxTexture_GetImageOffset(ktxTexture, level, 0, 0, &offset);
+                textureData.m_mipOffsets.push_back(offset);
+            }
+            ktx_uint8_t* data = ktxTexture_GetData(ktxTexture);
+            textureData.m_data.assign(data, data + ktxTexture_GetSize(ktxTexture));
+            ktxTexture_Destroy(ktxTexture);
+            return ;
+        }
+    }
+    else if (size > 0)
+    {
+        // 直接解码成4通道, 不再单独做RGB->RGBA
+        int width, height, component;
+        stbi_uc* rgba = stbi_load_from_memory(bytes, static_cast<int>(size), &width, &height, &component, STBI_rgb_alpha);
+        if (rgba)
+        {
+            textureData.m_width = width;
+            textureData.m_height = height;
+            textureData.m_mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
+            generateMipChain(rgba, width, height, textureData.m_mipLevels, textureData.m_data);
+            stbi_image_free(rgba);
+            
+            VkDeviceSize offset = 0;
+            for (uint32_t level = 0; level < textureData.m_mipLevels; level++)
+            {
+                textureData.m_mipOffsets.push_back(offset);
+                offset += std::max(1u, textureData.m_width >> level) * std::max(1u, textureData.m_height >> level) * 4;
+            }
+            return ;
+        }
+    }
+    
+    std::cout << "failed to decode image " << uri << ", use white instead" << std::endl;
+    textureData.m_width = 1;
+    textureData.m_height = 1;
+    textureData.m_mipLevels = 1;
+    textureData.m_mipOffsets.assign(1, 0);
+    textureData.m_data.assign(4, 255);
+}
+
 void Texture::fillTextrue(Texture* texture, void* buffer, VkDeviceSize bufferSize, VkQueue transferQueue)
 {
     // Get device properties for the requested texture format
@@ -129,10 +396,15 @@ void Texture::fillTextrue(Texture* texture, void* buffer, VkDeviceSize bufferSiz
                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
                                          stagingBuffer, stagingMemory);
     Tools::mapMemory(stagingMemory, bufferSize, buffer);
-    Tools::createImageAndMemoryThenBind(texture->m_fromat, texture->m_width, texture->m_height, texture->m_mipLevels, texture->m_layerCount,
+    
+    MipGenerator* pMipGenerator = MipGenerator::m_pShared;
+    bool useMipGenerator = pMipGenerator && texture->m_mipLevels > 1 && texture->m_layerCount == 1 && MipGenerator::isSupported(texture->m_fromat, texture->m_width, texture->m_height);
+    VkFormat imageFormat = useMipGenerator ? MipGenerator::getImageFormat(texture->m_fromat) : texture->m_fromat;
+    VkImageCreateFlags createFlags = useMipGenerator ? MipGenerator::getImageCreateFlags(texture->m_fromat) : 0;
+    Tools::createImageAndMemoryThenBind(imageFormat, texture->m_width, texture->m_height, texture->m_mipLevels, texture->m_layerCount,
                                         VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
                                         VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                        texture->m_image, texture->m_imageMemory);
+                                        texture->m_image, texture->m_imageMemory, createFlags);
     
     std::vector<VkBufferImageCopy> bufferCopyRegions;
     {
@@ -164,91 +436,180 @@ void Texture::fillTextrue(Texture* texture, void* buffer, VkDeviceSize bufferSiz
     vkCmdCopyBufferToImage(cmd, stagingBuffer, texture->m_image,
                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
 
-    VkImageLayout layout = texture->m_imageLayout;
-    
+    // 第0级拷贝完成后生成其它级, 优先用compute一次生成, 不支持时逐级blit
     if( texture->m_mipLevels > 1)
     {
-        layout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        if(useMipGenerator)
+        {
+            pMipGenerator->add(texture->m_image, texture->m_fromat, texture->m_width, texture->m_height, texture->m_mipLevels,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            pMipGenerator->generate(cmd);
+        }
+        else
+        {
+            MipGenerator::generateWithBlit(cmd, texture->m_image, texture->m_width, texture->m_height, texture->m_mipLevels,
+                                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        }
+    }
+    else
+    {
+        Tools::setImageLayout(cmd, texture->m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                              texture->m_imageLayout, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                              VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, subresourceRange);
     }
     
-    Tools::setImageLayout(cmd, texture->m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                          layout, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
-                          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, subresourceRange);
+    Tools::flushCommandBuffer(cmd, transferQueue, true);
+    if(useMipGenerator)
+    {
+        pMipGenerator->reset();
+    }
+    vkFreeMemory(Tools::m_device, stagingMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, stagingBuffer, nullptr);
+    
+    Tools::createImageView(texture->m_image, texture->m_fromat, VK_IMAGE_ASPECT_COLOR_BIT, texture->m_mipLevels, texture->m_layerCount, texture->m_imageView);
+    ResourceCache::acquireTextureSampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT, texture->m_mipLevels, texture->m_sampler);
+}
 
-    // Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
-    if( texture->m_mipLevels > 1)
+// 数据从映射的文件直接拷进staging, 所有level/layer/face的拷贝区域一次生成, 一条vkCmdCopyBufferToImage
+void Texture::fillTextrue(Texture* texture, const KtxFile& ktxFile, VkQueue transferQueue, TextureCopyRegion copyRegion)
+{
+    //从文件里拷贝的layer数和face数
+    uint32_t faceCount = 1;
+    if(copyRegion == TextureCopyRegion::Nothing)
+    {
+        texture->m_mipLevels = 1;
+        texture->m_layerCount = 1;
+    }
+    else if(copyRegion == TextureCopyRegion::MipLevel)
+    {
+        texture->m_layerCount = 1;
+    }
+    else if(copyRegion == TextureCopyRegion::Layer)
+    {
+        texture->m_mipLevels = 1;
+    }
+    else if(copyRegion == TextureCopyRegion::Cube)
+    {
+        texture->m_layerCount = 6;
+        faceCount = 6;
+    }
+    else if(copyRegion == TextureCopyRegion::CubeArry)
+    {
+        faceCount = 6;
+    }
+    uint32_t sourceLayerCount = copyRegion == TextureCopyRegion::Cube ? 1 : texture->m_layerCount;
+    assert(faceCount <= ktxFile.m_faceCount && sourceLayerCount <= ktxFile.m_layerCount);
+    
+    VkImageCreateFlags flags = 0;
+    uint32_t layerCount = sourceLayerCount * faceCount;
+    if(faceCount == 6)
     {
-        for (uint32_t i = 1; i < texture->m_mipLevels; i++)
+        flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+    }
+    
+    //bufferOffset要是4和texel(块)大小的倍数. KTX1未压缩格式的行按4字节对齐, 用bufferRowLength跳过补齐
+    VkDeviceSize blockSize = getLevelSize(texture->m_fromat, 1, 1);
+    bool isBlockCompressed = getLevelSize(texture->m_fromat, 4, 4) == blockSize;
+    VkDeviceSize alignment = std::max<VkDeviceSize>(4, blockSize);
+    
+    std::vector<VkBufferImageCopy> bufferCopyRegions;
+    std::vector<VkDeviceSize> sourceOffsets;
+    std::vector<VkDeviceSize> sourceSizes;
+    VkDeviceSize stagingSize = 0;
+    for (uint32_t level = 0; level < texture->m_mipLevels; level++)
+    {
+        uint32_t width = std::max(1u, texture->m_width >> level);
+        uint32_t height = std::max(1u, texture->m_height >> level);
+        VkDeviceSize imageSize = ktxFile.getImageSize(level);
+        uint32_t rowLength = 0;
+        if(!isBlockCompressed && imageSize > getLevelSize(texture->m_fromat, width, height) && imageSize % height == 0 && (imageSize / height) % blockSize == 0)
         {
-            VkImageBlit imageBlit{};
-            imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            imageBlit.srcSubresource.layerCount = 1;
-            imageBlit.srcSubresource.mipLevel = i - 1;
-            imageBlit.srcOffsets[1].x = int32_t(texture->m_width >> (i - 1));
-            imageBlit.srcOffsets[1].y = int32_t(texture->m_height >> (i - 1));
-            imageBlit.srcOffsets[1].z = 1;
-            
-            imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            imageBlit.dstSubresource.layerCount = 1;
-            imageBlit.dstSubresource.mipLevel = i;
-            imageBlit.dstOffsets[1].x = int32_t(texture->m_width >> i);
-            imageBlit.dstOffsets[1].y = int32_t(texture->m_height >> i);
-            imageBlit.dstOffsets[1].z = 1;
-        
-            VkImageSubresourceRange mipSubRange = {};
-            mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            mipSubRange.baseMipLevel = i;
-            mipSubRange.levelCount = 1;
-            mipSubRange.layerCount = 1;
+            rowLength = static_cast<uint32_t>(imageSize / height / blockSize);
+        }
         
+        for (uint32_t layer = 0; layer < sourceLayerCount; layer++)
+        {
+            for (uint32_t face = 0; face < faceCount; face++)
             {
-                VkImageMemoryBarrier imageMemoryBarrier{};
-                imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-                imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                imageMemoryBarrier.srcAccessMask = 0;
-                imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                imageMemoryBarrier.image = texture->m_image;
-                imageMemoryBarrier.subresourceRange = mipSubRange;
-                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-            }
-
-            vkCmdBlitImage(cmd, texture->m_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, texture->m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
-                    
-            {
-                VkImageMemoryBarrier imageMemoryBarrier{};
-                imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-                imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-                imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-                imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-                imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-                imageMemoryBarrier.image = texture->m_image;
-                imageMemoryBarrier.subresourceRange = mipSubRange;
-                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+                VkBufferImageCopy bufferCopyRegion = {};
+                bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                bufferCopyRegion.imageSubresource.mipLevel = level;
+                bufferCopyRegion.imageSubresource.baseArrayLayer = layer * faceCount + face;
+                bufferCopyRegion.imageSubresource.layerCount = 1;
+                bufferCopyRegion.imageExtent.width = width;
+                bufferCopyRegion.imageExtent.height = height;
+                bufferCopyRegion.imageExtent.depth = 1;
+                bufferCopyRegion.bufferOffset = stagingSize;
+                bufferCopyRegion.bufferRowLength = rowLength;
+                bufferCopyRegions.push_back(bufferCopyRegion);
+                sourceOffsets.push_back(ktxFile.getImageOffset(level, layer, face));
+                sourceSizes.push_back(imageSize);
+                stagingSize = (stagingSize + imageSize + alignment - 1) / alignment * alignment;
             }
         }
-
-        subresourceRange.levelCount = texture->m_mipLevels;
-
-        {
-            VkImageMemoryBarrier imageMemoryBarrier{};
-            imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-            imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-            imageMemoryBarrier.image = texture->m_image;
-            imageMemoryBarrier.subresourceRange = subresourceRange;
-            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-        }
     }
     
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    Tools::createBufferAndMemoryThenBind(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                         stagingBuffer, stagingMemory);
+    
+    uint8_t* mapped = nullptr;
+    VK_CHECK_RESULT(vkMapMemory(Tools::m_device, stagingMemory, 0, stagingSize, 0, reinterpret_cast<void**>(&mapped)));
+    for (size_t i = 0; i < bufferCopyRegions.size(); i++)
+    {
+        memcpy(mapped + bufferCopyRegions[i].bufferOffset, ktxFile.m_data + sourceOffsets[i], sourceSizes[i]);
+    }
+    vkUnmapMemory(Tools::m_device, stagingMemory);
+    
+    //块压缩格式不能用作storage image
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    if(!isBlockCompressed)
+    {
+        usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+    }
+    Tools::createImageAndMemoryThenBind(texture->m_fromat, texture->m_width, texture->m_height, texture->m_mipLevels, layerCount,
+                                        VK_SAMPLE_COUNT_1_BIT, usage, VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                        texture->m_image, texture->m_imageMemory, flags);
+    
+    VkImageSubresourceRange subresourceRange = {};
+    subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresourceRange.baseMipLevel = 0;
+    subresourceRange.levelCount = texture->m_mipLevels;
+    subresourceRange.baseArrayLayer = 0;
+    subresourceRange.layerCount = layerCount;
+    
+    VkCommandBuffer cmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    Tools::setImageLayout(cmd, texture->m_image, VK_IMAGE_LAYOUT_UNDEFINED,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, subresourceRange);
+    vkCmdCopyBufferToImage(cmd, stagingBuffer, texture->m_image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
+    Tools::setImageLayout(cmd, texture->m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          texture->m_imageLayout, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, subresourceRange);
     Tools::flushCommandBuffer(cmd, transferQueue, true);
+    
     vkFreeMemory(Tools::m_device, stagingMemory, nullptr);
     vkDestroyBuffer(Tools::m_device, stagingBuffer, nullptr);
     
-    Tools::createImageView(texture->m_image, texture->m_fromat, VK_IMAGE_ASPECT_COLOR_BIT, texture->m_mipLevels, texture->m_layerCount, texture->m_imageView);
-    Tools::createTextureSampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT, texture->m_mipLevels, texture->m_sampler);
+    VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D;
+    if(copyRegion == TextureCopyRegion::Layer)
+    {
+        viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    }
+    else if(copyRegion == TextureCopyRegion::Cube)
+    {
+        viewType = VK_IMAGE_VIEW_TYPE_CUBE;
+    }
+    else if(copyRegion == TextureCopyRegion::CubeArry)
+    {
+        viewType = VK_IMAGE_VIEW_TYPE_CUBE_ARRAY;
+    }
+    
+    Tools::createImageView(texture->m_image, texture->m_fromat, VK_IMAGE_ASPECT_COLOR_BIT, texture->m_mipLevels, layerCount, texture->m_imageView, viewType);
+    ResourceCache::acquireTextureSampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT, texture->m_mipLevels, texture->m_sampler);
 }
 
 void Texture::fillTextrue(Texture* texture, ktxTexture* ktxTexture, VkQueue transferQueue, TextureCopyRegion copyRegion)
@@ -318,7 +679,7 @@ void Texture::fillTextrue(Texture* texture, ktxTexture* ktxTexture, VkQueue tran
     }
     
     Tools::createImageAndMemoryThenBind(texture->m_fromat, texture->m_width, texture->m_height, texture->m_mipLevels, layerCount,
-                                        VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+                                        VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
                                         VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                                         texture->m_image, texture->m_imageMemory, flags);
     
@@ -471,229 +832,132 @@ void Texture::fillTextrue(Texture* texture, ktxTexture* ktxTexture, VkQueue tran
     }
     
     Tools::createImageView(texture->m_image, texture->m_fromat, VK_IMAGE_ASPECT_COLOR_BIT, texture->m_mipLevels, layerCount, texture->m_imageView, viewType);
-    Tools::createTextureSampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT, texture->m_mipLevels, texture->m_sampler);
+    ResourceCache::acquireTextureSampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT, texture->m_mipLevels, texture->m_sampler);
 }
 
 Texture* Texture::loadTextrue2D(std::string fileName, VkQueue transferQueue, VkFormat format, TextureCopyRegion copyRegion, VkImageLayout imageLayout)
 {
     Texture* newTexture = new Texture();
     assert(Tools::isFileExists(fileName));
-    ktxTexture* ktxTexture;
-    ktxResult result = ktxTexture_CreateFromNamedFile(fileName.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &ktxTexture);
-    assert(result == KTX_SUCCESS);
-
     newTexture->m_fromat = format;
     newTexture->m_imageLayout = imageLayout;
-    newTexture->m_width = ktxTexture->baseWidth;
-    newTexture->m_height = ktxTexture->baseHeight;
-    newTexture->m_mipLevels = ktxTexture->numLevels;
-    newTexture->m_layerCount = ktxTexture->numLayers;
-    ktx_size_t ktxTextureSize = ktxTexture_GetSize(ktxTexture);
-    ktx_uint8_t* ktxTextureData = ktxTexture_GetData(ktxTexture);
     
-    if(copyRegion == TextureCopyRegion::Nothing)
-    {
-        newTexture->m_mipLevels = 1;
-        newTexture->m_layerCount = 1;
-    }
-    else if(copyRegion == TextureCopyRegion::MipLevel)
-    {
-        newTexture->m_layerCount = 1;
-    }
-    else if(copyRegion == TextureCopyRegion::Layer)
+    KtxFile ktxFile;
+    if(ktxFile.open(fileName))
     {
-        newTexture->m_mipLevels = 1;
-    }
-    else if(copyRegion == TextureCopyRegion::Cube)
-    {
-//        newTexture->m_mipLevels = 1;
-        newTexture->m_layerCount = 6;
-    }
-    else if(copyRegion == TextureCopyRegion::CubeArry)
-    {
-        
+        newTexture->m_width = ktxFile.m_width;
+        newTexture->m_height = ktxFile.m_height;
+        newTexture->m_mipLevels = ktxFile.m_levelCount;
+        newTexture->m_layerCount = ktxFile.m_layerCount;
+        fillTextrue(newTexture, ktxFile, transferQueue, copyRegion);
+        return newTexture;
     }
     
-    // Get device properties for the requested texture format
-    VkFormatProperties formatProperties;
-    vkGetPhysicalDeviceFormatProperties(Tools::m_physicalDevice, format, &formatProperties);
-    
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingMemory;
-    
-    Tools::createBufferAndMemoryThenBind(ktxTextureSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                                         stagingBuffer, stagingMemory);
-    Tools::mapMemory(stagingMemory, ktxTextureSize, ktxTextureData);
-    
-    VkImageCreateFlags flags = 0;
-    uint32_t layerCount = newTexture->m_layerCount;
+    //超压缩或者大端的文件还是交给libktx
+    ktxTexture* ktxTexture;
+    ktxResult result = ktxTexture_CreateFromNamedFile(fileName.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &ktxTexture);
+    assert(result == KTX_SUCCESS);
     
-    if(copyRegion == TextureCopyRegion::Cube)
-    {
-        flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
-    }
-    else if(copyRegion == TextureCopyRegion::CubeArry)
-    {
-        layerCount = 6 * newTexture->m_layerCount;
-        flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
-    }
+    newTexture->m_width = ktxTexture->baseWidth;
+    newTexture->m_height = ktxTexture->baseHeight;
+    newTexture->m_mipLevels = ktxTexture->numLevels;
+    newTexture->m_layerCount = ktxTexture->numLayers;
+    fillTextrue(newTexture, ktxTexture, transferQueue, copyRegion);
+    return newTexture;
+}
+
+Texture* Texture::loadTextrueCubeBC6H(std::string fileName, VkQueue transferQueue)
+{
+    assert(Tools::isFileExists(fileName));
+    ktxTexture* ktxTexture;
+    ktxResult result = ktxTexture_CreateFromNamedFile(fileName.c_str(), KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT, &ktxTexture);
+    assert(result == KTX_SUCCESS && ktxTexture->numFaces == 6);
     
-    Tools::createImageAndMemoryThenBind(format, newTexture->m_width, newTexture->m_height, newTexture->m_mipLevels, layerCount,
-                                        VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
-                                        VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                        newTexture->m_image, newTexture->m_imageMemory, flags);
+    Texture* newTexture = new Texture();
+    newTexture->m_fromat = VK_FORMAT_BC6H_UFLOAT_BLOCK;
+    newTexture->m_imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    newTexture->m_width = ktxTexture->baseWidth;
+    newTexture->m_height = ktxTexture->baseHeight;
+    newTexture->m_mipLevels = ktxTexture->numLevels;
+    newTexture->m_layerCount = 6;
+    newTexture->m_name = fileName;
     
+    //每个mip的每个面单独编码, 块按mip, 面的顺序紧密排列
+    std::vector<TextureCompressor::Surface> surfaces;
     std::vector<VkBufferImageCopy> bufferCopyRegions;
-    if(copyRegion == TextureCopyRegion::Nothing)
+    VkDeviceSize bufferSize = 0;
+    for (uint32_t level = 0; level < newTexture->m_mipLevels; level++)
     {
-        ktx_size_t offset;
-        KTX_error_code ret = ktxTexture_GetImageOffset(ktxTexture, 0, 0, 0, &offset);
-        assert(ret == KTX_SUCCESS);
-        // Setup a buffer image copy structure for the current array layer
-        VkBufferImageCopy bufferCopyRegion = {};
-        bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        bufferCopyRegion.imageSubresource.mipLevel = 0;
-        bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
-        bufferCopyRegion.imageSubresource.layerCount = 1;
-        bufferCopyRegion.imageExtent.width = ktxTexture->baseWidth;
-        bufferCopyRegion.imageExtent.height = ktxTexture->baseHeight;
-        bufferCopyRegion.imageExtent.depth = 1;
-        bufferCopyRegion.bufferOffset = offset;
-        bufferCopyRegions.push_back(bufferCopyRegion);
-    }
-    else if(copyRegion == TextureCopyRegion::MipLevel)
-    {
-        for (uint32_t level = 0; level < newTexture->m_mipLevels; level++)
-        {
-            ktx_size_t offset;
-            KTX_error_code result = ktxTexture_GetImageOffset(ktxTexture, level, 0, 0, &offset);
-            assert(result == KTX_SUCCESS);
-            VkBufferImageCopy bufferCopyRegion = {};
-            bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            bufferCopyRegion.imageSubresource.mipLevel = level;
-            bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
-            bufferCopyRegion.imageSubresource.layerCount = 1;
-            bufferCopyRegion.imageExtent.width = std::max(1u, ktxTexture->baseWidth >> level);
-            bufferCopyRegion.imageExtent.height = std::max(1u, ktxTexture->baseHeight >> level);
-            bufferCopyRegion.imageExtent.depth = 1;
-            bufferCopyRegion.bufferOffset = offset;
-            bufferCopyRegions.push_back(bufferCopyRegion);
-        }
-    }
-    else if(copyRegion == TextureCopyRegion::Layer)
-    {
-        for (uint32_t layer = 0; layer < newTexture->m_layerCount; layer++)
+        for (uint32_t face = 0; face < 6; face++)
         {
-            // Calculate offset into staging buffer for the current array layer
             ktx_size_t offset;
-            KTX_error_code ret = ktxTexture_GetImageOffset(ktxTexture, 0, layer, 0, &offset);
+            KTX_error_code ret = ktxTexture_GetImageOffset(ktxTexture, level, 0, face, &offset);
             assert(ret == KTX_SUCCESS);
-            // Setup a buffer image copy structure for the current array layer
+            TextureCompressor::Surface surface = {};
+            surface.pixels = ktxTexture_GetData(ktxTexture) + offset;
+            surface.width = std::max(1u, newTexture->m_width >> level);
+            surface.height = std::max(1u, newTexture->m_height >> level);
+            surfaces.push_back(surface);
+            
             VkBufferImageCopy bufferCopyRegion = {};
             bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            bufferCopyRegion.imageSubresource.mipLevel = 0;
-            bufferCopyRegion.imageSubresource.baseArrayLayer = layer;
+            bufferCopyRegion.imageSubresource.mipLevel = level;
+            bufferCopyRegion.imageSubresource.baseArrayLayer = face;
             bufferCopyRegion.imageSubresource.layerCount = 1;
-            bufferCopyRegion.imageExtent.width = ktxTexture->baseWidth;
-            bufferCopyRegion.imageExtent.height = ktxTexture->baseHeight;
+            bufferCopyRegion.imageExtent.width = surface.width;
+            bufferCopyRegion.imageExtent.height = surface.height;
             bufferCopyRegion.imageExtent.depth = 1;
-            bufferCopyRegion.bufferOffset = offset;
+            bufferCopyRegion.bufferOffset = bufferSize;
             bufferCopyRegions.push_back(bufferCopyRegion);
+            bufferSize += getLevelSize(newTexture->m_fromat, surface.width, surface.height);
         }
     }
-    else if(copyRegion == TextureCopyRegion::Cube)
+    
+    std::vector<uint8_t> blocks(bufferSize);
+    for (size_t i = 0; i < surfaces.size(); i++)
     {
-        for (uint32_t face = 0; face < 6; face++)
-        {
-            for (uint32_t level = 0; level < newTexture->m_mipLevels; level++)
-            {
-                // Calculate offset into staging buffer for the current mip level and face
-                ktx_size_t offset;
-                KTX_error_code ret = ktxTexture_GetImageOffset(ktxTexture, level, 0, face, &offset);
-                assert(ret == KTX_SUCCESS);
-                VkBufferImageCopy bufferCopyRegion = {};
-                bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                bufferCopyRegion.imageSubresource.mipLevel = level;
-                bufferCopyRegion.imageSubresource.baseArrayLayer = face;
-                bufferCopyRegion.imageSubresource.layerCount = 1;
-                bufferCopyRegion.imageExtent.width = ktxTexture->baseWidth >> level;
-                bufferCopyRegion.imageExtent.height = ktxTexture->baseHeight >> level;
-                bufferCopyRegion.imageExtent.depth = 1;
-                bufferCopyRegion.bufferOffset = offset;
-                bufferCopyRegions.push_back(bufferCopyRegion);
-            }
-        }
-    }
-    else if(copyRegion == TextureCopyRegion::CubeArry)
-    {
-        for (uint32_t face = 0; face < 6; face++)
-        {
-            for (uint32_t layer = 0; layer < ktxTexture->numLayers; layer++)
-            {
-                for (uint32_t level = 0; level < ktxTexture->numLevels; level++)
-                {
-                    ktx_size_t offset;
-                    KTX_error_code ret = ktxTexture_GetImageOffset(ktxTexture, level, layer, face, &offset);
-                    assert(ret == KTX_SUCCESS);
-                    VkBufferImageCopy bufferCopyRegion = {};
-                    bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-                    bufferCopyRegion.imageSubresource.mipLevel = level;
-                    bufferCopyRegion.imageSubresource.baseArrayLayer = layer * 6 + face;
-                    bufferCopyRegion.imageSubresource.layerCount = 1;
-                    bufferCopyRegion.imageExtent.width = ktxTexture->baseWidth >> level;
-                    bufferCopyRegion.imageExtent.height = ktxTexture->baseHeight >> level;
-                    bufferCopyRegion.imageExtent.depth = 1;
-                    bufferCopyRegion.bufferOffset = offset;
-                    bufferCopyRegions.push_back(bufferCopyRegion);
-                }
-            }
-        }
+        surfaces[i].blocks = blocks.data() + bufferCopyRegions[i].bufferOffset;
     }
+    ThreadPool threadPool;
+    threadPool.setThreadCount(std::max(1u, std::thread::hardware_concurrency()));
+    TextureCompressor::compressSurfaces(surfaces, newTexture->m_fromat, &threadPool);
+    ktxTexture_Destroy(ktxTexture);
+    
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    Tools::createBufferAndMemoryThenBind(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                         stagingBuffer, stagingMemory);
+    Tools::mapMemory(stagingMemory, bufferSize, blocks.data());
+    //块压缩格式不能用作storage image
+    Tools::createImageAndMemoryThenBind(newTexture->m_fromat, newTexture->m_width, newTexture->m_height, newTexture->m_mipLevels, newTexture->m_layerCount,
+                                        VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                        VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                        newTexture->m_image, newTexture->m_imageMemory, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT);
     
     VkImageSubresourceRange subresourceRange = {};
     subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     subresourceRange.baseMipLevel = 0;
     subresourceRange.levelCount = newTexture->m_mipLevels;
     subresourceRange.baseArrayLayer = 0;
-    subresourceRange.layerCount = layerCount;
+    subresourceRange.layerCount = newTexture->m_layerCount;
     
     VkCommandBuffer cmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
     Tools::setImageLayout(cmd, newTexture->m_image, VK_IMAGE_LAYOUT_UNDEFINED,
                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
                           VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, subresourceRange);
-
     vkCmdCopyBufferToImage(cmd, stagingBuffer, newTexture->m_image,
                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
-
     Tools::setImageLayout(cmd, newTexture->m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
                           newTexture->m_imageLayout, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
                           VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, subresourceRange);
-
     Tools::flushCommandBuffer(cmd, transferQueue, true);
-//    vkDeviceWaitIdle(Tools::m_device);
     
-    ktxTexture_Destroy(ktxTexture);
     vkFreeMemory(Tools::m_device, stagingMemory, nullptr);
     vkDestroyBuffer(Tools::m_device, stagingBuffer, nullptr);
-
-    VkImageViewType viewType = VK_IMAGE_VIEW_TYPE_2D;
-    if(copyRegion == TextureCopyRegion::Layer)
-    {
-        viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
-    }
-    else if(copyRegion == TextureCopyRegion::Cube)
-    {
-        viewType = VK_IMAGE_VIEW_TYPE_CUBE;
-    }
-    else if(copyRegion == TextureCopyRegion::CubeArry)
-    {
-        viewType = VK_IMAGE_VIEW_TYPE_CUBE_ARRAY;
-    }
     
-    Tools::createImageView(newTexture->m_image, format, VK_IMAGE_ASPECT_COLOR_BIT, newTexture->m_mipLevels, layerCount, newTexture->m_imageView, viewType);
-    Tools::createTextureSampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT, newTexture->m_mipLevels, newTexture->m_sampler);
+    Tools::createImageView(newTexture->m_image, newTexture->m_fromat, VK_IMAGE_ASPECT_COLOR_BIT, newTexture->m_mipLevels, newTexture->m_layerCount, newTexture->m_imageView, VK_IMAGE_VIEW_TYPE_CUBE);
+    ResourceCache::acquireTextureSampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT, newTexture->m_mipLevels, newTexture->m_sampler);
+    
     return newTexture;
 }
-
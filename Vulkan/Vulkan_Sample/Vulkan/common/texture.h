@@ -2,6 +2,7 @@
 #pragma once
 
 #include "tools.h"
+#include "ktxFile.h"
 
 #include <ktx.h>
 #include <ktxvulkan.h>
@@ -10,6 +11,18 @@
 
 enum TextureCopyRegion { Nothing, MipLevel, Layer, Cube, CubeArry};
 
+// CPU上准备好的纹理数据, 所有mip依次排列, 可以在工作线程里生成
+struct TextureData
+{
+    std::string m_name;
+    VkFormat m_format = VK_FORMAT_R8G8B8A8_UNORM;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_mipLevels = 0;
+    std::vector<VkDeviceSize> m_mipOffsets;
+    std::vector<uint8_t> m_data;
+};
+
 class Texture
 {
 public:
@@ -22,9 +35,26 @@ public:
     static Texture* loadTextureEmpty(VkQueue transferQueue);
     
     static Texture* loadTextrue2D(void* buffer, VkDeviceSize bufferSize, uint32_t width, uint32_t height, VkFormat format, VkQueue transferQueue);
+    //buffer里依次紧密排列所有mip, 大小由getLevelSize决定, 可以是块压缩格式. 不再用blit生成
+    static Texture* loadTextrue2DWithMips(const void* buffer, VkDeviceSize bufferSize, uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format, VkQueue transferQueue);
+    //内存中完整的ktx文件, 直接从buffer拷到staging
+    static Texture* loadTextrue2DFromKtxMemory(const void* buffer, VkDeviceSize bufferSize, VkQueue transferQueue, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM);
+    //RGBA16F的ktx立方体贴图, 加载时压缩成BC6H, 需要开启textureCompressionBC
+    static Texture* loadTextrueCubeBC6H(std::string fileName, VkQueue transferQueue);
     
+    //ktxFile映射或指向整个文件, 不经过libktx的中间拷贝
+    static void fillTextrue(Texture* texture, const KtxFile& ktxFile, VkQueue transferQueue, TextureCopyRegion copyRegion);
+    //会销毁ktxTexture
     static void fillTextrue(Texture* texture, ktxTexture* ktxTexture, VkQueue transferQueue, TextureCopyRegion copyRegion);
     static void fillTextrue(Texture* texture, void* buffer, VkDeviceSize bufferSize, VkQueue transferQueue);
+    static void fillTextrueMips(Texture* texture, const void* buffer, VkDeviceSize bufferSize, VkQueue transferQueue);
+    
+    //只用到CPU, 线程安全. 解码png/jpg为RGBA8并生成mip, ktx取出所有mip. 失败时为1x1白色
+    static void decodeImage(const unsigned char* bytes, size_t size, const std::string& uri, TextureData& textureData);
+    //2x2盒式滤波逐级生成, 尺寸和blit一致
+    static void generateMipChain(const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t mipLevels, std::vector<uint8_t>& data);
+    //一个mip的字节数, 块压缩格式按4x4块向上取整
+    static VkDeviceSize getLevelSize(VkFormat format, uint32_t width, uint32_t height);
     
     void clear();
     VkDescriptorImageInfo getDescriptorImageInfo();
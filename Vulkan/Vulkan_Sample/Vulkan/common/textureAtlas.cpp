@@ -0,0 +1,358 @@
+
+#include "textureAtlas.h"
+#include "resourceCache.h"
+#include <map>
+#include <set>
+#include <tuple>
+
+//imgui_draw.cpp里的实现是static的, 这里单独实例化一份
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imstb_rectpack.h"
+
+// 块压缩格式的一个块和4x4纹素大小相同
+static uint32_t getBlockSize(VkFormat format)
+{
+    return Texture::getLevelSize(format, 4, 4) == Texture::getLevelSize(format, 1, 1) ? 4 : 1;
+}
+
+static uint32_t alignUp(uint32_t value, uint32_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static VkImageSubresourceRange getSubresourceRange(const Texture* texture)
+{
+    VkImageSubresourceRange subresourceRange = {};
+    subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresourceRange.baseMipLevel = 0;
+    subresourceRange.levelCount = texture->m_mipLevels;
+    subresourceRange.baseArrayLayer = 0;
+    subresourceRange.layerCount = texture->m_layerCount;
+    return subresourceRange;
+}
+
+TextureAtlas::TextureAtlas()
+{
+}
+
+TextureAtlas::~TextureAtlas()
+{}
+
+uint32_t TextureAtlas::add(Texture* texture)
+{
+    assert(texture && texture->m_layerCount == 1);
+    auto it = std::find(m_sources.begin(), m_sources.end(), texture);
+    if(it != m_sources.end())
+    {
+        return static_cast<uint32_t>(it - m_sources.begin());
+    }
+
+    m_sources.push_back(texture);
+    m_regions.push_back(Region());
+    return static_cast<uint32_t>(m_sources.size() - 1);
+}
+
+void TextureAtlas::build(VkQueue transferQueue)
+{
+    m_statistics = Statistics();
+    m_statistics.sourceCount = static_cast<uint32_t>(m_sources.size());
+    std::set<VkSampler> sourceSamplers;
+    for(Texture* source : m_sources)
+    {
+        sourceSamplers.insert(source->m_sampler);
+        for(uint32_t level = 0; level < source->m_mipLevels; level++)
+        {
+            m_statistics.sourceBytes += Texture::getLevelSize(source->m_fromat, std::max(1u, source->m_width >> level), std::max(1u, source->m_height >> level));
+        }
+    }
+    m_statistics.sourceSamplerCount = static_cast<uint32_t>(sourceSamplers.size());
+
+    //格式, 尺寸和mip数都相同的放进一个数组
+    std::map<std::tuple<VkFormat, uint32_t, uint32_t, uint32_t>, std::vector<uint32_t>> groups;
+    for(uint32_t i = 0; i < m_sources.size(); i++)
+    {
+        Texture* source = m_sources[i];
+        groups[std::make_tuple(source->m_fromat, source->m_width, source->m_height, source->m_mipLevels)].push_back(i);
+    }
+
+    const uint32_t maxLayers = std::max(1u, Tools::m_deviceProperties.limits.maxImageArrayLayers);
+    std::map<VkFormat, std::vector<uint32_t>> atlasSources;
+    for(auto& group : groups)
+    {
+        VkFormat format = std::get<0>(group.first);
+        uint32_t width = std::get<1>(group.first);
+        uint32_t height = std::get<2>(group.first);
+        uint32_t mipLevels = std::get<3>(group.first);
+
+        //单独的一张小纹理才装进图集. 边框在每级mip上至少一个块, 宽高要能被边框整除
+        uint32_t atlasMipLevels = static_cast<uint32_t>(std::log2(std::max(1u, m_padding / getBlockSize(format)))) + 1;
+        if(group.second.size() == 1 && width <= m_maxAtlasItemSize && height <= m_maxAtlasItemSize && width % m_padding == 0 && height % m_padding == 0 && mipLevels >= atlasMipLevels)
+        {
+            atlasSources[format].push_back(group.second[0]);
+            continue;
+        }
+
+        for(size_t first = 0; first < group.second.size(); first += maxLayers)
+        {
+            Page page = {};
+            page.format = format;
+            page.width = width;
+            page.height = height;
+            page.mipLevels = mipLevels;
+            page.addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+
+            size_t last = std::min(group.second.size(), first + maxLayers);
+            for(size_t i = first; i < last; i++)
+            {
+                Region& region = m_regions[group.second[i]];
+                region.scaleOffset = glm::vec4(1.0f, 1.0f, 0.0f, 0.0f);
+                region.page = static_cast<uint32_t>(m_pageLayouts.size());
+                region.layer = static_cast<uint32_t>(page.layers.size());
+                page.layers.push_back(std::vector<Item>(1, Item{group.second[i], 0, 0}));
+            }
+            m_statistics.arrayLayerCount += static_cast<uint32_t>(page.layers.size());
+            m_pageLayouts.push_back(page);
+        }
+    }
+
+    for(auto& atlas : atlasSources)
+    {
+        packAtlas(atlas.first, atlas.second);
+    }
+
+    //所有拷贝在一个命令缓冲里完成
+    VkCommandBuffer copyCmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    for(Texture* source : m_sources)
+    {
+        Tools::setImageLayout(copyCmd, source->m_image, source->m_imageLayout, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                              VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, getSubresourceRange(source));
+    }
+
+    for(const Page& page : m_pageLayouts)
+    {
+        Texture* target = createPage(page);
+        VkImageSubresourceRange subresourceRange = getSubresourceRange(target);
+        Tools::setImageLayout(copyCmd, target->m_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                              VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, subresourceRange);
+        for(uint32_t layer = 0; layer < page.layers.size(); layer++)
+        {
+            for(const Item& item : page.layers[layer])
+            {
+                copyItem(copyCmd, page, target, layer, item);
+            }
+        }
+        Tools::setImageLayout(copyCmd, target->m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, subresourceRange);
+        m_pages.push_back(target);
+    }
+
+    for(Texture* source : m_sources)
+    {
+        Tools::setImageLayout(copyCmd, source->m_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, source->m_imageLayout,
+                              VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, getSubresourceRange(source));
+    }
+    Tools::flushCommandBuffer(copyCmd, transferQueue, true);
+
+    std::set<VkSampler> pageSamplers;
+    for(Texture* page : m_pages)
+    {
+        pageSamplers.insert(page->m_sampler);
+        for(uint32_t level = 0; level < page->m_mipLevels; level++)
+        {
+            m_statistics.pageBytes += Texture::getLevelSize(page->m_fromat, std::max(1u, page->m_width >> level), std::max(1u, page->m_height >> level)) * page->m_layerCount;
+        }
+    }
+    m_statistics.pageCount = static_cast<uint32_t>(m_pages.size());
+    m_statistics.samplerCount = static_cast<uint32_t>(pageSamplers.size());
+}
+
+// 一个格式的小纹理装进若干层同样大小的图集. 矩形的宽高和位置都是m_padding的倍数, 每级mip上的位置仍然对齐到块
+void TextureAtlas::packAtlas(VkFormat format, std::vector<uint32_t>& sources)
+{
+    const uint32_t maxLayers = std::max(1u, Tools::m_deviceProperties.limits.maxImageArrayLayers);
+    const uint32_t padding = m_padding;
+
+    std::vector<stbrp_rect> rects;
+    uint64_t area = 0;
+    uint32_t maxSide = 0;
+    for(uint32_t i = 0; i < sources.size(); i++)
+    {
+        Texture* source = m_sources[sources[i]];
+        stbrp_rect rect = {};
+        rect.id = static_cast<int>(i);
+        rect.w = static_cast<stbrp_coord>(alignUp(source->m_width + 2 * padding, padding));
+        rect.h = static_cast<stbrp_coord>(alignUp(source->m_height + 2 * padding, padding));
+        area += static_cast<uint64_t>(rect.w) * rect.h;
+        maxSide = std::max(maxSide, static_cast<uint32_t>(std::max(rect.w, rect.h)));
+        rects.push_back(rect);
+    }
+
+    //放得下时用能装下总面积的最小的2的幂, 否则每层都用最大尺寸
+    uint32_t size = padding;
+    while(size < m_atlasSize && (static_cast<uint64_t>(size) * size < area || size < maxSide))
+    {
+        size *= 2;
+    }
+    size = std::min(size, Tools::m_deviceProperties.limits.maxImageDimension2D);
+
+    Page page = {};
+    page.format = format;
+    page.width = size;
+    page.height = size;
+    page.mipLevels = static_cast<uint32_t>(std::log2(std::max(1u, padding / getBlockSize(format)))) + 1;
+    page.addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    std::vector<stbrp_node> nodes(size);
+    while(!rects.empty())
+    {
+        stbrp_context context;
+        stbrp_init_target(&context, static_cast<int>(size), static_cast<int>(size), nodes.data(), static_cast<int>(nodes.size()));
+        stbrp_pack_rects(&context, rects.data(), static_cast<int>(rects.size()));
+
+        std::vector<Item> items;
+        std::vector<stbrp_rect> remaining;
+        for(const stbrp_rect& rect : rects)
+        {
+            if(!rect.was_packed)
+            {
+                remaining.push_back(rect);
+                continue;
+            }
+
+            uint32_t index = sources[rect.id];
+            Texture* source = m_sources[index];
+            Region& region = m_regions[index];
+            region.scaleOffset = glm::vec4(static_cast<float>(source->m_width) / size, static_cast<float>(source->m_height) / size,
+                                           static_cast<float>(rect.x + padding) / size, static_cast<float>(rect.y + padding) / size);
+            region.page = static_cast<uint32_t>(m_pageLayouts.size());
+            region.layer = static_cast<uint32_t>(page.layers.size());
+            items.push_back(Item{index, rect.x, rect.y});
+        }
+
+        //比一整层还大的纹理在分组时已经排除, 这里只是防止死循环
+        if(items.empty())
+        {
+            std::cout << "texture atlas: failed to pack " << remaining.size() << " textures" << std::endl;
+            break;
+        }
+
+        m_statistics.atlasTextureCount += static_cast<uint32_t>(items.size());
+        page.layers.push_back(items);
+        rects.swap(remaining);
+        if(page.layers.size() == maxLayers)
+        {
+            m_statistics.atlasLayerCount += static_cast<uint32_t>(page.layers.size());
+            m_pageLayouts.push_back(page);
+            page.layers.clear();
+        }
+    }
+
+    if(!page.layers.empty())
+    {
+        m_statistics.atlasLayerCount += static_cast<uint32_t>(page.layers.size());
+        m_pageLayouts.push_back(page);
+    }
+}
+
+Texture* TextureAtlas::createPage(const Page& page)
+{
+    Texture* texture = new Texture();
+    texture->m_width = page.width;
+    texture->m_height = page.height;
+    texture->m_mipLevels = page.mipLevels;
+    texture->m_layerCount = static_cast<uint32_t>(page.layers.size());
+    texture->m_imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    texture->m_fromat = page.format;
+    texture->m_descriptorSet = VK_NULL_HANDLE;
+    texture->m_name = page.addressMode == VK_SAMPLER_ADDRESS_MODE_REPEAT ? "texture array" : "texture atlas";
+
+    Tools::createImageAndMemoryThenBind(texture->m_fromat, texture->m_width, texture->m_height, texture->m_mipLevels, texture->m_layerCount,
+                                        VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                        VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                        texture->m_image, texture->m_imageMemory);
+    Tools::createImageView(texture->m_image, texture->m_fromat, VK_IMAGE_ASPECT_COLOR_BIT, texture->m_mipLevels, texture->m_layerCount, texture->m_imageView, VK_IMAGE_VIEW_TYPE_2D_ARRAY);
+    //图集靠边框重复, 页本身夹住边缘
+    ResourceCache::acquireTextureSampler(VK_FILTER_LINEAR, page.addressMode, texture->m_mipLevels, texture->m_sampler);
+    return texture;
+}
+
+// 数组的一层直接整张拷贝. 图集里的纹理每级mip拷9块: 中间是整张图, 四边和四角是对边的纹素
+void TextureAtlas::copyItem(VkCommandBuffer commandBuffer, const Page& page, Texture* target, uint32_t layer, const Item& item)
+{
+    Texture* source = m_sources[item.source];
+    const uint32_t padding = page.addressMode == VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE ? m_padding : 0;
+
+    std::vector<VkImageCopy> copyRegions;
+    for(uint32_t level = 0; level < page.mipLevels; level++)
+    {
+        int32_t width = static_cast<int32_t>(std::max(1u, source->m_width >> level));
+        int32_t height = static_cast<int32_t>(std::max(1u, source->m_height >> level));
+        int32_t border = static_cast<int32_t>(padding >> level);
+        int32_t x = static_cast<int32_t>((item.x + padding) >> level);
+        int32_t y = static_cast<int32_t>((item.y + padding) >> level);
+
+        const int32_t srcX[3] = {width - border, 0, 0};
+        const int32_t srcY[3] = {height - border, 0, 0};
+        const int32_t dstX[3] = {x - border, x, x + width};
+        const int32_t dstY[3] = {y - border, y, y + height};
+        const int32_t sizeX[3] = {border, width, border};
+        const int32_t sizeY[3] = {border, height, border};
+        for(uint32_t j = 0; j < 3; j++)
+        {
+            for(uint32_t i = 0; i < 3; i++)
+            {
+                if(sizeX[i] == 0 || sizeY[j] == 0)
+                {
+                    continue;
+                }
+
+                VkImageCopy copyRegion = {};
+                copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                copyRegion.srcSubresource.mipLevel = level;
+                copyRegion.srcSubresource.baseArrayLayer = 0;
+                copyRegion.srcSubresource.layerCount = 1;
+                copyRegion.srcOffset = {srcX[i], srcY[j], 0};
+                copyRegion.dstSubresource = copyRegion.srcSubresource;
+                copyRegion.dstSubresource.baseArrayLayer = layer;
+                copyRegion.dstOffset = {dstX[i], dstY[j], 0};
+                copyRegion.extent = {static_cast<uint32_t>(sizeX[i]), static_cast<uint32_t>(sizeY[j]), 1};
+                copyRegions.push_back(copyRegion);
+            }
+        }
+    }
+
+    vkCmdCopyImage(commandBuffer, source->m_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target->m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                   static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+}
+
+void TextureAtlas::clear()
+{
+    for(Texture* page : m_pages)
+    {
+        page->clear();
+        delete page;
+    }
+    m_pages.clear();
+    m_pageLayouts.clear();
+    m_sources.clear();
+    m_regions.clear();
+}
+
+void TextureAtlas::releaseSources(const std::vector<Texture*>& keep)
+{
+    for(Texture* source : m_sources)
+    {
+        if(std::find(keep.begin(), keep.end(), source) != keep.end())
+        {
+            continue;
+        }
+
+        //拥有者之后再调用clear时句柄都是空的
+        source->clear();
+        source->m_image = VK_NULL_HANDLE;
+        source->m_imageMemory = VK_NULL_HANDLE;
+        source->m_imageView = VK_NULL_HANDLE;
+        source->m_sampler = VK_NULL_HANDLE;
+    }
+}
@@ -0,0 +1,80 @@
+
+#pragma once
+
+#include "tools.h"
+#include "texture.h"
+
+// 把很多张小纹理合并成少量的2D数组纹理, 全部在GPU上用vkCmdCopyImage完成, 块压缩格式也可以.
+// 格式, 尺寸和mip数都相同的纹理放进同一个数组的不同层, 保留完整的mip.
+// 剩下的小纹理按格式用stb_rect_pack装进图集, 图集的每一页是数组的一层. 每张纹理四周留m_padding的边框,
+// 填入对边的纹素, 采样时uv先取fract再映射到图集, 线性过滤和重复寻址都不会混入相邻的纹理.
+// 边框在每级mip上减半, 所以图集只有log2(m_padding / 块大小) + 1级mip.
+// 所有页的采样器都从ResourceCache按创建参数取得, 同样的参数只有一个VkSampler
+class TextureAtlas
+{
+public:
+    // 和着色器里的布局一致. atlasUV = fract(uv) * scaleOffset.xy + scaleOffset.zw
+    struct Region {
+        glm::vec4 scaleOffset;
+        uint32_t page;              //m_pages中的下标
+        uint32_t layer;
+        uint32_t padding[2];
+    };
+
+    struct Statistics {
+        uint32_t sourceCount = 0;
+        uint32_t sourceSamplerCount = 0;    //源纹理里不同的VkSampler
+        uint32_t pageCount = 0;
+        uint32_t arrayLayerCount = 0;       //同尺寸纹理放进数组的层数
+        uint32_t atlasLayerCount = 0;       //图集的页数
+        uint32_t atlasTextureCount = 0;     //装进图集的纹理
+        uint32_t samplerCount = 0;
+        VkDeviceSize sourceBytes = 0;
+        VkDeviceSize pageBytes = 0;
+    };
+
+    TextureAtlas();
+    ~TextureAtlas();
+
+    // 源纹理是单层的2D纹理, 需要带VK_IMAGE_USAGE_TRANSFER_SRC_BIT. 返回在m_regions中的下标, 同一个指针只加入一次
+    uint32_t add(Texture* texture);
+    void build(VkQueue transferQueue);
+    // 销毁m_pages
+    void clear();
+    // 打包之后源纹理不再需要, 销毁它们的Vulkan对象并置空句柄, Texture对象本身由原来的拥有者释放. keep中的纹理保留(比如共享的缺省纹理)
+    void releaseSources(const std::vector<Texture*>& keep);
+    const Statistics& getStatistics() { return m_statistics; }
+
+private:
+    struct Item {
+        uint32_t source;
+        int32_t x;                  //图集里含边框的位置
+        int32_t y;
+    };
+
+    struct Page {
+        VkFormat format;
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipLevels;
+        VkSamplerAddressMode addressMode;
+        std::vector<std::vector<Item>> layers;
+    };
+
+    void packAtlas(VkFormat format, std::vector<uint32_t>& sources);
+    Texture* createPage(const Page& page);
+    void copyItem(VkCommandBuffer commandBuffer, const Page& page, Texture* target, uint32_t layer, const Item& item);
+
+public:
+    uint32_t m_atlasSize = 2048;            //图集的最大边长
+    uint32_t m_maxAtlasItemSize = 512;      //宽高都不超过这个值的纹理才装进图集
+    uint32_t m_padding = 16;                //2的幂
+
+    std::vector<Texture*> m_sources;
+    std::vector<Region> m_regions;          //和m_sources一一对应
+    std::vector<Texture*> m_pages;          //都是VK_IMAGE_VIEW_TYPE_2D_ARRAY
+
+private:
+    std::vector<Page> m_pageLayouts;
+    Statistics m_statistics;
+};
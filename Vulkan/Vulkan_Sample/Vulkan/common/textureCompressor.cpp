@@ -0,0 +1,1302 @@
+
+#include "textureCompressor.h"
+#include <chrono>
+#include <fstream>
+#include <random>
+#include <glm/gtc/packing.hpp>
+
+#define STB_DXT_IMPLEMENTATION
+#include <stb_dxt.h>
+
+// BC7和BC6H 2位和4位索引的插值权重
+static const uint32_t g_weights2[4] = {0, 21, 43, 64};
+static const uint32_t g_weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+static const uint8_t g_ktx2Identifier[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+struct Ktx2Header {
+    uint8_t identifier[12];
+    uint32_t vkFormat;
+    uint32_t typeSize;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t layerCount;
+    uint32_t faceCount;
+    uint32_t levelCount;
+    uint32_t supercompressionScheme;
+    uint32_t dfdByteOffset;
+    uint32_t dfdByteLength;
+    uint32_t kvdByteOffset;
+    uint32_t kvdByteLength;
+    uint64_t sgdByteOffset;
+    uint64_t sgdByteLength;
+};
+
+struct Ktx2Level {
+    uint64_t byteOffset;
+    uint64_t byteLength;
+    uint64_t uncompressedByteLength;
+};
+
+// 128位块按位顺序读写, 低位在前
+struct BlockWriter {
+    uint8_t* block;
+    uint32_t position;
+
+    void write(uint32_t value, uint32_t bitCount)
+    {
+        for(uint32_t i = 0; i < bitCount; ++i, ++position)
+        {
+            if((value >> i) & 1)
+            {
+                block[position >> 3] |= 1 << (position & 7);
+            }
+        }
+    }
+};
+
+struct BlockReader {
+    const uint8_t* block;
+    uint32_t position;
+
+    uint32_t read(uint32_t bitCount)
+    {
+        uint32_t value = 0;
+        for(uint32_t i = 0; i < bitCount; ++i, ++position)
+        {
+            value |= ((block[position >> 3] >> (position & 7)) & 1) << i;
+        }
+        return value;
+    }
+};
+
+// 主轴拟合, 返回所有像素沿主轴投影的两端
+template<uint32_t channels>
+static void fitEndpoints(const float pixels[16][4], float e0[4], float e1[4])
+{
+    float mean[4] = {};
+    float minValue[4] = {FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX};
+    float maxValue[4] = {-FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        for(uint32_t c = 0; c < channels; ++c)
+        {
+            mean[c] += pixels[i][c] / 16.0f;
+            minValue[c] = std::min(minValue[c], pixels[i][c]);
+            maxValue[c] = std::max(maxValue[c], pixels[i][c]);
+        }
+    }
+
+    float covariance[4][4] = {};
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        for(uint32_t a = 0; a < channels; ++a)
+        {
+            for(uint32_t b = 0; b < channels; ++b)
+            {
+                covariance[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+            }
+        }
+    }
+
+    // 幂迭代求最大特征向量, 从包围盒对角线开始
+    float axis[4] = {};
+    for(uint32_t c = 0; c < channels; ++c)
+    {
+        axis[c] = maxValue[c] - minValue[c];
+    }
+    for(uint32_t iteration = 0; iteration < 8; ++iteration)
+    {
+        float next[4] = {};
+        float length = 0.0f;
+        for(uint32_t a = 0; a < channels; ++a)
+        {
+            for(uint32_t b = 0; b < channels; ++b)
+            {
+                next[a] += covariance[a][b] * axis[b];
+            }
+            length += next[a] * next[a];
+        }
+        if(length < 1e-12f)
+        {
+            break;
+        }
+        length = 1.0f / sqrtf(length);
+        for(uint32_t c = 0; c < channels; ++c)
+        {
+            axis[c] = next[c] * length;
+        }
+    }
+
+    float length = 0.0f;
+    for(uint32_t c = 0; c < channels; ++c)
+    {
+        length += axis[c] * axis[c];
+    }
+    float tMin = 0.0f;
+    float tMax = 0.0f;
+    if(length > 1e-12f)
+    {
+        length = 1.0f / sqrtf(length);
+        tMin = FLT_MAX;
+        tMax = -FLT_MAX;
+        for(uint32_t c = 0; c < channels; ++c)
+        {
+            axis[c] *= length;
+        }
+        for(uint32_t i = 0; i < 16; ++i)
+        {
+            float t = 0.0f;
+            for(uint32_t c = 0; c < channels; ++c)
+            {
+                t += (pixels[i][c] - mean[c]) * axis[c];
+            }
+            tMin = std::min(tMin, t);
+            tMax = std::max(tMax, t);
+        }
+    }
+
+    for(uint32_t c = 0; c < channels; ++c)
+    {
+        e0[c] = mean[c] + axis[c] * tMin;
+        e1[c] = mean[c] + axis[c] * tMax;
+    }
+}
+
+// 索引固定后用最小二乘重新求两个端点
+template<uint32_t channels>
+static bool refitEndpoints(const float pixels[16][4], const uint8_t indices[16], const uint32_t* weights, float e0[4], float e1[4])
+{
+    float a = 0.0f, b = 0.0f, c = 0.0f;
+    float r0[4] = {};
+    float r1[4] = {};
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        float w = weights[indices[i]] / 64.0f;
+        a += (1.0f - w) * (1.0f - w);
+        b += (1.0f - w) * w;
+        c += w * w;
+        for(uint32_t k = 0; k < channels; ++k)
+        {
+            r0[k] += (1.0f - w) * pixels[i][k];
+            r1[k] += w * pixels[i][k];
+        }
+    }
+
+    float det = a * c - b * b;
+    if(fabsf(det) < 1e-6f)
+    {
+        return false;
+    }
+    det = 1.0f / det;
+    for(uint32_t k = 0; k < channels; ++k)
+    {
+        e0[k] = (c * r0[k] - b * r1[k]) * det;
+        e1[k] = (a * r1[k] - b * r0[k]) * det;
+    }
+    return true;
+}
+
+// BC7 mode 6
+
+struct Bc7Candidate {
+    uint8_t endpoints[2][4];    //7位
+    uint8_t pbits[2];
+    uint8_t indices[16];
+    uint32_t error;
+};
+
+static void quantizeBC7(const float endpoint[4], uint8_t quantized[4], uint8_t& pbit)
+{
+    float bestError = FLT_MAX;
+    for(uint32_t p = 0; p < 2; ++p)
+    {
+        uint8_t values[4];
+        float error = 0.0f;
+        for(uint32_t c = 0; c < 4; ++c)
+        {
+            float v = std::min(std::max(endpoint[c], 0.0f), 255.0f);
+            int32_t q = std::min(std::max(static_cast<int32_t>((v - p) * 0.5f + 0.5f), 0), 127);
+            values[c] = static_cast<uint8_t>(q);
+            float delta = static_cast<float>((q << 1) | p) - v;
+            error += delta * delta;
+        }
+        if(error < bestError)
+        {
+            bestError = error;
+            memcpy(quantized, values, 4);
+            pbit = static_cast<uint8_t>(p);
+        }
+    }
+}
+
+static void indexBC7(const uint8_t* rgba, Bc7Candidate& candidate)
+{
+    int32_t palette[16][4];
+    for(uint32_t c = 0; c < 4; ++c)
+    {
+        int32_t e0 = (candidate.endpoints[0][c] << 1) | candidate.pbits[0];
+        int32_t e1 = (candidate.endpoints[1][c] << 1) | candidate.pbits[1];
+        for(uint32_t k = 0; k < 16; ++k)
+        {
+            palette[k][c] = ((64 - g_weights4[k]) * e0 + g_weights4[k] * e1 + 32) >> 6;
+        }
+    }
+
+    candidate.error = 0;
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        const uint8_t* pixel = rgba + i * 4;
+        uint32_t bestError = UINT32_MAX;
+        for(uint32_t k = 0; k < 16; ++k)
+        {
+            uint32_t error = 0;
+            for(uint32_t c = 0; c < 4; ++c)
+            {
+                int32_t delta = palette[k][c] - pixel[c];
+                error += delta * delta;
+            }
+            if(error < bestError)
+            {
+                bestError = error;
+                candidate.indices[i] = static_cast<uint8_t>(k);
+            }
+        }
+        candidate.error += bestError;
+    }
+}
+
+static void encodeBC7Mode6(const uint8_t* rgba, const float pixels[16][4], Bc7Candidate& best)
+{
+    float e0[4], e1[4];
+    fitEndpoints<4>(pixels, e0, e1);
+    quantizeBC7(e0, best.endpoints[0], best.pbits[0]);
+    quantizeBC7(e1, best.endpoints[1], best.pbits[1]);
+    indexBC7(rgba, best);
+
+    for(uint32_t iteration = 0; iteration < 2 && best.error > 0; ++iteration)
+    {
+        if(!refitEndpoints<4>(pixels, best.indices, g_weights4, e0, e1))
+        {
+            break;
+        }
+        Bc7Candidate candidate;
+        quantizeBC7(e0, candidate.endpoints[0], candidate.pbits[0]);
+        quantizeBC7(e1, candidate.endpoints[1], candidate.pbits[1]);
+        indexBC7(rgba, candidate);
+        if(candidate.error >= best.error)
+        {
+            break;
+        }
+        best = candidate;
+    }
+}
+
+static void writeBC7Mode6(Bc7Candidate& best, uint8_t* block)
+{
+    // 第一个像素的索引最高位必须为0, 交换端点后索引取反, 权重是对称的所以结果不变
+    if(best.indices[0] & 8)
+    {
+        std::swap(best.endpoints[0], best.endpoints[1]);
+        std::swap(best.pbits[0], best.pbits[1]);
+        for(uint32_t i = 0; i < 16; ++i)
+        {
+            best.indices[i] = 15 - best.indices[i];
+        }
+    }
+
+    memset(block, 0, 16);
+    BlockWriter writer = {block, 0};
+    writer.write(1 << 6, 7);
+    for(uint32_t c = 0; c < 4; ++c)
+    {
+        writer.write(best.endpoints[0][c], 7);
+        writer.write(best.endpoints[1][c], 7);
+    }
+    writer.write(best.pbits[0], 1);
+    writer.write(best.pbits[1], 1);
+    writer.write(best.indices[0], 3);
+    for(uint32_t i = 1; i < 16; ++i)
+    {
+        writer.write(best.indices[i], 4);
+    }
+}
+
+// BC7 mode 5, 颜色和透明度各自插值, 用于透明度和颜色不相关的块
+
+struct Bc7Mode5Candidate {
+    uint8_t color[2][3];        //7位
+    uint8_t alpha[2];
+    uint8_t colorIndices[16];   //2位
+    uint8_t alphaIndices[16];
+    uint32_t colorError;
+    uint32_t alphaError;
+};
+
+static uint32_t expand7(uint32_t value)
+{
+    return (value << 1) | (value >> 6);
+}
+
+static void quantizeBC7Mode5(const float color[2][4], const float alpha[2], Bc7Mode5Candidate& candidate)
+{
+    for(uint32_t e = 0; e < 2; ++e)
+    {
+        for(uint32_t c = 0; c < 3; ++c)
+        {
+            float v = std::min(std::max(color[e][c], 0.0f), 255.0f);
+            candidate.color[e][c] = static_cast<uint8_t>(v * 127.0f / 255.0f + 0.5f);
+        }
+        candidate.alpha[e] = static_cast<uint8_t>(std::min(std::max(alpha[e], 0.0f), 255.0f) + 0.5f);
+    }
+}
+
+static void indexBC7Mode5(const uint8_t* rgba, Bc7Mode5Candidate& candidate)
+{
+    int32_t colors[4][3];
+    int32_t alphas[4];
+    for(uint32_t k = 0; k < 4; ++k)
+    {
+        for(uint32_t c = 0; c < 3; ++c)
+        {
+            colors[k][c] = ((64 - g_weights2[k]) * expand7(candidate.color[0][c]) + g_weights2[k] * expand7(candidate.color[1][c]) + 32) >> 6;
+        }
+        alphas[k] = ((64 - g_weights2[k]) * candidate.alpha[0] + g_weights2[k] * candidate.alpha[1] + 32) >> 6;
+    }
+
+    candidate.colorError = 0;
+    candidate.alphaError = 0;
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        const uint8_t* pixel = rgba + i * 4;
+        uint32_t bestColor = UINT32_MAX;
+        uint32_t bestAlpha = UINT32_MAX;
+        for(uint32_t k = 0; k < 4; ++k)
+        {
+            uint32_t error = 0;
+            for(uint32_t c = 0; c < 3; ++c)
+            {
+                int32_t delta = colors[k][c] - pixel[c];
+                error += delta * delta;
+            }
+            if(error < bestColor)
+            {
+                bestColor = error;
+                candidate.colorIndices[i] = static_cast<uint8_t>(k);
+            }
+            int32_t delta = alphas[k] - pixel[3];
+            if(static_cast<uint32_t>(delta * delta) < bestAlpha)
+            {
+                bestAlpha = delta * delta;
+                candidate.alphaIndices[i] = static_cast<uint8_t>(k);
+            }
+        }
+        candidate.colorError += bestColor;
+        candidate.alphaError += bestAlpha;
+    }
+}
+
+static void encodeBC7Mode5(const uint8_t* rgba, const float pixels[16][4], Bc7Mode5Candidate& best)
+{
+    float color[2][4];
+    float alpha[2] = {FLT_MAX, -FLT_MAX};
+    float alphaPixels[16][4] = {};
+    fitEndpoints<3>(pixels, color[0], color[1]);
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        alphaPixels[i][0] = pixels[i][3];
+        alpha[0] = std::min(alpha[0], pixels[i][3]);
+        alpha[1] = std::max(alpha[1], pixels[i][3]);
+    }
+    quantizeBC7Mode5(color, alpha, best);
+    indexBC7Mode5(rgba, best);
+
+    //颜色和透明度的索引互不影响, 各自修正端点后分别保留更好的一半
+    for(uint32_t iteration = 0; iteration < 2; ++iteration)
+    {
+        float alphaEndpoints[2][4];
+        bool colorRefit = refitEndpoints<3>(pixels, best.colorIndices, g_weights2, color[0], color[1]);
+        bool alphaRefit = refitEndpoints<1>(alphaPixels, best.alphaIndices, g_weights2, alphaEndpoints[0], alphaEndpoints[1]);
+        if(!colorRefit && !alphaRefit)
+        {
+            break;
+        }
+        alpha[0] = alphaRefit ? alphaEndpoints[0][0] : best.alpha[0];
+        alpha[1] = alphaRefit ? alphaEndpoints[1][0] : best.alpha[1];
+        Bc7Mode5Candidate candidate;
+        quantizeBC7Mode5(color, alpha, candidate);
+        if(!colorRefit)
+        {
+            memcpy(candidate.color, best.color, sizeof(best.color));
+        }
+        indexBC7Mode5(rgba, candidate);
+
+        bool improved = false;
+        if(candidate.colorError < best.colorError)
+        {
+            memcpy(best.color, candidate.color, sizeof(best.color));
+            memcpy(best.colorIndices, candidate.colorIndices, sizeof(best.colorIndices));
+            best.colorError = candidate.colorError;
+            improved = true;
+        }
+        if(candidate.alphaError < best.alphaError)
+        {
+            memcpy(best.alpha, candidate.alpha, sizeof(best.alpha));
+            memcpy(best.alphaIndices, candidate.alphaIndices, sizeof(best.alphaIndices));
+            best.alphaError = candidate.alphaError;
+            improved = true;
+        }
+        if(!improved)
+        {
+            break;
+        }
+    }
+}
+
+static void writeBC7Mode5(Bc7Mode5Candidate& best, uint8_t* block)
+{
+    //颜色和透明度的第一个索引最高位都必须为0
+    if(best.colorIndices[0] & 2)
+    {
+        std::swap(best.color[0], best.color[1]);
+        for(uint32_t i = 0; i < 16; ++i)
+        {
+            best.colorIndices[i] = 3 - best.colorIndices[i];
+        }
+    }
+    if(best.alphaIndices[0] & 2)
+    {
+        std::swap(best.alpha[0], best.alpha[1]);
+        for(uint32_t i = 0; i < 16; ++i)
+        {
+            best.alphaIndices[i] = 3 - best.alphaIndices[i];
+        }
+    }
+
+    memset(block, 0, 16);
+    BlockWriter writer = {block, 0};
+    writer.write(1 << 5, 6);
+    writer.write(0, 2);         //不交换通道
+    for(uint32_t c = 0; c < 3; ++c)
+    {
+        writer.write(best.color[0][c], 7);
+        writer.write(best.color[1][c], 7);
+    }
+    writer.write(best.alpha[0], 8);
+    writer.write(best.alpha[1], 8);
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        writer.write(best.colorIndices[i], i == 0 ? 1 : 2);
+    }
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        writer.write(best.alphaIndices[i], i == 0 ? 1 : 2);
+    }
+}
+
+void TextureCompressor::encodeBlockBC7(const uint8_t* rgba, uint8_t* block)
+{
+    float pixels[16][4];
+    bool alphaVaries = false;
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        for(uint32_t c = 0; c < 4; ++c)
+        {
+            pixels[i][c] = rgba[i * 4 + c];
+        }
+        alphaVaries = alphaVaries || rgba[i * 4 + 3] != rgba[3];
+    }
+
+    Bc7Candidate mode6;
+    encodeBC7Mode6(rgba, pixels, mode6);
+    //透明度不变时mode 6总是够用
+    if(alphaVaries && mode6.error > 0)
+    {
+        Bc7Mode5Candidate mode5;
+        encodeBC7Mode5(rgba, pixels, mode5);
+        if(mode5.colorError + mode5.alphaError < mode6.error)
+        {
+            writeBC7Mode5(mode5, block);
+            return ;
+        }
+    }
+    writeBC7Mode6(mode6, block);
+}
+
+void TextureCompressor::decodeBlockBC7(const uint8_t* block, uint8_t* rgba)
+{
+    //mode为第一个1之前0的个数
+    BlockReader reader = {block, 0};
+    uint32_t mode = 0;
+    while(mode < 8 && reader.read(1) == 0)
+    {
+        mode++;
+    }
+
+    if(mode == 5)
+    {
+        reader.read(2);
+        uint32_t color[2][3];
+        for(uint32_t c = 0; c < 3; ++c)
+        {
+            color[0][c] = expand7(reader.read(7));
+            color[1][c] = expand7(reader.read(7));
+        }
+        uint32_t alpha0 = reader.read(8);
+        uint32_t alpha1 = reader.read(8);
+        for(uint32_t i = 0; i < 16; ++i)
+        {
+            uint32_t w = g_weights2[reader.read(i == 0 ? 1 : 2)];
+            for(uint32_t c = 0; c < 3; ++c)
+            {
+                rgba[i * 4 + c] = static_cast<uint8_t>(((64 - w) * color[0][c] + w * color[1][c] + 32) >> 6);
+            }
+        }
+        for(uint32_t i = 0; i < 16; ++i)
+        {
+            uint32_t w = g_weights2[reader.read(i == 0 ? 1 : 2)];
+            rgba[i * 4 + 3] = static_cast<uint8_t>(((64 - w) * alpha0 + w * alpha1 + 32) >> 6);
+        }
+        return ;
+    }
+
+    if(mode != 6)
+    {
+        memset(rgba, 0, 64);
+        return ;
+    }
+
+    uint32_t endpoints[2][4];
+    for(uint32_t c = 0; c < 4; ++c)
+    {
+        endpoints[0][c] = reader.read(7) << 1;
+        endpoints[1][c] = reader.read(7) << 1;
+    }
+    uint32_t p0 = reader.read(1);
+    uint32_t p1 = reader.read(1);
+    for(uint32_t c = 0; c < 4; ++c)
+    {
+        endpoints[0][c] |= p0;
+        endpoints[1][c] |= p1;
+    }
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        uint32_t w = g_weights4[reader.read(i == 0 ? 3 : 4)];
+        for(uint32_t c = 0; c < 4; ++c)
+        {
+            rgba[i * 4 + c] = static_cast<uint8_t>(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6);
+        }
+    }
+}
+
+// BC6H mode 11, 在half的位模式上插值, 近似对数空间
+
+struct Bc6hCandidate {
+    uint32_t endpoints[2][3];   //10位
+    uint8_t indices[16];
+    float error;
+};
+
+static uint32_t unquantizeBC6H(uint32_t value)
+{
+    if(value == 0)
+    {
+        return 0;
+    }
+    if(value == 1023)
+    {
+        return 0xFFFF;
+    }
+    return ((value << 16) + 0x8000) >> 10;
+}
+
+static uint32_t finishBC6H(uint32_t value)
+{
+    return (value * 31) >> 6;
+}
+
+static uint32_t quantizeBC6H(float value)
+{
+    value = std::min(std::max(value, 0.0f), static_cast<float>(0x7BFF));
+    int32_t center = static_cast<int32_t>((value - 15.0f) / 31.0f + 0.5f);
+    uint32_t best = 0;
+    float bestError = FLT_MAX;
+    for(int32_t q = center - 1; q <= center + 1; ++q)
+    {
+        uint32_t clamped = static_cast<uint32_t>(std::min(std::max(q, 0), 1023));
+        float error = fabsf(static_cast<float>(finishBC6H(unquantizeBC6H(clamped))) - value);
+        if(error < bestError)
+        {
+            bestError = error;
+            best = clamped;
+        }
+    }
+    return best;
+}
+
+static void indexBC6H(const float pixels[16][4], Bc6hCandidate& candidate)
+{
+    float palette[16][3];
+    for(uint32_t c = 0; c < 3; ++c)
+    {
+        uint32_t e0 = unquantizeBC6H(candidate.endpoints[0][c]);
+        uint32_t e1 = unquantizeBC6H(candidate.endpoints[1][c]);
+        for(uint32_t k = 0; k < 16; ++k)
+        {
+            palette[k][c] = static_cast<float>(finishBC6H(((64 - g_weights4[k]) * e0 + g_weights4[k] * e1 + 32) >> 6));
+        }
+    }
+
+    candidate.error = 0.0f;
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        float bestError = FLT_MAX;
+        for(uint32_t k = 0; k < 16; ++k)
+        {
+            float error = 0.0f;
+            for(uint32_t c = 0; c < 3; ++c)
+            {
+                float delta = palette[k][c] - pixels[i][c];
+                error += delta * delta;
+            }
+            if(error < bestError)
+            {
+                bestError = error;
+                candidate.indices[i] = static_cast<uint8_t>(k);
+            }
+        }
+        candidate.error += bestError;
+    }
+}
+
+void TextureCompressor::encodeBlockBC6H(const uint16_t* rgbaHalf, uint8_t* block)
+{
+    // 负数当作0, inf和nan当作最大的有限值
+    float pixels[16][4] = {};
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        for(uint32_t c = 0; c < 3; ++c)
+        {
+            uint16_t half = rgbaHalf[i * 4 + c];
+            if(half & 0x8000)
+            {
+                half = 0;
+            }
+            else if((half & 0x7C00) == 0x7C00)
+            {
+                half = 0x7BFF;
+            }
+            pixels[i][c] = half;
+        }
+    }
+
+    float e0[4], e1[4];
+    fitEndpoints<3>(pixels, e0, e1);
+    Bc6hCandidate best;
+    for(uint32_t c = 0; c < 3; ++c)
+    {
+        best.endpoints[0][c] = quantizeBC6H(e0[c]);
+        best.endpoints[1][c] = quantizeBC6H(e1[c]);
+    }
+    indexBC6H(pixels, best);
+
+    for(uint32_t iteration = 0; iteration < 2 && best.error > 0.0f; ++iteration)
+    {
+        if(!refitEndpoints<3>(pixels, best.indices, g_weights4, e0, e1))
+        {
+            break;
+        }
+        Bc6hCandidate candidate;
+        for(uint32_t c = 0; c < 3; ++c)
+        {
+            candidate.endpoints[0][c] = quantizeBC6H(e0[c]);
+            candidate.endpoints[1][c] = quantizeBC6H(e1[c]);
+        }
+        indexBC6H(pixels, candidate);
+        if(candidate.error >= best.error)
+        {
+            break;
+        }
+        best = candidate;
+    }
+
+    if(best.indices[0] & 8)
+    {
+        std::swap(best.endpoints[0], best.endpoints[1]);
+        for(uint32_t i = 0; i < 16; ++i)
+        {
+            best.indices[i] = 15 - best.indices[i];
+        }
+    }
+
+    memset(block, 0, 16);
+    BlockWriter writer = {block, 0};
+    writer.write(0x03, 5);
+    for(uint32_t e = 0; e < 2; ++e)
+    {
+        for(uint32_t c = 0; c < 3; ++c)
+        {
+            writer.write(best.endpoints[e][c], 10);
+        }
+    }
+    writer.write(best.indices[0], 3);
+    for(uint32_t i = 1; i < 16; ++i)
+    {
+        writer.write(best.indices[i], 4);
+    }
+}
+
+void TextureCompressor::decodeBlockBC6H(const uint8_t* block, uint16_t* rgbaHalf)
+{
+    BlockReader reader = {block, 0};
+    if(reader.read(5) != 0x03)
+    {
+        memset(rgbaHalf, 0, 16 * 4 * sizeof(uint16_t));
+        return ;
+    }
+
+    uint32_t endpoints[2][3];
+    for(uint32_t e = 0; e < 2; ++e)
+    {
+        for(uint32_t c = 0; c < 3; ++c)
+        {
+            endpoints[e][c] = unquantizeBC6H(reader.read(10));
+        }
+    }
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        uint32_t w = g_weights4[reader.read(i == 0 ? 3 : 4)];
+        for(uint32_t c = 0; c < 3; ++c)
+        {
+            rgbaHalf[i * 4 + c] = static_cast<uint16_t>(finishBC6H(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6));
+        }
+        rgbaHalf[i * 4 + 3] = 0x3C00;
+    }
+}
+
+// BC1颜色块, BC3里的颜色块总是4色模式
+static void decodeColorBlock(const uint8_t* block, uint8_t* rgba, bool fourColor)
+{
+    uint32_t c0 = block[0] | (block[1] << 8);
+    uint32_t c1 = block[2] | (block[3] << 8);
+    uint8_t colors[4][4];
+    for(uint32_t e = 0; e < 2; ++e)
+    {
+        uint32_t c = e == 0 ? c0 : c1;
+        uint32_t r = (c >> 11) & 31;
+        uint32_t g = (c >> 5) & 63;
+        uint32_t b = c & 31;
+        colors[e][0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+        colors[e][1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+        colors[e][2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+        colors[e][3] = 255;
+    }
+    for(uint32_t c = 0; c < 3; ++c)
+    {
+        if(fourColor || c0 > c1)
+        {
+            colors[2][c] = static_cast<uint8_t>((2 * colors[0][c] + colors[1][c]) / 3);
+            colors[3][c] = static_cast<uint8_t>((colors[0][c] + 2 * colors[1][c]) / 3);
+        }
+        else
+        {
+            colors[2][c] = static_cast<uint8_t>((colors[0][c] + colors[1][c]) / 2);
+            colors[3][c] = 0;
+        }
+    }
+    colors[2][3] = 255;
+    colors[3][3] = (fourColor || c0 > c1) ? 255 : 0;
+
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        memcpy(rgba + i * 4, colors[(indices >> (i * 2)) & 3], 4);
+    }
+}
+
+// BC4单通道块, 写到每像素stride字节的第一个字节
+static void decodeChannelBlock(const uint8_t* block, uint8_t* output, uint32_t stride)
+{
+    uint32_t values[8];
+    values[0] = block[0];
+    values[1] = block[1];
+    if(values[0] > values[1])
+    {
+        for(uint32_t i = 1; i < 7; ++i)
+        {
+            values[i + 1] = ((7 - i) * values[0] + i * values[1]) / 7;
+        }
+    }
+    else
+    {
+        for(uint32_t i = 1; i < 5; ++i)
+        {
+            values[i + 1] = ((5 - i) * values[0] + i * values[1]) / 5;
+        }
+        values[6] = 0;
+        values[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for(uint32_t i = 0; i < 6; ++i)
+    {
+        indices |= static_cast<uint64_t>(block[2 + i]) << (i * 8);
+    }
+    for(uint32_t i = 0; i < 16; ++i)
+    {
+        output[i * stride] = static_cast<uint8_t>(values[(indices >> (i * 3)) & 7]);
+    }
+}
+
+VkFormat TextureCompressor::chooseFormat(const TextureData& source, bool isNormalMap, bool highQuality)
+{
+    //不是RGBA8时(比如ktx里本来就是压缩格式)返回原格式, 表示不压缩
+    if(source.m_format != VK_FORMAT_R8G8B8A8_UNORM)
+    {
+        return source.m_format;
+    }
+    if(isNormalMap)
+    {
+        return VK_FORMAT_BC5_UNORM_BLOCK;
+    }
+
+    bool hasAlpha = false;
+    size_t pixelCount = static_cast<size_t>(source.m_width) * source.m_height;
+    for(size_t i = 0; i < pixelCount && !hasAlpha; ++i)
+    {
+        hasAlpha = source.m_data[i * 4 + 3] < 255;
+    }
+    if(highQuality)
+    {
+        return VK_FORMAT_BC7_UNORM_BLOCK;
+    }
+    return hasAlpha ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+}
+
+bool TextureCompressor::isFormatSupported(VkFormat format)
+{
+    if(!Tools::m_deviceEnabledFeatures.textureCompressionBC)
+    {
+        return false;
+    }
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(Tools::m_physicalDevice, format, &formatProperties);
+    return (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+}
+
+void TextureCompressor::compressRow(const Surface& surface, VkFormat format, uint32_t blockY)
+{
+    //超出边界的像素复制边上的, 小于4x4的mip也能编码
+    const bool isHdr = format == VK_FORMAT_BC6H_UFLOAT_BLOCK;
+    const uint32_t pixelSize = isHdr ? 8 : 4;
+    const uint32_t blockSize = static_cast<uint32_t>(Texture::getLevelSize(format, 4, 4));
+    const uint32_t blockCountX = (surface.width + 3) / 4;
+    uint8_t* output = surface.blocks + static_cast<size_t>(blockY) * blockCountX * blockSize;
+
+    uint8_t pixels[16 * 8];
+    for(uint32_t blockX = 0; blockX < blockCountX; ++blockX)
+    {
+        for(uint32_t y = 0; y < 4; ++y)
+        {
+            uint32_t sourceY = std::min(blockY * 4 + y, surface.height - 1);
+            for(uint32_t x = 0; x < 4; ++x)
+            {
+                uint32_t sourceX = std::min(blockX * 4 + x, surface.width - 1);
+                memcpy(pixels + (y * 4 + x) * pixelSize, surface.pixels + (static_cast<size_t>(sourceY) * surface.width + sourceX) * pixelSize, pixelSize);
+            }
+        }
+
+        uint8_t* block = output + blockX * blockSize;
+        switch(format)
+        {
+            case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+                stb_compress_dxt_block(block, pixels, 0, STB_DXT_HIGHQUAL);
+                break;
+            case VK_FORMAT_BC3_UNORM_BLOCK:
+                stb_compress_dxt_block(block, pixels, 1, STB_DXT_HIGHQUAL);
+                break;
+            case VK_FORMAT_BC5_UNORM_BLOCK:
+            {
+                uint8_t rg[32];
+                for(uint32_t i = 0; i < 16; ++i)
+                {
+                    rg[i * 2 + 0] = pixels[i * 4 + 0];
+                    rg[i * 2 + 1] = pixels[i * 4 + 1];
+                }
+                stb_compress_bc5_block(block, rg);
+                break;
+            }
+            case VK_FORMAT_BC7_UNORM_BLOCK:
+                encodeBlockBC7(pixels, block);
+                break;
+            case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+                encodeBlockBC6H(reinterpret_cast<const uint16_t*>(pixels), block);
+                break;
+            default:
+                throw std::runtime_error("failed to compress texture, unsupported format!");
+        }
+    }
+}
+
+void TextureCompressor::compressSurfaces(const std::vector<Surface>& surfaces, VkFormat format, ThreadPool* pThreadPool)
+{
+    //所有surface的块行依次排列, 小mip和大mip一起切块
+    std::vector<uint32_t> firstRows(surfaces.size() + 1, 0);
+    for(size_t i = 0; i < surfaces.size(); ++i)
+    {
+        firstRows[i + 1] = firstRows[i] + (surfaces[i].height + 3) / 4;
+    }
+
+    auto encodeRows = [&](uint32_t begin, uint32_t end) {
+        size_t surface = std::upper_bound(firstRows.begin(), firstRows.end(), begin) - firstRows.begin() - 1;
+        for(uint32_t row = begin; row < end; ++row)
+        {
+            while(row >= firstRows[surface + 1])
+            {
+                surface++;
+            }
+            compressRow(surfaces[surface], format, row - firstRows[surface]);
+        }
+    };
+
+    if(pThreadPool)
+    {
+        pThreadPool->parallelFor(firstRows.back(), 4, encodeRows);
+    }
+    else
+    {
+        encodeRows(0, firstRows.back());
+    }
+}
+
+void TextureCompressor::compress(TextureData& textureData, VkFormat format, ThreadPool* pThreadPool)
+{
+    assert(textureData.m_format == VK_FORMAT_R8G8B8A8_UNORM);
+
+    std::vector<VkDeviceSize> mipOffsets;
+    VkDeviceSize size = 0;
+    for(uint32_t level = 0; level < textureData.m_mipLevels; ++level)
+    {
+        mipOffsets.push_back(size);
+        size += Texture::getLevelSize(format, std::max(1u, textureData.m_width >> level), std::max(1u, textureData.m_height >> level));
+    }
+
+    std::vector<uint8_t> blocks(size);
+    std::vector<Surface> surfaces;
+    for(uint32_t level = 0; level < textureData.m_mipLevels; ++level)
+    {
+        Surface surface = {};
+        surface.pixels = textureData.m_data.data() + textureData.m_mipOffsets[level];
+        surface.width = std::max(1u, textureData.m_width >> level);
+        surface.height = std::max(1u, textureData.m_height >> level);
+        surface.blocks = blocks.data() + mipOffsets[level];
+        surfaces.push_back(surface);
+    }
+    compressSurfaces(surfaces, format, pThreadPool);
+
+    textureData.m_format = format;
+    textureData.m_mipOffsets.swap(mipOffsets);
+    textureData.m_data.swap(blocks);
+}
+
+void TextureCompressor::decompress(const uint8_t* blocks, uint32_t width, uint32_t height, VkFormat format, uint8_t* pixels)
+{
+    const bool isHdr = format == VK_FORMAT_BC6H_UFLOAT_BLOCK;
+    const uint32_t pixelSize = isHdr ? 8 : 4;
+    const uint32_t blockSize = static_cast<uint32_t>(Texture::getLevelSize(format, 4, 4));
+    const uint32_t blockCountX = (width + 3) / 4;
+    const uint32_t blockCountY = (height + 3) / 4;
+
+    uint8_t decoded[16 * 8];
+    for(uint32_t blockY = 0; blockY < blockCountY; ++blockY)
+    {
+        for(uint32_t blockX = 0; blockX < blockCountX; ++blockX)
+        {
+            const uint8_t* block = blocks + (blockY * blockCountX + blockX) * blockSize;
+            switch(format)
+            {
+                case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+                case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+                    decodeColorBlock(block, decoded, false);
+                    break;
+                case VK_FORMAT_BC3_UNORM_BLOCK:
+                    decodeColorBlock(block + 8, decoded, true);
+                    decodeChannelBlock(block, decoded + 3, 4);
+                    break;
+                case VK_FORMAT_BC5_UNORM_BLOCK:
+                    memset(decoded, 255, 64);
+                    decodeChannelBlock(block, decoded, 4);
+                    decodeChannelBlock(block + 8, decoded + 1, 4);
+                    for(uint32_t i = 0; i < 16; ++i)
+                    {
+                        decoded[i * 4 + 2] = 0;
+                    }
+                    break;
+                case VK_FORMAT_BC7_UNORM_BLOCK:
+                    decodeBlockBC7(block, decoded);
+                    break;
+                case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+                    decodeBlockBC6H(block, reinterpret_cast<uint16_t*>(decoded));
+                    break;
+                default:
+                    throw std::runtime_error("failed to decompress texture, unsupported format!");
+            }
+
+            for(uint32_t y = 0; y < 4 && blockY * 4 + y < height; ++y)
+            {
+                for(uint32_t x = 0; x < 4 && blockX * 4 + x < width; ++x)
+                {
+                    memcpy(pixels + ((static_cast<size_t>(blockY) * 4 + y) * width + blockX * 4 + x) * pixelSize, decoded + (y * 4 + x) * pixelSize, pixelSize);
+                }
+            }
+        }
+    }
+}
+
+// ktx2的数据格式描述(DFD), 只写本类会输出的格式
+static bool getDataFormatDescriptor(VkFormat format, std::vector<uint32_t>& dfd)
+{
+    struct Sample {
+        uint32_t channel;
+        uint32_t bitOffset;
+        uint32_t bitLength;
+        uint32_t qualifiers;
+        uint32_t upper;
+    };
+
+    uint32_t colorModel = 0;
+    uint32_t blockDimension = 0x0303;       //4x4, 存的是尺寸减1
+    uint32_t bytesPlane0 = 16;
+    std::vector<Sample> samples;
+    switch(format)
+    {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+            colorModel = 128;
+            bytesPlane0 = 8;
+            samples = {{0, 0, 64, 0, UINT32_MAX}};
+            break;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+            colorModel = 130;
+            samples = {{15, 0, 64, 0, UINT32_MAX}, {0, 64, 64, 0, UINT32_MAX}};
+            break;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            colorModel = 132;
+            samples = {{0, 0, 64, 0, UINT32_MAX}, {1, 64, 64, 0, UINT32_MAX}};
+            break;
+        case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+            colorModel = 133;
+            samples = {{0, 0, 128, 0x80, 0x3F800000}};        //float, 上限1.0f
+            break;
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+            colorModel = 134;
+            samples = {{0, 0, 128, 0, UINT32_MAX}};
+            break;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+            colorModel = 1;
+            blockDimension = 0;
+            bytesPlane0 = 4;
+            samples = {{0, 0, 8, 0, 255}, {1, 8, 8, 0, 255}, {2, 16, 8, 0, 255}, {15, 24, 8, 0, 255}};
+            break;
+        default:
+            return false;
+    }
+
+    uint32_t blockSize = 24 + 16 * static_cast<uint32_t>(samples.size());
+    dfd.clear();
+    dfd.push_back(4 + blockSize);                               //dfdTotalSize
+    dfd.push_back(0);                                           //vendorId, descriptorType
+    dfd.push_back(2 | (blockSize << 16));                       //versionNumber, descriptorBlockSize
+    dfd.push_back(colorModel | (1 << 8) | (1 << 16));           //BT709, 线性, 非预乘
+    dfd.push_back(blockDimension);
+    dfd.push_back(bytesPlane0);
+    dfd.push_back(0);
+    for(const Sample& sample : samples)
+    {
+        dfd.push_back(sample.bitOffset | ((sample.bitLength - 1) << 16) | ((sample.channel | sample.qualifiers) << 24));
+        dfd.push_back(0);
+        dfd.push_back(0);
+        dfd.push_back(sample.upper);
+    }
+    return true;
+}
+
+bool TextureCompressor::saveKtx2(const std::string& fileName, const TextureData& textureData)
+{
+    std::vector<uint32_t> dfd;
+    if(!getDataFormatDescriptor(textureData.m_format, dfd))
+    {
+        return false;
+    }
+
+    Ktx2Header header = {};
+    memcpy(header.identifier, g_ktx2Identifier, sizeof(g_ktx2Identifier));
+    header.vkFormat = textureData.m_format;
+    header.typeSize = 1;
+    header.pixelWidth = textureData.m_width;
+    header.pixelHeight = textureData.m_height;
+    header.faceCount = 1;
+    header.levelCount = textureData.m_mipLevels;
+    header.dfdByteOffset = static_cast<uint32_t>(sizeof(Ktx2Header) + sizeof(Ktx2Level) * textureData.m_mipLevels);
+    header.dfdByteLength = static_cast<uint32_t>(dfd.size() * sizeof(uint32_t));
+
+    //mip数据从最小的一级开始存放, 每级16字节对齐
+    std::vector<Ktx2Level> levels(textureData.m_mipLevels);
+    uint64_t offset = header.dfdByteOffset + header.dfdByteLength;
+    for(uint32_t level = textureData.m_mipLevels; level-- > 0;)
+    {
+        VkDeviceSize end = level + 1 < textureData.m_mipLevels ? textureData.m_mipOffsets[level + 1] : textureData.m_data.size();
+        offset = (offset + 15) & ~static_cast<uint64_t>(15);
+        levels[level].byteOffset = offset;
+        levels[level].byteLength = end - textureData.m_mipOffsets[level];
+        levels[level].uncompressedByteLength = levels[level].byteLength;
+        offset += levels[level].byteLength;
+    }
+
+    std::vector<uint8_t> file(offset, 0);
+    memcpy(file.data(), &header, sizeof(header));
+    memcpy(file.data() + sizeof(header), levels.data(), sizeof(Ktx2Level) * levels.size());
+    memcpy(file.data() + header.dfdByteOffset, dfd.data(), header.dfdByteLength);
+    for(uint32_t level = 0; level < textureData.m_mipLevels; ++level)
+    {
+        memcpy(file.data() + levels[level].byteOffset, textureData.m_data.data() + textureData.m_mipOffsets[level], levels[level].byteLength);
+    }
+
+    std::ofstream stream(fileName, std::ios::binary);
+    stream.write(reinterpret_cast<const char*>(file.data()), file.size());
+    return stream.good();
+}
+
+bool TextureCompressor::loadKtx2(const uint8_t* bytes, size_t size, TextureData& textureData)
+{
+    if(size < sizeof(Ktx2Header) || memcmp(bytes, g_ktx2Identifier, sizeof(g_ktx2Identifier)) != 0)
+    {
+        return false;
+    }
+
+    Ktx2Header header;
+    memcpy(&header, bytes, sizeof(header));
+    if(header.supercompressionScheme != 0 || header.vkFormat == VK_FORMAT_UNDEFINED)
+    {
+        std::cout << "ktx2 with Basis or supercompression is not supported" << std::endl;
+        return false;
+    }
+    if(header.pixelDepth > 0 || header.layerCount > 1 || header.faceCount != 1 || header.levelCount == 0 ||
+       sizeof(Ktx2Header) + sizeof(Ktx2Level) * header.levelCount > size)
+    {
+        return false;
+    }
+
+    std::vector<Ktx2Level> levels(header.levelCount);
+    memcpy(levels.data(), bytes + sizeof(Ktx2Header), sizeof(Ktx2Level) * header.levelCount);
+    textureData.m_format = static_cast<VkFormat>(header.vkFormat);
+    textureData.m_width = header.pixelWidth;
+    textureData.m_height = std::max(1u, header.pixelHeight);
+    textureData.m_mipLevels = header.levelCount;
+    textureData.m_mipOffsets.clear();
+    textureData.m_data.clear();
+    for(const Ktx2Level& level : levels)
+    {
+        if(level.byteOffset + level.byteLength > size)
+        {
+            return false;
+        }
+        textureData.m_mipOffsets.push_back(textureData.m_data.size());
+        textureData.m_data.insert(textureData.m_data.end(), bytes + level.byteOffset, bytes + level.byteOffset + level.byteLength);
+    }
+    return true;
+}
+
+static const char* getFormatName(VkFormat format)
+{
+    switch(format)
+    {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK: return "BC1";
+        case VK_FORMAT_BC3_UNORM_BLOCK: return "BC3";
+        case VK_FORMAT_BC5_UNORM_BLOCK: return "BC5";
+        case VK_FORMAT_BC6H_UFLOAT_BLOCK: return "BC6H";
+        case VK_FORMAT_BC7_UNORM_BLOCK: return "BC7";
+        default: return "RGBA8";
+    }
+}
+
+void TextureCompressor::benchmark(const std::string& fileName, ThreadPool* pThreadPool)
+{
+    std::vector<char> bytes = Tools::readFile(fileName);
+    TextureData source;
+    Texture::decodeImage(reinterpret_cast<const unsigned char*>(bytes.data()), bytes.size(), fileName, source);
+    std::cout << fileName << " " << source.m_width << "x" << source.m_height << ", " << source.m_mipLevels << " mips, "
+              << source.m_data.size() / 1024 << " KB" << std::endl;
+
+    // 误差只统计格式里存了的通道
+    const std::vector<std::pair<VkFormat, uint32_t>> formats = {
+        {VK_FORMAT_BC1_RGB_UNORM_BLOCK, 3}, {VK_FORMAT_BC3_UNORM_BLOCK, 4}, {VK_FORMAT_BC5_UNORM_BLOCK, 2}, {VK_FORMAT_BC7_UNORM_BLOCK, 4}
+    };
+    std::vector<uint8_t> decoded(static_cast<size_t>(source.m_width) * source.m_height * 4);
+    for(const auto& format : formats)
+    {
+        TextureData textureData = source;
+        auto tStart = std::chrono::high_resolution_clock::now();
+        compress(textureData, format.first, pThreadPool);
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+
+        decompress(textureData.m_data.data(), source.m_width, source.m_height, format.first, decoded.data());
+        double squaredError = 0.0;
+        for(size_t i = 0; i < decoded.size(); ++i)
+        {
+            if(i % 4 < format.second)
+            {
+                double delta = static_cast<double>(decoded[i]) - source.m_data[i];
+                squaredError += delta * delta;
+            }
+        }
+        double mse = squaredError / (decoded.size() / 4 * format.second);
+        double psnr = mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+        std::cout << "  " << getFormatName(format.first) << ": " << ms << " ms, " << source.m_data.size() / (ms * 1000.0) << " MB/s, "
+                  << textureData.m_data.size() / 1024 << " KB (" << static_cast<double>(source.m_data.size()) / textureData.m_data.size() << ":1), "
+                  << "PSNR " << psnr << " dB" << std::endl;
+    }
+
+    // HDR: 平滑的渐变乘上随机的亮度, 范围0到64, 和RGBA16F比较log2误差
+    const uint32_t size = 512;
+    std::vector<uint16_t> hdr(size * size * 4);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> noise(0.8f, 1.25f);
+    for(uint32_t y = 0; y < size; ++y)
+    {
+        for(uint32_t x = 0; x < size; ++x)
+        {
+            float intensity = exp2f(12.0f * x / size - 6.0f) * noise(random);
+            uint16_t* pixel = &hdr[(y * size + x) * 4];
+            pixel[0] = glm::packHalf1x16(intensity);
+            pixel[1] = glm::packHalf1x16(intensity * (0.5f + 0.5f * y / size));
+            pixel[2] = glm::packHalf1x16(intensity * (1.0f - 0.5f * y / size));
+            pixel[3] = 0x3C00;
+        }
+    }
+
+    std::vector<uint8_t> blocks(Texture::getLevelSize(VK_FORMAT_BC6H_UFLOAT_BLOCK, size, size));
+    Surface surface = {reinterpret_cast<const uint8_t*>(hdr.data()), size, size, blocks.data()};
+    auto tStart = std::chrono::high_resolution_clock::now();
+    compressSurfaces({surface}, VK_FORMAT_BC6H_UFLOAT_BLOCK, pThreadPool);
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    double ms = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+
+    std::vector<uint16_t> decodedHdr(hdr.size());
+    decompress(blocks.data(), size, size, VK_FORMAT_BC6H_UFLOAT_BLOCK, reinterpret_cast<uint8_t*>(decodedHdr.data()));
+    double squaredError = 0.0;
+    for(size_t i = 0; i < hdr.size(); ++i)
+    {
+        if(i % 4 < 3)
+        {
+            double delta = log2(glm::unpackHalf1x16(decodedHdr[i]) + 1e-3) - log2(glm::unpackHalf1x16(hdr[i]) + 1e-3);
+            squaredError += delta * delta;
+        }
+    }
+    size_t hdrBytes = hdr.size() * sizeof(uint16_t);
+    std::cout << "  BC6H (" << size << "x" << size << " RGBA16F): " << ms << " ms, " << hdrBytes / (ms * 1000.0) << " MB/s, "
+              << blocks.size() / 1024 << " KB (" << static_cast<double>(hdrBytes) / blocks.size() << ":1), "
+              << "log2 RMSE " << sqrt(squaredError / (hdr.size() / 4 * 3)) << std::endl;
+}
@@ -0,0 +1,49 @@
+
+#pragma once
+
+#include "tools.h"
+#include "texture.h"
+#include "thread.h"
+
+// 纹理块压缩, 只用到CPU, 可以在烘焙时离线做, 也可以在加载时做并把结果缓存成ktx2.
+// BC1/BC3/BC5用stb_dxt. BC7只用mode 6(RGBA一起插值, 4位索引)和mode 5(颜色和透明度分开插值, 2位索引), BC6H只用mode 11(无符号, 10位端点, 4位索引),
+// 都是主轴拟合加一次最小二乘修正, 质量不如完整搜索所有mode的编码器, 换来加载时可以接受的速度.
+// 所有mip的4x4块按行摊平, 用线程池并行编码
+class TextureCompressor
+{
+public:
+    // 一张待压缩的图, RGBA8或者RGBA16F(BC6H), 块紧密排列写到blocks
+    struct Surface {
+        const uint8_t* pixels;
+        uint32_t width;
+        uint32_t height;
+        uint8_t* blocks;
+    };
+
+    // 法线贴图用BC5(只存xy, 着色器里重建z), 有透明度的用BC3, 其它用BC1. highQuality时颜色都用BC7
+    static VkFormat chooseFormat(const TextureData& source, bool isNormalMap, bool highQuality = false);
+    // 设备支持这个格式的采样
+    static bool isFormatSupported(VkFormat format);
+
+    // textureData为RGBA8的所有mip, 原地替换成压缩后的块
+    static void compress(TextureData& textureData, VkFormat format, ThreadPool* pThreadPool = nullptr);
+    static void compressSurfaces(const std::vector<Surface>& surfaces, VkFormat format, ThreadPool* pThreadPool = nullptr);
+    // 解码一个mip, BC6H输出RGBA16F, 其它输出RGBA8. BC7/BC6H只认识本类编出的mode
+    static void decompress(const uint8_t* blocks, uint32_t width, uint32_t height, VkFormat format, uint8_t* pixels);
+
+    static void encodeBlockBC7(const uint8_t* rgba, uint8_t* block);
+    static void encodeBlockBC6H(const uint16_t* rgbaHalf, uint8_t* block);
+    static void decodeBlockBC7(const uint8_t* block, uint8_t* rgba);
+    static void decodeBlockBC6H(const uint8_t* block, uint16_t* rgbaHalf);
+
+    // ktx2容器, 只支持没有超压缩的单层2D纹理. Basis(ETC1S/UASTC)需要转码器, 这里没有, 读到时返回false
+    // TODO: 接入Basis Universal转码器, 按设备支持的格式转成BC/ASTC/ETC2
+    static bool saveKtx2(const std::string& fileName, const TextureData& textureData);
+    static bool loadKtx2(const uint8_t* bytes, size_t size, TextureData& textureData);
+
+    // 对一张图片编码所有格式, 再用随机HDR图测BC6H, 输出耗时, 吞吐, 压缩比和误差到std::cout
+    static void benchmark(const std::string& fileName, ThreadPool* pThreadPool);
+
+private:
+    static void compressRow(const Surface& surface, VkFormat format, uint32_t blockY);
+};
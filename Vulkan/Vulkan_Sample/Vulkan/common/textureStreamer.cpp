@@ -0,0 +1,474 @@
+
+#include "textureStreamer.h"
+
+TextureStreamer::TextureStreamer()
+{
+}
+
+TextureStreamer::~TextureStreamer()
+{}
+
+void TextureStreamer::prepare(VkInstance instance, VkQueue transferQueue, bool memoryBudgetSupported, VkDeviceSize budget)
+{
+    m_transferQueue = transferQueue;
+    m_budget = budget;
+    if(memoryBudgetSupported)
+    {
+        m_getMemoryProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR"));
+    }
+}
+
+void TextureStreamer::clear()
+{
+    //Texture由调用者释放
+    m_entries.clear();
+    m_entryMap.clear();
+    m_pending.clear();
+}
+
+Texture* TextureStreamer::add(TextureData& textureData)
+{
+    std::unique_ptr<Entry> entry = std::make_unique<Entry>();
+    entry->data = std::move(textureData);
+    uint32_t mipLevels = entry->data.m_mipLevels;
+    uint32_t size = std::max(entry->data.m_width, entry->data.m_height);
+
+    uint32_t tailMip = 0;
+    while(tailMip + 1 < mipLevels && (size >> tailMip) > m_tailSize)
+    {
+        tailMip++;
+    }
+    entry->tailMip = tailMip;
+    entry->residentMip = mipLevels;
+    entry->requestedMip = tailMip;
+    entry->targetMip = tailMip;
+    entry->requestFrame = 0;
+    entry->lastUsedFrame = 0;
+
+    Texture* newTexture = new Texture();
+    newTexture->m_fromat = entry->data.m_format;
+    newTexture->m_imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    newTexture->m_layerCount = 1;
+    newTexture->m_name = entry->data.m_name;
+    newTexture->m_image = VK_NULL_HANDLE;
+    newTexture->m_imageMemory = VK_NULL_HANDLE;
+    newTexture->m_imageView = VK_NULL_HANDLE;
+    //sampler按完整的mip创建, 实际范围由image view限制
+    Tools::createTextureSampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT, mipLevels, newTexture->m_sampler);
+    entry->texture = newTexture;
+
+    m_pending.push_back({entry.get(), tailMip});
+    m_entryMap[newTexture] = entry.get();
+    m_entries.push_back(std::move(entry));
+    return newTexture;
+}
+
+void TextureStreamer::flush()
+{
+    reallocate(m_pending);
+    m_pending.clear();
+}
+
+void TextureStreamer::request(Texture* texture, float uvPerPixel)
+{
+    auto it = m_entryMap.find(texture);
+    if(it == m_entryMap.end())
+    {
+        return ;
+    }
+
+    //mip0上一个像素覆盖的纹素数取log2
+    Entry* entry = it->second;
+    float texelsPerPixel = uvPerPixel * std::max(entry->data.m_width, entry->data.m_height);
+    uint32_t mip = texelsPerPixel > 1.0f ? static_cast<uint32_t>(log2f(texelsPerPixel)) : 0;
+    mip = std::min(mip, entry->data.m_mipLevels - 1);
+
+    if(entry->requestFrame != m_frameIndex)
+    {
+        entry->requestFrame = m_frameIndex;
+        entry->requestedMip = mip;
+    }
+    else
+    {
+        entry->requestedMip = std::min(entry->requestedMip, mip);
+    }
+}
+
+VkDeviceSize TextureStreamer::getLevelsSize(const Entry& entry, uint32_t firstMip) const
+{
+    if(firstMip >= entry.data.m_mipLevels)
+    {
+        return 0;
+    }
+    return entry.data.m_data.size() - entry.data.m_mipOffsets[firstMip];
+}
+
+VkDeviceSize TextureStreamer::getUploadSize(const Entry& entry, uint32_t newMip) const
+{
+    //换出时没有新增的mip
+    if(newMip >= entry.residentMip)
+    {
+        return 0;
+    }
+    return getLevelsSize(entry, newMip) - getLevelsSize(entry, entry.residentMip);
+}
+
+void TextureStreamer::queryHeapBudget()
+{
+    if(m_getMemoryProperties2 == nullptr)
+    {
+        return ;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+    budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    VkPhysicalDeviceMemoryProperties2 properties = {};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+    properties.pNext = &budgetProperties;
+    m_getMemoryProperties2(Tools::m_physicalDevice, &properties);
+
+    m_statistics.heapBudget = 0;
+    m_statistics.heapUsage = 0;
+    for(uint32_t i = 0; i < properties.memoryProperties.memoryHeapCount; ++i)
+    {
+        if(properties.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+        {
+            m_statistics.heapBudget += budgetProperties.heapBudget[i];
+            m_statistics.heapUsage += budgetProperties.heapUsage[i];
+        }
+    }
+}
+
+void TextureStreamer::update()
+{
+    VkDeviceSize residentBytes = 0;
+    VkDeviceSize targetBytes = 0;
+    for(std::unique_ptr<Entry>& entry : m_entries)
+    {
+        //没有请求的纹理保持现状, 预算不够时再换出
+        entry->targetMip = entry->residentMip;
+        if(entry->requestFrame == m_frameIndex)
+        {
+            entry->lastUsedFrame = m_frameIndex;
+            entry->targetMip = std::min(entry->requestedMip, entry->residentMip);
+        }
+        residentBytes += getLevelsSize(*entry, entry->residentMip);
+        targetBytes += getLevelsSize(*entry, entry->targetMip);
+    }
+
+    VkDeviceSize budget = m_budget;
+    queryHeapBudget();
+    if(m_statistics.heapBudget > 0)
+    {
+        //其它资源也在用这个堆, 只能用剩余预算的一部分
+        VkDeviceSize available = m_statistics.heapBudget > m_statistics.heapUsage ? m_statistics.heapBudget - m_statistics.heapUsage : 0;
+        budget = std::min(budget, residentBytes + static_cast<VkDeviceSize>(available * m_heapBudgetRatio));
+    }
+    m_statistics.budget = budget;
+
+    if(targetBytes > budget)
+    {
+        //先把本帧没用到的纹理降到尾部mip, 最久没用的优先
+        std::vector<Entry*> order;
+        for(std::unique_ptr<Entry>& entry : m_entries)
+        {
+            order.push_back(entry.get());
+        }
+        std::sort(order.begin(), order.end(), [](const Entry* a, const Entry* b) { return a->lastUsedFrame < b->lastUsedFrame; });
+
+        for(Entry* entry : order)
+        {
+            if(targetBytes <= budget || entry->lastUsedFrame == m_frameIndex)
+            {
+                break;
+            }
+            uint32_t targetMip = std::max(entry->targetMip, entry->tailMip);
+            targetBytes -= getLevelsSize(*entry, entry->targetMip) - getLevelsSize(*entry, targetMip);
+            entry->targetMip = targetMip;
+        }
+
+        //还不够时本帧用到的纹理从最精细的开始逐级降低
+        while(targetBytes > budget)
+        {
+            Entry* finest = nullptr;
+            for(std::unique_ptr<Entry>& entry : m_entries)
+            {
+                if(entry->targetMip < entry->tailMip && (finest == nullptr || entry->targetMip < finest->targetMip))
+                {
+                    finest = entry.get();
+                }
+            }
+            if(finest == nullptr)
+            {
+                break;
+            }
+            targetBytes -= getLevelsSize(*finest, finest->targetMip) - getLevelsSize(*finest, finest->targetMip + 1);
+            finest->targetMip++;
+        }
+    }
+
+    //换出不需要上传; 调入每个纹理每次一级, 差得最多的优先, 总量不超过m_maxUploadBytes
+    std::vector<Change> changes;
+    std::vector<Entry*> streamIns;
+    for(std::unique_ptr<Entry>& entry : m_entries)
+    {
+        if(entry->targetMip > entry->residentMip)
+        {
+            changes.push_back({entry.get(), entry->targetMip});
+        }
+        else if(entry->targetMip < entry->residentMip)
+        {
+            streamIns.push_back(entry.get());
+        }
+    }
+    std::sort(streamIns.begin(), streamIns.end(), [](const Entry* a, const Entry* b) { return a->residentMip - a->targetMip > b->residentMip - b->targetMip; });
+
+    VkDeviceSize uploadBytes = 0;
+    for(Entry* entry : streamIns)
+    {
+        uint32_t newMip = entry->residentMip - 1;
+        VkDeviceSize bytes = getUploadSize(*entry, newMip);
+        if(uploadBytes > 0 && uploadBytes + bytes > m_maxUploadBytes)
+        {
+            continue;
+        }
+        uploadBytes += bytes;
+        changes.push_back({entry, newMip});
+    }
+
+    reallocate(changes);
+    m_frameIndex++;
+}
+
+void TextureStreamer::reallocate(const std::vector<Change>& changes)
+{
+    if(changes.empty())
+    {
+        return ;
+    }
+
+    //新增的mip放到一个staging buffer, bufferOffset需要是texel大小和4的倍数
+    std::vector<VkDeviceSize> stagingOffsets(changes.size());
+    VkDeviceSize stagingSize = 0;
+    for(size_t i = 0; i < changes.size(); ++i)
+    {
+        const Entry& entry = *changes[i].entry;
+        stagingOffsets[i] = (stagingSize + 15) & ~static_cast<VkDeviceSize>(15);
+        stagingSize = stagingOffsets[i] + getUploadSize(entry, changes[i].newMip);
+    }
+
+    VkBuffer stagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory stagingMemory = VK_NULL_HANDLE;
+    if(stagingSize > 0)
+    {
+        Tools::createBufferAndMemoryThenBind(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                             stagingBuffer, stagingMemory);
+        uint8_t* mapped = nullptr;
+        VK_CHECK_RESULT(vkMapMemory(Tools::m_device, stagingMemory, 0, stagingSize, 0, reinterpret_cast<void**>(&mapped)));
+        for(size_t i = 0; i < changes.size(); ++i)
+        {
+            const Entry& entry = *changes[i].entry;
+            VkDeviceSize size = getUploadSize(entry, changes[i].newMip);
+            if(size > 0)
+            {
+                memcpy(mapped + stagingOffsets[i], entry.data.m_data.data() + entry.data.m_mipOffsets[changes[i].newMip], size);
+            }
+        }
+        vkUnmapMemory(Tools::m_device, stagingMemory);
+    }
+
+    std::vector<VkImage> newImages(changes.size());
+    std::vector<VkDeviceMemory> newMemories(changes.size());
+    std::vector<VkImageMemoryBarrier> barriers;
+    bool replaceImages = false;
+    for(size_t i = 0; i < changes.size(); ++i)
+    {
+        const Entry& entry = *changes[i].entry;
+        uint32_t newMip = changes[i].newMip;
+        uint32_t levelCount = entry.data.m_mipLevels - newMip;
+        //保留的mip要从旧image拷贝, 所有image都可以作为拷贝源
+        Tools::createImageAndMemoryThenBind(entry.data.m_format, std::max(1u, entry.data.m_width >> newMip), std::max(1u, entry.data.m_height >> newMip), levelCount, 1,
+                                            VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                            VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                            newImages[i], newMemories[i]);
+
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.image = newImages[i];
+        barrier.subresourceRange.levelCount = levelCount;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers.push_back(barrier);
+
+        if(entry.texture->m_image != VK_NULL_HANDLE)
+        {
+            barrier.image = entry.texture->m_image;
+            barrier.subresourceRange.levelCount = entry.texture->m_mipLevels;
+            barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            barriers.push_back(barrier);
+            replaceImages = true;
+        }
+    }
+
+    //旧image可能还在之前提交的帧里采样, 等之前所有命令执行完
+    VkCommandBuffer cmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+                         static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    std::vector<VkBufferImageCopy> bufferCopyRegions;
+    std::vector<VkImageCopy> imageCopyRegions;
+    for(size_t i = 0; i < changes.size(); ++i)
+    {
+        const Entry& entry = *changes[i].entry;
+        uint32_t newMip = changes[i].newMip;
+        bufferCopyRegions.clear();
+        imageCopyRegions.clear();
+        for(uint32_t level = newMip; level < entry.data.m_mipLevels; ++level)
+        {
+            VkImageSubresourceLayers dstSubresource = {};
+            dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            dstSubresource.mipLevel = level - newMip;
+            dstSubresource.layerCount = 1;
+            VkExtent3D extent = {std::max(1u, entry.data.m_width >> level), std::max(1u, entry.data.m_height >> level), 1};
+
+            if(level < entry.residentMip)
+            {
+                VkBufferImageCopy bufferCopyRegion = {};
+                bufferCopyRegion.imageSubresource = dstSubresource;
+                bufferCopyRegion.imageExtent = extent;
+                bufferCopyRegion.bufferOffset = stagingOffsets[i] + entry.data.m_mipOffsets[level] - entry.data.m_mipOffsets[newMip];
+                bufferCopyRegions.push_back(bufferCopyRegion);
+            }
+            else
+            {
+                VkImageCopy imageCopyRegion = {};
+                imageCopyRegion.srcSubresource = dstSubresource;
+                imageCopyRegion.srcSubresource.mipLevel = level - entry.residentMip;
+                imageCopyRegion.dstSubresource = dstSubresource;
+                imageCopyRegion.extent = extent;
+                imageCopyRegions.push_back(imageCopyRegion);
+            }
+        }
+
+        if(!bufferCopyRegions.empty())
+        {
+            vkCmdCopyBufferToImage(cmd, stagingBuffer, newImages[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                   static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
+        }
+        if(!imageCopyRegions.empty())
+        {
+            vkCmdCopyImage(cmd, entry.texture->m_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, newImages[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(imageCopyRegions.size()), imageCopyRegions.data());
+        }
+    }
+
+    barriers.clear();
+    for(size_t i = 0; i < changes.size(); ++i)
+    {
+        VkImageMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = newImages[i];
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = changes[i].entry->data.m_mipLevels - changes[i].newMip;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barriers.push_back(barrier);
+    }
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+                         static_cast<uint32_t>(barriers.size()), barriers.data());
+    Tools::flushCommandBuffer(cmd, m_transferQueue, true);
+
+    if(stagingSize > 0)
+    {
+        vkDestroyBuffer(Tools::m_device, stagingBuffer, nullptr);
+        vkFreeMemory(Tools::m_device, stagingMemory, nullptr);
+    }
+
+    //之前提交的帧还引用着描述符集, 队列空闲后才能重写描述符和释放旧image
+    if(replaceImages)
+    {
+        vkQueueWaitIdle(m_transferQueue);
+        m_statistics.reallocateCount++;
+    }
+
+    for(size_t i = 0; i < changes.size(); ++i)
+    {
+        Entry& entry = *changes[i].entry;
+        Texture* texture = entry.texture;
+        uint32_t newMip = changes[i].newMip;
+        bool hasOldImage = texture->m_image != VK_NULL_HANDLE;
+        if(hasOldImage)
+        {
+            vkDestroyImageView(Tools::m_device, texture->m_imageView, nullptr);
+            vkDestroyImage(Tools::m_device, texture->m_image, nullptr);
+            vkFreeMemory(Tools::m_device, texture->m_imageMemory, nullptr);
+
+            if(newMip < entry.residentMip)
+            {
+                m_statistics.streamedLevels += entry.residentMip - newMip;
+            }
+            else
+            {
+                m_statistics.evictedLevels += newMip - entry.residentMip;
+            }
+        }
+
+        texture->m_image = newImages[i];
+        texture->m_imageMemory = newMemories[i];
+        texture->m_width = std::max(1u, entry.data.m_width >> newMip);
+        texture->m_height = std::max(1u, entry.data.m_height >> newMip);
+        texture->m_mipLevels = entry.data.m_mipLevels - newMip;
+        Tools::createImageView(texture->m_image, texture->m_fromat, VK_IMAGE_ASPECT_COLOR_BIT, texture->m_mipLevels, texture->m_layerCount, texture->m_imageView);
+        entry.residentMip = newMip;
+
+        if(hasOldImage && m_onTextureChanged)
+        {
+            m_onTextureChanged(texture);
+        }
+    }
+}
+
+const TextureStreamer::Statistics& TextureStreamer::getStatistics()
+{
+    m_statistics.textureCount = static_cast<uint32_t>(m_entries.size());
+    m_statistics.fullResidentCount = 0;
+    m_statistics.residentBytes = 0;
+    m_statistics.fullBytes = 0;
+    for(std::unique_ptr<Entry>& entry : m_entries)
+    {
+        m_statistics.fullResidentCount += entry->residentMip == 0 ? 1 : 0;
+        m_statistics.residentBytes += getLevelsSize(*entry, entry->residentMip);
+        m_statistics.fullBytes += entry->data.m_data.size();
+    }
+    return m_statistics;
+}
+
+float TextureStreamer::getUvDensity(const Vertex* vertices, const uint32_t* indices, uint32_t indexCount)
+{
+    double positionArea = 0.0;
+    double uvArea = 0.0;
+    for(uint32_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        const Vertex& v0 = vertices[indices[i]];
+        const Vertex& v1 = vertices[indices[i + 1]];
+        const Vertex& v2 = vertices[indices[i + 2]];
+        positionArea += glm::length(glm::cross(v1.m_position - v0.m_position, v2.m_position - v0.m_position));
+        glm::vec2 uv1 = v1.m_uv - v0.m_uv;
+        glm::vec2 uv2 = v2.m_uv - v0.m_uv;
+        uvArea += fabs(uv1.x * uv2.y - uv1.y * uv2.x);
+    }
+    return positionArea > 0.0 ? static_cast<float>(sqrt(uvArea / positionArea)) : 0.0f;
+}
@@ -0,0 +1,84 @@
+
+#pragma once
+
+#include "tools.h"
+#include "texture.h"
+#include "vertex.h"
+#include <memory>
+
+// 按mip渐进加载纹理. add时只上传尾部的小mip, 之后每帧根据屏幕上的纹素密度请求更精细的mip,
+// 超过显存预算时从最久没用到的纹理开始换出. 完整的mip数据保留在内存里, 作为调入的来源.
+// 常驻mip变化时重新分配image, 保留的mip在GPU上拷贝, 所以Texture的image, view和尺寸会变, 描述符由m_onTextureChanged重写
+class TextureStreamer
+{
+public:
+    struct Statistics {
+        uint32_t textureCount = 0;
+        uint32_t fullResidentCount = 0;     //所有mip都常驻的纹理数
+        VkDeviceSize residentBytes = 0;
+        VkDeviceSize fullBytes = 0;         //所有纹理全部mip的大小
+        VkDeviceSize budget = 0;            //本次update实际使用的预算
+        VkDeviceSize heapBudget = 0;        //VK_EXT_memory_budget报告的设备本地堆, 不支持时为0
+        VkDeviceSize heapUsage = 0;
+        uint32_t streamedLevels = 0;        //累计调入和换出的mip级数
+        uint32_t evictedLevels = 0;
+        uint32_t reallocateCount = 0;       //累计重新分配image的次数
+    };
+
+    TextureStreamer();
+    ~TextureStreamer();
+    // memoryBudgetSupported表示设备扩展VK_EXT_memory_budget已开启, 同时需要实例扩展VK_KHR_get_physical_device_properties2
+    void prepare(VkInstance instance, VkQueue transferQueue, bool memoryBudgetSupported, VkDeviceSize budget = 256 * 1024 * 1024);
+    void clear();
+
+    // 立即返回Texture, flush之后可用. 只支持单层2D纹理, textureData的数据会被移走
+    Texture* add(TextureData& textureData);
+    void flush();
+
+    // 每帧对看得到的纹理调用, uvPerPixel为一个屏幕像素跨过的uv, 多次调用取最精细的
+    void request(Texture* texture, float uvPerPixel);
+    // 根据本帧的请求和预算调入或换出mip, 每个纹理每次最多调入一级
+    void update();
+    const Statistics& getStatistics();
+
+    // 三角形的平均uv密度, 每个局部空间单位对应的uv. indices是全局索引
+    static float getUvDensity(const Vertex* vertices, const uint32_t* indices, uint32_t indexCount);
+
+private:
+    struct Entry {
+        Texture* texture;
+        TextureData data;
+        uint32_t residentMip;       //常驻的最精细一级, 等于m_mipLevels时还没有上传
+        uint32_t tailMip;           //初始上传和换出的下限
+        uint32_t requestedMip;
+        uint32_t targetMip;
+        uint64_t requestFrame;
+        uint64_t lastUsedFrame;
+    };
+
+    struct Change {
+        Entry* entry;
+        uint32_t newMip;
+    };
+
+    VkDeviceSize getLevelsSize(const Entry& entry, uint32_t firstMip) const;
+    VkDeviceSize getUploadSize(const Entry& entry, uint32_t newMip) const;
+    void queryHeapBudget();
+    void reallocate(const std::vector<Change>& changes);
+
+public:
+    uint32_t m_tailSize = 128;                              //初始上传边长不超过这个的mip
+    VkDeviceSize m_maxUploadBytes = 16 * 1024 * 1024;       //每次update调入的上限, 限制卡顿
+    float m_heapBudgetRatio = 0.8f;                         //最多用到设备本地堆剩余预算的比例
+    std::function<void(Texture* texture)> m_onTextureChanged;
+
+private:
+    VkQueue m_transferQueue = VK_NULL_HANDLE;
+    VkDeviceSize m_budget = 0;
+    PFN_vkGetPhysicalDeviceMemoryProperties2KHR m_getMemoryProperties2 = nullptr;
+    std::vector<std::unique_ptr<Entry>> m_entries;
+    std::unordered_map<Texture*, Entry*> m_entryMap;
+    std::vector<Change> m_pending;
+    uint64_t m_frameIndex = 1;
+    Statistics m_statistics;
+};
@@ -0,0 +1,137 @@
+
+#include "textureUploader.h"
+#include "resourceCache.h"
+
+TextureUploader::TextureUploader(VkQueue transferQueue, VkDeviceSize batchSize)
+{
+    m_transferQueue = transferQueue;
+    m_batchSize = batchSize;
+}
+
+TextureUploader::~TextureUploader()
+{
+    flush();
+}
+
+Texture* TextureUploader::add(TextureData& textureData, Texture* texture)
+{
+    VkDeviceSize size = textureData.m_data.size();
+    if(!m_pending.empty() && m_pendingSize + size > m_batchSize)
+    {
+        flush();
+    }
+
+    Texture* newTexture = texture ? texture : new Texture();
+    newTexture->m_fromat = textureData.m_format;
+    newTexture->m_imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    newTexture->m_width = textureData.m_width;
+    newTexture->m_height = textureData.m_height;
+    newTexture->m_mipLevels = textureData.m_mipLevels;
+    newTexture->m_layerCount = 1;
+    newTexture->m_name = textureData.m_name;
+
+    Tools::createImageAndMemoryThenBind(newTexture->m_fromat, newTexture->m_width, newTexture->m_height, newTexture->m_mipLevels, newTexture->m_layerCount,
+                                        VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                        VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                        newTexture->m_image, newTexture->m_imageMemory);
+
+    //bufferOffset需要是texel大小和4的倍数
+    Pending pending = {};
+    pending.texture = newTexture;
+    pending.data = std::move(textureData);
+    pending.stagingOffset = (m_pendingSize + 15) & ~static_cast<VkDeviceSize>(15);
+    m_pendingSize = pending.stagingOffset + size;
+    m_pending.push_back(std::move(pending));
+    return newTexture;
+}
+
+void TextureUploader::flush()
+{
+    if(m_pending.empty())
+    {
+        return ;
+    }
+
+    VkBuffer stagingBuffer;
+    VkDeviceMemory stagingMemory;
+    Tools::createBufferAndMemoryThenBind(m_pendingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                         stagingBuffer, stagingMemory);
+
+    uint8_t* mapped = nullptr;
+    VK_CHECK_RESULT(vkMapMemory(Tools::m_device, stagingMemory, 0, m_pendingSize, 0, reinterpret_cast<void**>(&mapped)));
+    for(const Pending& pending : m_pending)
+    {
+        memcpy(mapped + pending.stagingOffset, pending.data.m_data.data(), pending.data.m_data.size());
+    }
+    vkUnmapMemory(Tools::m_device, stagingMemory);
+
+    std::vector<VkImageMemoryBarrier> barriers(m_pending.size());
+    for(size_t i = 0; i < m_pending.size(); ++i)
+    {
+        VkImageMemoryBarrier& barrier = barriers[i];
+        barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = m_pending[i].texture->m_image;
+        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        barrier.subresourceRange.levelCount = m_pending[i].texture->m_mipLevels;
+        barrier.subresourceRange.layerCount = 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    }
+
+    VkCommandBuffer cmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr,
+                         static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    std::vector<VkBufferImageCopy> bufferCopyRegions;
+    for(const Pending& pending : m_pending)
+    {
+        Texture* texture = pending.texture;
+        bufferCopyRegions.clear();
+        for(uint32_t level = 0; level < texture->m_mipLevels; level++)
+        {
+            VkBufferImageCopy bufferCopyRegion = {};
+            bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            bufferCopyRegion.imageSubresource.mipLevel = level;
+            bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+            bufferCopyRegion.imageSubresource.layerCount = 1;
+            bufferCopyRegion.imageExtent.width = std::max(1u, texture->m_width >> level);
+            bufferCopyRegion.imageExtent.height = std::max(1u, texture->m_height >> level);
+            bufferCopyRegion.imageExtent.depth = 1;
+            bufferCopyRegion.bufferOffset = pending.stagingOffset + pending.data.m_mipOffsets[level];
+            bufferCopyRegions.push_back(bufferCopyRegion);
+        }
+        vkCmdCopyBufferToImage(cmd, stagingBuffer, texture->m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
+    }
+
+    for(VkImageMemoryBarrier& barrier : barriers)
+    {
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    }
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+                         static_cast<uint32_t>(barriers.size()), barriers.data());
+
+    Tools::flushCommandBuffer(cmd, m_transferQueue, true);
+    vkDestroyBuffer(Tools::m_device, stagingBuffer, nullptr);
+    vkFreeMemory(Tools::m_device, stagingMemory, nullptr);
+
+    for(const Pending& pending : m_pending)
+    {
+        Texture* texture = pending.texture;
+        Tools::createImageView(texture->m_image, texture->m_fromat, VK_IMAGE_ASPECT_COLOR_BIT, texture->m_mipLevels, texture->m_layerCount, texture->m_imageView);
+        ResourceCache::acquireTextureSampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT, texture->m_mipLevels, texture->m_sampler);
+    }
+
+    m_pending.clear();
+    m_pendingSize = 0;
+    m_batchCount++;
+}
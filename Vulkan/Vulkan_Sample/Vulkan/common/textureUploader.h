@@ -0,0 +1,35 @@
+
+#pragma once
+
+#include "tools.h"
+#include "texture.h"
+
+// 把多张纹理的数据合并到一个staging buffer, 一个命令缓冲里完成所有拷贝和布局转换, 一次提交.
+// 累计数据超过m_batchSize时自动提交一批, 限制staging内存的峰值
+class TextureUploader
+{
+public:
+    TextureUploader(VkQueue transferQueue, VkDeviceSize batchSize = 64 * 1024 * 1024);
+    ~TextureUploader();
+
+    // 立即返回Texture, image view和sampler在flush之后才可用. textureData的数据会被移走.
+    // texture不为空时上传到这个还没有Vulkan对象的Texture, 已经被材质引用的对象不用替换指针
+    Texture* add(TextureData& textureData, Texture* texture = nullptr);
+    void flush();
+
+private:
+    struct Pending {
+        Texture* texture;
+        TextureData data;
+        VkDeviceSize stagingOffset;
+    };
+
+public:
+    uint32_t m_batchCount = 0;
+
+private:
+    VkQueue m_transferQueue;
+    VkDeviceSize m_batchSize;
+    VkDeviceSize m_pendingSize = 0;
+    std::vector<Pending> m_pending;
+};
@@ -1,5 +1,6 @@
 
 #include "thread.h"
+#include <algorithm>
 
 Thread::Thread()
 {
@@ -78,3 +79,27 @@ void ThreadPool::wait()
     }
 }
 
+void ThreadPool::parallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t begin, uint32_t end)>& function)
+{
+    uint32_t chunkCount = (count + grainSize - 1) / grainSize;
+    if (m_threads.empty() || chunkCount <= 1)
+    {
+        function(0, count);
+        return ;
+    }
+
+    // 每个线程一段连续的块
+    uint32_t threadCount = std::min(static_cast<uint32_t>(m_threads.size()), chunkCount);
+    uint32_t chunksPerThread = (chunkCount + threadCount - 1) / threadCount;
+    for (uint32_t t = 0; t < threadCount; t++)
+    {
+        uint32_t begin = t * chunksPerThread * grainSize;
+        uint32_t end = std::min(count, begin + chunksPerThread * grainSize);
+        if (begin >= end)
+        {
+            break;
+        }
+        m_threads[t]->addJob([&function, begin, end] { function(begin, end); });
+    }
+    wait();
+}
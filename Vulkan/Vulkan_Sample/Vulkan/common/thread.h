@@ -31,6 +31,8 @@ class ThreadPool
 public:
     void setThreadCount(uint32_t count);
     void wait();
+    // [0, count)按grainSize切块分给各线程, 阻塞到全部完成. 块的起点是grainSize的整数倍
+    void parallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t begin, uint32_t end)>& function);
     
 public:
     std::vector<std::unique_ptr<Thread>> m_threads;
@@ -1,6 +1,7 @@
 
 #include "tools.h"
-#include "common/svpng.inc"
+#include "pixelConvert.h"
+#include "frameCapture.h"
 #include <stdlib.h>
 #include <random>
 
@@ -58,6 +59,11 @@ std::string Tools::getTexturePath()
     return "assets/textures/";
 }
 
+std::string Tools::getCachePath()
+{
+    return "cache/";
+}
+
 bool Tools::isFileExists(const std::string &filename)
 {
     std::ifstream f(filename.c_str());
@@ -307,7 +313,7 @@ void Tools::flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, boo
     }
 }
 
-void Tools::createTextureSampler(VkFilter filter, VkSamplerAddressMode addressMode, uint32_t maxLod, VkSampler &sampler)
+VkSamplerCreateInfo Tools::getSamplerCreateInfo(VkFilter filter, VkSamplerAddressMode addressMode, uint32_t maxLod)
 {
     VkSamplerCreateInfo createInfo = {};
     createInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
@@ -337,7 +343,12 @@ void Tools::createTextureSampler(VkFilter filter, VkSamplerAddressMode addressMo
     createInfo.maxLod = maxLod;
     createInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK; //寻址模式是 VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER 时设置
     createInfo.unnormalizedCoordinates = VK_FALSE; // false,(0,1), true,(0,width/height)
-    
+    return createInfo;
+}
+
+void Tools::createTextureSampler(VkFilter filter, VkSamplerAddressMode addressMode, uint32_t maxLod, VkSampler &sampler)
+{
+    VkSamplerCreateInfo createInfo = getSamplerCreateInfo(filter, addressMode, maxLod);
     if( vkCreateSampler(m_device, &createInfo, nullptr, &sampler) != VK_SUCCESS )
     {
         throw std::runtime_error("failed to create sampler!");
@@ -878,61 +889,15 @@ void Tools::saveImage(const VkImage& srcImage, VkFormat srcFormat, VkImageLayout
     vkMapMemory(m_device, dstMemory, 0, VK_WHOLE_SIZE, 0, (void**)&pDstImage);
     pDstImage += subResourceLayout.offset;
     
-    if(dstFormat == VK_FORMAT_R8G8B8A8_UNORM)
+    // 按rowPitch逐行转成紧凑的RGBA8, 浮点格式截断到[0,1]. 同步截图, 连续截帧用FrameCapture
+    std::vector<unsigned char> img(width * height * 4);
+    if(!PixelConvert::toRgba8(dstFormat, pDstImage, subResourceLayout.rowPitch, width, height, img.data(), width * 4))
     {
-        svpng(fopen(filePath.c_str(), "wb"), width, height, pDstImage, 1);
+        std::cout << "saveImage: unsupported format " << dstFormat << std::endl;
     }
-    else
+    else if(!FrameCapture::writePng(filePath, img.data(), width, height))
     {
-        unsigned char* img = new unsigned char[width * height * 4];
-        unsigned char* pOutImage = img;
-        
-        for(uint32_t j=0; j<height; ++j)
-        {
-            for(uint32_t i=0; i<width; ++i)
-            {
-                if(VK_FORMAT_B8G8R8A8_UNORM == dstFormat)
-                {
-                    uint32_t offset = i*4;
-                    *pOutImage++ = *(pDstImage+offset+2);
-                    *pOutImage++ = *(pDstImage+offset+1);
-                    *pOutImage++ = *(pDstImage+offset);
-                    *pOutImage++ = *(pDstImage+offset+3);
-                }
-                else if(VK_FORMAT_R16G16_SFLOAT == dstFormat)
-                {
-                    uint32_t offset = i*4;
-                    float r = Tools::float16(*(pDstImage+offset+1), *(pDstImage+offset));
-                    float g = Tools::float16(*(pDstImage+offset+3), *(pDstImage+offset+2));
-                    if(r > 1) r = 1;
-                    if(g > 1) g = 1;
-                    *pOutImage++ = r*255;
-                    *pOutImage++ = g*255;
-                    *pOutImage++ = 0;
-                    *pOutImage++ = 255;
-                }
-                else if(VK_FORMAT_R16G16B16A16_SFLOAT == dstFormat)
-                {
-                    uint32_t offset = i*8;
-                    float r = Tools::float16(*(pDstImage+offset+1), *(pDstImage+offset));
-                    float g = Tools::float16(*(pDstImage+offset+3), *(pDstImage+offset+2));
-                    float b = Tools::float16(*(pDstImage+offset+5), *(pDstImage+offset+4));
-                    float a = Tools::float16(*(pDstImage+offset+7), *(pDstImage+offset+6));
-                    if(r > 1) r = 1;
-                    if(g > 1) g = 1;
-                    if(b > 1) b = 1;
-                    if(a > 1) a = 1;
-                    *pOutImage++ = r*255;
-                    *pOutImage++ = g*255;
-                    *pOutImage++ = b*255;
-                    *pOutImage++ = a*255;
-                }
-            }
-            pDstImage += subResourceLayout.rowPitch;
-        }
-        
-        svpng(fopen(filePath.c_str(), "wb"), width, height, img, 1);
-        delete[] img;
+        std::cout << "saveImage: failed to write " << filePath << std::endl;
     }
     
     vkUnmapMemory(m_device, dstMemory);
@@ -948,11 +913,5 @@ float Tools::float16(unsigned char high, unsigned char low)
     }
     
     //1 + 5 + 10
-    int sign = 0x80 & high;
-    int exp = ((0x7c & high) >> 2) - 15;
-    int precision = (high & 0x3);
-    precision = (precision << 8) + low;
-    float p = (1 + precision*1.0f/1024) * pow(2.0f, exp);
-    if (sign) p = -p;
-    return p;
+    return PixelConvert::halfToFloat(static_cast<uint16_t>((high << 8) | low));
 }
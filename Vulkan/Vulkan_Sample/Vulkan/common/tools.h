@@ -43,6 +43,7 @@ public:
     static std::string getShaderPath();
     static std::string getModelPath();
     static std::string getTexturePath();
+    static std::string getCachePath();      //加载时生成的缓存(压缩纹理等), 不写进assets
     static bool isFileExists(const std::string &filename);
     static std::vector<char> readFile(const std::string& filename);
 
@@ -69,6 +70,7 @@ public:
     static void flushCommandBuffer(VkCommandBuffer commandBuffer, VkQueue queue, bool free);
     static void setImageLayout(VkCommandBuffer cmdbuffer, VkImage image, VkImageLayout oldImageLayout, VkImageLayout newImageLayout, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, VkImageSubresourceRange subresourceRange);
     static void setImageLayout(VkCommandBuffer cmdbuffer, VkImage image, VkImageLayout oldImageLayout, VkImageLayout newImageLayout, VkPipelineStageFlags srcStageMask, VkPipelineStageFlags dstStageMask, VkImageAspectFlags aspectMask);
+    static VkSamplerCreateInfo getSamplerCreateInfo(VkFilter filter, VkSamplerAddressMode addressMode, uint32_t maxLod);
     static void createTextureSampler(VkFilter filter, VkSamplerAddressMode addressMode, uint32_t maxLod, VkSampler &sampler);
     static VkDescriptorSetLayoutCreateInfo getDescriptorSetLayoutCreateInfo(const VkDescriptorSetLayoutBinding* pBindings, uint32_t bindingCount);
     static void allocateDescriptorSets(VkDescriptorPool descriptorPool, VkDescriptorSetLayout* pSetLayouts, uint32_t descriptorSetCount, VkDescriptorSet& descriptorSet);
@@ -0,0 +1,765 @@
+
+#include "virtualTexture.h"
+#include "textureCompressor.h"
+#include "resourceCache.h"
+#include <algorithm>
+#include <chrono>
+
+bool VirtualTexture::bake(const std::string& fileName, uint32_t size, uint32_t tileSize, uint32_t border, VkFormat format, const TileGenerator& generator, ThreadPool* pThreadPool)
+{
+    bool isCompressed = format == VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    uint32_t pageSize = tileSize + 2 * border;
+    if(!isCompressed && format != VK_FORMAT_R8G8B8A8_UNORM)
+    {
+        std::cout << "virtual texture only supports RGBA8 and BC1" << std::endl;
+        return false;
+    }
+
+    //块压缩时每页要按4x4块对齐, tile坐标在反馈里各占14位
+    if(size < tileSize || (size & (size - 1)) != 0 || (tileSize & (tileSize - 1)) != 0 || pageSize % 4 != 0 || size / tileSize > 16384)
+    {
+        std::cout << "virtual texture size " << size << " or tile size " << tileSize << " is invalid" << std::endl;
+        return false;
+    }
+
+    FileHeader header = {};
+    header.magic = m_fileMagic;
+    header.version = 1;
+    header.format = format;
+    header.size = size;
+    header.tileSize = tileSize;
+    header.border = border;
+    header.levelCount = 1;
+    while(((size / tileSize) >> (header.levelCount - 1)) > 1)
+    {
+        header.levelCount++;
+    }
+
+    //先写临时文件, 中途退出不会留下不完整的.vtex
+    std::string tempFile = fileName + ".tmp";
+    std::ofstream file(tempFile, std::ios::binary);
+    if(!file.is_open())
+    {
+        std::cout << "failed to create " << tempFile << std::endl;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+
+    auto startTime = std::chrono::steady_clock::now();
+    VkDeviceSize tileBytes = Texture::getLevelSize(format, pageSize, pageSize);
+    VkDeviceSize totalBytes = 0;
+    std::vector<uint8_t> row;
+    for(uint32_t level = 0; level < header.levelCount; level++)
+    {
+        uint32_t tileCount = (size / tileSize) >> level;
+        row.resize(tileCount * tileBytes);
+        for(uint32_t y = 0; y < tileCount; y++)
+        {
+            auto bakeTiles = [&](uint32_t begin, uint32_t end) {
+                std::vector<uint8_t> rgba(isCompressed ? pageSize * pageSize * 4 : 0);
+                for(uint32_t x = begin; x < end; x++)
+                {
+                    uint8_t* tile = row.data() + x * tileBytes;
+                    generator(level, static_cast<int32_t>(x * tileSize) - static_cast<int32_t>(border), static_cast<int32_t>(y * tileSize) - static_cast<int32_t>(border), pageSize, pageSize, isCompressed ? rgba.data() : tile);
+                    if(isCompressed)
+                    {
+                        TextureCompressor::Surface surface = {rgba.data(), pageSize, pageSize, tile};
+                        TextureCompressor::compressSurfaces({surface}, format);
+                    }
+                }
+            };
+
+            if(pThreadPool)
+            {
+                pThreadPool->parallelFor(tileCount, 1, bakeTiles);
+            }
+            else
+            {
+                bakeTiles(0, tileCount);
+            }
+
+            file.write(reinterpret_cast<const char*>(row.data()), row.size());
+            totalBytes += row.size();
+        }
+    }
+
+    file.close();
+    if(!file.good() || std::rename(tempFile.c_str(), fileName.c_str()) != 0)
+    {
+        std::cout << "failed to write " << fileName << std::endl;
+        std::remove(tempFile.c_str());
+        return false;
+    }
+
+    double time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    std::cout << "baked virtual texture " << fileName << ", " << size << "x" << size << ", " << header.levelCount << " levels, "
+              << totalBytes / tileBytes << " tiles, " << totalBytes / (1024 * 1024) << " MB, " << time << " ms" << std::endl;
+    return true;
+}
+
+VirtualTexture::VirtualTexture()
+{
+}
+
+VirtualTexture::~VirtualTexture()
+{
+}
+
+bool VirtualTexture::prepare(const std::string& fileName, VkQueue transferQueue, VkDeviceSize budget, VkExtent2D feedbackExtent, uint32_t threadCount)
+{
+    if(!m_file.open(fileName) || m_file.m_size < sizeof(FileHeader))
+    {
+        std::cout << "failed to open virtual texture " << fileName << std::endl;
+        m_file.close();
+        return false;
+    }
+
+    memcpy(&m_header, m_file.m_data, sizeof(FileHeader));
+    m_format = static_cast<VkFormat>(m_header.format);
+    m_pageSize = m_header.tileSize + 2 * m_header.border;
+    m_tileCount = m_header.tileSize > 0 ? m_header.size / m_header.tileSize : 0;
+    m_tileBytes = Texture::getLevelSize(m_format, m_pageSize, m_pageSize);
+
+    uint32_t totalTiles = 0;
+    m_levelFirstTile.clear();
+    for(uint32_t level = 0; level < m_header.levelCount; level++)
+    {
+        m_levelFirstTile.push_back(totalTiles);
+        totalTiles += getTileCount(level) * getTileCount(level);
+    }
+
+    bool isValid = m_header.magic == m_fileMagic && m_header.version == 1 && m_tileCount > 0 && m_header.levelCount > 0 && m_header.levelCount <= 15;
+    isValid = isValid && (m_tileCount >> (m_header.levelCount - 1)) == 1 && m_file.m_size == sizeof(FileHeader) + totalTiles * m_tileBytes;
+    if(!isValid)
+    {
+        std::cout << "virtual texture " << fileName << " is invalid" << std::endl;
+        m_file.close();
+        return false;
+    }
+
+    //页坐标存在页表的8位里, 物理缓存的边长不超过设备限制, 也不需要比整张图还大
+    m_pinnedLevels = std::min(m_pinnedLevels, m_header.levelCount);
+    uint32_t pinnedCount = 0;
+    for(uint32_t level = m_header.levelCount - m_pinnedLevels; level < m_header.levelCount; level++)
+    {
+        pinnedCount += getTileCount(level) * getTileCount(level);
+    }
+
+    uint32_t maxPagesPerSide = std::min(255u, Tools::m_deviceProperties.limits.maxImageDimension2D / m_pageSize);
+    m_pagesPerSide = static_cast<uint32_t>(std::sqrt(static_cast<double>(budget / m_tileBytes)));
+    m_pagesPerSide = std::min(m_pagesPerSide, std::min(maxPagesPerSide, static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(totalTiles))))));
+    if(m_pagesPerSide * m_pagesPerSide < pinnedCount + m_maxUploadTiles)
+    {
+        std::cout << "virtual texture budget " << budget / (1024 * 1024) << " MB is too small" << std::endl;
+        m_file.close();
+        return false;
+    }
+
+    m_transferQueue = transferQueue;
+    m_threadPool.setThreadCount(std::max(1u, threadCount));
+
+    uint32_t pageCount = m_pagesPerSide * m_pagesPerSide;
+    m_pages.assign(pageCount, {m_invalidTile, 0, false});
+    m_freePages.clear();
+    for(uint32_t i = pageCount; i > 0; i--)
+    {
+        m_freePages.push_back(i - 1);
+    }
+
+    //物理缓存只有一级mip, 着色器里按页表选好level后采样
+    uint32_t cacheSize = m_pagesPerSide * m_pageSize;
+    m_pCacheTexture = new Texture();
+    m_pCacheTexture->m_name = fileName;
+    m_pCacheTexture->m_fromat = m_format;
+    m_pCacheTexture->m_width = cacheSize;
+    m_pCacheTexture->m_height = cacheSize;
+    m_pCacheTexture->m_mipLevels = 1;
+    m_pCacheTexture->m_layerCount = 1;
+    m_pCacheTexture->m_imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    Tools::createImageAndMemoryThenBind(m_format, cacheSize, cacheSize, 1, 1, VK_SAMPLE_COUNT_1_BIT,
+                                        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_TILING_OPTIMAL,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_pCacheTexture->m_image, m_pCacheTexture->m_imageMemory);
+    Tools::createImageView(m_pCacheTexture->m_image, m_format, VK_IMAGE_ASPECT_COLOR_BIT, 1, 1, m_pCacheTexture->m_imageView);
+    ResourceCache::acquireTextureSampler(VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, 1, m_pCacheTexture->m_sampler);
+
+    //整数格式只能用最近点采样, 着色器里用texelFetch
+    m_pPageTable = new Texture();
+    m_pPageTable->m_name = fileName + " page table";
+    m_pPageTable->m_fromat = VK_FORMAT_R8G8B8A8_UINT;
+    m_pPageTable->m_width = m_tileCount;
+    m_pPageTable->m_height = m_tileCount;
+    m_pPageTable->m_mipLevels = m_header.levelCount;
+    m_pPageTable->m_layerCount = 1;
+    m_pPageTable->m_imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    Tools::createImageAndMemoryThenBind(VK_FORMAT_R8G8B8A8_UINT, m_tileCount, m_tileCount, m_header.levelCount, 1, VK_SAMPLE_COUNT_1_BIT,
+                                        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_TILING_OPTIMAL,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_pPageTable->m_image, m_pPageTable->m_imageMemory);
+    Tools::createImageView(m_pPageTable->m_image, VK_FORMAT_R8G8B8A8_UINT, VK_IMAGE_ASPECT_COLOR_BIT, m_header.levelCount, 1, m_pPageTable->m_imageView);
+    VkSamplerCreateInfo samplerInfo = Tools::getSamplerCreateInfo(VK_FILTER_NEAREST, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, m_header.levelCount);
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.anisotropyEnable = VK_FALSE;
+    samplerInfo.maxAnisotropy = 1.0f;
+    m_pPageTable->m_sampler = ResourceCache::acquireSampler(samplerInfo);
+
+    VkDeviceSize pageTableBytes = 0;
+    m_pageTableData.resize(m_header.levelCount);
+    for(uint32_t level = 0; level < m_header.levelCount; level++)
+    {
+        m_pageTableData[level].assign(getTileCount(level) * getTileCount(level), 0);
+        pageTableBytes += m_pageTableData[level].size() * sizeof(uint32_t);
+    }
+
+    //前面放这一帧上传的tile, 后面放页表
+    VkDeviceSize stagingSize = m_maxUploadTiles * m_tileBytes + pageTableBytes;
+    Tools::createBufferAndMemoryThenBind(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_stagingBuffer, m_stagingMemory);
+    VK_CHECK_RESULT(vkMapMemory(Tools::m_device, m_stagingMemory, 0, VK_WHOLE_SIZE, 0, (void**)&m_pStaging));
+
+    m_feedbackExtent = feedbackExtent;
+    createFeedbackResources();
+
+    VkImageSubresourceRange subresourceRange = {};
+    subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresourceRange.baseMipLevel = 0;
+    subresourceRange.levelCount = m_header.levelCount;
+    subresourceRange.baseArrayLayer = 0;
+    subresourceRange.layerCount = 1;
+
+    VkCommandBuffer cmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    Tools::setImageLayout(cmd, m_pCacheTexture->m_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+    Tools::setImageLayout(cmd, m_pPageTable->m_image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                          VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, subresourceRange);
+    Tools::flushCommandBuffer(cmd, m_transferQueue, true);
+
+    //最粗的几级直接读入并常驻, 作为所有缺页的回退
+    std::vector<std::unique_ptr<TileJob>> jobs;
+    for(uint32_t level = m_header.levelCount; level > m_header.levelCount - m_pinnedLevels; level--)
+    {
+        for(uint32_t y = 0; y < getTileCount(level - 1); y++)
+        {
+            for(uint32_t x = 0; x < getTileCount(level - 1); x++)
+            {
+                std::unique_ptr<TileJob> job(new TileJob());
+                job->tile = packTile(level - 1, x, y);
+                const uint8_t* src = m_file.m_data + getTileOffset(job->tile);
+                job->data.assign(src, src + m_tileBytes);
+                job->isReady = true;
+                jobs.push_back(std::move(job));
+
+                if(jobs.size() == m_maxUploadTiles)
+                {
+                    cmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+                    uploadTiles(cmd, jobs);
+                    Tools::flushCommandBuffer(cmd, m_transferQueue, true);
+                    jobs.clear();
+                }
+            }
+        }
+    }
+
+    cmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+    uploadTiles(cmd, jobs);
+    updatePageTable(cmd);
+    Tools::flushCommandBuffer(cmd, m_transferQueue, true);
+
+    m_statistics = Statistics();
+    m_statistics.pageCount = pageCount;
+    m_statistics.pinnedPages = pinnedCount;
+    m_statistics.residentPages = static_cast<uint32_t>(m_residentTiles.size());
+    m_statistics.cacheBytes = Texture::getLevelSize(m_format, cacheSize, cacheSize) + pageTableBytes;
+    m_statistics.virtualBytes = totalTiles * m_tileBytes;
+    return true;
+}
+
+void VirtualTexture::clear()
+{
+    m_threadPool.wait();
+    m_threadPool.setThreadCount(0);
+    m_jobs.clear();
+    m_pendingTiles.clear();
+
+    if(m_pCacheTexture)
+    {
+        m_pCacheTexture->clear();
+        delete m_pCacheTexture;
+        m_pCacheTexture = nullptr;
+    }
+
+    if(m_pPageTable)
+    {
+        m_pPageTable->clear();
+        delete m_pPageTable;
+        m_pPageTable = nullptr;
+    }
+
+    if(m_pStaging)
+    {
+        vkUnmapMemory(Tools::m_device, m_stagingMemory);
+        m_pStaging = nullptr;
+    }
+    vkFreeMemory(Tools::m_device, m_stagingMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_stagingBuffer, nullptr);
+    m_stagingMemory = VK_NULL_HANDLE;
+    m_stagingBuffer = VK_NULL_HANDLE;
+
+    if(m_pReadback)
+    {
+        vkUnmapMemory(Tools::m_device, m_readbackMemory);
+        m_pReadback = nullptr;
+    }
+    vkFreeMemory(Tools::m_device, m_readbackMemory, nullptr);
+    vkDestroyBuffer(Tools::m_device, m_readbackBuffer, nullptr);
+    vkDestroyFramebuffer(Tools::m_device, m_feedbackFramebuffer, nullptr);
+    vkDestroyRenderPass(Tools::m_device, m_feedbackRenderPass, nullptr);
+    vkDestroyImageView(Tools::m_device, m_feedbackImageView, nullptr);
+    vkDestroyImage(Tools::m_device, m_feedbackImage, nullptr);
+    vkFreeMemory(Tools::m_device, m_feedbackMemory, nullptr);
+    vkDestroyImageView(Tools::m_device, m_feedbackDepthImageView, nullptr);
+    vkDestroyImage(Tools::m_device, m_feedbackDepthImage, nullptr);
+    vkFreeMemory(Tools::m_device, m_feedbackDepthMemory, nullptr);
+    m_readbackMemory = VK_NULL_HANDLE;
+    m_readbackBuffer = VK_NULL_HANDLE;
+    m_feedbackFramebuffer = VK_NULL_HANDLE;
+    m_feedbackRenderPass = VK_NULL_HANDLE;
+    m_feedbackImageView = VK_NULL_HANDLE;
+    m_feedbackImage = VK_NULL_HANDLE;
+    m_feedbackMemory = VK_NULL_HANDLE;
+    m_feedbackDepthImageView = VK_NULL_HANDLE;
+    m_feedbackDepthImage = VK_NULL_HANDLE;
+    m_feedbackDepthMemory = VK_NULL_HANDLE;
+    m_hasFeedback = false;
+
+    m_pages.clear();
+    m_freePages.clear();
+    m_residentTiles.clear();
+    m_pageTableData.clear();
+    m_file.close();
+}
+
+void VirtualTexture::createFeedbackResources()
+{
+    m_feedbackDepthFormat = Tools::findSupportedFormat({VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT},
+                                                       VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+
+    Tools::createImageAndMemoryThenBind(VK_FORMAT_R32_UINT, m_feedbackExtent.width, m_feedbackExtent.height, 1, 1, VK_SAMPLE_COUNT_1_BIT,
+                                        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_TILING_OPTIMAL,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_feedbackImage, m_feedbackMemory);
+    Tools::createImageView(m_feedbackImage, VK_FORMAT_R32_UINT, VK_IMAGE_ASPECT_COLOR_BIT, 1, 1, m_feedbackImageView);
+
+    Tools::createImageAndMemoryThenBind(m_feedbackDepthFormat, m_feedbackExtent.width, m_feedbackExtent.height, 1, 1, VK_SAMPLE_COUNT_1_BIT,
+                                        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_TILING_OPTIMAL,
+                                        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, m_feedbackDepthImage, m_feedbackDepthMemory);
+    Tools::createImageView(m_feedbackDepthImage, m_feedbackDepthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1, 1, m_feedbackDepthImageView);
+
+    //结束时直接转成拷贝源, 拷到readback缓冲
+    std::array<VkAttachmentDescription, 2> attachmentDescription;
+    attachmentDescription[0] = Tools::getAttachmentDescription(VK_FORMAT_R32_UINT, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_STORE, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    attachmentDescription[1] = Tools::getAttachmentDescription(m_feedbackDepthFormat, VK_SAMPLE_COUNT_1_BIT, VK_ATTACHMENT_LOAD_OP_CLEAR, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_ATTACHMENT_LOAD_OP_DONT_CARE, VK_ATTACHMENT_STORE_OP_DONT_CARE, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+
+    VkAttachmentReference colorAttachmentReference = {};
+    colorAttachmentReference.attachment = 0;
+    colorAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    VkAttachmentReference depthAttachmentReference = {};
+    depthAttachmentReference.attachment = 1;
+    depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpassDescription = {};
+    subpassDescription.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpassDescription.colorAttachmentCount = 1;
+    subpassDescription.pColorAttachments = &colorAttachmentReference;
+    subpassDescription.pDepthStencilAttachment = &depthAttachmentReference;
+
+    std::array<VkSubpassDependency, 2> dependencies;
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dependencyFlags = 0;
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    dependencies[1].dependencyFlags = 0;
+
+    VkRenderPassCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    createInfo.attachmentCount = static_cast<uint32_t>(attachmentDescription.size());
+    createInfo.pAttachments = attachmentDescription.data();
+    createInfo.subpassCount = 1;
+    createInfo.pSubpasses = &subpassDescription;
+    createInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
+    createInfo.pDependencies = dependencies.data();
+    VK_CHECK_RESULT(vkCreateRenderPass(Tools::m_device, &createInfo, nullptr, &m_feedbackRenderPass));
+
+    std::array<VkImageView, 2> attachments = {m_feedbackImageView, m_feedbackDepthImageView};
+    VkFramebufferCreateInfo framebufferInfo = {};
+    framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebufferInfo.renderPass = m_feedbackRenderPass;
+    framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+    framebufferInfo.pAttachments = attachments.data();
+    framebufferInfo.width = m_feedbackExtent.width;
+    framebufferInfo.height = m_feedbackExtent.height;
+    framebufferInfo.layers = 1;
+    VK_CHECK_RESULT(vkCreateFramebuffer(Tools::m_device, &framebufferInfo, nullptr, &m_feedbackFramebuffer));
+
+    VkDeviceSize readbackSize = static_cast<VkDeviceSize>(m_feedbackExtent.width) * m_feedbackExtent.height * sizeof(uint32_t);
+    Tools::createBufferAndMemoryThenBind(readbackSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_readbackBuffer, m_readbackMemory);
+    VK_CHECK_RESULT(vkMapMemory(Tools::m_device, m_readbackMemory, 0, VK_WHOLE_SIZE, 0, (void**)&m_pReadback));
+    memset(m_pReadback, 0xFF, readbackSize);
+}
+
+void VirtualTexture::beginFeedbackPass(VkCommandBuffer commandBuffer)
+{
+    std::array<VkClearValue, 2> clearValues = {};
+    clearValues[0].color.uint32[0] = m_invalidTile;
+    clearValues[1].depthStencil = {1.0f, 0};
+
+    VkRenderPassBeginInfo passBeginInfo = {};
+    passBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    passBeginInfo.renderPass = m_feedbackRenderPass;
+    passBeginInfo.framebuffer = m_feedbackFramebuffer;
+    passBeginInfo.renderArea.offset = {0, 0};
+    passBeginInfo.renderArea.extent = m_feedbackExtent;
+    passBeginInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+    passBeginInfo.pClearValues = clearValues.data();
+    vkCmdBeginRenderPass(commandBuffer, &passBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+    VkViewport viewport = Tools::getViewport(0, 0, m_feedbackExtent.width, m_feedbackExtent.height);
+    VkRect2D scissor;
+    scissor.offset = {0, 0};
+    scissor.extent = m_feedbackExtent;
+    vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+void VirtualTexture::endFeedbackPass(VkCommandBuffer commandBuffer)
+{
+    vkCmdEndRenderPass(commandBuffer);
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {m_feedbackExtent.width, m_feedbackExtent.height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, m_feedbackImage, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_readbackBuffer, 1, &region);
+
+    VkBufferMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.buffer = m_readbackBuffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    m_hasFeedback = true;
+}
+
+void VirtualTexture::update()
+{
+    m_frameIndex++;
+
+    std::vector<uint32_t> missingTiles;
+    readFeedback(missingTiles);
+
+    //读好的tile按请求的顺序上传, 超过上限的留到下一帧
+    std::vector<std::unique_ptr<TileJob>> readyJobs;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(size_t i = 0; i < m_jobs.size() && readyJobs.size() < m_maxUploadTiles; )
+        {
+            if(m_jobs[i]->isReady)
+            {
+                m_pendingTiles.erase(m_jobs[i]->tile);
+                readyJobs.push_back(std::move(m_jobs[i]));
+                m_jobs.erase(m_jobs.begin() + i);
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+    if(!readyJobs.empty() || m_isPageTableDirty)
+    {
+        VkCommandBuffer cmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        uploadTiles(cmd, readyJobs);
+        if(m_isPageTableDirty)
+        {
+            updatePageTable(cmd);
+        }
+        Tools::flushCommandBuffer(cmd, m_transferQueue, true);
+    }
+
+    //粗的level先读, 缺页时能尽快有接近的回退. 工作线程只是从映射里拷贝, 缺页中断在工作线程上发生
+    for(uint32_t tile : missingTiles)
+    {
+        if(m_pendingTiles.size() >= m_maxPendingTiles)
+        {
+            break;
+        }
+
+        std::unique_ptr<TileJob> job(new TileJob());
+        job->tile = tile;
+        job->isReady = false;
+        TileJob* pJob = job.get();
+        const uint8_t* src = m_file.m_data + getTileOffset(tile);
+        VkDeviceSize size = m_tileBytes;
+        m_pendingTiles.insert(tile);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(std::move(job));
+        }
+
+        m_threadPool.m_threads[m_nextThread++ % m_threadPool.m_threads.size()]->addJob([this, pJob, src, size] {
+            pJob->data.assign(src, src + size);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            pJob->isReady = true;
+        });
+    }
+
+    m_statistics.pendingTiles = static_cast<uint32_t>(m_pendingTiles.size());
+    m_statistics.residentPages = static_cast<uint32_t>(m_residentTiles.size());
+}
+
+void VirtualTexture::readFeedback(std::vector<uint32_t>& missingTiles)
+{
+    m_statistics.requestedTiles = 0;
+    m_statistics.missingTiles = 0;
+    if(!m_hasFeedback)
+    {
+        return ;
+    }
+
+    //相邻像素大多请求同一个tile, 先跳过连续重复的值
+    std::unordered_set<uint32_t> requested;
+    uint32_t previous = m_invalidTile;
+    size_t count = static_cast<size_t>(m_feedbackExtent.width) * m_feedbackExtent.height;
+    for(size_t i = 0; i < count; i++)
+    {
+        uint32_t tile = m_pReadback[i];
+        if(tile != m_invalidTile && tile != previous)
+        {
+            requested.insert(tile);
+        }
+        previous = tile;
+    }
+    m_statistics.requestedTiles = static_cast<uint32_t>(requested.size());
+
+    //请求的tile和它所有的祖先都算在用, 祖先是缺页时的回退, 不能先于子tile换出
+    std::unordered_set<uint32_t> missing;
+    for(uint32_t tile : requested)
+    {
+        uint32_t level = tile >> 28;
+        uint32_t x = tile & 0x3FFF;
+        uint32_t y = (tile >> 14) & 0x3FFF;
+        if(level >= m_header.levelCount || x >= getTileCount(level) || y >= getTileCount(level))
+        {
+            continue;
+        }
+
+        for(; level < m_header.levelCount; level++, x >>= 1, y >>= 1)
+        {
+            uint32_t ancestor = packTile(level, x, y);
+            auto it = m_residentTiles.find(ancestor);
+            if(it != m_residentTiles.end())
+            {
+                m_pages[it->second].lastUsedFrame = m_frameIndex;
+            }
+            else if(m_pendingTiles.find(ancestor) == m_pendingTiles.end())
+            {
+                missing.insert(ancestor);
+            }
+        }
+    }
+
+    //level在最高位, 从大到小排就是从粗到细
+    missingTiles.assign(missing.begin(), missing.end());
+    std::sort(missingTiles.begin(), missingTiles.end(), std::greater<uint32_t>());
+    m_statistics.missingTiles = static_cast<uint32_t>(missingTiles.size());
+}
+
+uint32_t VirtualTexture::allocatePage()
+{
+    if(!m_freePages.empty())
+    {
+        uint32_t page = m_freePages.back();
+        m_freePages.pop_back();
+        return page;
+    }
+
+    //最久没用的页, 一样久时先换出精细的level. 这一帧用到的不换
+    uint32_t victim = m_invalidTile;
+    for(uint32_t i = 0; i < m_pages.size(); i++)
+    {
+        const Page& page = m_pages[i];
+        if(page.isPinned || page.lastUsedFrame >= m_frameIndex)
+        {
+            continue;
+        }
+
+        if(victim == m_invalidTile || page.lastUsedFrame < m_pages[victim].lastUsedFrame ||
+           (page.lastUsedFrame == m_pages[victim].lastUsedFrame && (page.tile >> 28) < (m_pages[victim].tile >> 28)))
+        {
+            victim = i;
+        }
+    }
+
+    if(victim != m_invalidTile)
+    {
+        m_residentTiles.erase(m_pages[victim].tile);
+        m_pages[victim].tile = m_invalidTile;
+        m_statistics.evictedTiles++;
+        m_isPageTableDirty = true;
+    }
+    return victim;
+}
+
+void VirtualTexture::uploadTiles(VkCommandBuffer commandBuffer, const std::vector<std::unique_ptr<TileJob>>& jobs)
+{
+    assert(jobs.size() <= m_maxUploadTiles);
+
+    std::vector<VkBufferImageCopy> regions;
+    for(const std::unique_ptr<TileJob>& job : jobs)
+    {
+        uint32_t pageIndex = allocatePage();
+        if(pageIndex == m_invalidTile)
+        {
+            m_statistics.droppedTiles++;
+            continue;
+        }
+
+        Page& page = m_pages[pageIndex];
+        page.tile = job->tile;
+        page.lastUsedFrame = m_frameIndex;
+        page.isPinned = (job->tile >> 28) >= m_header.levelCount - m_pinnedLevels;
+        m_residentTiles[job->tile] = pageIndex;
+
+        VkDeviceSize offset = regions.size() * m_tileBytes;
+        memcpy(m_pStaging + offset, job->data.data(), m_tileBytes);
+
+        VkBufferImageCopy region = {};
+        region.bufferOffset = offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = 0;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset.x = static_cast<int32_t>((pageIndex % m_pagesPerSide) * m_pageSize);
+        region.imageOffset.y = static_cast<int32_t>((pageIndex / m_pagesPerSide) * m_pageSize);
+        region.imageExtent = {m_pageSize, m_pageSize, 1};
+        regions.push_back(region);
+
+        m_statistics.uploadedTiles++;
+        m_isPageTableDirty = true;
+    }
+
+    if(regions.empty())
+    {
+        return ;
+    }
+
+    //旧布局不是UNDEFINED, 其它页的内容保留
+    Tools::setImageLayout(commandBuffer, m_pCacheTexture->m_image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+    vkCmdCopyBufferToImage(commandBuffer, m_stagingBuffer, m_pCacheTexture->m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+    Tools::setImageLayout(commandBuffer, m_pCacheTexture->m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+}
+
+void VirtualTexture::updatePageTable(VkCommandBuffer commandBuffer)
+{
+    //从粗到细, 不常驻的tile沿用父tile的项
+    for(uint32_t level = m_header.levelCount; level > 0; level--)
+    {
+        uint32_t tileCount = getTileCount(level - 1);
+        std::vector<uint32_t>& entries = m_pageTableData[level - 1];
+        for(uint32_t y = 0; y < tileCount; y++)
+        {
+            for(uint32_t x = 0; x < tileCount; x++)
+            {
+                auto it = m_residentTiles.find(packTile(level - 1, x, y));
+                if(it != m_residentTiles.end())
+                {
+                    uint32_t page = it->second;
+                    entries[y * tileCount + x] = (page % m_pagesPerSide) | ((page / m_pagesPerSide) << 8) | ((level - 1) << 16) | (255u << 24);
+                }
+                else if(level < m_header.levelCount)
+                {
+                    entries[y * tileCount + x] = m_pageTableData[level][(y / 2) * (tileCount / 2) + x / 2];
+                }
+            }
+        }
+    }
+
+    std::vector<VkBufferImageCopy> regions;
+    VkDeviceSize offset = m_maxUploadTiles * m_tileBytes;
+    for(uint32_t level = 0; level < m_header.levelCount; level++)
+    {
+        VkDeviceSize size = m_pageTableData[level].size() * sizeof(uint32_t);
+        memcpy(m_pStaging + offset, m_pageTableData[level].data(), size);
+
+        VkBufferImageCopy region = {};
+        region.bufferOffset = offset;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = level;
+        region.imageSubresource.baseArrayLayer = 0;
+        region.imageSubresource.layerCount = 1;
+        region.imageExtent = {getTileCount(level), getTileCount(level), 1};
+        regions.push_back(region);
+        offset += size;
+    }
+
+    VkImageSubresourceRange subresourceRange = {};
+    subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresourceRange.baseMipLevel = 0;
+    subresourceRange.levelCount = m_header.levelCount;
+    subresourceRange.baseArrayLayer = 0;
+    subresourceRange.layerCount = 1;
+
+    Tools::setImageLayout(commandBuffer, m_pPageTable->m_image, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, subresourceRange);
+    vkCmdCopyBufferToImage(commandBuffer, m_stagingBuffer, m_pPageTable->m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(regions.size()), regions.data());
+    Tools::setImageLayout(commandBuffer, m_pPageTable->m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, subresourceRange);
+    m_isPageTableDirty = false;
+}
+
+VkDeviceSize VirtualTexture::getTileOffset(uint32_t tile) const
+{
+    uint32_t level = tile >> 28;
+    uint32_t x = tile & 0x3FFF;
+    uint32_t y = (tile >> 14) & 0x3FFF;
+    VkDeviceSize index = m_levelFirstTile[level] + y * getTileCount(level) + x;
+    return sizeof(FileHeader) + index * m_tileBytes;
+}
+
+VirtualTexture::ShaderParams VirtualTexture::getShaderParams(float lodBias) const
+{
+    ShaderParams params = {};
+    params.virtualSize = static_cast<float>(m_header.size);
+    params.tileCount = static_cast<float>(m_tileCount);
+    params.tileSize = static_cast<float>(m_header.tileSize);
+    params.border = static_cast<float>(m_header.border);
+    params.pageSize = static_cast<float>(m_pageSize);
+    params.cacheSize = static_cast<float>(m_pagesPerSide * m_pageSize);
+    params.maxLevel = static_cast<float>(m_header.levelCount - 1);
+    params.lodBias = lodBias;
+    return params;
+}
+
+VkDescriptorImageInfo VirtualTexture::getCacheDescriptorImageInfo()
+{
+    return m_pCacheTexture->getDescriptorImageInfo();
+}
+
+VkDescriptorImageInfo VirtualTexture::getPageTableDescriptorImageInfo()
+{
+    return m_pPageTable->getDescriptorImageInfo();
+}
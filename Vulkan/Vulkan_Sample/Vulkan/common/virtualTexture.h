@@ -0,0 +1,160 @@
+
+#pragma once
+
+#include "tools.h"
+#include "texture.h"
+#include "thread.h"
+#include "mappedFile.h"
+#include <unordered_set>
+
+// 虚拟纹理. 源图离线切成带边框的tile, 按level依次存进.vtex文件. 运行时显存里只有固定大小的物理缓存(一张图分成pageCount x pageCount页)
+// 和页表(每个tile一个纹素, 带mip, 记录所在的页和实际常驻的level). 低分辨率的反馈pass写出每个像素需要的(level, tile),
+// 下一帧读回, 工作线程从映射的文件里拷出缺的tile, 主线程在帧边界上传到空闲页或者最久没用的页, 再重建页表.
+// 不常驻的tile在页表里指向最近的常驻祖先, 最粗的几级一直常驻, 任何时候都有内容可以采样
+class VirtualTexture
+{
+public:
+    struct FileHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t format;
+        uint32_t size;              //level 0的边长, 2的幂
+        uint32_t tileSize;          //不含边框
+        uint32_t border;
+        uint32_t levelCount;        //最粗的一级只有一个tile
+        uint32_t reserved;
+    };
+
+    // 着色器里的push constant, 布局和terrain_vt.frag/terrain_feedback.frag一致
+    struct ShaderParams {
+        float virtualSize;
+        float tileCount;            //level 0每行的tile数
+        float tileSize;
+        float border;
+        float pageSize;             //tileSize + 2 * border
+        float cacheSize;
+        float maxLevel;
+        float lodBias;
+    };
+
+    struct Statistics {
+        uint32_t pageCount = 0;
+        uint32_t residentPages = 0;
+        uint32_t pinnedPages = 0;
+        uint32_t requestedTiles = 0;        //上一帧反馈里不同的tile数
+        uint32_t missingTiles = 0;          //其中还没有常驻的
+        uint32_t pendingTiles = 0;          //正在读的
+        uint32_t uploadedTiles = 0;         //累计
+        uint32_t evictedTiles = 0;
+        uint32_t droppedTiles = 0;          //读完了但这一帧所有页都在用, 丢掉等下次请求
+        VkDeviceSize cacheBytes = 0;        //物理缓存和页表, 不随源图大小变化
+        VkDeviceSize virtualBytes = 0;      //整张图所有level全部常驻需要的大小
+    };
+
+    // 填充level上从(x, y)开始width x height的RGBA8纹素, 坐标可能超出图的范围(边框). 在工作线程里调用
+    typedef std::function<void(uint32_t level, int32_t x, int32_t y, uint32_t width, uint32_t height, uint8_t* rgba)> TileGenerator;
+    // format为RGBA8或BC1, 一行tile生成完顺序写入文件
+    static bool bake(const std::string& fileName, uint32_t size, uint32_t tileSize, uint32_t border, VkFormat format, const TileGenerator& generator, ThreadPool* pThreadPool = nullptr);
+
+    VirtualTexture();
+    ~VirtualTexture();
+    // budget是物理缓存的大小, feedbackExtent一般取屏幕的1/8
+    bool prepare(const std::string& fileName, VkQueue transferQueue, VkDeviceSize budget, VkExtent2D feedbackExtent, uint32_t threadCount = 2);
+    void clear();
+
+    // 在主渲染通道之前录制, 中间用m_feedbackRenderPass创建的管线绘制, 写出packTile的值. end时把结果拷到可读回的缓冲
+    void beginFeedbackPass(VkCommandBuffer commandBuffer);
+    void endFeedbackPass(VkCommandBuffer commandBuffer);
+    // 每帧在录制命令之前调用, 这时上一帧已经结束(每帧末尾vkDeviceWaitIdle). 读反馈, 上传读好的tile, 发起新的读取
+    void update();
+
+    // 反馈pass的分辨率是屏幕的1/n时, lodBias取-log2(n)
+    ShaderParams getShaderParams(float lodBias = 0.0f) const;
+    VkDescriptorImageInfo getCacheDescriptorImageInfo();
+    VkDescriptorImageInfo getPageTableDescriptorImageInfo();
+    const Statistics& getStatistics() { return m_statistics; }
+
+    // 和着色器里的打包方式一致, 反馈清成0xFFFFFFFF表示没有请求
+    static uint32_t packTile(uint32_t level, uint32_t x, uint32_t y) { return (level << 28) | (y << 14) | x; }
+
+private:
+    struct Page {
+        uint32_t tile;              //packTile, 空闲时为m_invalidTile
+        uint64_t lastUsedFrame;
+        bool isPinned;
+    };
+
+    struct TileJob {
+        uint32_t tile;
+        std::vector<uint8_t> data;
+        bool isReady;
+    };
+
+    uint32_t getTileCount(uint32_t level) const { return m_tileCount >> level; }
+    VkDeviceSize getTileOffset(uint32_t tile) const;
+    uint32_t allocatePage();
+    void readFeedback(std::vector<uint32_t>& missingTiles);
+    void uploadTiles(VkCommandBuffer commandBuffer, const std::vector<std::unique_ptr<TileJob>>& jobs);
+    void updatePageTable(VkCommandBuffer commandBuffer);
+    void createFeedbackResources();
+
+public:
+    // 在prepare之前设置
+    uint32_t m_maxUploadTiles = 32;     //每次update上传的上限, 限制卡顿
+    uint32_t m_maxPendingTiles = 64;    //同时在读的上限
+    uint32_t m_pinnedLevels = 3;        //最粗的几级在prepare里同步读入, 不会被换出
+    VkRenderPass m_feedbackRenderPass = VK_NULL_HANDLE;
+    VkExtent2D m_feedbackExtent = {};
+
+    static const uint32_t m_invalidTile = 0xFFFFFFFF;
+    static const uint32_t m_fileMagic = 0x58455456;    //"VTEX"
+
+private:
+    FileHeader m_header = {};
+    VkFormat m_format = VK_FORMAT_UNDEFINED;
+    uint32_t m_tileCount = 0;
+    uint32_t m_pageSize = 0;
+    VkDeviceSize m_tileBytes = 0;
+    std::vector<uint32_t> m_levelFirstTile;     //每个level第一个tile在文件里的序号
+
+    MappedFile m_file;
+    VkQueue m_transferQueue = VK_NULL_HANDLE;
+    ThreadPool m_threadPool;
+    uint32_t m_nextThread = 0;
+    std::mutex m_mutex;                         //保护isReady, 工作线程会修改
+    std::vector<std::unique_ptr<TileJob>> m_jobs;
+    std::unordered_set<uint32_t> m_pendingTiles;
+
+    // 物理缓存
+    uint32_t m_pagesPerSide = 0;
+    std::vector<Page> m_pages;
+    std::vector<uint32_t> m_freePages;
+    std::unordered_map<uint32_t, uint32_t> m_residentTiles;    //tile到页的序号
+    Texture* m_pCacheTexture = nullptr;
+
+    // 页表, 每个level一张RGBA8_UINT的mip: (页x, 页y, 常驻的level, 255)
+    Texture* m_pPageTable = nullptr;
+    std::vector<std::vector<uint32_t>> m_pageTableData;
+    bool m_isPageTableDirty = true;
+
+    VkBuffer m_stagingBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_stagingMemory = VK_NULL_HANDLE;
+    uint8_t* m_pStaging = nullptr;
+
+    // 反馈
+    VkFormat m_feedbackDepthFormat = VK_FORMAT_D32_SFLOAT;
+    VkImage m_feedbackImage = VK_NULL_HANDLE;
+    VkDeviceMemory m_feedbackMemory = VK_NULL_HANDLE;
+    VkImageView m_feedbackImageView = VK_NULL_HANDLE;
+    VkImage m_feedbackDepthImage = VK_NULL_HANDLE;
+    VkDeviceMemory m_feedbackDepthMemory = VK_NULL_HANDLE;
+    VkImageView m_feedbackDepthImageView = VK_NULL_HANDLE;
+    VkFramebuffer m_feedbackFramebuffer = VK_NULL_HANDLE;
+    VkBuffer m_readbackBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_readbackMemory = VK_NULL_HANDLE;
+    uint32_t* m_pReadback = nullptr;
+    bool m_hasFeedback = false;
+
+    uint64_t m_frameIndex = 1;
+    Statistics m_statistics;
+};
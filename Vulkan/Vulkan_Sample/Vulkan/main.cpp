@@ -53,9 +53,98 @@
 #include "sample/parallaxmapping/parallaxmapping.h"
 #include "sample/sphericalenvmapping/sphericalenvmapping.h"
 #include "sample/shadowquality/shadowquality.h"
+#include "common/sceneCooker.h"
+#include "common/bvh.h"
+#include "common/textureCompressor.h"
+#include "common/pixelConvert.h"
+
+// 基准测试的物体数量, 命令行从argv[2]开始给出, 没有时用缺省值
+static std::vector<uint32_t> parseCounts(int argc, const char * argv[])
+{
+    std::vector<uint32_t> objectCounts = {10000, 100000, 1000000};
+    if(argc > 2)
+    {
+        objectCounts.clear();
+        for(int i = 2; i < argc; ++i)
+        {
+            objectCounts.push_back(static_cast<uint32_t>(std::stoul(argv[i])));
+        }
+    }
+    return objectCounts;
+}
 
 int main(int argc, const char * argv[])
 {
+    // 离线烘焙场景: --cook input.gltf [output] [loadFlags] [lodCount]
+    if(argc > 2 && std::string(argv[1]) == "--cook")
+    {
+        std::string input = argv[2];
+        std::string output = argc > 3 ? argv[3] : input + ".cooked";
+        uint32_t loadFlags = argc > 4 ? static_cast<uint32_t>(std::stoul(argv[4], nullptr, 0)) : GltfFileLoadFlags::PreTransformVertices | GltfFileLoadFlags::PreMultiplyVertexColors | GltfFileLoadFlags::FlipY;
+        uint32_t lodCount = argc > 5 ? static_cast<uint32_t>(std::stoul(argv[5])) : 4;
+        return SceneCooker::cook(input, output, loadFlags, lodCount) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    
+    // BVH和线性扫描的视锥剔除对比: --bench-bvh [objectCount...]
+    if(argc > 1 && std::string(argv[1]) == "--bench-bvh")
+    {
+        std::vector<uint32_t> objectCounts = parseCounts(argc, argv);
+        Bvh::benchmark(objectCounts);
+        return EXIT_SUCCESS;
+    }
+    
+    // checkSphere和SIMD批量剔除的对比: --bench-frustum [objectCount...]
+    if(argc > 1 && std::string(argv[1]) == "--bench-frustum")
+    {
+        std::vector<uint32_t> objectCounts = parseCounts(argc, argv);
+        ThreadPool threadPool;
+        threadPool.setThreadCount(std::max(1u, std::thread::hardware_concurrency()));
+        Frustum::benchmark(objectCounts, &threadPool);
+        return EXIT_SUCCESS;
+    }
+    
+    // 像素格式转换的吞吐量: --bench-pixel [width height]
+    if(argc > 1 && std::string(argv[1]) == "--bench-pixel")
+    {
+        uint32_t width = argc > 3 ? static_cast<uint32_t>(std::stoul(argv[2])) : 2048;
+        uint32_t height = argc > 3 ? static_cast<uint32_t>(std::stoul(argv[3])) : 2048;
+        PixelConvert::benchmark(width, height);
+        return EXIT_SUCCESS;
+    }
+    
+    // BC块压缩的耗时和质量: --bench-bc [image...]
+    if(argc > 1 && std::string(argv[1]) == "--bench-bc")
+    {
+        std::vector<std::string> fileNames = {Tools::getTexturePath() + "ground_dry_rgba.ktx", Tools::getTexturePath() + "fireplace_normalmap_rgba.ktx"};
+        if(argc > 2)
+        {
+            fileNames.assign(argv + 2, argv + argc);
+        }
+        ThreadPool threadPool;
+        threadPool.setThreadCount(std::max(1u, std::thread::hardware_concurrency()));
+        for(const std::string& fileName : fileNames)
+        {
+            TextureCompressor::benchmark(fileName, &threadPool);
+        }
+        return EXIT_SUCCESS;
+    }
+    
+    // 逐个primitive绘制和多重间接绘制的命令录制耗时: --bench-record [repeatCount]
+    if(argc > 1 && std::string(argv[1]) == "--bench-record")
+    {
+        uint32_t repeatCount = argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2])) : 100;
+        GltfSceneRendering app("gltfscenerendering");
+        try {
+            app.init();
+            app.benchmarkRecording(repeatCount);
+            app.clear();
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+    
 //    Triangle app("triangle");
 //    Pipelines app("pipeline");
 //    Descriptorsets app("descriptorsets");
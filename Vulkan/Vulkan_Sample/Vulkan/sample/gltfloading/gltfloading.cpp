@@ -12,11 +12,9 @@ void GltfLoading::init()
 {
     Application::init();
     
-    prepareVertex();
     prepareUniform();
     prepareDescriptorSetLayoutAndPipelineLayout();
-    prepareDescriptorSetAndWrite();
-    createGraphicsPipeline();
+    prepareVertex();
 }
 
 void GltfLoading::initCamera()
@@ -35,20 +33,55 @@ void GltfLoading::setEnabledFeatures()
 void GltfLoading::clear()
 {
 //    vkDestroyPipelineLayout(m_device, m_textruePipelineLayout, nullptr);
+    m_asyncLoader.clear();
     vkDestroyDescriptorSetLayout(m_device, m_textureDescriptorSetLayout, nullptr);
-    vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
     vkFreeMemory(m_device, m_uniformMemory, nullptr);
     vkDestroyBuffer(m_device, m_uniformBuffer, nullptr);
 
-    m_gltfLoader.clear();
+    //没加载完就退出时顶点缓冲和管线还没有创建
+    if(m_isModelLoaded)
+    {
+        vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
+        m_gltfLoader.clear();
+    }
     Application::clear();
 }
 
 void GltfLoading::prepareVertex()
 {
-    m_gltfLoader.loadFromFile(Tools::getModelPath() + "FlightHelmet/glTF/FlightHelmet.gltf", m_graphicsQueue, GltfFileLoadFlags::None);
-    m_gltfLoader.createVertexAndIndexBuffer();
+    uint32_t loadFlags = m_quantizeVertices ? GltfFileLoadFlags::QuantizeVertices : GltfFileLoadFlags::None;
+    std::string fileName = Tools::getModelPath() + "FlightHelmet/glTF/FlightHelmet.gltf";
+    if(!m_useAsyncLoading)
+    {
+        m_gltfLoader.loadFromFile(fileName, m_graphicsQueue, loadFlags);
+        onModelLoaded();
+        return ;
+    }
+    
+    m_asyncLoader.prepare(m_graphicsQueue, std::max(2u, std::thread::hardware_concurrency()));
+    m_asyncLoader.m_onTextureChanged = [this](Texture* texture) {
+        VkDescriptorImageInfo imageInfo = texture->getDescriptorImageInfo();
+        VkWriteDescriptorSet write = Tools::getWriteDescriptorSet(texture->m_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageInfo);
+        vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+    };
+    m_asyncLoader.loadModel(&m_gltfLoader, fileName, loadFlags, [this](GltfLoader*) {
+        onModelLoaded();
+    });
+}
+
+void GltfLoading::onModelLoaded()
+{
     m_gltfLoader.setVertexBindingAndAttributeDescription({VertexComponent::Position, VertexComponent::Normal, VertexComponent::UV, VertexComponent::Color});
+    m_gltfLoader.createVertexAndIndexBuffer();
+    if(m_quantizeVertices)
+    {
+        const GltfLoader::Statistics& statistics = m_gltfLoader.getStatistics();
+        std::cout << "model vertex and index " << statistics.originBufferSize / 1024 << " KB -> "
+                  << (statistics.vertexBufferSize + statistics.indexBufferSize) / 1024 << " KB, index " << (m_gltfLoader.m_indexType == VK_INDEX_TYPE_UINT16 ? 16 : 32) << " bit" << std::endl;
+    }
+    prepareDescriptorSetAndWrite();
+    createGraphicsPipeline();
+    m_isModelLoaded = true;
 }
 
 void GltfLoading::prepareUniform()
@@ -169,7 +202,8 @@ void GltfLoading::createGraphicsPipeline()
     createInfo.pDynamicState = &dynamic;
     createInfo.subpass = 0;
 
-    VkShaderModule vertModule = Tools::createShaderModule( Tools::getShaderPath() + "gltfloading/mesh.vert.spv");
+    std::string vertShader = m_quantizeVertices ? "gltfloading/mesh_packed.vert.spv" : "gltfloading/mesh.vert.spv";
+    VkShaderModule vertModule = Tools::createShaderModule( Tools::getShaderPath() + vertShader);
     VkShaderModule fragModule = Tools::createShaderModule( Tools::getShaderPath() + "gltfloading/mesh.frag.spv");
     shaderStages[0] = Tools::getPipelineShaderStageCreateInfo(vertModule, VK_SHADER_STAGE_VERTEX_BIT);
     shaderStages[1] = Tools::getPipelineShaderStageCreateInfo(fragModule, VK_SHADER_STAGE_FRAGMENT_BIT);
@@ -180,6 +214,19 @@ void GltfLoading::createGraphicsPipeline()
 
 void GltfLoading::updateRenderData()
 {
+    if(m_useAsyncLoading)
+    {
+        m_asyncLoader.update();
+        //全部上传完后输出一次首帧和完全加载的时间
+        const AsyncLoader::Statistics& statistics = m_asyncLoader.getStatistics();
+        if(!m_isLoadTimeReported && statistics.fullyLoadedTime > 0.0)
+        {
+            std::cout << "async loader first frame " << statistics.firstFrameTime << " ms, fully loaded " << statistics.fullyLoadedTime << " ms, "
+                      << statistics.loadedModelCount << " models, " << statistics.loadedTextureCount << " textures, " << statistics.uploadedBytes / (1024 * 1024) << " MB" << std::endl;
+            m_isLoadTimeReported = true;
+        }
+    }
+    
 //    static int i  = 0;
 //    i++;
 //
@@ -200,6 +247,11 @@ void GltfLoading::recordRenderCommand(const VkCommandBuffer commandBuffer)
     
     vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+    
+    if(!m_isModelLoaded)
+    {
+        return ;
+    }
 
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
     m_gltfLoader.bindBuffers(commandBuffer);
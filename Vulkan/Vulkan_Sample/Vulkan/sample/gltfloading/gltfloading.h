@@ -3,6 +3,7 @@
 
 #include "common/application.h"
 #include "common/gltfLoader.h"
+#include "common/asyncLoader.h"
 
 class GltfLoading : public Application
 {
@@ -26,6 +27,7 @@ public:
     
 protected:
     void prepareVertex();
+    void onModelLoaded();
     void prepareUniform();
     void prepareDescriptorSetLayoutAndPipelineLayout();
     void prepareDescriptorSetAndWrite();
@@ -45,4 +47,11 @@ protected:
 
 private:
     GltfLoader m_gltfLoader;
+    bool m_quantizeVertices = true;
+    
+    //模型在后台加载, 完成前只清屏, 图片先用占位再逐张替换
+    AsyncLoader m_asyncLoader;
+    bool m_useAsyncLoading = true;
+    bool m_isModelLoaded = false;
+    bool m_isLoadTimeReported = false;
 };
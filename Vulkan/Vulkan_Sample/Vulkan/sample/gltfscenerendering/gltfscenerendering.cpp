@@ -17,6 +17,36 @@ void GltfSceneRendering::init()
     prepareDescriptorSetLayoutAndPipelineLayout();
     prepareDescriptorSetAndWrite();
     createGraphicsPipeline();
+    
+    if(m_useTextureStreaming)
+    {
+        prepareTextureStreaming();
+    }
+    
+    m_clusterCulling.prepare(&m_gltfLoader, m_pipelineCache);
+    std::cout << "cluster culling: " << m_clusterCulling.m_meshlets.size() << " meshlets, " << m_clusterCulling.m_drawCommands.size() << " draws" << std::endl;
+    if(m_useHiZ)
+    {
+        createLoadRenderPass();
+        m_hiZ.prepare(m_depthImage, m_depthFormat, m_swapchainExtent.width, m_swapchainExtent.height, m_pipelineCache);
+        m_clusterCulling.setHiZ(m_hiZ.m_imageView, m_hiZ.m_sampler, m_hiZ.m_width, m_hiZ.m_height, m_hiZ.m_mipLevels);
+    }
+    
+    if(m_supportNonUniformIndexing)
+    {
+        m_indirectScene.prepare(&m_gltfLoader, m_supportDrawIndirectCount);
+        std::cout << "indirect scene: " << m_indirectScene.m_drawCommands.size() << " draws, " << m_indirectScene.m_matrices.size() << " matrices, "
+                  << m_indirectScene.m_textures.size() << " textures" << std::endl;
+        createIndirectPipelines(m_indirectScene, m_indirectPipelineLayout);
+        if(m_packTextures)
+        {
+            preparePackedScene();
+        }
+    }
+    
+    m_softwareOcclusion.prepare(&m_gltfLoader);
+    std::cout << "software occlusion: " << m_softwareOcclusion.m_occluders.size() << " occluders, " << m_softwareOcclusion.m_vertices.size() / 3 << " triangles, "
+              << m_softwareOcclusion.m_width << "x" << m_softwareOcclusion.m_height << " depth buffer" << std::endl;
 }
 
 void GltfSceneRendering::initCamera()
@@ -31,6 +61,79 @@ void GltfSceneRendering::initCamera()
 
 void GltfSceneRendering::setEnabledFeatures()
 {
+    //多重间接绘制用firstInstance区分每次绘制
+    if(m_deviceFeatures.multiDrawIndirect)
+    {
+        m_deviceEnabledFeatures.multiDrawIndirect = VK_TRUE;
+    }
+    
+    if(m_deviceFeatures.drawIndirectFirstInstance)
+    {
+        m_deviceEnabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+    }
+    
+    //一次间接绘制里不同绘制的片元可能在同一个subgroup, 材质下标不是动态一致的, 纹理数组要用nonuniformEXT访问
+    if(m_deviceFeatures.shaderSampledImageArrayDynamicIndexing && isDeviceExtensionSupported(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME))
+    {
+        VkPhysicalDeviceFeatures2KHR features2 = {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+        features2.pNext = &m_descriptorIndexingFeatures;
+        PFN_vkGetPhysicalDeviceFeatures2KHR getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(m_instance, "vkGetPhysicalDeviceFeatures2KHR"));
+        if(getFeatures2)
+        {
+            getFeatures2(m_physicalDevice, &features2);
+        }
+        
+        //只启用需要的特征
+        bool nonUniformIndexing = m_descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing;
+        m_descriptorIndexingFeatures = {};
+        m_descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+        if(nonUniformIndexing)
+        {
+            m_deviceEnabledFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+            m_descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+            m_pDeviceCreateNext = &m_descriptorIndexingFeatures;
+            m_enabledDeviceExtensions.push_back(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+            m_enabledDeviceExtensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+            m_supportNonUniformIndexing = true;
+        }
+    }
+    
+    //不支持时不准备多重间接绘制, 退回逐个primitive绘制, 每次绘制绑定材质的描述符集
+    if(!m_supportNonUniformIndexing)
+    {
+        m_useMultiDrawIndirect = false;
+        m_packTextures = false;
+    }
+    
+    if(m_compressTextures && m_deviceFeatures.textureCompressionBC)
+    {
+        m_deviceEnabledFeatures.textureCompressionBC = VK_TRUE;
+    }
+    
+    if(isDeviceExtensionSupported(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME))
+    {
+        m_enabledDeviceExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+        m_supportDrawIndirectCount = true;
+    }
+    
+    //纹理流送的预算同时受显存堆剩余预算限制
+    if(m_useTextureStreaming && isDeviceExtensionSupported(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME))
+    {
+        m_enabledDeviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        m_supportMemoryBudget = true;
+    }
+    
+    //Hi-Z金字塔是rg32f的storage image
+    if(m_deviceFeatures.shaderStorageImageExtendedFormats)
+    {
+        m_deviceEnabledFeatures.shaderStorageImageExtendedFormats = VK_TRUE;
+        m_depthSampled = true;
+    }
+    else
+    {
+        m_useHiZ = false;
+    }
 }
 
 void GltfSceneRendering::clear()
@@ -41,15 +144,57 @@ void GltfSceneRendering::clear()
     vkFreeMemory(m_device, m_uniformMemory, nullptr);
     vkDestroyBuffer(m_device, m_uniformBuffer, nullptr);
 
+    m_clusterCulling.clear();
+    m_hiZ.clear();
+    if(m_supportNonUniformIndexing)
+    {
+        destroyIndirectScene(m_indirectScene, m_indirectPipelineLayout);
+        clearPackedScene();
+    }
+    m_softwareOcclusion.clear();
+    m_textureStreamer.clear();
     m_gltfLoader.clear();
     Application::clear();
 }
 
 void GltfSceneRendering::prepareVertex()
 {
-    m_gltfLoader.loadFromFile(Tools::getModelPath() + "sponza/sponza.gltf", m_graphicsQueue, GltfFileLoadFlags::None);
-    m_gltfLoader.createVertexAndIndexBuffer();
+    uint32_t loadFlags = m_quantizeVertices ? GltfFileLoadFlags::QuantizeVertices : GltfFileLoadFlags::None;
+    if(m_compressTextures)
+    {
+        loadFlags |= GltfFileLoadFlags::CompressTextures;
+    }
+    if(m_useTextureStreaming)
+    {
+        m_textureStreamer.prepare(m_instance, m_graphicsQueue, m_supportMemoryBudget);
+        m_textureStreamer.m_onTextureChanged = [this](Texture* texture) {
+            for(Material* mat : m_gltfLoader.m_materials)
+            {
+                if(mat->m_pBaseColorTexture == texture || mat->m_pNormalTexture == texture)
+                {
+                    writeMaterialDescriptorSet(mat);
+                }
+            }
+            m_indirectScene.updateTexture(texture);
+        };
+        m_gltfLoader.m_pTextureStreamer = &m_textureStreamer;
+    }
+    m_gltfLoader.loadFromFile(Tools::getModelPath() + "sponza/sponza.gltf", m_graphicsQueue, loadFlags);
     m_gltfLoader.setVertexBindingAndAttributeDescription({VertexComponent::Position, VertexComponent::Normal, VertexComponent::UV, VertexComponent::Color, VertexComponent::Tangent});
+    m_gltfLoader.createVertexAndIndexBuffer();
+    const GltfLoader::Statistics& statistics = m_gltfLoader.getStatistics();
+    std::cout << "sponza" << (statistics.isCooked ? " (cooked)" : "") << " load " << statistics.loadTime << " ms" << std::endl;
+    if(!statistics.isCooked)
+    {
+        std::cout << "sponza " << statistics.imageCount << " images, " << statistics.decodeThreadCount << " threads, " << statistics.uploadBatchCount << " upload batches, "
+                  << statistics.imageTime << " ms, texture " << statistics.textureSize / (1024 * 1024) << " MB"
+                  << " (RGBA8 " << statistics.uncompressedTextureSize / (1024 * 1024) << " MB)" << std::endl;
+    }
+    if(m_quantizeVertices)
+    {
+        std::cout << "sponza vertex and index " << statistics.originBufferSize / 1024 << " KB -> "
+                  << (statistics.vertexBufferSize + statistics.indexBufferSize) / 1024 << " KB, index " << (m_gltfLoader.m_indexType == VK_INDEX_TYPE_UINT16 ? 16 : 32) << " bit" << std::endl;
+    }
 }
 
 void GltfSceneRendering::prepareUniform()
@@ -124,18 +269,22 @@ void GltfSceneRendering::prepareDescriptorSetAndWrite()
         for(Material* mat : m_gltfLoader.m_materials)
         {
             createDescriptorSet(&m_textureDescriptorSetLayout, 1, mat->m_descriptorSet);
-
-            VkDescriptorImageInfo imageInfo1 = mat->m_pBaseColorTexture->getDescriptorImageInfo();
-            VkDescriptorImageInfo imageInfo2 = mat->m_pNormalTexture->getDescriptorImageInfo();
-            
-            VkWriteDescriptorSet writes[2] = {};
-            writes[0] = Tools::getWriteDescriptorSet(mat->m_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageInfo1);
-            writes[1] = Tools::getWriteDescriptorSet(mat->m_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageInfo2);
-            vkUpdateDescriptorSets(m_device, 2, writes, 0, nullptr);
+            writeMaterialDescriptorSet(mat);
         }
     }
 }
 
+void GltfSceneRendering::writeMaterialDescriptorSet(Material* mat)
+{
+    VkDescriptorImageInfo imageInfo1 = mat->m_pBaseColorTexture->getDescriptorImageInfo();
+    VkDescriptorImageInfo imageInfo2 = mat->m_pNormalTexture->getDescriptorImageInfo();
+    
+    VkWriteDescriptorSet writes[2] = {};
+    writes[0] = Tools::getWriteDescriptorSet(mat->m_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 0, &imageInfo1);
+    writes[1] = Tools::getWriteDescriptorSet(mat->m_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageInfo2);
+    vkUpdateDescriptorSets(m_device, 2, writes, 0, nullptr);
+}
+
 void GltfSceneRendering::createGraphicsPipeline()
 {
     VkPipelineInputAssemblyStateCreateInfo inputAssembly = Tools::getPipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VK_FALSE);
@@ -177,7 +326,8 @@ void GltfSceneRendering::createGraphicsPipeline()
     createInfo.pDynamicState = &dynamic;
     createInfo.subpass = 0;
 
-    VkShaderModule vertModule = Tools::createShaderModule( Tools::getShaderPath() + "gltfscenerendering/scene.vert.spv");
+    std::string vertShader = m_quantizeVertices ? "gltfscenerendering/scene_packed.vert.spv" : "gltfscenerendering/scene.vert.spv";
+    VkShaderModule vertModule = Tools::createShaderModule( Tools::getShaderPath() + vertShader);
     VkShaderModule fragModule = Tools::createShaderModule( Tools::getShaderPath() + "gltfscenerendering/scene.frag.spv");
     shaderStages[0] = Tools::getPipelineShaderStageCreateInfo(vertModule, VK_SHADER_STAGE_VERTEX_BIT);
     shaderStages[1] = Tools::getPipelineShaderStageCreateInfo(fragModule, VK_SHADER_STAGE_FRAGMENT_BIT);
@@ -208,6 +358,9 @@ void GltfSceneRendering::createGraphicsPipeline()
         
         shaderStages[1].pSpecializationInfo = &specializationInfo;
         
+        //只有双面材质不剔除背面, 和ClusterCulling的法线锥剔除一致
+        rasterization.cullMode = mat->m_doubleSided ? VK_CULL_MODE_NONE : VK_CULL_MODE_BACK_BIT;
+        
         VK_CHECK_RESULT(vkCreateGraphicsPipelines(m_device, m_pipelineCache, 1, &createInfo, nullptr, &mat->m_graphicsPipeline));
         mat->m_isNeedVkBuffer = true;
     }
@@ -216,8 +369,230 @@ void GltfSceneRendering::createGraphicsPipeline()
     vkDestroyShaderModule(m_device, fragModule, nullptr);
 }
 
+void GltfSceneRendering::createIndirectPipelines(IndirectScene& scene, VkPipelineLayout& pipelineLayout)
+{
+    VkDescriptorSetLayout descriptorSetLayout[2] = {m_descriptorSetLayout, scene.m_descriptorSetLayout};
+    
+    VkPipelineLayoutCreateInfo layoutInfo = {};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.flags = 0;
+    layoutInfo.setLayoutCount = 2;
+    layoutInfo.pSetLayouts = descriptorSetLayout;
+    layoutInfo.pushConstantRangeCount = 0;
+    VK_CHECK_RESULT( vkCreatePipelineLayout(m_device, &layoutInfo, nullptr, &pipelineLayout) );
+    
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = Tools::getPipelineInputAssemblyStateCreateInfo(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST, VK_FALSE);
+    
+    VkPipelineViewportStateCreateInfo viewport = {};
+    viewport.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport.flags = 0;
+    viewport.viewportCount = 1;
+    viewport.pViewports = nullptr;
+    viewport.scissorCount = 1;
+    viewport.pScissors = nullptr;
+    
+    std::vector<VkDynamicState> dynamicStates = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+    
+    VkPipelineDynamicStateCreateInfo dynamic = Tools::getPipelineDynamicStateCreateInfo(dynamicStates);
+    VkPipelineRasterizationStateCreateInfo rasterization = Tools::getPipelineRasterizationStateCreateInfo(VK_POLYGON_MODE_FILL, VK_CULL_MODE_NONE, VK_FRONT_FACE_COUNTER_CLOCKWISE);
+    VkPipelineMultisampleStateCreateInfo multisample = Tools::getPipelineMultisampleStateCreateInfo(VK_SAMPLE_COUNT_1_BIT);
+    VkPipelineDepthStencilStateCreateInfo depthStencil = Tools::getPipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, VK_COMPARE_OP_LESS_OR_EQUAL);
+
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = Tools::getPipelineColorBlendAttachmentState(VK_FALSE);
+    VkPipelineColorBlendStateCreateInfo colorBlend = Tools::getPipelineColorBlendStateCreateInfo(1, &colorBlendAttachment);
+    
+    std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages;
+    VkGraphicsPipelineCreateInfo createInfo = Tools::getGraphicsPipelineCreateInfo(pipelineLayout, m_renderPass);
+    createInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+    createInfo.pStages = shaderStages.data();
+
+    createInfo.pVertexInputState = m_gltfLoader.getPipelineVertexInputState();
+    createInfo.pInputAssemblyState = &inputAssembly;
+    createInfo.pTessellationState = nullptr;
+    createInfo.pViewportState = &viewport;
+    createInfo.pRasterizationState = &rasterization;
+    createInfo.pMultisampleState = &multisample;
+    createInfo.pDepthStencilState = &depthStencil;
+    createInfo.pColorBlendState = &colorBlend;
+    createInfo.pDynamicState = &dynamic;
+    createInfo.subpass = 0;
+
+    std::string vertShader = m_quantizeVertices ? "gltfscenerendering/scene_indirect_packed.vert.spv" : "gltfscenerendering/scene_indirect.vert.spv";
+    VkShaderModule vertModule = Tools::createShaderModule( Tools::getShaderPath() + vertShader);
+    std::string fragShader = scene.m_isTexturePacked ? "gltfscenerendering/scene_indirect_atlas.frag.spv" : "gltfscenerendering/scene_indirect.frag.spv";
+    VkShaderModule fragModule = Tools::createShaderModule( Tools::getShaderPath() + fragShader);
+    shaderStages[0] = Tools::getPipelineShaderStageCreateInfo(vertModule, VK_SHADER_STAGE_VERTEX_BIT);
+    shaderStages[1] = Tools::getPipelineShaderStageCreateInfo(fragModule, VK_SHADER_STAGE_FRAGMENT_BIT);
+    
+    //每个桶一个pipeline, alpha cutoff从材质表读取
+    for(uint32_t i = 0; i < IndirectScene::BucketCount; ++i)
+    {
+        IndirectSpecializationData specializationData = {};
+        specializationData.alphaMask = i == IndirectScene::Mask;
+        specializationData.textureCount = static_cast<int32_t>(scene.m_textures.size());
+        
+        std::array<VkSpecializationMapEntry, 2> specializationMapEntries;
+        specializationMapEntries[0].constantID = 0;
+        specializationMapEntries[0].size = sizeof(specializationData.alphaMask);
+        specializationMapEntries[0].offset = offsetof(IndirectSpecializationData, alphaMask);
+        specializationMapEntries[1].constantID = 1;
+        specializationMapEntries[1].size = sizeof(specializationData.textureCount);
+        specializationMapEntries[1].offset = offsetof(IndirectSpecializationData, textureCount);
+
+        VkSpecializationInfo specializationInfo = {};
+        specializationInfo.dataSize = sizeof(IndirectSpecializationData);
+        specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationMapEntries.size());
+        specializationInfo.pMapEntries = specializationMapEntries.data();
+        specializationInfo.pData = &specializationData;
+        shaderStages[1].pSpecializationInfo = &specializationInfo;
+        
+        //半透明混合, 不写深度
+        bool isBlend = i == IndirectScene::Blend;
+        colorBlendAttachment = Tools::getPipelineColorBlendAttachmentState(isBlend ? VK_TRUE : VK_FALSE);
+        depthStencil.depthWriteEnable = isBlend ? VK_FALSE : VK_TRUE;
+        
+        VK_CHECK_RESULT(vkCreateGraphicsPipelines(m_device, m_pipelineCache, 1, &createInfo, nullptr, &scene.m_buckets[i].pipeline));
+    }
+    
+    vkDestroyShaderModule(m_device, vertModule, nullptr);
+    vkDestroyShaderModule(m_device, fragModule, nullptr);
+}
+
+void GltfSceneRendering::destroyIndirectScene(IndirectScene& scene, VkPipelineLayout pipelineLayout)
+{
+    for(uint32_t i = 0; i < IndirectScene::BucketCount; ++i)
+    {
+        vkDestroyPipeline(m_device, scene.m_buckets[i].pipeline, nullptr);
+    }
+    vkDestroyPipelineLayout(m_device, pipelineLayout, nullptr);
+    scene.clear();
+}
+
+// 按当前常驻的mip重新打包, 在按键回调里调用时设备已经空闲
+void GltfSceneRendering::preparePackedScene()
+{
+    clearPackedScene();
+    m_pPackedScene = new IndirectScene();
+    m_pPackedScene->prepare(&m_gltfLoader, m_supportDrawIndirectCount, true, false);
+    const TextureAtlas::Statistics& statistics = m_pPackedScene->m_textureAtlas.getStatistics();
+    std::cout << "texture atlas: " << statistics.sourceCount << " textures, " << statistics.sourceSamplerCount << " samplers -> "
+              << statistics.pageCount << " pages (" << statistics.arrayLayerCount << " array layers, " << statistics.atlasLayerCount << " atlas layers with "
+              << statistics.atlasTextureCount << " textures), " << statistics.samplerCount << " samplers, "
+              << statistics.sourceBytes / 1024 << " KB -> " << statistics.pageBytes / 1024 << " KB" << std::endl;
+    createIndirectPipelines(*m_pPackedScene, m_packedPipelineLayout);
+}
+
+void GltfSceneRendering::clearPackedScene()
+{
+    if(m_pPackedScene)
+    {
+        destroyIndirectScene(*m_pPackedScene, m_packedPipelineLayout);
+        delete m_pPackedScene;
+        m_pPackedScene = nullptr;
+        m_packedPipelineLayout = VK_NULL_HANDLE;
+    }
+}
+
 void GltfSceneRendering::updateRenderData()
 {
+    if(m_useTextureStreaming)
+    {
+        requestTextureMips();
+        m_textureStreamer.update();
+    }
+    
+    if(m_useClusterCulling)
+    {
+        m_clusterCulling.update(m_camera.m_projMat * m_camera.m_viewMat, glm::vec3(m_camera.m_viewPos));
+    }
+    else if(!m_useMultiDrawIndirect)
+    {
+        //不透明物体从近到远, 半透明从远到近
+        m_gltfLoader.sortRenderList(glm::vec3(m_camera.m_viewPos));
+        if(m_useSoftwareOcclusion)
+        {
+            cullOccludedItems();
+        }
+    }
+}
+
+void GltfSceneRendering::prepareTextureStreaming()
+{
+    //包围球和uv密度都换算到世界空间
+    for(GltfNode* node : m_gltfLoader.m_linearNodes)
+    {
+        if(node->m_mesh == nullptr)
+        {
+            continue;
+        }
+        
+        float scale = cbrtf(fabsf(glm::determinant(glm::mat3(node->m_worldMatrix))));
+        for(Primitive* primitive : node->m_mesh->m_primitives)
+        {
+            if(primitive->m_material == nullptr || primitive->m_min.x > primitive->m_max.x || scale <= 0.0f)
+            {
+                continue;
+            }
+            
+            Bvh::Aabb bounds = Bvh::getPrimitiveBounds(&m_gltfLoader, node, primitive);
+            StreamingPrimitive streamingPrimitive;
+            streamingPrimitive.material = primitive->m_material;
+            streamingPrimitive.center = bounds.center();
+            streamingPrimitive.radius = glm::distance(bounds.min, bounds.max) * 0.5f;
+            streamingPrimitive.uvDensity = TextureStreamer::getUvDensity(m_gltfLoader.getVertices(), m_gltfLoader.getIndices() + primitive->m_indexOffset, primitive->m_indexCount) / scale;
+            m_streamingPrimitives.push_back(streamingPrimitive);
+        }
+    }
+}
+
+void GltfSceneRendering::requestTextureMips()
+{
+    //距离d处一个像素的世界空间大小为 d / pixelScale
+    Frustum frustum;
+    frustum.update(m_camera.m_projMat * m_camera.m_viewMat);
+    float pixelScale = fabsf(m_camera.m_projMat[1][1]) * m_swapchainExtent.height * 0.5f;
+    
+    for(const StreamingPrimitive& primitive : m_streamingPrimitives)
+    {
+        if(!frustum.checkSphere(primitive.center, primitive.radius))
+        {
+            continue;
+        }
+        
+        glm::vec3 viewCenter = glm::vec3(m_camera.m_viewMat * glm::vec4(primitive.center, 1.0f));
+        float distance = std::max(glm::length(viewCenter) - primitive.radius, m_camera.getNearClip());
+        float uvPerPixel = primitive.uvDensity * distance / pixelScale;
+        m_textureStreamer.request(primitive.material->m_pBaseColorTexture, uvPerPixel);
+        m_textureStreamer.request(primitive.material->m_pNormalTexture, uvPerPixel);
+    }
+}
+
+void GltfSceneRendering::cullOccludedItems()
+{
+    //渲染列表在第一次绘制时生成
+    std::vector<RenderList::DrawItem>& items = m_gltfLoader.m_renderList.m_items;
+    if(items.empty())
+    {
+        return ;
+    }
+    
+    if(m_itemBounds.size() != items.size())
+    {
+        m_itemBounds.clear();
+        for(const RenderList::DrawItem& item : items)
+        {
+            m_itemBounds.push_back(Bvh::getPrimitiveBounds(&m_gltfLoader, item.node, item.primitive));
+        }
+    }
+    
+    m_softwareOcclusion.render(m_camera.m_projMat * m_camera.m_viewMat);
+    for(size_t i = 0; i < items.size(); ++i)
+    {
+        items[i].isVisible = m_softwareOcclusion.testAabb(m_itemBounds[i].min, m_itemBounds[i].max);
+    }
 }
 
 void GltfSceneRendering::recordRenderCommand(const VkCommandBuffer commandBuffer)
@@ -229,11 +604,148 @@ void GltfSceneRendering::recordRenderCommand(const VkCommandBuffer commandBuffer
     
     vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
-    m_gltfLoader.bindBuffers(commandBuffer);
-
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
-    m_gltfLoader.draw(commandBuffer, m_pipelineLayout, 3);
+    
+    if(m_useClusterCulling)
+    {
+        m_clusterCulling.bindBuffers(commandBuffer);
+        m_clusterCulling.draw(commandBuffer, m_pipelineLayout);
+        
+        if(m_useHiZ)
+        {
+            //上一帧可见的簇画完后建Hi-Z, Late阶段补画新出现的簇
+            vkCmdEndRenderPass(commandBuffer);
+            m_hiZ.build(commandBuffer);
+            m_clusterCulling.dispatch(commandBuffer, LatePhase);
+            beginLoadRenderPass(commandBuffer);
+            
+            vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+            vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+            vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+            m_clusterCulling.bindBuffers(commandBuffer);
+            m_clusterCulling.draw(commandBuffer, m_pipelineLayout);
+        }
+    }
+    else if(m_useMultiDrawIndirect)
+    {
+        IndirectScene& scene = m_pPackedScene ? *m_pPackedScene : m_indirectScene;
+        VkPipelineLayout pipelineLayout = m_pPackedScene ? m_packedPipelineLayout : m_indirectPipelineLayout;
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+        scene.bindBuffers(commandBuffer);
+        scene.draw(commandBuffer, pipelineLayout, 1);
+    }
+    else
+    {
+        m_gltfLoader.bindBuffers(commandBuffer);
+        m_gltfLoader.draw(commandBuffer, m_pipelineLayout, 3);
+    }
     
 //    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
 //    m_gltfLoader.draw(commandBuffer, m_pipelineLayout, 1);
 }
+
+// 逐个primitive绘制和多重间接绘制录制场景命令的CPU耗时, 只录制不提交
+void GltfSceneRendering::benchmarkRecording(uint32_t repeatCount)
+{
+    bool useClusterCulling = m_useClusterCulling;
+    bool useMultiDrawIndirect = m_useMultiDrawIndirect;
+    bool useSoftwareOcclusion = m_useSoftwareOcclusion;
+    m_useClusterCulling = false;
+    m_useSoftwareOcclusion = false;
+    
+    repeatCount = std::max(repeatCount, 1u);
+    VkCommandBuffer commandBuffer = m_commandBuffers[0];
+    // 返回平均毫秒数, 第一次录制会生成渲染列表, 不计时
+    auto measure = [&](bool multiDrawIndirect) -> double {
+        m_useMultiDrawIndirect = multiDrawIndirect;
+        updateRenderData();
+        double total = 0.0;
+        for(uint32_t repeat = 0; repeat <= repeatCount; ++repeat)
+        {
+            beginRenderCommandAndPass(commandBuffer, 0);
+            auto tStart = std::chrono::high_resolution_clock::now();
+            recordRenderCommand(commandBuffer);
+            auto tEnd = std::chrono::high_resolution_clock::now();
+            endRenderCommandAndPass(commandBuffer);
+            if(repeat > 0)
+            {
+                total += std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+            }
+        }
+        return total / repeatCount;
+    };
+    
+    double perPrimitiveTime = measure(false);
+    std::cout << "record scene commands, " << repeatCount << " times: per primitive " << perPrimitiveTime << " ms (" << m_gltfLoader.m_renderList.m_items.size() << " draws)";
+    if(m_supportNonUniformIndexing)
+    {
+        double multiDrawIndirectTime = measure(true);
+        std::cout << ", multi draw indirect " << multiDrawIndirectTime << " ms (" << m_indirectScene.m_drawCommands.size() << " draws in " << IndirectScene::BucketCount << " buckets)";
+    }
+    std::cout << std::endl;
+    
+    vkDeviceWaitIdle(m_device);
+    m_useClusterCulling = useClusterCulling;
+    m_useMultiDrawIndirect = useMultiDrawIndirect;
+    m_useSoftwareOcclusion = useSoftwareOcclusion;
+}
+
+void GltfSceneRendering::keyboard(int key, int scancode, int action, int mods)
+{
+    Application::keyboard(key, scancode, action, mods);
+    if(action != GLFW_RELEASE) return ;
+    if(key == GLFW_KEY_C)
+    {
+        m_useClusterCulling = !m_useClusterCulling;
+        std::cout << "cluster culling " << (m_useClusterCulling ? "on" : "off") << std::endl;
+    }
+    else if(key == GLFW_KEY_M)
+    {
+        if(!m_supportNonUniformIndexing)
+        {
+            std::cout << "multi draw indirect needs shaderSampledImageArrayNonUniformIndexing" << std::endl;
+            return ;
+        }
+        m_useMultiDrawIndirect = !m_useMultiDrawIndirect;
+        std::cout << "multi draw indirect " << (m_useMultiDrawIndirect ? "on" : "off") << std::endl;
+    }
+    else if(key == GLFW_KEY_O)
+    {
+        m_useSoftwareOcclusion = !m_useSoftwareOcclusion;
+        if(!m_useSoftwareOcclusion)
+        {
+            //恢复上一次被剔除的primitive
+            for(RenderList::DrawItem& item : m_gltfLoader.m_renderList.m_items)
+            {
+                item.isVisible = true;
+            }
+        }
+        std::cout << "software occlusion " << (m_useSoftwareOcclusion ? "on" : "off") << std::endl;
+    }
+    else if(key == GLFW_KEY_P)
+    {
+        if(!m_supportNonUniformIndexing)
+        {
+            std::cout << "pack textures needs shaderSampledImageArrayNonUniformIndexing" << std::endl;
+            return ;
+        }
+        m_packTextures = !m_packTextures;
+        if(m_packTextures)
+        {
+            preparePackedScene();
+        }
+        else
+        {
+            clearPackedScene();
+        }
+        std::cout << "pack textures " << (m_packTextures ? "on" : "off") << std::endl;
+    }
+}
+
+void GltfSceneRendering::createOtherRenderPass(const VkCommandBuffer& commandBuffer)
+{
+    if(m_useClusterCulling)
+    {
+        m_clusterCulling.dispatch(commandBuffer, m_useHiZ ? EarlyPhase : SinglePhase);
+    }
+}
@@ -3,6 +3,12 @@
 
 #include "common/application.h"
 #include "common/gltfLoader.h"
+#include "common/clusterCulling.h"
+#include "common/indirectScene.h"
+#include "common/hiZPyramid.h"
+#include "common/softwareOcclusion.h"
+#include "common/bvh.h"
+#include "common/textureStreamer.h"
 
 class GltfSceneRendering : public Application
 {
@@ -19,6 +25,11 @@ public:
         float alphaMaskCutoff;
     };
     
+    struct IndirectSpecializationData {
+        VkBool32 alphaMask;
+        int32_t textureCount;
+    };
+    
     GltfSceneRendering(std::string title);
     virtual ~GltfSceneRendering();
     
@@ -29,6 +40,10 @@ public:
     
     virtual void updateRenderData();
     virtual void recordRenderCommand(const VkCommandBuffer commandBuffer);
+    virtual void createOtherRenderPass(const VkCommandBuffer& commandBuffer);
+    virtual void keyboard(int key, int scancode, int action, int mods);
+    // 在init之后调用, 对比逐个primitive绘制和多重间接绘制的命令录制时间
+    void benchmarkRecording(uint32_t repeatCount);
     
 protected:
     void prepareVertex();
@@ -37,6 +52,14 @@ protected:
     void prepareDescriptorSetLayoutAndPipelineLayout();
     void prepareDescriptorSetAndWrite();
     void createGraphicsPipeline();
+    void createIndirectPipelines(IndirectScene& scene, VkPipelineLayout& pipelineLayout);
+    void destroyIndirectScene(IndirectScene& scene, VkPipelineLayout pipelineLayout);
+    void preparePackedScene();
+    void clearPackedScene();
+    void cullOccludedItems();
+    void writeMaterialDescriptorSet(Material* mat);
+    void prepareTextureStreaming();
+    void requestTextureMips();
 
 protected:
 //    VkPipeline m_graphicsPipeline;
@@ -49,4 +72,40 @@ protected:
 
 private:
     GltfLoader m_gltfLoader;
+    bool m_quantizeVertices = true;
+    //图片压缩成BC格式(法线贴图BC5), 结果缓存在图片旁边
+    bool m_compressTextures = true;
+    //几种绘制方式在init时都准备好, 运行时用按键切换: C cluster culling, M 多重间接绘制, O 软件遮挡剔除, P 打包纹理
+    ClusterCulling m_clusterCulling;
+    bool m_useClusterCulling = true;
+    //cluster culling时做两阶段Hi-Z遮挡剔除
+    bool m_useHiZ = true;
+    HiZPyramid m_hiZ;
+    //不用cluster culling时, 整个场景按桶多重间接绘制, 否则逐个primitive绘制
+    IndirectScene m_indirectScene;
+    bool m_useMultiDrawIndirect = true;
+    bool m_supportDrawIndirectCount = false;
+    //纹理数组用nonuniformEXT访问, 需要VK_EXT_descriptor_indexing的shaderSampledImageArrayNonUniformIndexing, 不支持时不准备多重间接绘制
+    bool m_supportNonUniformIndexing = false;
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT m_descriptorIndexingFeatures = {};
+    VkPipelineLayout m_indirectPipelineLayout = VK_NULL_HANDLE;
+    //多重间接绘制时把材质纹理打包成数组和图集, 描述符和采样器大大减少. 每次打开时按当时常驻的mip重新打包, 原来的纹理保留给其它绘制方式
+    bool m_packTextures = false;
+    IndirectScene* m_pPackedScene = nullptr;
+    VkPipelineLayout m_packedPipelineLayout = VK_NULL_HANDLE;
+    //逐个primitive绘制时, 录制命令前用CPU软件光栅化剔除被遮挡的primitive
+    SoftwareOcclusion m_softwareOcclusion;
+    bool m_useSoftwareOcclusion = true;
+    std::vector<Bvh::Aabb> m_itemBounds;    //和渲染列表的m_items一一对应
+    //纹理先上传尾部mip, 按屏幕上的纹素密度调入更精细的mip
+    struct StreamingPrimitive {
+        Material* material;
+        glm::vec3 center;
+        float radius;
+        float uvDensity;        //每个世界空间单位对应的uv
+    };
+    TextureStreamer m_textureStreamer;
+    bool m_useTextureStreaming = true;
+    bool m_supportMemoryBudget = false;
+    std::vector<StreamingPrimitive> m_streamingPrimitives;
 };
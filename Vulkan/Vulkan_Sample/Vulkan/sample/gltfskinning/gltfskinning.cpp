@@ -17,6 +17,11 @@ void GltfSkinning::init()
     prepareDescriptorSetLayoutAndPipelineLayout();
     prepareDescriptorSetAndWrite();
     createGraphicsPipeline();
+    
+    if(m_useComputeSkinning)
+    {
+        m_computeSkinning.prepare(&m_gltfLoader, m_pipelineCache, true);
+    }
 }
 
 void GltfSkinning::initCamera()
@@ -40,6 +45,10 @@ void GltfSkinning::clear()
     vkFreeMemory(m_device, m_uniformMemory, nullptr);
     vkDestroyBuffer(m_device, m_uniformBuffer, nullptr);
 
+    if(m_useComputeSkinning)
+    {
+        m_computeSkinning.clear();
+    }
     m_gltfLoader.clear();
     Application::clear();
 }
@@ -187,7 +196,9 @@ void GltfSkinning::createGraphicsPipeline()
     createInfo.pDynamicState = &dynamic;
     createInfo.subpass = 0;
 
-    VkShaderModule vertModule = Tools::createShaderModule( Tools::getShaderPath() + "gltfskinning/skinnedmodel.vert.spv");
+    //compute蒙皮之后顶点已经是最终位置, 用静态模型的vertex shader
+    std::string vertShader = m_useComputeSkinning ? "gltfskinning/prebaked.vert.spv" : "gltfskinning/skinnedmodel.vert.spv";
+    VkShaderModule vertModule = Tools::createShaderModule( Tools::getShaderPath() + vertShader);
     VkShaderModule fragModule = Tools::createShaderModule( Tools::getShaderPath() + "gltfskinning/skinnedmodel.frag.spv");
     shaderStages[0] = Tools::getPipelineShaderStageCreateInfo(vertModule, VK_SHADER_STAGE_VERTEX_BIT);
     shaderStages[1] = Tools::getPipelineShaderStageCreateInfo(fragModule, VK_SHADER_STAGE_FRAGMENT_BIT);
@@ -199,6 +210,12 @@ void GltfSkinning::createGraphicsPipeline()
 void GltfSkinning::updateRenderData()
 {
     m_gltfLoader.updateAnimation(0.01f);
+    
+    //上一帧compute算出的包围盒
+    if(m_useComputeSkinning && m_computeSkinning.getBounds(m_gltfLoader.m_min, m_gltfLoader.m_max))
+    {
+        m_gltfLoader.m_radius = glm::distance(m_gltfLoader.m_min, m_gltfLoader.m_max)/2.0f;
+    }
 }
 
 void GltfSkinning::recordRenderCommand(const VkCommandBuffer commandBuffer)
@@ -212,11 +229,26 @@ void GltfSkinning::recordRenderCommand(const VkCommandBuffer commandBuffer)
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
-    m_gltfLoader.bindBuffers(commandBuffer);
+    if(m_useComputeSkinning)
+    {
+        m_computeSkinning.bindBuffers(commandBuffer);
+    }
+    else
+    {
+        m_gltfLoader.bindBuffers(commandBuffer);
+    }
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
     m_gltfLoader.draw(commandBuffer, m_pipelineLayout, 2);
 }
 
+void GltfSkinning::createOtherRenderPass(const VkCommandBuffer& commandBuffer)
+{
+    if(m_useComputeSkinning)
+    {
+        m_computeSkinning.dispatch(commandBuffer);
+    }
+}
+
 std::vector<VkClearValue> GltfSkinning::getClearValue()
 {
     std::vector<VkClearValue> clearValues = {};
@@ -3,6 +3,7 @@
 
 #include "common/application.h"
 #include "common/gltfLoader.h"
+#include "common/computeSkinning.h"
 
 class GltfSkinning : public Application
 {
@@ -23,6 +24,7 @@ public:
     
     virtual void updateRenderData();
     virtual void recordRenderCommand(const VkCommandBuffer commandBuffer);
+    virtual void createOtherRenderPass(const VkCommandBuffer& commandBuffer);
     
 protected:
     void prepareVertex();
@@ -45,4 +47,6 @@ protected:
 
 private:
     GltfLoader m_gltfLoader;
+    ComputeSkinning m_computeSkinning;
+    bool m_useComputeSkinning = true;
 };
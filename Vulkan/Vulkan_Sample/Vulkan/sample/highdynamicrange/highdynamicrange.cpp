@@ -1,5 +1,6 @@
 
 #include "highdynamicrange.h"
+#include "common/textureCompressor.h"
 
 HighDynamicRange::HighDynamicRange(std::string title) : Application(title)
 {
@@ -36,6 +37,11 @@ void HighDynamicRange::setEnabledFeatures()
 //    {
 //        m_deviceEnabledFeatures.samplerAnisotropy = VK_TRUE;
 //    }
+    //HDR环境贴图压缩成BC6H
+    if(m_deviceFeatures.textureCompressionBC)
+    {
+        m_deviceEnabledFeatures.textureCompressionBC = VK_TRUE;
+    }
 }
 
 void HighDynamicRange::clear()
@@ -79,7 +85,15 @@ void HighDynamicRange::prepareVertex()
     m_skyboxLoader.loadFromFile(Tools::getModelPath() + "cube.gltf", m_graphicsQueue, GltfFileLoadFlags::PreTransformVertices | GltfFileLoadFlags::FlipY);
     m_skyboxLoader.createVertexAndIndexBuffer();
     m_skyboxLoader.setVertexBindingAndAttributeDescription({VertexComponent::Position, VertexComponent::Normal});
-    m_pTexture = Texture::loadTextrue2D(Tools::getTexturePath() +  "hdr/uffizi_cube.ktx", m_graphicsQueue, VK_FORMAT_R16G16B16A16_SFLOAT, TextureCopyRegion::Cube);
+    std::string cubeFile = Tools::getTexturePath() + "hdr/uffizi_cube.ktx";
+    if(TextureCompressor::isFormatSupported(VK_FORMAT_BC6H_UFLOAT_BLOCK))
+    {
+        m_pTexture = Texture::loadTextrueCubeBC6H(cubeFile, m_graphicsQueue);
+    }
+    else
+    {
+        m_pTexture = Texture::loadTextrue2D(cubeFile, m_graphicsQueue, VK_FORMAT_R16G16B16A16_SFLOAT, TextureCopyRegion::Cube);
+    }
 
     std::vector<std::string> filenames = { "sphere.gltf", "teapot.gltf", "torusknot.gltf", "venus.gltf" };
     m_objectLoader.loadFromFile(Tools::getModelPath() + filenames[1], m_graphicsQueue);
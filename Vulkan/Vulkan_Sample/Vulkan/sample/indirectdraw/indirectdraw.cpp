@@ -4,6 +4,7 @@
 #include <random>
 
 #define OBJECT_INSTANCE_COUNT 1024
+#define GPU_CULLING_INSTANCE_COUNT (1024 * 1024)
 
 IndirectDraw::IndirectDraw(std::string title) : Application(title)
 {
@@ -37,6 +38,16 @@ void IndirectDraw::setEnabledFeatures()
     {
         m_deviceEnabledFeatures.multiDrawIndirect = true;
     }
+    
+    //GPU剔除写入的firstInstance不为0
+    if(m_deviceFeatures.drawIndirectFirstInstance)
+    {
+        m_deviceEnabledFeatures.drawIndirectFirstInstance = true;
+    }
+    else
+    {
+        m_useGpuCulling = false;
+    }
 }
 
 void IndirectDraw::clear()
@@ -52,6 +63,7 @@ void IndirectDraw::clear()
     vkFreeMemory(m_device, m_instanceMemory, nullptr);
     vkDestroyBuffer(m_device, m_indirectBuffer, nullptr);
     vkFreeMemory(m_device, m_indirectMemory, nullptr);
+    m_gpuCulling.clear();
     
     m_skysphereLoader.clear();
     m_groundLoader.clear();
@@ -71,8 +83,17 @@ void IndirectDraw::prepareVertex()
     m_skysphereLoader.setVertexBindingAndAttributeDescription({VertexComponent::Position, VertexComponent::Normal, VertexComponent::UV, VertexComponent::Color});
     m_groundLoader.loadFromFile(Tools::getModelPath() + "plane_circle.gltf", m_graphicsQueue, flags);
     m_groundLoader.createVertexAndIndexBuffer();
-    m_plantsLoader.loadFromFile(Tools::getModelPath() + "plants.gltf", m_graphicsQueue, flags);
+    m_plantsLoader.loadFromFile(Tools::getModelPath() + "plants.gltf", m_graphicsQueue, m_useLod ? flags | GltfFileLoadFlags::GenerateLods : flags);
     m_plantsLoader.createVertexAndIndexBuffer();
+    if(m_useLod)
+    {
+        std::cout << "plants LOD triangles";
+        for(uint32_t count : m_plantsLoader.m_lodTriangleCounts)
+        {
+            std::cout << " " << count;
+        }
+        std::cout << std::endl;
+    }
     
     m_pGround = Texture::loadTextrue2D(Tools::getTexturePath() + "ground_dry_rgba.ktx", m_graphicsQueue);
     m_pPlants = Texture::loadTextrue2D(Tools::getTexturePath() + "texturearray_plants_rgba.ktx", m_graphicsQueue, VK_FORMAT_R8G8B8A8_UNORM, TextureCopyRegion::Layer);
@@ -98,6 +119,17 @@ void IndirectDraw::prepareIndirectData()
 {
     m_indirectCommands.clear();
     
+    m_instancePerObject = OBJECT_INSTANCE_COUNT;
+    if(m_useGpuCulling)
+    {
+        uint32_t plantCount = 0;
+        for (auto &node : m_plantsLoader.m_linearNodes)
+        {
+            plantCount += node->m_mesh ? 1 : 0;
+        }
+        m_instancePerObject = GPU_CULLING_INSTANCE_COUNT / std::max(plantCount, 1u);
+    }
+    
     // Create on indirect command for node in the scene with a mesh attached to it
     uint32_t m = 0;
     for (auto &node : m_plantsLoader.m_linearNodes)
@@ -105,14 +137,15 @@ void IndirectDraw::prepareIndirectData()
         if (node->m_mesh)
         {
             VkDrawIndexedIndirectCommand indirectCmd = {};
-            indirectCmd.instanceCount = OBJECT_INSTANCE_COUNT;
-            indirectCmd.firstInstance = m * OBJECT_INSTANCE_COUNT;
+            indirectCmd.instanceCount = m_instancePerObject;
+            indirectCmd.firstInstance = m * m_instancePerObject;
             // @todo: Multiple primitives
             // A glTF node may consist of multiple primitives, so we may have to do multiple commands per mesh
             indirectCmd.firstIndex = node->m_mesh->m_primitives[0]->m_indexOffset;
             indirectCmd.indexCount = node->m_mesh->m_primitives[0]->m_indexCount;
 
             m_indirectCommands.push_back(indirectCmd);
+            m_plantPrimitives.push_back(node->m_mesh->m_primitives[0]);
             m++;
         }
     }
@@ -123,6 +156,23 @@ void IndirectDraw::prepareIndirectData()
         m_objectCount += indirectCmd.instanceCount;
     }
     
+    //命令和实例buffer由GpuCulling创建
+    if(m_useGpuCulling)
+    {
+        return ;
+    }
+    
+    if(m_useLod)
+    {
+        //命令每帧在updateInstanceLods里重写, 用host可见的buffer
+        m_indirectCommands.resize(m_plantPrimitives.size() * m_plantsLoader.m_lodCount);
+        VkDeviceSize commandSize = sizeof(VkDrawIndexedIndirectCommand) * m_indirectCommands.size();
+        Tools::createBufferAndMemoryThenBind(commandSize, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                             m_indirectBuffer, m_indirectMemory);
+        return ;
+    }
+    
     VkDeviceSize instanceSize = sizeof(VkDrawIndexedIndirectCommand) * m_indirectCommands.size();
 //    Tools::createBufferAndMemoryThenBind(instanceSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
 //                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
@@ -157,20 +207,29 @@ void IndirectDraw::prepareIndirectData()
 
 void IndirectDraw::prepareInstanceData()
 {
-    std::vector<InstanceData> instanceData;
+    std::vector<InstanceData>& instanceData = m_instanceData;
     instanceData.resize(m_objectCount);
 
     std::default_random_engine rndEngine((unsigned)time(nullptr));
     std::uniform_real_distribution<float> uniformDist(0.0f, 1.0f);
+    
+    //实例变多时按面积放大分布范围, 密度不变
+    float radius = 25.0f * sqrt(float(m_instancePerObject) / OBJECT_INSTANCE_COUNT);
 
     for (uint32_t i = 0; i < m_objectCount; i++)
     {
         float theta = 2 * float(M_PI) * uniformDist(rndEngine);
         float phi = acos(1 - 2 * uniformDist(rndEngine));
         instanceData[i].rot = glm::vec3(0.0f, float(M_PI) * uniformDist(rndEngine), 0.0f);
-        instanceData[i].pos = glm::vec3(sin(phi) * cos(theta), 0.0f, cos(phi)) * 25.0f;
+        instanceData[i].pos = glm::vec3(sin(phi) * cos(theta), 0.0f, cos(phi)) * radius;
         instanceData[i].scale = 1.0f + uniformDist(rndEngine) * 2.0f;
-        instanceData[i].texIndex = i / OBJECT_INSTANCE_COUNT;
+        instanceData[i].texIndex = i / m_instancePerObject;
+    }
+    
+    if(m_useGpuCulling)
+    {
+        prepareGpuCulling();
+        return ;
     }
     
     VkDeviceSize instanceSize = sizeof(InstanceData) * instanceData.size();
@@ -180,6 +239,31 @@ void IndirectDraw::prepareInstanceData()
     Tools::mapMemory(m_instanceMemory, instanceSize, instanceData.data());
 }
 
+void IndirectDraw::prepareGpuCulling()
+{
+    for(Primitive* primitive : m_plantPrimitives)
+    {
+        m_gpuCulling.addGroup(&m_plantsLoader, primitive);
+    }
+    
+    // 和indirectdraw.vert一致: (顶点 * scale + pos) * rotMat, rotMat只绕y轴旋转
+    std::vector<GpuCulling::Bounds> bounds(m_instanceData.size());
+    for(size_t i = 0; i < m_instanceData.size(); ++i)
+    {
+        const InstanceData& instance = m_instanceData[i];
+        const glm::vec4& sphere = m_gpuCulling.m_groupSpheres[instance.texIndex];
+        glm::vec3 pos = glm::vec3(sphere) * instance.scale + instance.pos;
+        float s = sin(instance.rot.y);
+        float c = cos(instance.rot.y);
+        bounds[i].sphere = glm::vec4(c * pos.x + s * pos.z, pos.y, c * pos.z - s * pos.x, sphere.w * instance.scale);
+        bounds[i].group = instance.texIndex;
+        bounds[i].lodScale = instance.scale;
+    }
+    
+    m_gpuCulling.m_lodSelection = m_useLod;
+    m_gpuCulling.prepare(m_instanceData.data(), sizeof(InstanceData), bounds, m_graphicsQueue, m_pipelineCache);
+}
+
 void IndirectDraw::prepareDescriptorSetLayoutAndPipelineLayout()
 {
     std::array<VkDescriptorSetLayoutBinding, 3> bindings;
@@ -318,6 +402,74 @@ void IndirectDraw::createGraphicsPipeline()
 
 void IndirectDraw::updateRenderData()
 {
+    if(m_useGpuCulling)
+    {
+        glm::vec3 cameraPos = glm::vec3(glm::inverse(m_camera.m_viewMat)[3]);
+        float pixelsPerUnit = m_camera.m_projMat[1][1] * m_swapchainExtent.height * 0.5f;
+        m_gpuCulling.update(m_camera.m_projMat * m_camera.m_viewMat, cameraPos, pixelsPerUnit, m_maxPixelError);
+        return ;
+    }
+    
+    if(m_useLod)
+    {
+        updateInstanceLods();
+    }
+}
+
+void IndirectDraw::updateInstanceLods()
+{
+    uint32_t lodCount = m_plantsLoader.m_lodCount;
+    glm::vec3 cameraPos = glm::vec3(glm::inverse(m_camera.m_viewMat)[3]);
+    float pixelsPerUnit = m_camera.m_projMat[1][1] * m_swapchainExtent.height * 0.5f;
+    
+    // 命令下标 = 种类 * lodCount + LOD, 先计数再按前缀和分配firstInstance
+    std::vector<uint32_t> keys(m_instanceData.size());
+    std::vector<uint32_t> counts(m_indirectCommands.size(), 0);
+    for(size_t i = 0; i < m_instanceData.size(); ++i)
+    {
+        const InstanceData& instance = m_instanceData[i];
+        const Primitive* primitive = m_plantPrimitives[instance.texIndex];
+        // 和indirectdraw.vert一致, pos也要绕y轴旋转
+        float s = sin(instance.rot.y);
+        float c = cos(instance.rot.y);
+        glm::vec3 pos = glm::vec3(c * instance.pos.x + s * instance.pos.z, instance.pos.y, c * instance.pos.z - s * instance.pos.x);
+        float distance = glm::distance(pos, cameraPos) / std::max(instance.scale, 1e-4f);
+        keys[i] = instance.texIndex * lodCount + primitive->selectLod(distance, pixelsPerUnit, m_maxPixelError);
+        counts[keys[i]]++;
+    }
+    
+    uint32_t firstInstance = 0;
+    for(uint32_t type = 0; type < m_plantPrimitives.size(); ++type)
+    {
+        const Primitive* primitive = m_plantPrimitives[type];
+        for(uint32_t lod = 0; lod < lodCount; ++lod)
+        {
+            uint32_t index = type * lodCount + lod;
+            const Primitive::Lod& range = primitive->m_lods[std::min<size_t>(lod, primitive->m_lods.size() - 1)];
+            VkDrawIndexedIndirectCommand& command = m_indirectCommands[index];
+            command.indexCount = range.indexCount;
+            command.instanceCount = counts[index];
+            command.firstIndex = range.indexOffset;
+            command.vertexOffset = 0;
+            command.firstInstance = firstInstance;
+            firstInstance += counts[index];
+        }
+    }
+    
+    m_sortedInstanceData.resize(m_instanceData.size());
+    std::vector<uint32_t> cursors(m_indirectCommands.size());
+    for(size_t i = 0; i < m_indirectCommands.size(); ++i)
+    {
+        cursors[i] = m_indirectCommands[i].firstInstance;
+    }
+    for(size_t i = 0; i < m_instanceData.size(); ++i)
+    {
+        m_sortedInstanceData[cursors[keys[i]]++] = m_instanceData[i];
+    }
+    
+    //每帧结束时会等待设备空闲, 可以直接覆盖
+    Tools::mapMemory(m_instanceMemory, sizeof(InstanceData) * m_sortedInstanceData.size(), m_sortedInstanceData.data());
+    Tools::mapMemory(m_indirectMemory, sizeof(VkDrawIndexedIndirectCommand) * m_indirectCommands.size(), m_indirectCommands.data());
 }
 
 void IndirectDraw::recordRenderCommand(const VkCommandBuffer commandBuffer)
@@ -342,8 +494,16 @@ void IndirectDraw::recordRenderCommand(const VkCommandBuffer commandBuffer)
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_plantsPipeline);
     const VkDeviceSize offsets[1] = {0};
     vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_plantsLoader.m_vertexBuffer, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, m_plantsLoader.m_indexBuffer, 0, m_plantsLoader.m_indexType);
+    
+    if(m_useGpuCulling)
+    {
+        m_gpuCulling.bindInstanceBuffer(commandBuffer, 1);
+        m_gpuCulling.draw(commandBuffer, m_deviceEnabledFeatures.multiDrawIndirect);
+        return ;
+    }
+    
     vkCmdBindVertexBuffers(commandBuffer, 1, 1, &m_instanceBuffer, offsets);
-    vkCmdBindIndexBuffer(commandBuffer, m_plantsLoader.m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
     
     if(m_deviceEnabledFeatures.multiDrawIndirect)
     {
@@ -357,3 +517,28 @@ void IndirectDraw::recordRenderCommand(const VkCommandBuffer commandBuffer)
         }
     }
 }
+
+void IndirectDraw::createOtherRenderPass(const VkCommandBuffer& commandBuffer)
+{
+    if(m_useGpuCulling)
+    {
+        m_gpuCulling.dispatch(commandBuffer);
+    }
+}
+
+void IndirectDraw::keyboard(int key, int scancode, int action, int mods)
+{
+    Application::keyboard(key, scancode, action, mods);
+    if(action != GLFW_RELEASE) return ;
+    //G键打印最近一次GPU剔除的统计
+    if(key == GLFW_KEY_G && m_useGpuCulling)
+    {
+        GpuCulling::Statistics statistics;
+        std::cout << "gpu culling: " << m_gpuCulling.m_instanceCount << " instances, " << m_gpuCulling.m_drawCommands.size() << " draws";
+        if(m_gpuCulling.getStatistics(statistics))
+        {
+            std::cout << ", visible " << statistics.visible << ", frustum culled " << statistics.frustumCulled << ", occlusion culled " << statistics.occlusionCulled;
+        }
+        std::cout << std::endl;
+    }
+}
@@ -3,6 +3,7 @@
 
 #include "common/application.h"
 #include "common/gltfLoader.h"
+#include "common/gpuCulling.h"
 
 class IndirectDraw : public Application
 {
@@ -29,6 +30,8 @@ public:
 
     virtual void updateRenderData();
     virtual void recordRenderCommand(const VkCommandBuffer commandBuffer);
+    virtual void createOtherRenderPass(const VkCommandBuffer& commandBuffer);
+    virtual void keyboard(int key, int scancode, int action, int mods);
 
 protected:
     void prepareVertex();
@@ -39,6 +42,8 @@ protected:
     
     void prepareIndirectData();
     void prepareInstanceData();
+    void updateInstanceLods();
+    void prepareGpuCulling();
     
 private:
     // sky
@@ -53,12 +58,13 @@ private:
     // plants
     VkPipeline m_plantsPipeline;
     VkDescriptorSet m_plantsDescriptorSet;
-    VkBuffer m_instanceBuffer;
-    VkDeviceMemory m_instanceMemory;
-    VkBuffer m_indirectBuffer;
-    VkDeviceMemory m_indirectMemory;
+    VkBuffer m_instanceBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_instanceMemory = VK_NULL_HANDLE;
+    VkBuffer m_indirectBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_indirectMemory = VK_NULL_HANDLE;
     
     uint32_t m_objectCount = 0;
+    uint32_t m_instancePerObject = 0;
     // Store the indirect draw commands containing index offsets and instance count per object
     std::vector<VkDrawIndexedIndirectCommand> m_indirectCommands;
     
@@ -69,4 +75,15 @@ private:
 
     Texture* m_pPlants;
     Texture* m_pGround;
+    
+    // 每种植物每级LOD一条间接命令, 实例每帧按(种类, LOD)重新排序
+    bool m_useLod = true;
+    float m_maxPixelError = 1.0f;
+    std::vector<Primitive*> m_plantPrimitives;
+    std::vector<InstanceData> m_instanceData;
+    std::vector<InstanceData> m_sortedInstanceData;
+    
+    // GPU剔除时实例总数放大到GPU_CULLING_INSTANCE_COUNT, 视锥剔除和LOD都在compute shader里做
+    bool m_useGpuCulling = true;
+    GpuCulling m_gpuCulling;
 };
@@ -4,6 +4,7 @@
 #include <random>
 
 #define INSTANCE_COUNT 4096
+#define GPU_CULLING_INSTANCE_COUNT (1024 * 1024)
 
 Instancing::Instancing(std::string title) : Application(title)
 {
@@ -32,6 +33,31 @@ void Instancing::initCamera()
 
 void Instancing::setEnabledFeatures()
 {
+    //GPU剔除用间接绘制, firstInstance不为0
+    if(m_deviceFeatures.drawIndirectFirstInstance)
+    {
+        m_deviceEnabledFeatures.drawIndirectFirstInstance = true;
+    }
+    else
+    {
+        m_useGpuCulling = false;
+    }
+    
+    if(m_deviceFeatures.multiDrawIndirect)
+    {
+        m_deviceEnabledFeatures.multiDrawIndirect = true;
+    }
+    
+    //Hi-Z金字塔是rg32f的storage image
+    if(m_useGpuCulling && m_deviceFeatures.shaderStorageImageExtendedFormats)
+    {
+        m_deviceEnabledFeatures.shaderStorageImageExtendedFormats = true;
+        m_depthSampled = true;
+    }
+    else
+    {
+        m_useHiZ = false;
+    }
 }
 
 void Instancing::clear()
@@ -44,6 +70,8 @@ void Instancing::clear()
     vkDestroyPipeline(m_device, m_instanceRockPipeline, nullptr);
     vkDestroyBuffer(m_device, m_instanceBuffer, nullptr);
     vkFreeMemory(m_device, m_instanceMemory, nullptr);
+    m_gpuCulling.clear();
+    m_hiZ.clear();
     
     m_planetLoader.clear();
     m_rocksLoader.clear();
@@ -60,8 +88,31 @@ void Instancing::prepareVertex()
     m_planetLoader.loadFromFile(Tools::getModelPath() + "lavaplanet.gltf", m_graphicsQueue, flags);
     m_planetLoader.createVertexAndIndexBuffer();
     m_planetLoader.setVertexBindingAndAttributeDescription({VertexComponent::Position, VertexComponent::Normal, VertexComponent::UV, VertexComponent::Color});
-    m_rocksLoader.loadFromFile(Tools::getModelPath() + "rock01.gltf", m_graphicsQueue, flags);
+    m_rocksLoader.loadFromFile(Tools::getModelPath() + "rock01.gltf", m_graphicsQueue, m_useLod ? flags | GltfFileLoadFlags::GenerateLods : flags);
     m_rocksLoader.createVertexAndIndexBuffer();
+    if(m_useLod)
+    {
+        std::cout << "rock LOD triangles";
+        for(uint32_t count : m_rocksLoader.m_lodTriangleCounts)
+        {
+            std::cout << " " << count;
+        }
+        std::cout << std::endl;
+    }
+    
+    for(GltfNode* node : m_rocksLoader.m_linearNodes)
+    {
+        if(node->m_mesh && node->m_mesh->m_primitives.size() > 0)
+        {
+            m_pRockPrimitive = node->m_mesh->m_primitives[0];
+            break;
+        }
+    }
+    assert(m_pRockPrimitive);
+    if(m_pRockPrimitive->m_lods.empty())
+    {
+        m_pRockPrimitive->m_lods.push_back({m_pRockPrimitive->m_indexOffset, m_pRockPrimitive->m_indexCount, 0.0f});
+    }
     
     m_pPlanet = Texture::loadTextrue2D(Tools::getTexturePath() + "lavaplanet_rgba.ktx", m_graphicsQueue);
     m_pRocks = Texture::loadTextrue2D(Tools::getTexturePath() + "texturearray_rocks_rgba.ktx", m_graphicsQueue, VK_FORMAT_R8G8B8A8_UNORM, TextureCopyRegion::Layer);
@@ -79,7 +130,7 @@ void Instancing::prepareUniform()
     mvp.viewMatrix = m_camera.m_viewMat;
     mvp.lightPos = glm::vec4(0.0f, -5.0f, 0.0f, 1.0f);
     mvp.locSpeed = 0.35f;
-    mvp.globSpeed = 0.01f;
+    mvp.globSpeed = m_globSpeed;
 
     Tools::mapMemory(m_uniformMemory, uniformSize, &mvp);
     
@@ -88,18 +139,21 @@ void Instancing::prepareUniform()
 
 void Instancing::prepareInstanceData()
 {
-    std::vector<InstanceData> instanceData;
-    instanceData.resize(INSTANCE_COUNT);
+    std::vector<InstanceData>& instanceData = m_instanceData;
+    uint32_t instanceCount = m_useGpuCulling ? GPU_CULLING_INSTANCE_COUNT : INSTANCE_COUNT;
+    instanceData.resize(instanceCount);
+    //实例变多时放大圆环, 避免全部挤在一起
+    float ringScale = m_useGpuCulling ? 4.0f : 1.0f;
     
     std::default_random_engine rndGenerator((unsigned)time(nullptr));
     std::uniform_real_distribution<float> uniformDist(0.0, 1.0);
     std::uniform_int_distribution<uint32_t> rndTextureIndex(0, m_pRocks->m_layerCount);
     
     // Distribute rocks randomly on two different rings
-    for (auto i = 0; i < INSTANCE_COUNT / 2; i++)
+    for (uint32_t i = 0; i < instanceCount / 2; i++)
     {
-        glm::vec2 ring0 { 7.0f, 11.0f };
-        glm::vec2 ring1 { 14.0f, 18.0f };
+        glm::vec2 ring0 = glm::vec2(7.0f, 11.0f) * ringScale;
+        glm::vec2 ring1 = glm::vec2(14.0f, 18.0f) * ringScale;
 
         float rho, theta;
 
@@ -115,11 +169,17 @@ void Instancing::prepareInstanceData()
         // Outer ring
         rho = sqrt((pow(ring1[1], 2.0f) - pow(ring1[0], 2.0f)) * uniformDist(rndGenerator) + pow(ring1[0], 2.0f));
         theta = 2.0 * M_PI * uniformDist(rndGenerator);
-        instanceData[i + INSTANCE_COUNT / 2].pos = glm::vec3(rho*cos(theta), uniformDist(rndGenerator) * 0.5f - 0.25f, rho*sin(theta));
-        instanceData[i + INSTANCE_COUNT / 2].rot = glm::vec3(M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator));
-        instanceData[i + INSTANCE_COUNT / 2].scale = 1.5f + uniformDist(rndGenerator) - uniformDist(rndGenerator);
-        instanceData[i + INSTANCE_COUNT / 2].texIndex = rndTextureIndex(rndGenerator);
-        instanceData[i + INSTANCE_COUNT / 2].scale *= 0.75f;
+        instanceData[i + instanceCount / 2].pos = glm::vec3(rho*cos(theta), uniformDist(rndGenerator) * 0.5f - 0.25f, rho*sin(theta));
+        instanceData[i + instanceCount / 2].rot = glm::vec3(M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator));
+        instanceData[i + instanceCount / 2].scale = 1.5f + uniformDist(rndGenerator) - uniformDist(rndGenerator);
+        instanceData[i + instanceCount / 2].texIndex = rndTextureIndex(rndGenerator);
+        instanceData[i + instanceCount / 2].scale *= 0.75f;
+    }
+    
+    if(m_useGpuCulling)
+    {
+        prepareGpuCulling();
+        return ;
     }
     
     VkDeviceSize instanceSize = sizeof(InstanceData) * INSTANCE_COUNT;
@@ -129,6 +189,36 @@ void Instancing::prepareInstanceData()
     Tools::mapMemory(m_instanceMemory, instanceSize, instanceData.data());
 }
 
+void Instancing::prepareGpuCulling()
+{
+    m_gpuCulling.addGroup(&m_rocksLoader, m_pRockPrimitive);
+    
+    // 和instancing.vert一致: 实例位置绕y轴旋转(rot.y + globSpeed). 自转围绕网格原点, 半径加上包围球中心的偏移
+    const glm::vec4& sphere = m_gpuCulling.m_groupSpheres[0];
+    float radius = glm::length(glm::vec3(sphere)) + sphere.w;
+    std::vector<GpuCulling::Bounds> bounds(m_instanceData.size());
+    for(size_t i = 0; i < m_instanceData.size(); ++i)
+    {
+        const InstanceData& instance = m_instanceData[i];
+        float s = sin(instance.rot.y + m_globSpeed);
+        float c = cos(instance.rot.y + m_globSpeed);
+        glm::vec3 pos = glm::vec3(c * instance.pos.x - s * instance.pos.z, instance.pos.y, s * instance.pos.x + c * instance.pos.z);
+        bounds[i].sphere = glm::vec4(pos, radius * instance.scale);
+        bounds[i].group = 0;
+        bounds[i].lodScale = instance.scale;
+    }
+    
+    m_gpuCulling.m_lodSelection = m_useLod;
+    m_gpuCulling.prepare(m_instanceData.data(), sizeof(InstanceData), bounds, m_graphicsQueue, m_pipelineCache);
+    
+    if(m_useHiZ)
+    {
+        createLoadRenderPass();
+        m_hiZ.prepare(m_depthImage, m_depthFormat, m_swapchainExtent.width, m_swapchainExtent.height, m_pipelineCache);
+        m_gpuCulling.setHiZ(m_hiZ.m_imageView, m_hiZ.m_sampler, m_hiZ.m_width, m_hiZ.m_height, m_hiZ.m_mipLevels);
+    }
+}
+
 void Instancing::prepareDescriptorSetLayoutAndPipelineLayout()
 {
     std::array<VkDescriptorSetLayoutBinding, 2> bindings;
@@ -280,6 +370,52 @@ void Instancing::createGraphicsPipeline()
 
 void Instancing::updateRenderData()
 {
+    if(m_useGpuCulling)
+    {
+        glm::vec3 cameraPos = glm::vec3(glm::inverse(m_camera.m_viewMat)[3]);
+        float pixelsPerUnit = m_camera.m_projMat[1][1] * m_swapchainExtent.height * 0.5f;
+        m_gpuCulling.update(m_camera.m_projMat * m_camera.m_viewMat, cameraPos, pixelsPerUnit, m_maxPixelError);
+        return ;
+    }
+    
+    updateInstanceLods();
+}
+
+void Instancing::updateInstanceLods()
+{
+    uint32_t lodCount = static_cast<uint32_t>(m_pRockPrimitive->m_lods.size());
+    glm::vec3 cameraPos = glm::vec3(glm::inverse(m_camera.m_viewMat)[3]);
+    float pixelsPerUnit = m_camera.m_projMat[1][1] * m_swapchainExtent.height * 0.5f;
+    
+    // 和instancing.vert一致: 实例位置绕y轴旋转(rot.y + globSpeed), 误差随缩放放大
+    std::vector<uint32_t> lods(m_instanceData.size());
+    m_lodInstanceCounts.assign(lodCount, 0);
+    for(size_t i = 0; i < m_instanceData.size(); ++i)
+    {
+        const InstanceData& instance = m_instanceData[i];
+        float s = sin(instance.rot.y + m_globSpeed);
+        float c = cos(instance.rot.y + m_globSpeed);
+        glm::vec3 pos = glm::vec3(c * instance.pos.x - s * instance.pos.z, instance.pos.y, s * instance.pos.x + c * instance.pos.z);
+        float distance = glm::distance(pos, cameraPos) / std::max(instance.scale, 1e-4f);
+        
+        lods[i] = m_useLod ? m_pRockPrimitive->selectLod(distance, pixelsPerUnit, m_maxPixelError) : 0;
+        m_lodInstanceCounts[lods[i]]++;
+    }
+    
+    std::vector<uint32_t> lodOffsets(lodCount, 0);
+    for(uint32_t lod = 0; lod < lodCount; ++lod)
+    {
+        lodOffsets[lod] = lod > 0 ? lodOffsets[lod - 1] + m_lodInstanceCounts[lod - 1] : 0;
+    }
+    
+    m_sortedInstanceData.resize(m_instanceData.size());
+    for(size_t i = 0; i < m_instanceData.size(); ++i)
+    {
+        m_sortedInstanceData[lodOffsets[lods[i]]++] = m_instanceData[i];
+    }
+    
+    //每帧结束时会等待设备空闲, 可以直接覆盖
+    Tools::mapMemory(m_instanceMemory, sizeof(InstanceData) * m_sortedInstanceData.size(), m_sortedInstanceData.data());
 }
 
 void Instancing::recordRenderCommand(const VkCommandBuffer commandBuffer)
@@ -300,13 +436,74 @@ void Instancing::recordRenderCommand(const VkCommandBuffer commandBuffer)
     m_planetLoader.bindBuffers(commandBuffer);
     m_planetLoader.draw(commandBuffer);
     
+    drawRocks(commandBuffer);
+    
+    if(m_useGpuCulling && m_useHiZ)
+    {
+        //用已画的深度建Hi-Z, Late阶段测试全部岩石后在同一个帧缓冲上继续画
+        vkCmdEndRenderPass(commandBuffer);
+        m_hiZ.build(commandBuffer);
+        m_gpuCulling.dispatch(commandBuffer, LatePhase);
+        beginLoadRenderPass(commandBuffer);
+        
+        vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+        vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+        drawRocks(commandBuffer);
+    }
+}
+
+void Instancing::drawRocks(const VkCommandBuffer commandBuffer)
+{
     vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_instanceRockPipeline);
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_instanceRockdescriptorSet, 0, nullptr);
 
     const VkDeviceSize offsets[1] = {0};
     vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_rocksLoader.m_vertexBuffer, offsets);
+    vkCmdBindIndexBuffer(commandBuffer, m_rocksLoader.m_indexBuffer, 0, m_rocksLoader.m_indexType);
+    
+    if(m_useGpuCulling)
+    {
+        m_gpuCulling.bindInstanceBuffer(commandBuffer, 1);
+        m_gpuCulling.draw(commandBuffer, m_deviceEnabledFeatures.multiDrawIndirect);
+        return ;
+    }
+    
     vkCmdBindVertexBuffers(commandBuffer, 1, 1, &m_instanceBuffer, offsets);
-    vkCmdBindIndexBuffer(commandBuffer, m_rocksLoader.m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(m_rocksLoader.m_indexData.size()), INSTANCE_COUNT, 0, 0, 0);
+    
+    //实例已按LOD排好, 每级一次draw
+    uint32_t firstInstance = 0;
+    for(uint32_t lod = 0; lod < m_lodInstanceCounts.size(); ++lod)
+    {
+        const Primitive::Lod& range = m_pRockPrimitive->m_lods[lod];
+        if(m_lodInstanceCounts[lod] > 0)
+        {
+            vkCmdDrawIndexed(commandBuffer, range.indexCount, m_lodInstanceCounts[lod], range.indexOffset, 0, firstInstance);
+        }
+        firstInstance += m_lodInstanceCounts[lod];
+    }
 }
 
+void Instancing::createOtherRenderPass(const VkCommandBuffer& commandBuffer)
+{
+    if(m_useGpuCulling)
+    {
+        m_gpuCulling.dispatch(commandBuffer, m_useHiZ ? EarlyPhase : SinglePhase);
+    }
+}
+
+void Instancing::keyboard(int key, int scancode, int action, int mods)
+{
+    Application::keyboard(key, scancode, action, mods);
+    if(action != GLFW_RELEASE) return ;
+    //G键打印最近一次GPU剔除的统计
+    if(key == GLFW_KEY_G && m_useGpuCulling)
+    {
+        GpuCulling::Statistics statistics;
+        std::cout << "gpu culling: " << m_gpuCulling.m_instanceCount << " instances, " << m_gpuCulling.m_drawCommands.size() << " draws";
+        if(m_gpuCulling.getStatistics(statistics))
+        {
+            std::cout << ", visible " << statistics.visible << ", frustum culled " << statistics.frustumCulled << ", occlusion culled " << statistics.occlusionCulled;
+        }
+        std::cout << std::endl;
+    }
+}
@@ -3,6 +3,8 @@
 
 #include "common/application.h"
 #include "common/gltfLoader.h"
+#include "common/gpuCulling.h"
+#include "common/hiZPyramid.h"
 
 class Instancing : public Application
 {
@@ -32,6 +34,8 @@ public:
 
     virtual void updateRenderData();
     virtual void recordRenderCommand(const VkCommandBuffer commandBuffer);
+    virtual void createOtherRenderPass(const VkCommandBuffer& commandBuffer);
+    virtual void keyboard(int key, int scancode, int action, int mods);
 
 protected:
     void prepareVertex();
@@ -40,6 +44,9 @@ protected:
     void prepareDescriptorSetAndWrite();
     void createGraphicsPipeline();
     void prepareInstanceData();
+    void updateInstanceLods();
+    void prepareGpuCulling();
+    void drawRocks(const VkCommandBuffer commandBuffer);
     
 private:
     // background
@@ -54,12 +61,28 @@ private:
     // instanced rock
     VkPipeline m_instanceRockPipeline;
     VkDescriptorSet m_instanceRockdescriptorSet;
-    VkBuffer m_instanceBuffer;
-    VkDeviceMemory m_instanceMemory;
+    VkBuffer m_instanceBuffer = VK_NULL_HANDLE;
+    VkDeviceMemory m_instanceMemory = VK_NULL_HANDLE;
 
 private:
     GltfLoader m_planetLoader;
     GltfLoader m_rocksLoader;
     Texture* m_pPlanet;
     Texture* m_pRocks;
+    
+    // 按距离选择岩石的LOD, 实例按LOD分段写入实例buffer
+    bool m_useLod = true;
+    float m_maxPixelError = 1.0f;
+    float m_globSpeed = 0.01f;
+    Primitive* m_pRockPrimitive = nullptr;
+    std::vector<InstanceData> m_instanceData;
+    std::vector<InstanceData> m_sortedInstanceData;
+    std::vector<uint32_t> m_lodInstanceCounts;
+    
+    // GPU剔除时实例数为GPU_CULLING_INSTANCE_COUNT, 视锥剔除和LOD都在compute shader里做
+    bool m_useGpuCulling = true;
+    GpuCulling m_gpuCulling;
+    // 两阶段遮挡剔除: 星球和上一帧可见的岩石画完后建Hi-Z, 再补画新出现的岩石
+    bool m_useHiZ = true;
+    HiZPyramid m_hiZ;
 };
@@ -178,6 +178,10 @@ void MultiThread::recordRenderCommand(const VkCommandBuffer primaryCommandBuffer
     inheritanceInfo.framebuffer = m_framebuffers[m_imageIndex];
     
     updateSecondaryCommandBuffers(inheritanceInfo);
+    if(m_cullingMethod != PerObjectCulling)
+    {
+        cullObjects();
+    }
     
     commandBuffers.push_back(m_secondaryCommandBuffer);
     
@@ -263,6 +267,78 @@ void MultiThread::prepareMultiThread()
             threadData->pushConstBlock[j].color = glm::vec3(Tools::random01(), Tools::random01(), Tools::random01());
         }
     }
+    
+    uint32_t objectCount = m_threadCount * m_objectCountPerThread;
+    if(m_cullingMethod == BvhCulling)
+    {
+        m_objectBounds.resize(objectCount);
+    }
+    else if(m_cullingMethod == BatchCulling)
+    {
+        m_sphereX.resize(objectCount);
+        m_sphereY.resize(objectCount);
+        m_sphereZ.resize(objectCount);
+        m_sphereRadius.assign(objectCount, m_ufoLoader.m_radius * 0.5f);
+        m_visibleMask.resize((objectCount + 63) / 64);
+    }
+}
+
+void MultiThread::cullObjects()
+{
+    if(m_cullingMethod == BatchCulling)
+    {
+        for (uint32_t t = 0; t < m_threadCount; t++)
+        {
+            for (uint32_t i = 0; i < m_objectCountPerThread; i++)
+            {
+                const glm::vec3& pos = m_threadDatas[t]->objectData[i].pos;
+                uint32_t index = t * m_objectCountPerThread + i;
+                m_sphereX[index] = pos.x;
+                m_sphereY[index] = pos.y;
+                m_sphereZ[index] = pos.z;
+            }
+        }
+        
+        uint32_t objectCount = static_cast<uint32_t>(m_sphereX.size());
+        Frustum::SphereSoA spheres = {m_sphereX.data(), m_sphereY.data(), m_sphereZ.data(), m_sphereRadius.data()};
+        m_frustum.cullSpheres(spheres, objectCount, m_visibleMask.data());
+        for(uint32_t index = 0; index < objectCount; ++index)
+        {
+            bool visible = (m_visibleMask[index >> 6] >> (index & 63)) & 1;
+            m_threadDatas[index / m_objectCountPerThread]->objectData[index % m_objectCountPerThread].visible = visible;
+        }
+        return ;
+    }
+    
+    // 物体只在y方向上下浮动, 拓扑第一次build后不变, 之后每帧refit
+    float radius = m_ufoLoader.m_radius * 0.5f;
+    for (uint32_t t = 0; t < m_threadCount; t++)
+    {
+        for (uint32_t i = 0; i < m_objectCountPerThread; i++)
+        {
+            ObjectData& objectData = m_threadDatas[t]->objectData[i];
+            Bvh::Aabb& box = m_objectBounds[t * m_objectCountPerThread + i];
+            box.min = objectData.pos - glm::vec3(radius);
+            box.max = objectData.pos + glm::vec3(radius);
+            objectData.visible = false;
+        }
+    }
+    
+    if(m_bvh.m_nodes.empty())
+    {
+        m_bvh.build(m_objectBounds);
+    }
+    else
+    {
+        m_bvh.refit(m_objectBounds);
+    }
+    
+    std::vector<uint32_t> visible;
+    m_bvh.cullFrustum(m_frustum, visible);
+    for(uint32_t index : visible)
+    {
+        m_threadDatas[index / m_objectCountPerThread]->objectData[index % m_objectCountPerThread].visible = true;
+    }
 }
 
 void MultiThread::updateSecondaryCommandBuffers(VkCommandBufferInheritanceInfo inheritanceInfo)
@@ -299,7 +375,10 @@ void MultiThread::threadRenderCode(uint32_t threadIndex, uint32_t cmdBufferIndex
     ObjectData* objectData = &threadData->objectData[cmdBufferIndex];
 
     // Check visibility against view frustum using a simple sphere check based on the radius of the mesh
-    objectData->visible = m_frustum.checkSphere(objectData->pos,  m_ufoLoader.m_radius * 0.5f); // models.ufo.dimensions.radius
+    if(m_cullingMethod == PerObjectCulling)
+    {
+        objectData->visible = m_frustum.checkSphere(objectData->pos,  m_ufoLoader.m_radius * 0.5f); // models.ufo.dimensions.radius
+    }
     // objectData->visible = false;
     if(objectData->visible == false) return ;
 
@@ -6,6 +6,7 @@
 #include "common/gltfLoader.h"
 #include "common/thread.h"
 #include "common/frustum.h"
+#include "common/bvh.h"
 
 class MultiThread : public Application
 {
@@ -65,6 +66,7 @@ protected:
     void createSecondaryCommandBuffer();
     void prepareMultiThread();
     void updateSecondaryCommandBuffers(VkCommandBufferInheritanceInfo inheritanceInfo);
+    void cullObjects();
     void threadRenderCode(uint32_t threadIndex, uint32_t cmdBufferIndex, VkCommandBufferInheritanceInfo inheritanceInfo);
     
 protected:
@@ -78,6 +80,13 @@ protected:
     VkCommandBuffer m_secondaryCommandBuffer;
     
     Frustum m_frustum;
+    // PerObject在每个线程里逐个测试包围球, 另外两种在录制之前一次完成
+    enum CullingMethod { PerObjectCulling, BatchCulling, BvhCulling };
+    CullingMethod m_cullingMethod = BvhCulling;
+    Bvh m_bvh;
+    std::vector<Bvh::Aabb> m_objectBounds;
+    std::vector<float> m_sphereX, m_sphereY, m_sphereZ, m_sphereRadius;     //批量剔除的结构数组
+    std::vector<uint64_t> m_visibleMask;
     
     // ufo
     VkPushConstantRange m_ufoPushConstantRange;
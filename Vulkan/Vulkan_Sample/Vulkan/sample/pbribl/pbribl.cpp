@@ -1,6 +1,7 @@
 
 
 #include "pbribl.h"
+#include "common/textureCompressor.h"
 #include <stdlib.h>
 #include <random>
 
@@ -34,6 +35,11 @@ void PbrIbl::initCamera()
 
 void PbrIbl::setEnabledFeatures()
 {
+    //HDR环境贴图压缩成BC6H
+    if(m_deviceFeatures.textureCompressionBC)
+    {
+        m_deviceEnabledFeatures.textureCompressionBC = VK_TRUE;
+    }
 }
 
 void PbrIbl::clear()
@@ -85,7 +91,15 @@ void PbrIbl::prepareVertex()
     m_skyboxLoader.setVertexBindingAndAttributeDescription({VertexComponent::Position, VertexComponent::Normal, VertexComponent::UV});
     
     // HDR cubemap
-    m_pEnvCube = Texture::loadTextrue2D(Tools::getTexturePath() +  "hdr/pisa_cube.ktx", m_graphicsQueue, VK_FORMAT_R16G16B16A16_SFLOAT, TextureCopyRegion::Cube);
+    std::string envCubeFile = Tools::getTexturePath() + "hdr/pisa_cube.ktx";
+    if(TextureCompressor::isFormatSupported(VK_FORMAT_BC6H_UFLOAT_BLOCK))
+    {
+        m_pEnvCube = Texture::loadTextrueCubeBC6H(envCubeFile, m_graphicsQueue);
+    }
+    else
+    {
+        m_pEnvCube = Texture::loadTextrue2D(envCubeFile, m_graphicsQueue, VK_FORMAT_R16G16B16A16_SFLOAT, TextureCopyRegion::Cube);
+    }
     
     m_irrMaxLevels = static_cast<uint32_t>(floor(log2(std::max(m_pEnvCube->m_width, m_pEnvCube->m_height))) + 1.0);
 //    m_irrMaxLevels = 1;
@@ -366,7 +380,7 @@ void PbrIbl::createIrrImage()
     
     uint32_t width = m_pEnvCube->m_width;
     uint32_t height = m_pEnvCube->m_height;
-    VkFormat format = m_pEnvCube->m_fromat;
+    VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;    //环境贴图可能是BC6H, 生成的立方体贴图要作为渲染目标
     
     Tools::createImageAndMemoryThenBind(format, width, height, m_irrMaxLevels, 6,
                                         VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
@@ -588,7 +602,7 @@ void PbrIbl::generateIrradianceCube()
     uint32_t width = m_pEnvCube->m_width;
     uint32_t height = m_pEnvCube->m_height;
     
-    VkFormat format = m_pEnvCube->m_fromat;
+    VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;    //环境贴图可能是BC6H, 生成的立方体贴图要作为渲染目标
     VkImage frameImage;
     VkDeviceMemory frameMemory;
     VkImageView frameImageView;
@@ -906,7 +920,7 @@ void PbrIbl::generatePrefilteredCube()
     auto tStart = std::chrono::high_resolution_clock::now();
     uint32_t width = m_pEnvCube->m_width;
     uint32_t height = m_pEnvCube->m_height;
-    VkFormat format = m_pEnvCube->m_fromat;
+    VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;    //环境贴图可能是BC6H, 生成的立方体贴图要作为渲染目标
     
     VkImage frameImage;
     VkDeviceMemory frameMemory;
@@ -1,6 +1,7 @@
 
 
 #include "pbrtexture.h"
+#include "common/textureCompressor.h"
 #include <stdlib.h>
 #include <random>
 
@@ -32,6 +33,11 @@ void PbrTexture::initCamera()
 
 void PbrTexture::setEnabledFeatures()
 {
+    //HDR环境贴图压缩成BC6H
+    if(m_deviceFeatures.textureCompressionBC)
+    {
+        m_deviceEnabledFeatures.textureCompressionBC = VK_TRUE;
+    }
 }
 
 void PbrTexture::clear()
@@ -92,7 +98,15 @@ void PbrTexture::prepareVertex()
     m_gltfLoader.setVertexBindingAndAttributeDescription({VertexComponent::Position, VertexComponent::Normal, VertexComponent::UV, VertexComponent::Tangent});
     
     // HDR cubemap && texture
-    m_pEnvCube = Texture::loadTextrue2D(Tools::getTexturePath() +  "hdr/gcanyon_cube.ktx", m_graphicsQueue, VK_FORMAT_R16G16B16A16_SFLOAT, TextureCopyRegion::Cube);
+    std::string envCubeFile = Tools::getTexturePath() + "hdr/gcanyon_cube.ktx";
+    if(TextureCompressor::isFormatSupported(VK_FORMAT_BC6H_UFLOAT_BLOCK))
+    {
+        m_pEnvCube = Texture::loadTextrueCubeBC6H(envCubeFile, m_graphicsQueue);
+    }
+    else
+    {
+        m_pEnvCube = Texture::loadTextrue2D(envCubeFile, m_graphicsQueue, VK_FORMAT_R16G16B16A16_SFLOAT, TextureCopyRegion::Cube);
+    }
     m_pAlbedo = Texture::loadTextrue2D(Tools::getModelPath() + "cerberus/albedo.ktx", m_graphicsQueue, VK_FORMAT_R8G8B8A8_UNORM);
     m_pNormal = Texture::loadTextrue2D(Tools::getModelPath() + "cerberus/normal.ktx", m_graphicsQueue, VK_FORMAT_R8G8B8A8_UNORM);
     m_pAmbientOcclusion = Texture::loadTextrue2D(Tools::getModelPath() + "cerberus/ao.ktx", m_graphicsQueue, VK_FORMAT_R8_UNORM);
@@ -379,7 +393,7 @@ void PbrTexture::createIrrImage()
     
     uint32_t width = m_pEnvCube->m_width;
     uint32_t height = m_pEnvCube->m_height;
-    VkFormat format = m_pEnvCube->m_fromat;
+    VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;    //环境贴图可能是BC6H, 生成的立方体贴图要作为渲染目标
     
     Tools::createImageAndMemoryThenBind(format, width, height, m_irrMaxLevels, 6,
                                         VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
@@ -601,7 +615,7 @@ void PbrTexture::generateIrradianceCube()
     uint32_t width = m_pEnvCube->m_width;
     uint32_t height = m_pEnvCube->m_height;
     
-    VkFormat format = m_pEnvCube->m_fromat;
+    VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;    //环境贴图可能是BC6H, 生成的立方体贴图要作为渲染目标
     VkImage frameImage;
     VkDeviceMemory frameMemory;
     VkImageView frameImageView;
@@ -919,7 +933,7 @@ void PbrTexture::generatePrefilteredCube()
     auto tStart = std::chrono::high_resolution_clock::now();
     uint32_t width = m_pEnvCube->m_width;
     uint32_t height = m_pEnvCube->m_height;
-    VkFormat format = m_pEnvCube->m_fromat;
+    VkFormat format = VK_FORMAT_R16G16B16A16_SFLOAT;    //环境贴图可能是BC6H, 生成的立方体贴图要作为渲染目标
     
     VkImage frameImage;
     VkDeviceMemory frameMemory;
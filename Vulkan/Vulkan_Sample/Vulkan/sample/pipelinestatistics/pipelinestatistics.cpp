@@ -63,9 +63,18 @@ void PipelineStatistics::clear()
 
 void PipelineStatistics::prepareVertex()
 {
-    const uint32_t flags = GltfFileLoadFlags::PreTransformVertices | GltfFileLoadFlags::FlipY;
+    uint32_t flags = GltfFileLoadFlags::PreTransformVertices | GltfFileLoadFlags::FlipY;
+    if(m_optimizeMesh)
+    {
+        flags |= GltfFileLoadFlags::OptimizeMesh;
+    }
     std::vector<std::string> fileNames = { "sphere.gltf", "teapot.gltf", "torusknot.gltf", "venus.gltf" };
     m_gltfLoader.loadFromFile(Tools::getModelPath() + fileNames[3], m_graphicsQueue, flags);
+    if(m_optimizeMesh)
+    {
+        std::cout << fileNames[3] << " ACMR " << m_gltfLoader.m_cacheStatsBefore.acmr() << " -> " << m_gltfLoader.m_cacheStatsAfter.acmr()
+                  << ", ATVR " << m_gltfLoader.m_cacheStatsBefore.atvr() << " -> " << m_gltfLoader.m_cacheStatsAfter.atvr() << std::endl;
+    }
     m_gltfLoader.createVertexAndIndexBuffer();
     m_gltfLoader.setVertexBindingAndAttributeDescription({VertexComponent::Position, VertexComponent::Normal, VertexComponent::Color});
     
@@ -46,6 +46,7 @@ private:
     bool m_discard = false;
     bool m_wireframe = false;
     bool m_tessellation = false;
+    bool m_optimizeMesh = true;     //对比优化前后的vertex shader调用次数
     
     std::vector<uint64_t> m_pipelineStatValues;
     std::vector<std::string> m_pipelineStatNames;
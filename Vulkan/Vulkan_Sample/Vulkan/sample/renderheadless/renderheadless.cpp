@@ -338,9 +338,15 @@ void RenderHeadless::renderToFile()
     
     Tools::setImageLayout(commandBuffer, m_colorImage, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
     
+    // 拷贝和渲染在同一个命令缓冲里, 只有一帧, 在当前线程编码
+    FrameCapture frameCapture;
+    frameCapture.prepare(m_swapchainExtent.width, m_swapchainExtent.height, m_colorFormat, 1, 0);
+    frameCapture.record(commandBuffer, m_colorImage, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, "screenshot.png");
+    
     Tools::flushCommandBuffer(commandBuffer, m_graphicsQueue, true);
     
-    Tools::saveImage(m_colorImage, m_colorFormat, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, m_swapchainExtent.width, m_swapchainExtent.height, "screenshot.png");
+    frameCapture.submit(m_graphicsQueue);
+    frameCapture.clear();
 }
 
 void RenderHeadless::recordRenderCommand(const VkCommandBuffer commandBuffer)
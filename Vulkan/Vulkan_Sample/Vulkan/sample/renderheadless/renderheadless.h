@@ -2,6 +2,7 @@
 #pragma once
 
 #include "common/application.h"
+#include "common/frameCapture.h"
 
 class RenderHeadless : public Application
 {
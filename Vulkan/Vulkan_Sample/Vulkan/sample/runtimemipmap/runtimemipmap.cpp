@@ -12,6 +12,9 @@ void RuntimeMipmap::init()
 {
     Application::init();
     
+    m_mipGenerator.prepare(m_pipelineCache);
+    MipGenerator::m_pShared = &m_mipGenerator;
+    
     prepareVertex();
     prepareUniform();
     prepareDescriptorSetLayoutAndPipelineLayout();
@@ -34,6 +37,13 @@ void RuntimeMipmap::setEnabledFeatures()
     {
         m_deviceEnabledFeatures.samplerAnisotropy = VK_TRUE;
     }
+    
+    //compute生成mip时按纹理下标访问描述符数组
+    if(m_deviceFeatures.shaderSampledImageArrayDynamicIndexing && m_deviceFeatures.shaderStorageImageArrayDynamicIndexing)
+    {
+        m_deviceEnabledFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+        m_deviceEnabledFeatures.shaderStorageImageArrayDynamicIndexing = VK_TRUE;
+    }
 }
 
 void RuntimeMipmap::clear()
@@ -52,6 +62,8 @@ void RuntimeMipmap::clear()
     
     m_pTexture->clear();
     delete m_pTexture;
+    MipGenerator::m_pShared = nullptr;
+    m_mipGenerator.clear();
     m_sceneLoader.clear();
     Application::clear();
 }
@@ -67,12 +79,13 @@ void RuntimeMipmap::prepareVertex()
     m_mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(m_pTexture->m_width, m_pTexture->m_height)))) + 1;
     
     Tools::createImageAndMemoryThenBind(m_pTexture->m_fromat, m_pTexture->m_width, m_pTexture->m_height, m_mipLevels, 1,
-                                        VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                        VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
                                         VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                                         m_image, m_imageMemory);
         
     // 生成mipmap
     generateMipmaps();
+    benchmarkMipmaps();
     
     // 创建3个sampler
     VkSamplerCreateInfo createInfo = {};
@@ -132,72 +145,122 @@ void RuntimeMipmap::generateMipmaps()
         vkCmdCopyImage(cmd, m_pTexture->m_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
     }
     
-    //generate mipmaps
+    //generate mipmaps, 支持时用compute一次生成所有级, 否则逐级blit
+    bool useCompute = MipGenerator::isSupported(m_pTexture->m_fromat, m_pTexture->m_width, m_pTexture->m_height);
+    if(useCompute)
     {
-        Tools::setImageLayout(cmd, m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
-        
-        VkImageMemoryBarrier barrier = {};
-        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        barrier.image = m_image;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 1;
-        barrier.subresourceRange.levelCount = 1;
-        
-        uint32_t mipWidth = m_pTexture->m_width;
-        uint32_t mipHeight = m_pTexture->m_height;
-        
-        for(uint32_t i = 1; i < m_mipLevels; ++i)
+        m_mipGenerator.add(m_image, m_pTexture->m_fromat, m_pTexture->m_width, m_pTexture->m_height, m_mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        m_mipGenerator.generate(cmd);
+    }
+    else
+    {
+        MipGenerator::generateWithBlit(cmd, m_image, m_pTexture->m_width, m_pTexture->m_height, m_mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    }
+    
+    Tools::flushCommandBuffer(cmd, m_graphicsQueue, true);
+    m_mipGenerator.reset();
+}
+
+void RuntimeMipmap::benchmarkMipmaps()
+{
+    // 同样的第0级分别用逐级blit和compute生成, GPU时间由时间戳得到, 单张和一批各测一次
+    if(!m_deviceProperties.limits.timestampComputeAndGraphics)
+    {
+        std::cout << "timestamp is not supported, skip mipmap benchmark" << std::endl;
+        return ;
+    }
+    
+    bool computeSupported = MipGenerator::isSupported(m_pTexture->m_fromat, m_pTexture->m_width, m_pTexture->m_height);
+    bool blitSupported = MipGenerator::isBlitSupported(m_pTexture->m_fromat);
+    const uint32_t batchSize = MipGenerator::m_maxBatchSize;
+    const uint32_t repeatCount = 10;
+    
+    std::vector<VkImage> images(batchSize);
+    std::vector<VkDeviceMemory> memories(batchSize);
+    for(uint32_t i = 0; i < batchSize; ++i)
+    {
+        Tools::createImageAndMemoryThenBind(m_pTexture->m_fromat, m_pTexture->m_width, m_pTexture->m_height, m_mipLevels, 1,
+                                            VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+                                            VK_IMAGE_TILING_OPTIMAL, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                            images[i], memories[i]);
+    }
+    
+    VkQueryPoolCreateInfo queryPoolInfo = {};
+    queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolInfo.queryCount = 2;
+    VkQueryPool queryPool;
+    VK_CHECK_RESULT(vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &queryPool));
+    
+    // 返回平均毫秒数, mode 0: blit, 1: compute, 2: compute + sRGB + alpha覆盖率
+    auto measure = [&](uint32_t imageCount, uint32_t mode) -> double {
+        double total = 0.0;
+        for(uint32_t repeat = 0; repeat < repeatCount; ++repeat)
         {
-            barrier.subresourceRange.baseMipLevel = i;
-            barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            
-            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+            VkCommandBuffer cmd = Tools::createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+            vkCmdResetQueryPool(cmd, queryPool, 0, 2);
             
-            VkImageBlit imageBlit = {};
-            imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            imageBlit.srcSubresource.mipLevel = i - 1;
-            imageBlit.srcSubresource.baseArrayLayer = 0;
-            imageBlit.srcSubresource.layerCount = 1;
-            imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-            imageBlit.dstSubresource.mipLevel = i;
-            imageBlit.dstSubresource.baseArrayLayer = 0;
-            imageBlit.dstSubresource.layerCount = 1;
-            imageBlit.srcOffsets[0] = {0,0,0};
-            imageBlit.srcOffsets[1] = {(int)mipWidth, (int)mipHeight, 1};
-            imageBlit.dstOffsets[0] = {0,0,0};
-            imageBlit.dstOffsets[1] = { std::max((int)mipWidth>>1, 1), std::max((int)mipHeight>>1, 1), 1};
+            VkImageCopy copyRegion = {};
+            copyRegion.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+            copyRegion.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+            copyRegion.extent = {m_pTexture->m_width, m_pTexture->m_height, 1};
+            for(uint32_t i = 0; i < imageCount; ++i)
+            {
+                Tools::setImageLayout(cmd, images[i], VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+                vkCmdCopyImage(cmd, m_pTexture->m_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, images[i], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+            }
             
-            vkCmdBlitImage(cmd, m_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+            // BOTTOM_OF_PIPE的时间戳要等之前的命令都完成, 不把拷贝算进去
+            vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 0);
+            for(uint32_t i = 0; i < imageCount; ++i)
+            {
+                if(mode == 0)
+                {
+                    MipGenerator::generateWithBlit(cmd, images[i], m_pTexture->m_width, m_pTexture->m_height, m_mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+                }
+                else
+                {
+                    uint32_t flags = mode == 2 ? MipGenerator::Srgb | MipGenerator::PreserveCoverage : MipGenerator::None;
+                    m_mipGenerator.add(images[i], m_pTexture->m_fromat, m_pTexture->m_width, m_pTexture->m_height, m_mipLevels, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, flags);
+                }
+            }
+            m_mipGenerator.generate(cmd);
+            vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
             
-            barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-            barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-            barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            Tools::flushCommandBuffer(cmd, m_graphicsQueue, true);
+            m_mipGenerator.reset();
             
-            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-            
-            if(mipWidth > 1) mipWidth /= 2;
-            if(mipHeight > 1) mipHeight /= 2;
+            uint64_t timestamps[2] = {};
+            vkGetQueryPoolResults(m_device, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+            total += (timestamps[1] - timestamps[0]) * m_deviceProperties.limits.timestampPeriod / 1000000.0;
         }
-        
-        // transition all to SHADER_READ
-        VkImageSubresourceRange subresourceRange = {};
-        subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        subresourceRange.baseArrayLayer = 0;
-        subresourceRange.layerCount = 1;
-        subresourceRange.baseMipLevel = 0;
-        subresourceRange.levelCount = m_mipLevels;
-        
-        Tools::setImageLayout(cmd, m_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, subresourceRange);
+        return total / repeatCount;
+    };
+    
+    std::cout << "mipmap " << m_pTexture->m_width << "x" << m_pTexture->m_height << ", " << m_mipLevels << " levels" << std::endl;
+    for(uint32_t imageCount : {1u, batchSize})
+    {
+        std::cout << "  " << imageCount << " texture(s):";
+        if(blitSupported)
+        {
+            std::cout << " blit " << measure(imageCount, 0) << " ms";
+        }
+        if(computeSupported)
+        {
+            uint32_t dispatchCount = m_mipGenerator.m_dispatchCount;
+            double computeTime = measure(imageCount, 1);
+            std::cout << ", compute " << computeTime << " ms (" << (m_mipGenerator.m_dispatchCount - dispatchCount) / repeatCount << " dispatch)";
+            std::cout << ", compute sRGB + coverage " << measure(imageCount, 2) << " ms";
+        }
+        std::cout << std::endl;
     }
     
-    Tools::flushCommandBuffer(cmd, m_graphicsQueue, true);
+    vkDestroyQueryPool(m_device, queryPool, nullptr);
+    for(uint32_t i = 0; i < batchSize; ++i)
+    {
+        vkDestroyImage(m_device, images[i], nullptr);
+        vkFreeMemory(m_device, memories[i], nullptr);
+    }
 }
 
 void RuntimeMipmap::prepareUniform()
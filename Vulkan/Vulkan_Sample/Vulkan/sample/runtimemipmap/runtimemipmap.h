@@ -4,6 +4,7 @@
 #include "common/application.h"
 #include "common/texture.h"
 #include "common/gltfLoader.h"
+#include "common/mipGenerator.h"
 
 class RuntimeMipmap : public Application
 {
@@ -36,6 +37,7 @@ protected:
     void createGraphicsPipeline();
     
     void generateMipmaps();
+    void benchmarkMipmaps();
 
 protected:
     VkDescriptorSet m_descriptorSet;
@@ -55,5 +57,6 @@ protected:
     
 private:
     GltfLoader m_sceneLoader;
+    MipGenerator m_mipGenerator;
     Texture* m_pTexture = nullptr;
 };
@@ -19,6 +19,8 @@ void ScreenShot::init()
     prepareDescriptorSetAndWrite();
     
     createGraphicsPipeline();
+    
+    m_frameCapture.prepare(m_swapchainExtent.width, m_swapchainExtent.height, m_surfaceFormatKHR.format);
 }
 
 void ScreenShot::initCamera()
@@ -34,6 +36,7 @@ void ScreenShot::setEnabledFeatures()
 
 void ScreenShot::clear()
 {
+    m_frameCapture.clear();
     vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
     vkFreeMemory(m_device, m_uniformMemory, nullptr);
     vkDestroyBuffer(m_device, m_uniformBuffer, nullptr);
@@ -169,14 +172,38 @@ void ScreenShot::keyboard(int key, int scancode, int action, int mods)
     if(key == GLFW_KEY_1)
     {
         std::cout << "key 1" << std::endl;
-        saveToFile();
+        m_isScreenshotRequested = true;
+    }
+    else if(key == GLFW_KEY_2)
+    {
+        // 连续截帧, 再按一次停止
+        if(m_frameCapture.isRecordingSequence())
+        {
+            m_frameCapture.endSequence();
+            std::cout << "sequence stopped, " << m_frameCapture.m_sequenceFrame << " frames, " << m_frameCapture.m_droppedCount << " dropped" << std::endl;
+        }
+        else
+        {
+            m_frameCapture.beginSequence("frame", FrameCapture::Encoding::Qoi);
+            std::cout << "sequence started" << std::endl;
+        }
     }
 }
 
-void ScreenShot::saveToFile()
+// 拷贝录制在这一帧的命令缓冲里, 呈现会等到拷贝完成
+void ScreenShot::recordAfterRenderPass(const VkCommandBuffer commandBuffer)
 {
     VkImage srcImage = m_swapchainImages[m_imageIndex];
-    uint32_t width = m_swapchainExtent.width;
-    uint32_t height = m_swapchainExtent.height;
-    Tools::saveImage(srcImage, m_surfaceFormatKHR.format, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, width, height, "screenshot.png");
+    if(m_isScreenshotRequested)
+    {
+        m_frameCapture.record(commandBuffer, srcImage, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, "screenshot.png");
+        m_isScreenshotRequested = false;
+    }
+    m_frameCapture.recordSequenceFrame(commandBuffer, srcImage, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+}
+
+void ScreenShot::queueResult()
+{
+    m_frameCapture.submit(m_graphicsQueue);
+    m_frameCapture.update();
 }
@@ -3,6 +3,7 @@
 
 #include "common/application.h"
 #include "common/gltfLoader.h"
+#include "common/frameCapture.h"
 
 class ScreenShot : public Application
 {
@@ -23,6 +24,8 @@ public:
     
     virtual void updateRenderData();
     virtual void recordRenderCommand(const VkCommandBuffer commandBuffer);
+    virtual void recordAfterRenderPass(const VkCommandBuffer commandBuffer);
+    virtual void queueResult();
     virtual void keyboard(int key, int scancode, int action, int mods);
     
 protected:
@@ -32,9 +35,6 @@ protected:
     void prepareDescriptorSetAndWrite();
     void createGraphicsPipeline();
     
-private:
-    void saveToFile();
-
 protected:
     VkPipeline m_graphicsPipeline;
     VkDescriptorSet m_descriptorSet;
@@ -46,4 +46,6 @@ protected:
     
 private:
     GltfLoader m_dragonLoader;
+    FrameCapture m_frameCapture;
+    bool m_isScreenshotRequested = false;
 };
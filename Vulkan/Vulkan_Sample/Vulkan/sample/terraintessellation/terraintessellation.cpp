@@ -1,5 +1,6 @@
 
 #include "terraintessellation.h"
+#include "common/textureCompressor.h"
 
 TerrainHeight::TerrainHeight(std::string filename, uint32_t tileSize)
 {
@@ -46,6 +47,7 @@ void TerrainTessellation::init()
     
     createTerrain();
     prepareVertex();
+    prepareVirtualTexture();
     prepareUniform();
     prepareDescriptorSetLayoutAndPipelineLayout();
     prepareDescriptorSetAndWrite();
@@ -77,6 +79,12 @@ void TerrainTessellation::setEnabledFeatures()
     {
         m_deviceEnabledFeatures.fillModeNonSolid = VK_TRUE;
     }
+    
+    //虚拟纹理优先用BC1, 磁盘和缓存都是RGBA8的1/8
+    if(m_deviceFeatures.textureCompressionBC)
+    {
+        m_deviceEnabledFeatures.textureCompressionBC = VK_TRUE;
+    }
 }
 
 void TerrainTessellation::clear()
@@ -88,6 +96,9 @@ void TerrainTessellation::clear()
     vkDestroyBuffer(m_device, m_skyboxUniformBuffer, nullptr);
     
     vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
+    vkDestroyPipeline(m_device, m_virtualTexturePipeline, nullptr);
+    vkDestroyPipeline(m_device, m_feedbackPipeline, nullptr);
+    m_virtualTexture.clear();
     vkFreeMemory(m_device, m_tessEvalMemory, nullptr);
     vkDestroyBuffer(m_device, m_tessEvalmBuffer, nullptr);
     
@@ -126,15 +137,20 @@ void TerrainTessellation::prepareUniform()
                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
                                          m_skyboxUniformBuffer, m_skyboxUniformMemory);
     
-    SkyboxUniform mvp = {};
-    mvp.mvp = m_camera.m_projMat * glm::mat4(glm::mat3(m_camera.m_viewMat));
-    Tools::mapMemory(m_skyboxUniformMemory, uniformSize, &mvp);
-    
     uniformSize = sizeof(TessEval);
     Tools::createBufferAndMemoryThenBind(uniformSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
                                          m_tessEvalmBuffer, m_tessEvalMemory);
     
+    updateUniform();
+}
+
+void TerrainTessellation::updateUniform()
+{
+    SkyboxUniform mvp = {};
+    mvp.mvp = m_camera.m_projMat * glm::mat4(glm::mat3(m_camera.m_viewMat));
+    Tools::mapMemory(m_skyboxUniformMemory, sizeof(SkyboxUniform), &mvp);
+    
     TessEval eval = {};
     eval.projection = m_camera.m_projMat;
     eval.modelview = m_camera.m_viewMat;
@@ -146,7 +162,7 @@ void TerrainTessellation::prepareUniform()
     frustum.update(m_camera.m_projMat * m_camera.m_viewMat);
     memcpy(eval.frustumPlanes, frustum.m_planes.data(), sizeof(glm::vec4)*6);
     
-    Tools::mapMemory(m_tessEvalMemory, uniformSize, &eval);
+    Tools::mapMemory(m_tessEvalMemory, sizeof(TessEval), &eval);
 }
 
 void TerrainTessellation::prepareDescriptorSetLayoutAndPipelineLayout()
@@ -162,13 +178,21 @@ void TerrainTessellation::prepareDescriptorSetLayoutAndPipelineLayout()
     }
     
     {
-        std::array<VkDescriptorSetLayoutBinding, 3> bindings = {};
+        //3, 4是虚拟纹理的物理缓存和页表, 参数用push constant传
+        std::array<VkDescriptorSetLayoutBinding, 5> bindings = {};
         bindings[0] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, 0);
         bindings[1] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT | VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 1);
         bindings[2] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 2);
+        bindings[3] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 3);
+        bindings[4] = Tools::getDescriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT, 4);
+        
+        VkPushConstantRange pushConstantRange = {};
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+        pushConstantRange.offset = 0;
+        pushConstantRange.size = sizeof(VirtualTexture::ShaderParams);
         
         createDescriptorSetLayout(bindings.data(), static_cast<uint32_t>(bindings.size()));
-        createPipelineLayout();
+        createPipelineLayout(&pushConstantRange, 1);
     }
 }
 
@@ -178,7 +202,7 @@ void TerrainTessellation::prepareDescriptorSetAndWrite()
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     poolSizes[0].descriptorCount = 2;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = 3;
+    poolSizes[1].descriptorCount = 5;
     
     createDescriptorPool(poolSizes.data(), static_cast<uint32_t>(poolSizes.size()), 2);
     
@@ -209,10 +233,21 @@ void TerrainTessellation::prepareDescriptorSetAndWrite()
         VkDescriptorImageInfo imageInfo1 = m_pHeightMap->getDescriptorImageInfo();
         VkDescriptorImageInfo imageInfo2 = m_pTerrainMap->getDescriptorImageInfo();
         
-        std::array<VkWriteDescriptorSet, 3> writes = {};
+        std::vector<VkWriteDescriptorSet> writes(3);
         writes[0] = Tools::getWriteDescriptorSet(m_descriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 0, &bufferInfo);
         writes[1] = Tools::getWriteDescriptorSet(m_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, &imageInfo1);
         writes[2] = Tools::getWriteDescriptorSet(m_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2, &imageInfo2);
+        
+        //没有准备好时不会用到这两个绑定
+        VkDescriptorImageInfo cacheInfo = {};
+        VkDescriptorImageInfo pageTableInfo = {};
+        if(m_isVirtualTextureReady)
+        {
+            cacheInfo = m_virtualTexture.getCacheDescriptorImageInfo();
+            pageTableInfo = m_virtualTexture.getPageTableDescriptorImageInfo();
+            writes.push_back(Tools::getWriteDescriptorSet(m_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3, &cacheInfo));
+            writes.push_back(Tools::getWriteDescriptorSet(m_descriptorSet, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4, &pageTableInfo));
+        }
         vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
     }
 }
@@ -280,11 +315,28 @@ void TerrainTessellation::createGraphicsPipeline()
     shaderStages[2] = Tools::getPipelineShaderStageCreateInfo(teseModule, VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT);
     shaderStages[3] = Tools::getPipelineShaderStageCreateInfo(fragModule, VK_SHADER_STAGE_FRAGMENT_BIT);
     VK_CHECK_RESULT(vkCreateGraphicsPipelines(m_device, m_pipelineCache, 1, &createInfo, nullptr, &m_graphicsPipeline));
+    vkDestroyShaderModule(m_device, fragModule, nullptr);
+    
+    // virtual texture, 顶点和细分阶段一样, 只换片元着色器
+    if(m_isVirtualTextureReady)
+    {
+        fragModule = Tools::createShaderModule( Tools::getShaderPath() + "terraintessellation/terrain_vt.frag.spv");
+        shaderStages[3] = Tools::getPipelineShaderStageCreateInfo(fragModule, VK_SHADER_STAGE_FRAGMENT_BIT);
+        VK_CHECK_RESULT(vkCreateGraphicsPipelines(m_device, m_pipelineCache, 1, &createInfo, nullptr, &m_virtualTexturePipeline));
+        vkDestroyShaderModule(m_device, fragModule, nullptr);
+        
+        //反馈pass只有一个整数的颜色附件, 不混合
+        fragModule = Tools::createShaderModule( Tools::getShaderPath() + "terraintessellation/terrain_feedback.frag.spv");
+        shaderStages[3] = Tools::getPipelineShaderStageCreateInfo(fragModule, VK_SHADER_STAGE_FRAGMENT_BIT);
+        createInfo.renderPass = m_virtualTexture.m_feedbackRenderPass;
+        VK_CHECK_RESULT(vkCreateGraphicsPipelines(m_device, m_pipelineCache, 1, &createInfo, nullptr, &m_feedbackPipeline));
+        vkDestroyShaderModule(m_device, fragModule, nullptr);
+        createInfo.renderPass = m_renderPass;
+    }
     
     vkDestroyShaderModule(m_device, vertModule, nullptr);
     vkDestroyShaderModule(m_device, tescModule, nullptr);
     vkDestroyShaderModule(m_device, teseModule, nullptr);
-    vkDestroyShaderModule(m_device, fragModule, nullptr);
     
     // skybox
     createInfo.pVertexInputState = m_skyboxLoader.getPipelineVertexInputState();
@@ -306,6 +358,40 @@ void TerrainTessellation::createGraphicsPipeline()
 
 void TerrainTessellation::updateRenderData()
 {
+    updateUniform();
+    
+    if(m_useVirtualTexture)
+    {
+        m_virtualTexture.update();
+    }
+}
+
+void TerrainTessellation::keyboard(int key, int scancode, int action, int mods)
+{
+    Application::keyboard(key, scancode, action, mods);
+    if(action != GLFW_RELEASE) return ;
+    if(key == GLFW_KEY_V && m_isVirtualTextureReady)
+    {
+        m_useVirtualTexture = !m_useVirtualTexture;
+        std::cout << "virtual texture " << (m_useVirtualTexture ? "on" : "off") << std::endl;
+    }
+}
+
+void TerrainTessellation::createOtherRenderPass(const VkCommandBuffer& commandBuffer)
+{
+    if(!m_useVirtualTexture)
+    {
+        return ;
+    }
+    
+    //低分辨率画一遍地形, 写出每个像素需要的tile, 下一帧读回
+    VirtualTexture::ShaderParams params = m_virtualTexture.getShaderParams(-std::log2(static_cast<float>(m_feedbackScale)));
+    m_virtualTexture.beginFeedbackPass(commandBuffer);
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_feedbackPipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(VirtualTexture::ShaderParams), &params);
+    drawTerrain(commandBuffer);
+    m_virtualTexture.endFeedbackPass(commandBuffer);
 }
 
 void TerrainTessellation::recordRenderCommand(const VkCommandBuffer commandBuffer)
@@ -323,8 +409,22 @@ void TerrainTessellation::recordRenderCommand(const VkCommandBuffer commandBuffe
     m_skyboxLoader.bindBuffers(commandBuffer);
     m_skyboxLoader.draw(commandBuffer);
     
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+    if(m_useVirtualTexture)
+    {
+        VirtualTexture::ShaderParams params = m_virtualTexture.getShaderParams();
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_virtualTexturePipeline);
+        vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(VirtualTexture::ShaderParams), &params);
+    }
+    else
+    {
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+    }
+    drawTerrain(commandBuffer);
+}
+
+void TerrainTessellation::drawTerrain(const VkCommandBuffer commandBuffer)
+{
     VkDeviceSize offsets[1] = {0};
     vkCmdBindVertexBuffers(commandBuffer, 0, 1, &m_vertexBuffer, offsets);
     vkCmdBindIndexBuffer(commandBuffer, m_indexBuffer, 0, VK_INDEX_TYPE_UINT32);
@@ -440,3 +540,119 @@ void TerrainTessellation::createTerrain()
     vkDestroyBuffer(m_device, indexStageBuffer, nullptr);
     
 }
+
+void TerrainTessellation::prepareVirtualTexture()
+{
+    //BC1的16k图在磁盘上约190MB, RGBA8约1.5GB, 只在第一次运行时烘焙
+    VkFormat format = TextureCompressor::isFormatSupported(VK_FORMAT_BC1_RGB_UNORM_BLOCK) ? VK_FORMAT_BC1_RGB_UNORM_BLOCK : VK_FORMAT_R8G8B8A8_UNORM;
+    std::string fileName = Tools::getTexturePath() + (format == VK_FORMAT_BC1_RGB_UNORM_BLOCK ? "terrain_virtual_16k_bc1.vtex" : "terrain_virtual_16k_rgba.vtex");
+    if(!Tools::isFileExists(fileName))
+    {
+        bakeVirtualTexture(fileName, format);
+    }
+    
+    VkExtent2D feedbackExtent;
+    feedbackExtent.width = std::max(1u, m_swapchainExtent.width / m_feedbackScale);
+    feedbackExtent.height = std::max(1u, m_swapchainExtent.height / m_feedbackScale);
+    m_isVirtualTextureReady = m_virtualTexture.prepare(fileName, m_graphicsQueue, m_virtualTextureBudget, feedbackExtent);
+    m_useVirtualTexture = m_useVirtualTexture && m_isVirtualTextureReady;
+    if(m_isVirtualTextureReady)
+    {
+        const VirtualTexture::Statistics& statistics = m_virtualTexture.getStatistics();
+        std::cout << "virtual texture " << m_virtualTextureSize << "x" << m_virtualTextureSize << ", " << statistics.virtualBytes / (1024 * 1024) << " MB on disk, cache "
+                  << statistics.pageCount << " pages (" << statistics.pinnedPages << " pinned), " << statistics.cacheBytes / (1024 * 1024) << " MB" << std::endl;
+    }
+}
+
+// 和terrain.frag的sampleTerrainLayer一样按高度混合6层, 只是预先烘焙到16k的图里, 每个level单独求值, 边框和相邻tile自然一致
+void TerrainTessellation::bakeVirtualTexture(const std::string& fileName, VkFormat format)
+{
+    KtxFile heightFile;
+    KtxFile layerFile;
+    if(!heightFile.open(Tools::getTexturePath() + "terrain_heightmap_r16.ktx") || !layerFile.open(Tools::getTexturePath() + "terrain_texturearray_rgba.ktx") || layerFile.m_layerCount < 6)
+    {
+        std::cout << "failed to open terrain textures for baking" << std::endl;
+        return ;
+    }
+    
+    const uint16_t* heights = reinterpret_cast<const uint16_t*>(heightFile.m_data + heightFile.getImageOffset(0, 0, 0));
+    const int32_t heightSize = static_cast<int32_t>(heightFile.m_width);
+    const glm::vec2 layerRanges[6] = {
+        glm::vec2(-10.0f, 10.0f), glm::vec2(5.0f, 45.0f), glm::vec2(45.0f, 80.0f),
+        glm::vec2(75.0f, 100.0f), glm::vec2(95.0f, 140.0f), glm::vec2(140.0f, 190.0f)
+    };
+    //纹理数组在地形上重复16次, level 0的一个纹素对应的数组纹素数
+    const float layerScale = 16.0f * layerFile.m_width / m_virtualTextureSize;
+    const float virtualSize = static_cast<float>(m_virtualTextureSize);
+    
+    VirtualTexture::TileGenerator generator = [&](uint32_t level, int32_t x, int32_t y, uint32_t width, uint32_t height, uint8_t* rgba) {
+        uint32_t layerLevel = static_cast<uint32_t>(std::max(0.0f, std::floor(level + std::log2(layerScale) + 0.5f)));
+        layerLevel = std::min(layerLevel, layerFile.m_levelCount - 1);
+        int32_t layerWidth = static_cast<int32_t>(std::max(1u, layerFile.m_width >> layerLevel));
+        int32_t layerHeight = static_cast<int32_t>(std::max(1u, layerFile.m_height >> layerLevel));
+        
+        //重复寻址的双线性采样
+        auto sampleLayer = [&](uint32_t layer, glm::vec2 uv) {
+            const uint8_t* pixels = layerFile.m_data + layerFile.getImageOffset(layerLevel, layer, 0);
+            glm::vec2 pos = uv * glm::vec2(layerWidth, layerHeight) - 0.5f;
+            glm::vec2 base = glm::floor(pos);
+            glm::vec2 t = pos - base;
+            glm::vec3 color(0.0f);
+            for(int32_t j = 0; j < 2; j++)
+            {
+                for(int32_t i = 0; i < 2; i++)
+                {
+                    int32_t px = ((static_cast<int32_t>(base.x) + i) % layerWidth + layerWidth) % layerWidth;
+                    int32_t py = ((static_cast<int32_t>(base.y) + j) % layerHeight + layerHeight) % layerHeight;
+                    const uint8_t* p = pixels + (py * layerWidth + px) * 4;
+                    float w = (i ? t.x : 1.0f - t.x) * (j ? t.y : 1.0f - t.y);
+                    color += w * glm::vec3(p[0], p[1], p[2]);
+                }
+            }
+            return color;
+        };
+        
+        float texelSize = static_cast<float>(1u << level) / virtualSize;
+        for(uint32_t j = 0; j < height; j++)
+        {
+            for(uint32_t i = 0; i < width; i++)
+            {
+                glm::vec2 uv = glm::clamp((glm::vec2(x + static_cast<int32_t>(i), y + static_cast<int32_t>(j)) + 0.5f) * texelSize, 0.0f, 1.0f);
+                
+                //高度图双线性, 边上夹住
+                glm::vec2 pos = uv * static_cast<float>(heightSize) - 0.5f;
+                glm::vec2 base = glm::floor(pos);
+                glm::vec2 t = pos - base;
+                int32_t x0 = glm::clamp(static_cast<int32_t>(base.x), 0, heightSize - 1);
+                int32_t y0 = glm::clamp(static_cast<int32_t>(base.y), 0, heightSize - 1);
+                int32_t x1 = std::min(x0 + 1, heightSize - 1);
+                int32_t y1 = std::min(y0 + 1, heightSize - 1);
+                float h0 = glm::mix(static_cast<float>(heights[y0 * heightSize + x0]), static_cast<float>(heights[y0 * heightSize + x1]), t.x);
+                float h1 = glm::mix(static_cast<float>(heights[y1 * heightSize + x0]), static_cast<float>(heights[y1 * heightSize + x1]), t.x);
+                float terrainHeight = glm::mix(h0, h1, t.y) / 65535.0f * 255.0f;
+                
+                glm::vec3 color(0.0f);
+                for(uint32_t layer = 0; layer < 6; layer++)
+                {
+                    float range = layerRanges[layer].y - layerRanges[layer].x;
+                    float weight = (range - std::abs(terrainHeight - layerRanges[layer].y)) / range;
+                    if(weight > 0.0f)
+                    {
+                        color += weight * sampleLayer(layer, uv * 16.0f);
+                    }
+                }
+                
+                uint8_t* dst = rgba + (j * width + i) * 4;
+                dst[0] = static_cast<uint8_t>(std::min(color.r, 255.0f));
+                dst[1] = static_cast<uint8_t>(std::min(color.g, 255.0f));
+                dst[2] = static_cast<uint8_t>(std::min(color.b, 255.0f));
+                dst[3] = 255;
+            }
+        }
+    };
+    
+    ThreadPool threadPool;
+    threadPool.setThreadCount(std::max(1u, std::thread::hardware_concurrency()));
+    VirtualTexture::bake(fileName, m_virtualTextureSize, 128, 2, format, generator, &threadPool);
+    threadPool.setThreadCount(0);
+}
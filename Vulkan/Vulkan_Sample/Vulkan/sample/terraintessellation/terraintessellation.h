@@ -4,6 +4,7 @@
 #include "common/application.h"
 #include "common/gltfLoader.h"
 #include "common/frustum.h"
+#include "common/virtualTexture.h"
 
 class TerrainHeight
 {
@@ -56,15 +57,22 @@ public:
     
     virtual void updateRenderData();
     virtual void recordRenderCommand(const VkCommandBuffer commandBuffer);
+    virtual void createOtherRenderPass(const VkCommandBuffer& commandBuffer);
+    virtual void keyboard(int key, int scancode, int action, int mods);
     
 protected:
     void prepareVertex();
     void prepareUniform();
+    void updateUniform();
     void prepareDescriptorSetLayoutAndPipelineLayout();
     void prepareDescriptorSetAndWrite();
     void createGraphicsPipeline();
     
     void createTerrain();
+    void drawTerrain(const VkCommandBuffer commandBuffer);
+    
+    void prepareVirtualTexture();
+    void bakeVirtualTexture(const std::string& fileName, VkFormat format);
 
 protected:
     // skybox
@@ -98,4 +106,15 @@ private:
     Texture* m_pSkyboxMap; //天空盒
     Texture* m_pTerrainMap;//地形贴图
     Texture* m_pHeightMap; //高度贴图
+    
+private:
+    //虚拟纹理, 地形的颜色预先烘焙成16k的图, 显存里只有固定大小的缓存. 按V切换回纹理数组
+    VirtualTexture m_virtualTexture;
+    bool m_useVirtualTexture = true;
+    bool m_isVirtualTextureReady = false;
+    VkPipeline m_virtualTexturePipeline = VK_NULL_HANDLE;
+    VkPipeline m_feedbackPipeline = VK_NULL_HANDLE;
+    uint32_t m_virtualTextureSize = 16384;
+    VkDeviceSize m_virtualTextureBudget = 64 * 1024 * 1024;
+    uint32_t m_feedbackScale = 8;       //反馈pass的分辨率是屏幕的1/8
 };